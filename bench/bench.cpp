@@ -0,0 +1,416 @@
+/**
+	 bench.cpp - Created by Timothy Morey on 10/19/2026
+
+   Renders synthetic height fields offscreen, with scripted camera sweeps, and
+   reports how long the meshes take to build and the frames take to draw.  It
+   needs no X server, so it can be run anywhere that the library can.
+ */
+
+
+#include "nvn.h"
+
+#include "DataGrid.hpp"
+#include "GlacierLayer.hpp"
+#include "Layer.hpp"
+#include "ShadedSurfaceLayer.hpp"
+
+#include <getopt.h>
+#include <math.h>
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+
+#define BENCH_NODATA -9999.0f
+#define BENCH_OCTAVES 6
+
+
+/**
+   The camera moves that are timed, in the order they are run.
+ */
+enum Sweep
+{
+  SweepOrbit = 0,
+  SweepZoom,
+  SweepPan,
+  NumSweeps
+};
+
+const char* SweepNames[NumSweeps] = { "orbit", "zoom", "pan" };
+
+/**
+   Fills data with an n by n fractal height field between about -1 and 1,
+   which is the same for the same seed.
+ */
+int GenerateHeights(int n, unsigned int seed, float data[]);
+
+/**
+   Sets about fraction of the n by n points in data to BENCH_NODATA, in
+   clumps rather than scattered points, as real gaps in coverage are.
+ */
+int MaskNodata(int n, float fraction, unsigned int seed, float data[]);
+
+/**
+   Runs every sweep over the layer, and prints the results.
+ */
+int RunBenchmark(const char* name, NVN_Layer layer,
+                 int width, int height, int nframes);
+
+int SetNodata(NVN_DataGrid grid);
+
+
+int main(int argc, char* argv[])
+{
+  int c;
+  int n = 1024;
+  float nodata = 0.1f;
+  int width = 800;
+  int height = 600;
+  int nframes = 120;
+  bool surface = true;
+  bool glacier = true;
+  int retval = NVN_NOERR;
+
+  MPI_Init(&argc, &argv);
+
+  while((c = getopt(argc, argv, "f:h:l:n:s:w:")) != -1)
+  {
+    switch(c)
+    {
+    case 'f':
+      // Fraction of the grid points without data
+      nodata = atof(optarg);
+      break;
+
+    case 'h':
+      height = atoi(optarg);
+      break;
+
+    case 'l':
+      // Which layers to run: surface, glacier or both
+      surface = 0 == strcmp("surface", optarg) || 0 == strcmp("both", optarg);
+      glacier = 0 == strcmp("glacier", optarg) || 0 == strcmp("both", optarg);
+      break;
+
+    case 'n':
+      // Grid size, in points along each side
+      n = atoi(optarg);
+      break;
+
+    case 's':
+      // Frames in each camera sweep
+      nframes = atoi(optarg);
+      break;
+
+    case 'w':
+      width = atoi(optarg);
+      break;
+
+    default:
+      fprintf(stderr,
+              "Usage: bench [-n gridsize] [-f nodatafraction] "
+              "[-l surface|glacier|both] [-s sweepframes] [-w width] "
+              "[-h height]\n");
+      retval = NVN_EINVARGS;
+      break;
+    }
+  }
+
+  if(n < 2 || nframes < 1 || width < 1 || height < 1)
+  {
+    fprintf(stderr, "Invalid benchmark size\n");
+    retval = NVN_EINVARGS;
+  }
+
+  if(NVN_NOERR == retval)
+    retval = NVN_InitBackend(NVN_BACKEND_HEADLESS);
+
+  if(NVN_NOERR == retval)
+  {
+    MPI_Offset dimlen[2] = { n, n };
+    float* topg = (float*)malloc((size_t)n * n * sizeof(float));
+    float* usurf = (float*)malloc((size_t)n * n * sizeof(float));
+    NVN_DataGrid topggrid = 0, usurfgrid = 0;
+    NVN_Layer layer = 0;
+    double start;
+
+    printf("%dx%d grid, %.0f%% nodata, %dx%d frames, %d frames per sweep\n",
+           n, n, nodata * 100.0f, width, height, nframes);
+
+    // Land runs from -500 m to 1500 m, so that some of it is below sea level.
+    start = MPI_Wtime();
+    GenerateHeights(n, 1, topg);
+    for(size_t i = 0; i < (size_t)n * n; i++)
+      topg[i] = 500.0f + 1000.0f * topg[i];
+    MaskNodata(n, nodata, 2, topg);
+
+    // An ice cap, thickest in the middle, covers the center of the grid.  The
+    // surface lies on the land everywhere else, as it does in model output.
+    for(int i = 0; i < n; i++)
+    {
+      for(int j = 0; j < n; j++)
+      {
+        float x = 2.0f * i / (n - 1) - 1.0f;
+        float y = 2.0f * j / (n - 1) - 1.0f;
+        float r2 = (x * x + y * y) / 0.5f;
+        float land = BENCH_NODATA == topg[i * n + j] ? 0.0f : topg[i * n + j];
+
+        if(r2 < 1.0f)
+          usurf[i * n + j] = MAX(land, 1000.0f + 2500.0f * sqrtf(1.0f - r2));
+        else
+          usurf[i * n + j] = topg[i * n + j];
+      }
+    }
+    printf("generated grids in %.3f s\n", MPI_Wtime() - start);
+
+    NVN_CreateDataGrid(2, dimlen, MPI_FLOAT, topg, &topggrid);
+    NVN_CreateDataGrid(2, dimlen, MPI_FLOAT, usurf, &usurfgrid);
+    SetNodata(topggrid);
+    SetNodata(usurfgrid);
+
+    if(surface && NVN_NOERR == retval)
+    {
+      NVN_CreateShadedSurfaceLayer(topggrid, &layer);
+      retval = RunBenchmark("surface", layer, width, height, nframes);
+    }
+
+    if(glacier && NVN_NOERR == retval)
+    {
+      NVN_CreateGlacierLayer(topggrid, usurfgrid, &layer);
+      retval = RunBenchmark("glacier", layer, width, height, nframes);
+    }
+  }
+
+  NVN_Shutdown();
+  MPI_Finalize();
+
+  return NVN_NOERR == retval ? 0 : 1;
+}
+
+int GenerateHeights(int n, unsigned int seed, float data[])
+{
+  int retval = NVN_NOERR;
+  int cells = 4;
+  float amplitude = 0.5f;
+
+  memset(data, 0, (size_t)n * n * sizeof(float));
+
+  // Each octave is value noise on a lattice twice as fine as the last, with
+  // half the amplitude, smoothly interpolated between the lattice points.
+  for(int octave = 0; octave < BENCH_OCTAVES; octave++)
+  {
+    std::vector<float> lattice((cells + 1) * (cells + 1));
+
+    srand(seed * 7919 + octave);
+    for(size_t k = 0; k < lattice.size(); k++)
+      lattice[k] = 2.0f * rand() / RAND_MAX - 1.0f;
+
+    for(int i = 0; i < n; i++)
+    {
+      float u = (float)i * cells / n;
+      int li = (int)u;
+      float fu = u - li;
+      fu = fu * fu * (3.0f - 2.0f * fu);
+
+      for(int j = 0; j < n; j++)
+      {
+        float v = (float)j * cells / n;
+        int lj = (int)v;
+        float fv = v - lj;
+        fv = fv * fv * (3.0f - 2.0f * fv);
+
+        float a = lattice[li * (cells + 1) + lj];
+        float b = lattice[(li + 1) * (cells + 1) + lj];
+        float c = lattice[li * (cells + 1) + lj + 1];
+        float d = lattice[(li + 1) * (cells + 1) + lj + 1];
+
+        data[i * n + j] += amplitude *
+          ((a * (1.0f - fu) + b * fu) * (1.0f - fv) +
+           (c * (1.0f - fu) + d * fu) * fv);
+      }
+    }
+
+    cells *= 2;
+    amplitude *= 0.5f;
+  }
+
+  return retval;
+}
+
+int MaskNodata(int n, float fraction, unsigned int seed, float data[])
+{
+  int retval = NVN_NOERR;
+  size_t npoints = (size_t)n * n;
+  size_t nmasked = 0;
+  std::vector<float> mask(npoints);
+  std::vector<float> sorted;
+  float threshold;
+
+  if(fraction >= 1.0f)
+    nmasked = npoints;
+  else if(fraction > 0.0f)
+    nmasked = (size_t)(fraction * npoints);
+
+  if(nmasked > 0)
+  {
+    // The points under the lowest parts of a second field are masked, which
+    // gives clumps of the requested total size.
+    GenerateHeights(n, seed, &mask[0]);
+    sorted = mask;
+    std::nth_element(sorted.begin(), sorted.begin() + (nmasked - 1),
+                     sorted.end());
+    threshold = sorted[nmasked - 1];
+
+    for(size_t i = 0; i < npoints; i++)
+    {
+      if(mask[i] <= threshold)
+        data[i] = BENCH_NODATA;
+    }
+  }
+
+  return retval;
+}
+
+int RunBenchmark(const char* name, NVN_Layer layer,
+                 int width, int height, int nframes)
+{
+  int retval = NVN_NOERR;
+  int ntriangles = 0;
+  int nskipped = -1;
+  NVN_Model model = 0;
+  NVN_Window window = 0;
+  NVN_FrameStats stats;
+  size_t len = (size_t)width * height * 4;
+  unsigned char* rgba = (unsigned char*)malloc(len);
+  float cx, cy, zoom, xrot, zrot;
+  std::vector<double> times(nframes);
+  double start, total;
+  NVN_BBox bounds = ((Layer*)layer)->GetBounds();
+
+  if(NVN_NOERR == retval)
+    retval = NVN_CreateModel(&model);
+  if(NVN_NOERR == retval)
+    retval = NVN_AddLayer(model, layer);
+  if(NVN_NOERR == retval)
+    retval = NVN_CreateWindow(name, 0, 0, width, height, 0, &window);
+  if(NVN_NOERR == retval)
+    retval = NVN_ShowModel(window, model);
+
+  // The first frame compiles the mesh, which the profiler counts as the mesh
+  // phase of that frame.
+  if(NVN_NOERR == retval)
+  {
+    NVN_GetViewParms(window, &cx, &cy, &zoom, &xrot, &zrot);
+    start = MPI_Wtime();
+    retval = NVN_ReadFrame(window, rgba, len);
+    total = MPI_Wtime() - start;
+  }
+
+  if(NVN_NOERR == retval)
+  {
+    ShadedSurfaceLayer* surface = dynamic_cast<ShadedSurfaceLayer*>((Layer*)layer);
+    GlacierLayer* glacier = dynamic_cast<GlacierLayer*>((Layer*)layer);
+
+    if(surface)
+      ntriangles = surface->GetNTriangles();
+    else if(glacier)
+    {
+      ntriangles = glacier->GetNTriangles();
+      nskipped = glacier->GetNSkippedCells();
+    }
+
+    NVN_GetFrameStats(window, &stats);
+    printf("%s: mesh built in %.3f s, %d triangles, first frame %.3f s\n",
+           name, stats.Phase[NVN_PHASE_MESH].Max, ntriangles, total);
+    if(nskipped >= 0)
+      printf("  %d ice-free cells left out of the ice mesh\n", nskipped);
+  }
+
+  for(int sweep = 0; NVN_NOERR == retval && sweep < NumSweeps; sweep++)
+  {
+    total = 0.0;
+
+    for(int f = 0; NVN_NOERR == retval && f < nframes; f++)
+    {
+      float t = (float)f / nframes;
+
+      switch(sweep)
+      {
+      case SweepOrbit:
+        // Once around the whole model, tilted
+        NVN_SetViewParms(window, cx, cy, zoom, -60.0f, 360.0f * t);
+        break;
+
+      case SweepZoom:
+        // In to 16x and back out again
+        NVN_SetViewParms(window, cx, cy,
+                         zoom * powf(16.0f, 1.0f - fabsf(2.0f * t - 1.0f)),
+                         -30.0f, 0.0f);
+        break;
+
+      case SweepPan:
+        // Corner to corner, from straight above, at 4x
+        NVN_SetViewParms(window,
+                         bounds.Min[XDIM] + t * (bounds.Max[XDIM] - bounds.Min[XDIM]),
+                         bounds.Min[YDIM] + t * (bounds.Max[YDIM] - bounds.Min[YDIM]),
+                         zoom * 4.0f, 0.0f, 0.0f);
+        break;
+      }
+
+      // Reading the frame back waits for the GPU, so each time covers the
+      // whole frame and not just the commands being queued.
+      start = MPI_Wtime();
+      retval = NVN_ReadFrame(window, rgba, len);
+      times[f] = MPI_Wtime() - start;
+      total += times[f];
+    }
+
+    if(NVN_NOERR == retval)
+    {
+      std::sort(times.begin(), times.end());
+      printf("  %-6s %4d frames  mean %7.2f  p50 %7.2f  p95 %7.2f  "
+             "p99 %7.2f  max %7.2f ms  %.3g triangles/s\n",
+             SweepNames[sweep], nframes,
+             1000.0 * total / nframes,
+             1000.0 * times[(int)ceil(0.50 * nframes) - 1],
+             1000.0 * times[(int)ceil(0.95 * nframes) - 1],
+             1000.0 * times[(int)ceil(0.99 * nframes) - 1],
+             1000.0 * times[nframes - 1],
+             total > 0.0 ? (double)ntriangles * nframes / total : 0.0);
+    }
+  }
+
+  if(NVN_NOERR == retval)
+  {
+    NVN_GetFrameStats(window, &stats);
+    printf("  layers p95 %.2f ms, swap p95 %.2f ms",
+           1000.0 * stats.Phase[NVN_PHASE_LAYERS].P95,
+           1000.0 * stats.Phase[NVN_PHASE_SWAP].P95);
+    if(stats.Phase[NVN_PHASE_GPU].NFrames > 0)
+      printf(", gpu p95 %.2f ms", 1000.0 * stats.Phase[NVN_PHASE_GPU].P95);
+    printf("\n");
+  }
+
+  if(window)
+    NVN_DestroyWindow(window);
+
+  free(rgba);
+
+  return retval;
+}
+
+int SetNodata(NVN_DataGrid grid)
+{
+  int retval = NVN_NOERR;
+  Variant value;
+
+  value.Type = VariantTypeFloat;
+  value.Value.FloatVal = BENCH_NODATA;
+  retval = ((DataGrid*)grid)->SetNodataValue(value);
+
+  return retval;
+}
@@ -0,0 +1,305 @@
+/**
+	 queuebench.cpp - Created by Timothy Morey on 10/19/2026
+
+   Measures how long it takes to push a message onto the UI thread's command
+   queue while several other threads are pushing at the same time, as the
+   loader, the server and the application do.  One consumer thread drains the
+   queue the way the UI thread does.  The same load is run against a ring
+   guarded by a mutex, like the queue used to be, for comparison.
+ */
+
+
+#include "nvn.h"
+
+#include "communication-queue.h"
+
+#include <getopt.h>
+#include <mpi.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+
+#define QBENCH_ROLES 3
+
+
+/**
+   The threads that push onto the UI queue in the library.
+ */
+const char* RoleNames[QBENCH_ROLES] = { "loader", "server", "application" };
+
+/**
+   A ring guarded by a mutex, which is how the queue used to work.  Push waits
+   for room rather than dropping the message, so that both queues carry the
+   same load.
+ */
+struct LockedQueue
+{
+  Message Messages[QUEUE_SIZE];
+  int Front;
+  int Size;
+  pthread_mutex_t Mutex;
+};
+
+/**
+   Everything a producer or consumer thread needs to know.
+ */
+struct Worker
+{
+  CommunicationQueue* Queue;
+  LockedQueue* Locked;
+  pthread_barrier_t* Start;
+  int NMessages;
+  int NExpected;
+  std::vector<double> Latency;
+};
+
+int LockedPop(LockedQueue* queue, Message msgs[], int max, int* count);
+int LockedPush(LockedQueue* queue, Message msg);
+int Percentile(std::vector<double>& values, double fraction, double* value);
+int RunTrial(const char* name, bool locked, int nproducers, int nmessages);
+void* ConsumerEntryPoint(void* arg);
+void* ProducerEntryPoint(void* arg);
+
+
+int main(int argc, char* argv[])
+{
+  int c;
+  int nproducers = 1;
+  int nmessages = 100000;
+  int retval = NVN_NOERR;
+
+  MPI_Init(&argc, &argv);
+
+  while((c = getopt(argc, argv, "m:p:")) != -1)
+  {
+    switch(c)
+    {
+    case 'm':
+      // Messages pushed by each producer
+      nmessages = atoi(optarg);
+      break;
+
+    case 'p':
+      // Producer threads for each role
+      nproducers = atoi(optarg);
+      break;
+
+    default:
+      fprintf(stderr, "Usage: queuebench [-p producersperrole] [-m messages]\n");
+      retval = NVN_EINVARGS;
+      break;
+    }
+  }
+
+  if(nproducers < 1 || nmessages < 1)
+  {
+    fprintf(stderr, "Invalid benchmark size\n");
+    retval = NVN_EINVARGS;
+  }
+
+  if(NVN_NOERR == retval)
+  {
+    printf("%d producers (%d each as ", QBENCH_ROLES * nproducers, nproducers);
+    for(int i = 0; i < QBENCH_ROLES; i++)
+      printf("%s%s", RoleNames[i], i + 1 < QBENCH_ROLES ? ", " : "");
+    printf("), %d messages each, %d slots\n", nmessages, QUEUE_SIZE);
+
+    retval = RunTrial("mutex", true, nproducers, nmessages);
+    if(NVN_NOERR == retval)
+      retval = RunTrial("lockfree", false, nproducers, nmessages);
+  }
+
+  MPI_Finalize();
+
+  return retval;
+}
+
+int LockedPop(LockedQueue* queue, Message msgs[], int max, int* count)
+{
+  int retval = NVN_NOERR;
+
+  pthread_mutex_lock(&queue->Mutex);
+
+  *count = 0;
+  while(*count < max && queue->Size > 0)
+  {
+    msgs[(*count)++] = queue->Messages[queue->Front];
+    queue->Front = (queue->Front + 1) % QUEUE_SIZE;
+    queue->Size--;
+  }
+
+  pthread_mutex_unlock(&queue->Mutex);
+
+  return retval;
+}
+
+int LockedPush(LockedQueue* queue, Message msg)
+{
+  int retval = NVN_NOERR;
+  bool pushed = false;
+
+  while(! pushed)
+  {
+    pthread_mutex_lock(&queue->Mutex);
+
+    if(queue->Size < QUEUE_SIZE)
+    {
+      queue->Messages[(queue->Front + queue->Size) % QUEUE_SIZE] = msg;
+      queue->Size++;
+      pushed = true;
+    }
+
+    pthread_mutex_unlock(&queue->Mutex);
+
+    if(! pushed)
+      sched_yield();
+  }
+
+  return retval;
+}
+
+int Percentile(std::vector<double>& values, double fraction, double* value)
+{
+  int retval = NVN_NOERR;
+
+  if(values.size() > 0)
+  {
+    size_t i = (size_t)(fraction * (values.size() - 1));
+    std::nth_element(values.begin(), values.begin() + i, values.end());
+    *value = values[i];
+  }
+  else
+  {
+    *value = 0.0;
+  }
+
+  return retval;
+}
+
+int RunTrial(const char* name, bool locked, int nproducers, int nmessages)
+{
+  int retval = NVN_NOERR;
+  int nthreads = QBENCH_ROLES * nproducers + 1;
+  CommunicationQueue* queue = new CommunicationQueue;
+  LockedQueue* lockedqueue = new LockedQueue;
+  std::vector<Worker> workers(nthreads);
+  std::vector<pthread_t> threads(nthreads);
+  pthread_barrier_t start;
+  double elapsed = 0.0;
+
+  InitQueue(queue);
+  memset(lockedqueue, 0, sizeof(LockedQueue));
+  pthread_mutex_init(&lockedqueue->Mutex, 0);
+  pthread_barrier_init(&start, 0, nthreads + 1);
+
+  // The last worker is the consumer, which stands in for the UI thread.
+  for(int i = 0; i < nthreads; i++)
+  {
+    workers[i].Queue = locked ? 0 : queue;
+    workers[i].Locked = locked ? lockedqueue : 0;
+    workers[i].Start = &start;
+    workers[i].NMessages = i + 1 < nthreads ? nmessages : 0;
+    workers[i].NExpected = i + 1 < nthreads ? 0 : (nthreads - 1) * nmessages;
+
+    if(0 != pthread_create(&threads[i], 0,
+                           i + 1 < nthreads ? ProducerEntryPoint :
+                                              ConsumerEntryPoint,
+                           &workers[i]))
+    {
+      fprintf(stderr, "Unable to start a benchmark thread\n");
+      exit(NVN_ETHREADFAIL);
+    }
+  }
+
+  pthread_barrier_wait(&start);
+  elapsed = MPI_Wtime();
+
+  for(int i = 0; i < nthreads; i++)
+    pthread_join(threads[i], 0);
+
+  elapsed = MPI_Wtime() - elapsed;
+
+  printf("%s: %.0f messages/s\n", name,
+         (nthreads - 1) * nmessages / elapsed);
+
+  for(int role = 0; role < QBENCH_ROLES; role++)
+  {
+    std::vector<double> latency;
+    double p50, p95, p99, max;
+
+    for(int i = role; i < nthreads - 1; i += QBENCH_ROLES)
+      latency.insert(latency.end(),
+                     workers[i].Latency.begin(), workers[i].Latency.end());
+
+    Percentile(latency, 0.5, &p50);
+    Percentile(latency, 0.95, &p95);
+    Percentile(latency, 0.99, &p99);
+    max = *std::max_element(latency.begin(), latency.end());
+
+    printf("  %-11s push  p50 %7.2f  p95 %7.2f  p99 %7.2f  max %9.2f us\n",
+           RoleNames[role], 1.0e6 * p50, 1.0e6 * p95, 1.0e6 * p99,
+           1.0e6 * max);
+  }
+
+  pthread_barrier_destroy(&start);
+  pthread_mutex_destroy(&lockedqueue->Mutex);
+  DestroyQueue(queue);
+  delete lockedqueue;
+  delete queue;
+
+  return retval;
+}
+
+void* ConsumerEntryPoint(void* arg)
+{
+  Worker* worker = (Worker*)arg;
+  Message batch[QUEUE_BATCH_SIZE];
+  int count = 0;
+  int received = 0;
+
+  pthread_barrier_wait(worker->Start);
+
+  while(received < worker->NExpected)
+  {
+    if(worker->Locked)
+      LockedPop(worker->Locked, batch, QUEUE_BATCH_SIZE, &count);
+    else
+      PopBatch(worker->Queue, batch, QUEUE_BATCH_SIZE, &count);
+
+    received += count;
+  }
+
+  return 0;
+}
+
+void* ProducerEntryPoint(void* arg)
+{
+  Worker* worker = (Worker*)arg;
+  Message msg;
+  double start;
+
+  InitMessage(&msg, 0);
+  worker->Latency.resize(worker->NMessages);
+
+  pthread_barrier_wait(worker->Start);
+
+  for(int i = 0; i < worker->NMessages; i++)
+  {
+    start = MPI_Wtime();
+
+    if(worker->Locked)
+      LockedPush(worker->Locked, msg);
+    else
+      Push(worker->Queue, msg);
+
+    worker->Latency[i] = MPI_Wtime() - start;
+  }
+
+  return 0;
+}
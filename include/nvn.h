@@ -58,8 +58,58 @@ extern "C"
 #define NVN_ETHREADFAIL   12
 #define NVN_ECOMMFAIL     13
 #define NVN_ECLIENTGONE   14
+#define NVN_EEGLFAIL      15
+#define NVN_ETIMEOUT      16
 
-#define NVN_NUMERRS       15
+#define NVN_NUMERRS       17
+
+
+/******************************************************************************
+ * Rendering backends:
+ ******************************************************************************/
+
+#define NVN_BACKEND_AUTO      0   // GLX if an X display is available, else EGL
+#define NVN_BACKEND_GLX       1   // On-screen X11 windows
+#define NVN_BACKEND_HEADLESS  2   // Offscreen EGL pbuffers, no X server needed
+
+
+/******************************************************************************
+ * Plot decimation modes:
+ ******************************************************************************/
+
+#define NVN_DECIMATE_NONE     0   // Draw every sample
+#define NVN_DECIMATE_MINMAX   1   // The extremes within each pixel column
+#define NVN_DECIMATE_LTTB     2   // Largest-Triangle-Three-Buckets, one per column
+
+
+/******************************************************************************
+ * Recording modes:
+ ******************************************************************************/
+
+#define NVN_RECORD_PPM        0   // Numbered PPM files
+#define NVN_RECORD_PIPE       1   // Raw RGB frames piped to a command
+
+
+/******************************************************************************
+ * Frame profiling phases:
+ ******************************************************************************/
+
+#define NVN_PHASE_FRAME       0   // The whole frame, including the swap
+#define NVN_PHASE_EVENTS      1   // X events handled since the last frame
+#define NVN_PHASE_QUEUE       2   // Messages handled since the last frame
+#define NVN_PHASE_LAYERS      3   // Rendering the layers of the model
+#define NVN_PHASE_MESH        4   // Building meshes and lines, within layers
+#define NVN_PHASE_SWAP        5   // Swapping or finishing the frame
+#define NVN_PHASE_GPU         6   // GPU time, if timer queries are available
+
+#define NVN_NUM_PHASES        7
+
+
+/******************************************************************************
+ * Probing:
+ ******************************************************************************/
+
+#define NVN_PROBE_RADIUS      5   // How close to a line, in pixels, is a hit
 
 
 /*****************************************************************************
@@ -67,11 +117,20 @@ extern "C"
  *****************************************************************************/
 
 typedef int NVN_Err;
+typedef intptr_t NVN_Completion;
 typedef intptr_t NVN_DataGrid;
 typedef intptr_t NVN_Layer;
 typedef intptr_t NVN_Model;
 typedef intptr_t NVN_Window;
 
+/**
+   Called when a completion is finished, with the result of its command.  It
+   is called on the UI thread, or on the caller's own thread if that is where
+   the command ran, and should return quickly.
+ */
+typedef void (*NVN_CompletionFunc)(NVN_Completion done, NVN_Err result,
+                                   void* arg);
+
 typedef struct
 {
   char Filename[MAX_PATH];
@@ -89,6 +148,47 @@ typedef struct
 
  extern NVN_BBox NVN_BBoxEmpty;
 
+/**
+   The data found under a point of a model.  Layer is 0 if nothing was found.
+   For a grid layer, Index is the grid cell nearest the point, and Value is
+   interpolated from the cells around it.  For a line layer, Index[0] is the
+   line, Index[1] is the first vertex of the nearest segment within that line,
+   and Value is the y value of the line nearest the point.
+ */
+typedef struct
+{
+  NVN_Layer Layer;
+  MPI_Offset Index[MAX_DIMS];
+  double Value;
+  float X;
+  float Y;
+} NVN_ProbeResult;
+
+/**
+   Statistics of the time, in seconds, that one phase took over the frames
+   that a window rendered recently.  NFrames is how many frames they are
+   taken over, and the rest are 0 if there were none.
+ */
+typedef struct
+{
+  int NFrames;
+  double Mean;
+  double P50;
+  double P95;
+  double P99;
+  double Max;
+} NVN_PhaseStats;
+
+/**
+   Statistics for each phase of the recent frames of a window, indexed by the
+   NVN_PHASE_* constants.
+ */
+typedef struct
+{
+  int NFrames;
+  NVN_PhaseStats Phase[NVN_NUM_PHASES];
+} NVN_FrameStats;
+
 
 /*****************************************************************************
  * Public interface functions
@@ -96,8 +196,39 @@ typedef struct
 
 NVN_Err NVN_AddLayer(NVN_Model model, NVN_Layer layer);
 
+/**
+   Adds a polyline of n >= 2 vertices to a multi-line layer, and returns its
+   index in line.  Lines are numbered from 0 in the order they are added.
+ */
+NVN_Err NVN_AddLine(NVN_Layer layer, const float x[], const float y[], int n,
+                    int color, int* line);
+
+/**
+   Appends n samples to a series layer.  This may be called from any thread
+   while the layer is being shown, and the windows that show it redraw on
+   their next pass through the event loop.
+ */
+NVN_Err NVN_AppendToSeries(NVN_Layer layer, const float x[], const float y[],
+                           int n);
+
 NVN_Err NVN_BBoxUnion(NVN_BBox b1, NVN_BBox b2, NVN_BBox* u);
 
+/**
+   Creates a completion, which is passed to one of the *Async functions to
+   find out when the command that it starts has been carried out.  A command
+   can be waited on with NVN_WaitCompletion, or func can be given to be called
+   when it is done, or both.  Each completion is used for a single command.
+ */
+NVN_Err NVN_CreateCompletion(NVN_CompletionFunc func, void* arg,
+                             NVN_Completion* done);
+
+/**
+   Creates a layer of contour lines of the grid at each of the nlevels values
+   in levels, drawn in the given color.
+ */
+NVN_Err NVN_CreateContourLayer(NVN_DataGrid grid, const float levels[],
+                               int nlevels, int color, NVN_Layer* layer);
+
 NVN_Err NVN_CreateDataGrid(int ndims,
                            const MPI_Offset dimlen[],
                            MPI_Datatype type,
@@ -106,31 +237,205 @@ NVN_Err NVN_CreateDataGrid(int ndims,
 
 NVN_Err NVN_CreateModel(NVN_Model* model);
 
+/**
+   Creates an empty layer for drawing many 2D polylines at once, such as the
+   flight lines of a radar campaign.  Lines are added with NVN_AddLine, and
+   all of the visible ones are drawn with a single call.
+ */
+NVN_Err NVN_CreateMultiLineLayer(NVN_Layer* layer);
+
 NVN_Err NVN_Create2DPlotLayer(NVN_DataGrid x, NVN_DataGrid y, int color,
                               NVN_Layer* layer);
 
 NVN_Err NVN_CreateGlacierLayer(NVN_DataGrid topg, NVN_DataGrid usurf,
                                NVN_Layer* layer);
 
+/**
+   Creates an empty 2D line plot for streaming samples with
+   NVN_AppendToSeries.  A layer with a positive capacity keeps only that many
+   of the most recent samples, and one with a capacity of 0 keeps them all.
+ */
+NVN_Err NVN_CreateSeriesLayer(int capacity, int color, NVN_Layer* layer);
+
 NVN_Err NVN_CreateShadedSurfaceLayer(NVN_DataGrid grid, NVN_Layer* layer);
 
+/**
+   Creates a layer that draws a 3D grid as a translucent volume, colored by
+   value.  The grid's third dimension is drawn along z.
+ */
+NVN_Err NVN_CreateVolumeLayer(NVN_DataGrid grid, NVN_Layer* layer);
+
 NVN_Err NVN_CreateWindow(const char* title,
 			             int x, int y,
 		                 int width, int height,
 		                 int borderless,
 		                 NVN_Window* window);
 
+/**
+   Starts creating a window, and returns without waiting for it.  The window
+   is stored in *window, which must stay valid until done is finished.
+ */
+NVN_Err NVN_CreateWindowAsync(const char* title,
+                              int x, int y,
+                              int width, int height,
+                              int borderless,
+                              NVN_Window* window,
+                              NVN_Completion done);
+
+/**
+   Releases a completion.  One whose command is still pending is kept until
+   the command is finished, although its callback is still made.
+ */
+NVN_Err NVN_DestroyCompletion(NVN_Completion done);
+
 NVN_Err NVN_DestroyWindow(NVN_Window window);
 
+/**
+   Starts destroying a window, and returns without waiting for it.
+ */
+NVN_Err NVN_DestroyWindowAsync(NVN_Window window, NVN_Completion done);
+
+/**
+   Makes the window part of a sort-last parallel renderer.  Every rank in comm
+   renders its own model into a window of the same size, and the frames are
+   depth-composited and shown in the window on displayrank.  All ranks share
+   the display rank's view.  This is collective over comm, the window must be
+   destroyed collectively as well, and MPI must have been initialized with
+   MPI_THREAD_MULTIPLE.
+ */
+NVN_Err NVN_EnableCompositing(NVN_Window window, MPI_Comm comm, int displayrank);
+
 NVN_Err NVN_ErrMsg(NVN_Err err, char msg[], size_t len);
 
+/**
+   Summarizes the last frames that the window rendered, with the mean,
+   percentiles and worst time of each NVN_PHASE_*, in seconds.  Phases nest, so
+   they do not add up to the frame time.  GPU times are only given where the
+   driver supports timer queries, and NFrames of that phase is 0 otherwise.
+ */
+NVN_Err NVN_GetFrameStats(NVN_Window window, NVN_FrameStats* stats);
+
+/**
+   Returns the probe of the point under the mouse pointer, as of the last time
+   it moved over the window.  Hovering only probes the model, and never causes
+   the window to redraw.
+ */
+NVN_Err NVN_GetHoverProbe(NVN_Window window, NVN_ProbeResult* result);
+
+/**
+   Summarizes the time that one layer took to render in the last frames that
+   the window rendered, in seconds.  A layer that is drawn more than once in a
+   frame counts the total time of that frame.
+ */
+NVN_Err NVN_GetLayerStats(NVN_Window window, NVN_Layer layer,
+                          NVN_PhaseStats* stats);
+
 NVN_Err NVN_GetViewParms(NVN_Window window, float* centerx, float* centery,
                          float* zoomlevel, float* xrotation, float* zrotation);
 
 NVN_Err NVN_Init();
 
+/**
+   Starts the library with the given backend.  Once it has started, asking for
+   a different backend fails with NVN_EINVARGS, and NVN_BACKEND_AUTO accepts
+   whichever one is running.
+ */
+NVN_Err NVN_InitBackend(int backend);
+
 NVN_Err NVN_LoadDataGrid(NVN_DataGridDescriptor desc, NVN_DataGrid* grid);
 
+/**
+   Finds the data under pixel (x, y) of the window, counted from its top-left
+   corner.  The topmost layer that has data there wins, and lines count if
+   they are within NVN_PROBE_RADIUS pixels.
+ */
+NVN_Err NVN_Probe(NVN_Window window, int x, int y, NVN_ProbeResult* result);
+
+/**
+   Finds the data under the model point (x, y), counting lines that are within
+   radius model units of it.
+ */
+NVN_Err NVN_ProbeModel(NVN_Model model, float x, float y, float radius,
+                       NVN_ProbeResult* result);
+
+/**
+   Copies the most recent frame rendered in the window into rgba, which must
+   hold at least 4 * width * height bytes.  Rows are stored bottom-up, as
+   returned by glReadPixels.  The window is rendered first if it is dirty.
+ */
+NVN_Err NVN_ReadFrame(NVN_Window window, void* rgba, size_t len);
+
+/**
+   Starts reading back a frame as NVN_ReadFrame does, and returns without
+   waiting for it.  rgba must stay valid until done is finished.
+ */
+NVN_Err NVN_ReadFrameAsync(NVN_Window window, void* rgba, size_t len,
+                           NVN_Completion done);
+
+/**
+   Turns adaptive detail on or off for a window.  While it is on, which is the
+   default, a scene that is too slow to draw at 60 frames per second is drawn
+   at reduced detail while the view is being moved, and at full detail again
+   once the view comes to rest.  Frames read with NVN_ReadFrame are always
+   drawn at full detail.
+ */
+NVN_Err NVN_SetAdaptiveDetail(NVN_Window window, int enable);
+
+/**
+   Replaces the levels of a contour layer.  Levels that the layer already has
+   are kept as they are, and only the new ones are extracted, on the next
+   render.
+ */
+NVN_Err NVN_SetContourLevels(NVN_Layer layer, const float levels[], int nlevels);
+
+/**
+   Makes the window one tile of a display wall.  The wall is a logical
+   framebuffer of wallwidth x wallheight pixels, and this window shows the
+   part of it whose top-left corner is at (tilex, tiley).  All tiles share the
+   view of the window on rank 0 of comm, and each one only draws the geometry
+   that falls inside its own tile.  This is collective over comm, and has the
+   same requirements as NVN_EnableCompositing.
+ */
+NVN_Err NVN_SetDisplayTile(NVN_Window window, MPI_Comm comm,
+                           int wallwidth, int wallheight,
+                           int tilex, int tiley);
+
+/**
+   Changes the color of one line of a multi-line layer.
+ */
+NVN_Err NVN_SetLineColor(NVN_Layer layer, int line, int color);
+
+/**
+   Shows or hides one line of a multi-line layer.  Hidden lines still count
+   towards the bounds of the layer, so the view does not move.
+ */
+NVN_Err NVN_SetLineVisible(NVN_Layer layer, int line, int visible);
+
+/**
+   Chooses how a 2D plot layer reduces its samples to about one vertex per
+   pixel column of the view.  Plots use NVN_DECIMATE_MINMAX by default, and
+   any mode falls back to drawing every sample if the x values are unsorted.
+ */
+NVN_Err NVN_SetPlotDecimation(NVN_Layer layer, int mode);
+
+/**
+   Names the calling thread in traces.  The name must be a string constant.
+ */
+NVN_Err NVN_SetTraceThreadName(const char* name);
+
+/**
+   Turns event tracing on or off for the whole process.  While it is off, the
+   traced parts of nvn cost no more than a flag test.  Events accumulate until
+   a thread's buffer fills, and are then dropped.
+ */
+NVN_Err NVN_SetTracing(int enable);
+
+/**
+   Moves the camera of a window, from any thread, without waiting for it to
+   be drawn.  The window draws its next frame from the newest view it has
+   been given, so views that come faster than frames are skipped rather than
+   queued.  NVN_GetViewParms gives the newest view even before it is drawn.
+ */
 NVN_Err NVN_SetViewParms(NVN_Window window, float centerx, float centery,
                          float zoomlevel, float xrotation, float zrotation);
 
@@ -138,6 +443,63 @@ NVN_Err NVN_ShowModel(NVN_Window window, NVN_Model model);
 
 NVN_Err NVN_Shutdown();
 
+/**
+   Starts saving every frame that the window renders.  With NVN_RECORD_PPM,
+   target is a path prefix, and frames are written to <target>000000.ppm,
+   <target>000001.ppm and so on.  With NVN_RECORD_PIPE, target is a shell
+   command that is sent the frames as raw top-down rgb24 on its standard
+   input, such as
+     ffmpeg -f rawvideo -pix_fmt rgb24 -s 640x480 -r 30 -i - movie.mp4
+   Frames are read back and written in the background, and are dropped if
+   the writer falls too far behind.
+ */
+NVN_Err NVN_StartRecording(NVN_Window window, const char* target, int mode);
+
+/**
+   Starts recording as NVN_StartRecording does, and returns without waiting
+   for the recorder to start.
+ */
+NVN_Err NVN_StartRecordingAsync(NVN_Window window, const char* target, int mode,
+                                NVN_Completion done);
+
+/**
+   Stops recording, and waits until every captured frame has been written.
+ */
+NVN_Err NVN_StopRecording(NVN_Window window);
+
+/**
+   Stops recording, and returns without waiting for the captured frames to be
+   written.  done is finished once they have been.
+ */
+NVN_Err NVN_StopRecordingAsync(NVN_Window window, NVN_Completion done);
+
+/**
+   Begins a traced event on the calling thread, which lasts until the matching
+   call to NVN_TraceEnd.  Events may nest, and the name must be a string
+   constant.  An event begun while tracing is off is not recorded, and
+   neither is its end, even if tracing has been turned on in between.
+ */
+NVN_Err NVN_TraceBegin(const char* name);
+
+NVN_Err NVN_TraceEnd();
+
+/**
+   Waits for the command started with a completion to be carried out, for up
+   to timeout seconds, or for as long as it takes if timeout is negative.  A
+   timeout of 0 just checks whether it is done.  The command's own error code
+   is stored in result.
+
+   Returns NVN_ETIMEOUT if the command is not done in time.
+ */
+NVN_Err NVN_WaitCompletion(NVN_Completion done, double timeout,
+                           NVN_Err* result);
+
+/**
+   Writes the events traced so far on this rank to <prefix>.<rank>.json, in
+   the Chrome trace format that chrome://tracing and Perfetto can open.
+ */
+NVN_Err NVN_WriteTrace(const char* prefix);
+
 
 /*****************************************************************************
  * Public interface predicates
@@ -0,0 +1,313 @@
+/*
+ * Compositor.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Timothy Morey
+ */
+
+
+#include "nvn.h"
+
+#include "Compositor.hpp"
+#include "Trace.hpp"
+
+#define MPICH_SKIP_MPICXX 1
+#include <mpi.h>
+
+#include <GL/gl.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+/******************************************************************************
+ * Constructors
+ ******************************************************************************/
+
+Compositor::Compositor(MPI_Comm comm, int displayrank)
+  : _Comm(comm),
+    _DisplayRank(displayrank),
+    _Capacity(0),
+    _Color(0),
+    _Depth(0),
+    _RecvColor(0),
+    _RecvDepth(0),
+    _Final(0),
+    _Counts(0),
+    _Displs(0)
+{
+  MPI_Comm_rank(_Comm, &_Rank);
+  MPI_Comm_size(_Comm, &_Size);
+
+  _SwapSize = 1;
+  while(_SwapSize * 2 <= _Size)
+    _SwapSize *= 2;
+
+  if(this->IsDisplayRank())
+  {
+    _Counts = (int*)malloc(_Size * sizeof(int));
+    _Displs = (int*)malloc(_Size * sizeof(int));
+  }
+}
+
+Compositor::~Compositor()
+{
+  free(_Color);
+  free(_Depth);
+  free(_RecvColor);
+  free(_RecvDepth);
+  free(_Final);
+  free(_Counts);
+  free(_Displs);
+}
+
+
+/******************************************************************************
+ * Public Members
+ ******************************************************************************/
+
+int Compositor::Composite(int width, int height)
+{
+  int retval = NVN_NOERR;
+  int npixels = width * height;
+  int lo, hi;
+  int failed = 0, anyfailed = 0;
+
+  retval = this->Reserve(npixels);
+
+  if(NVN_NOERR == retval)
+    retval = this->ReadBack(width, height);
+
+  // The swap and gather are matched point to point across every rank, so a
+  // rank that cannot take part would leave the others waiting forever.  The
+  // ranks agree first, and all of them skip the frame together.
+  failed = NVN_NOERR == retval ? 0 : 1;
+  MPI_Allreduce(&failed, &anyfailed, 1, MPI_INT, MPI_MAX, _Comm);
+  if(NVN_NOERR == retval && anyfailed)
+    retval = NVN_ERROR;
+
+  if(NVN_NOERR == retval)
+    retval = this->BinarySwap(npixels, &lo, &hi);
+
+  if(NVN_NOERR == retval)
+    retval = this->Gather(npixels, lo, hi);
+
+  if(NVN_NOERR == retval && this->IsDisplayRank())
+    retval = this->DrawComposite(width, height);
+
+  return retval;
+}
+
+
+/******************************************************************************
+ * Protected Members
+ ******************************************************************************/
+
+int Compositor::BinarySwap(int npixels, int* lo, int* hi)
+{
+  int retval = NVN_NOERR;
+  TraceScope trace("Compositor::BinarySwap", "mpi");
+  int partner;
+  int mid, keeplo, keephi, sendlo, sendhi;
+
+  *lo = 0;
+  *hi = npixels;
+
+  if(_Rank >= _SwapSize)
+  {
+    // Fold the ranks beyond the largest power of two into their partners, and
+    // then sit out the swap rounds.
+    partner = _Rank - _SwapSize;
+    MPI_Send(_Color, npixels, MPI_UNSIGNED, partner, 0, _Comm);
+    MPI_Send(_Depth, npixels, MPI_FLOAT, partner, 1, _Comm);
+    *lo = 0;
+    *hi = 0;
+  }
+  else
+  {
+    if(_Rank + _SwapSize < _Size)
+    {
+      partner = _Rank + _SwapSize;
+      MPI_Recv(_RecvColor, npixels, MPI_UNSIGNED, partner, 0, _Comm,
+               MPI_STATUS_IGNORE);
+      MPI_Recv(_RecvDepth, npixels, MPI_FLOAT, partner, 1, _Comm,
+               MPI_STATUS_IGNORE);
+      this->MergePixels(npixels, _RecvColor, _RecvDepth, _Color, _Depth);
+    }
+
+    // Each round, a rank and its partner own the same region of the image.
+    // The lower rank keeps the first half and the upper rank keeps the second,
+    // and each merges the half it receives into the half it keeps.
+    for(int bit = 1; bit < _SwapSize; bit <<= 1)
+    {
+      partner = _Rank ^ bit;
+      mid = *lo + (*hi - *lo) / 2;
+
+      if(_Rank < partner)
+      {
+        keeplo = *lo;  keephi = mid;
+        sendlo = mid;  sendhi = *hi;
+      }
+      else
+      {
+        keeplo = mid;  keephi = *hi;
+        sendlo = *lo;  sendhi = mid;
+      }
+
+      MPI_Sendrecv(_Color + sendlo, sendhi - sendlo, MPI_UNSIGNED, partner, 0,
+                   _RecvColor, keephi - keeplo, MPI_UNSIGNED, partner, 0,
+                   _Comm, MPI_STATUS_IGNORE);
+      MPI_Sendrecv(_Depth + sendlo, sendhi - sendlo, MPI_FLOAT, partner, 1,
+                   _RecvDepth, keephi - keeplo, MPI_FLOAT, partner, 1,
+                   _Comm, MPI_STATUS_IGNORE);
+
+      this->MergePixels(keephi - keeplo, _RecvColor, _RecvDepth,
+                        _Color + keeplo, _Depth + keeplo);
+
+      *lo = keeplo;
+      *hi = keephi;
+    }
+  }
+
+  return retval;
+}
+
+int Compositor::DrawComposite(int width, int height)
+{
+  int retval = NVN_NOERR;
+
+  glMatrixMode(GL_PROJECTION);
+  glPushMatrix();
+  glLoadIdentity();
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+  glLoadIdentity();
+
+  glPushAttrib(GL_ENABLE_BIT);
+  glDisable(GL_DEPTH_TEST);
+  glDisable(GL_LIGHTING);
+  glDisable(GL_BLEND);
+  glDisable(GL_TEXTURE_2D);
+
+  glRasterPos2f(-1.0f, -1.0f);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glDrawPixels(width, height, GL_RGBA, GL_UNSIGNED_BYTE, _Final);
+
+  glPopAttrib();
+
+  glMatrixMode(GL_PROJECTION);
+  glPopMatrix();
+  glMatrixMode(GL_MODELVIEW);
+  glPopMatrix();
+
+  return retval;
+}
+
+int Compositor::Gather(int npixels, int lo, int hi)
+{
+  int retval = NVN_NOERR;
+  TraceScope trace("Compositor::Gather", "mpi");
+  int region[2] = { lo, hi };
+  int* regions = 0;
+
+  if(this->IsDisplayRank())
+    regions = (int*)malloc(2 * _Size * sizeof(int));
+
+  MPI_Gather(region, 2, MPI_INT, regions, 2, MPI_INT, _DisplayRank, _Comm);
+
+  if(this->IsDisplayRank())
+  {
+    for(int i = 0; i < _Size; i++)
+    {
+      _Displs[i] = regions[2 * i];
+      _Counts[i] = regions[2 * i + 1] - regions[2 * i];
+    }
+
+    free(regions);
+  }
+
+  MPI_Gatherv(_Color + lo, hi - lo, MPI_UNSIGNED,
+              _Final, _Counts, _Displs, MPI_UNSIGNED,
+              _DisplayRank, _Comm);
+
+  return retval;
+}
+
+int Compositor::MergePixels(int n, const unsigned int* color, const float* depth,
+                            unsigned int* outcolor, float* outdepth) const
+{
+  int retval = NVN_NOERR;
+
+  for(int i = 0; i < n; i++)
+  {
+    if(depth[i] < outdepth[i])
+    {
+      outdepth[i] = depth[i];
+      outcolor[i] = color[i];
+    }
+  }
+
+  return retval;
+}
+
+int Compositor::ReadBack(int width, int height)
+{
+  int retval = NVN_NOERR;
+  TraceScope trace("Compositor::ReadBack", "render");
+
+  // The frame has not been swapped yet, so it is still in the back buffer.
+  glReadBuffer(GL_BACK);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, _Color);
+  glReadPixels(0, 0, width, height, GL_DEPTH_COMPONENT, GL_FLOAT, _Depth);
+
+  return retval;
+}
+
+int Compositor::Reserve(int npixels)
+{
+  int retval = NVN_NOERR;
+
+  if(npixels > _Capacity)
+  {
+    // Each buffer is only replaced once it has grown, so a failed allocation
+    // leaves the old buffers in place, all still large enough for _Capacity.
+    unsigned int* color =
+      (unsigned int*)realloc(_Color, npixels * sizeof(unsigned int));
+    if(color)
+      _Color = color;
+
+    float* depth = (float*)realloc(_Depth, npixels * sizeof(float));
+    if(depth)
+      _Depth = depth;
+
+    unsigned int* recvcolor =
+      (unsigned int*)realloc(_RecvColor, npixels * sizeof(unsigned int));
+    if(recvcolor)
+      _RecvColor = recvcolor;
+
+    float* recvdepth = (float*)realloc(_RecvDepth, npixels * sizeof(float));
+    if(recvdepth)
+      _RecvDepth = recvdepth;
+
+    unsigned int* final = _Final;
+    if(this->IsDisplayRank())
+    {
+      final = (unsigned int*)realloc(_Final, npixels * sizeof(unsigned int));
+      if(final)
+        _Final = final;
+    }
+
+    if(color && depth && recvcolor && recvdepth &&
+       (final || ! this->IsDisplayRank()))
+    {
+      _Capacity = npixels;
+    }
+    else
+    {
+      retval = NVN_ERROR;
+      fprintf(stderr, "Unable to allocate compositing buffers.\n");
+    }
+  }
+
+  return retval;
+}
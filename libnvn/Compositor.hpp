@@ -0,0 +1,77 @@
+/*
+ * Compositor.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Timothy Morey
+ */
+
+#ifndef __COMPOSITOR_HPP__
+#define __COMPOSITOR_HPP__
+
+
+#include "nvn.h"
+
+#define MPICH_SKIP_MPICXX 1
+#include <mpi.h>
+
+
+/**
+ * The Compositor implements sort-last parallel rendering.  Every rank in the
+ * communicator renders its own part of the scene into a window of the same
+ * size, and the Compositor reads back the color and depth buffers and merges
+ * them with the binary-swap algorithm, so that each rank only ever exchanges
+ * half of its remaining image per round.  The finished image is gathered on
+ * the display rank and drawn into its window before the buffers are swapped.
+ *
+ * The communicator is borrowed from the window that owns the Compositor, and
+ * must be private to that window so that compositing traffic can never be
+ * confused with the application's own messages.
+ *
+ * Merging is a pure depth test, so translucent geometry is composited as if it
+ * were opaque.
+ */
+class Compositor
+{
+public:
+  Compositor(MPI_Comm comm, int displayrank);
+  ~Compositor();
+
+public:
+  MPI_Comm GetComm() const { return _Comm; }
+  int GetDisplayRank() const { return _DisplayRank; }
+  bool IsDisplayRank() const { return _Rank == _DisplayRank; }
+
+/**
+ * The following public methods must be called from the thread that owns the
+ * current GL context, and are collective over the compositing communicator.
+ */
+public:
+  int Composite(int width, int height);
+
+protected:
+  int BinarySwap(int npixels, int* lo, int* hi);
+  int DrawComposite(int width, int height);
+  int Gather(int npixels, int lo, int hi);
+  int MergePixels(int n, const unsigned int* color, const float* depth,
+                  unsigned int* outcolor, float* outdepth) const;
+  int ReadBack(int width, int height);
+  int Reserve(int npixels);
+
+protected:
+  MPI_Comm _Comm;
+  int _DisplayRank;
+  int _Rank;
+  int _Size;
+  int _SwapSize;   // The largest power of two no larger than _Size
+
+  int _Capacity;
+  unsigned int* _Color;
+  float* _Depth;
+  unsigned int* _RecvColor;
+  float* _RecvDepth;
+  unsigned int* _Final;
+  int* _Counts;
+  int* _Displs;
+};
+
+#endif
@@ -0,0 +1,534 @@
+/*
+ * ContourLayer.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Timothy Morey
+ */
+
+#include "nvn.h"
+
+#include "color-ramp.h"
+#include "variant.h"
+
+#include "CartesianCRS.hpp"
+#include "ContourLayer.hpp"
+#include "DataGrid.hpp"
+#include "FrameProfiler.hpp"
+#include "GridTransform.hpp"
+#include "Layer.hpp"
+#include "Trace.hpp"
+
+#define MPICH_SKIP_MPICXX 1
+#include <mpi.h>
+
+#define GL_GLEXT_PROTOTYPES 1
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+/**
+ * The fewest rows of cells worth handing to a thread of their own.
+ */
+#define CONTOUR_MIN_ROWS 32
+
+/**
+ * How far the lines are lifted above the surface, as a fraction of the range
+ * of the data, so that they are not buried in it.
+ */
+#define CONTOUR_LIFT 0.005f
+
+
+/**
+ * The share of one contour level that is extracted by one thread.
+ */
+struct ContourTask
+{
+  const ContourLayer* Layer;
+  float Value;
+  int Row0, Row1;
+  std::vector<MPI_Offset> Segments;
+};
+
+
+ContourLayer::ContourLayer(DataGrid* grid, const float levels[], int nlevels,
+                           int color)
+  : Layer(),
+    _DataGrid(grid),
+    _Color(color),
+    _NI(0),
+    _NJ(0),
+    _Values(0),
+    _MinVal(FLT_MAX),
+    _MaxVal(-FLT_MAX)
+{
+  MPI_Offset pos[MAX_DIMS] = { 0 };
+  Variant value;
+  float* v;
+
+  pthread_mutex_init(&_Lock, 0);
+
+  if(_DataGrid)
+  {
+    _NI = _DataGrid->GetDimLen(0);
+    _NJ = _DataGrid->GetDimLen(1);
+    _Values = (float*)malloc(_NI * _NJ * sizeof(float));
+  }
+
+  // The grid is read once into a plain array, which every level and thread
+  // can then scan without going through the DataGrid.
+  if(_Values)
+  {
+    for(pos[0] = 0; pos[0] < _NI; pos[0]++)
+    {
+      v = _Values + pos[0] * _NJ;
+
+      for(pos[1] = 0; pos[1] < _NJ; pos[1]++)
+      {
+        if(_DataGrid->HasData(pos) &&
+           NVN_NOERR == _DataGrid->GetElemAsVariant(pos, &value))
+        {
+          v[pos[1]] = VariantValueAsFloat(value);
+          if(v[pos[1]] < _MinVal) _MinVal = v[pos[1]];
+          if(v[pos[1]] > _MaxVal) _MaxVal = v[pos[1]];
+        }
+        else
+        {
+          v[pos[1]] = NAN;
+        }
+      }
+    }
+  }
+  else if(_DataGrid)
+  {
+    _NI = _NJ = 0;
+    fprintf(stderr, "Unable to allocate the contour grid.\n");
+  }
+
+  this->SetLevels(levels, nlevels);
+}
+
+ContourLayer::~ContourLayer()
+{
+  for(size_t i = 0; i < _Levels.size(); i++)
+    delete _Levels[i];
+
+  free(_Values);
+  pthread_mutex_destroy(&_Lock);
+}
+
+const CRS& ContourLayer::GetDataCRS() const
+{
+  if(_DataGrid)
+    return _DataGrid->GetCRS();
+  else
+    return _ModelCrs;
+}
+
+int ContourLayer::Render(const RenderContext& context)
+{
+  int retval = NVN_NOERR;
+  int nextracted = 0;
+  double start = MPI_Wtime();
+  FrameProfiler* profiler = context.GetProfiler();
+  ContourLevel* level;
+
+  pthread_mutex_lock(&_Lock);
+
+  for(size_t i = 0; NVN_NOERR == retval && i < _Levels.size(); i++)
+  {
+    if(! _Levels[i]->Extracted)
+    {
+      retval = this->Extract(_Levels[i]);
+      nextracted++;
+    }
+  }
+
+  if(nextracted > 0 && profiler)
+    profiler->AddTime(NVN_PHASE_MESH, MPI_Wtime() - start);
+
+  glPushAttrib(GL_ENABLE_BIT | GL_LINE_BIT);
+  glDisable(GL_LIGHTING);
+  glLineWidth(2.0f);
+  glColor4ub(GetA(_Color), GetB(_Color), GetG(_Color), GetR(_Color));
+  glEnableClientState(GL_VERTEX_ARRAY);
+
+  for(size_t i = 0; i < _Levels.size(); i++)
+  {
+    level = _Levels[i];
+
+    if(! level->First.empty())
+    {
+      glVertexPointer(3, GL_FLOAT, 0, &level->Verts[0]);
+      glMultiDrawArrays(GL_LINE_STRIP, &level->First[0], &level->Count[0],
+                        (GLsizei)level->First.size());
+    }
+  }
+
+  glDisableClientState(GL_VERTEX_ARRAY);
+  glPopAttrib();
+
+  pthread_mutex_unlock(&_Lock);
+
+  return retval;
+}
+
+int ContourLayer::SetLevels(const float levels[], int nlevels)
+{
+  int retval = NVN_NOERR;
+  std::vector<ContourLevel*> keep;
+  ContourLevel* level;
+
+  if(nlevels < 0 || (nlevels > 0 && ! levels))
+    retval = NVN_EINVARGS;
+
+  if(NVN_NOERR == retval)
+  {
+    pthread_mutex_lock(&_Lock);
+
+    // Levels that are already known are taken over as they are, and only the
+    // new ones are left to be extracted.
+    for(int i = 0; i < nlevels; i++)
+    {
+      level = 0;
+
+      for(size_t k = 0; ! level && k < _Levels.size(); k++)
+      {
+        if(_Levels[k] && _Levels[k]->Value == levels[i])
+        {
+          level = _Levels[k];
+          _Levels[k] = 0;
+        }
+      }
+
+      if(! level)
+      {
+        level = new ContourLevel();
+        level->Value = levels[i];
+        level->Extracted = false;
+      }
+
+      keep.push_back(level);
+    }
+
+    for(size_t k = 0; k < _Levels.size(); k++)
+      delete _Levels[k];
+
+    _Levels.swap(keep);
+    _Revision++;
+
+    pthread_mutex_unlock(&_Lock);
+  }
+
+  return retval;
+}
+
+int ContourLayer::SetModelCRS(const CartesianCRS& crs)
+{
+  int retval = NVN_NOERR;
+
+  pthread_mutex_lock(&_Lock);
+
+  _ModelCrs = crs;
+  for(size_t i = 0; i < _Levels.size(); i++)
+    _Levels[i]->Extracted = false;
+
+  this->InvalidateBounds();
+
+  pthread_mutex_unlock(&_Lock);
+
+  return retval;
+}
+
+NVN_BBox ContourLayer::ComputeBounds() const
+{
+  NVN_BBox bounds = NVN_BBoxEmpty;
+  MPI_Offset minpti[MAX_DIMS] = { 0 }, maxpti[MAX_DIMS] = { 0 };
+  float corner1[MAX_DIMS], corner2[MAX_DIMS];
+
+  if(_DataGrid && _NI > 0 && _NJ > 0 && _MinVal <= _MaxVal)
+  {
+    GridTransform transform(_ModelCrs, _DataGrid->GetCRS());
+    float zscale = transform.GetModelUnitsPerCell() / 100.0f;
+
+    maxpti[0] = _NI - 1;
+    maxpti[1] = _NJ - 1;
+
+    // The same bounds as the surface of the grid, so that adding contours to
+    // a surface does not move the view.
+    transform.GridToModel(minpti, corner1);
+    transform.GridToModel(maxpti, corner2);
+
+    for(int i = XDIM; i <= YDIM; i++)
+    {
+      bounds.Min[i] = corner1[i] < corner2[i] ? corner1[i] : corner2[i];
+      bounds.Max[i] = corner1[i] < corner2[i] ? corner2[i] : corner1[i];
+    }
+
+    bounds.Min[ZDIM] = _MinVal * zscale;
+    bounds.Max[ZDIM] = _MaxVal * zscale;
+  }
+
+  return bounds;
+}
+
+int ContourLayer::Extract(ContourLevel* level)
+{
+  int retval = NVN_NOERR;
+  TraceScope trace("ContourLayer::Extract", "mesh");
+  int nrows = _NI - 1;
+  int nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  pthread_t threads[CONTOUR_MAX_THREADS];
+  bool started[CONTOUR_MAX_THREADS];
+  ContourTask tasks[CONTOUR_MAX_THREADS];
+  std::vector<MPI_Offset> segments;
+  size_t nsegments = 0;
+
+  level->Verts.clear();
+  level->First.clear();
+  level->Count.clear();
+
+  if(nthreads > CONTOUR_MAX_THREADS) nthreads = CONTOUR_MAX_THREADS;
+  if(nthreads > nrows / CONTOUR_MIN_ROWS) nthreads = nrows / CONTOUR_MIN_ROWS;
+  if(nthreads < 1) nthreads = 1;
+
+  // Each thread takes a band of rows.  The first band is done on this thread,
+  // and so is any band whose thread could not be started.
+  for(int t = 0; t < nthreads; t++)
+  {
+    tasks[t].Layer = this;
+    tasks[t].Value = level->Value;
+    tasks[t].Row0 = (int)((long)nrows * t / nthreads);
+    tasks[t].Row1 = (int)((long)nrows * (t + 1) / nthreads);
+    started[t] = t > 0 &&
+      0 == pthread_create(&threads[t], 0, ExtractThreadEntryPoint, &tasks[t]);
+  }
+
+  for(int t = 0; t < nthreads; t++)
+  {
+    if(! started[t])
+      ExtractThreadEntryPoint(&tasks[t]);
+  }
+
+  for(int t = 0; t < nthreads; t++)
+  {
+    if(started[t])
+      pthread_join(threads[t], 0);
+    nsegments += tasks[t].Segments.size();
+  }
+
+  segments.reserve(nsegments);
+  for(int t = 0; t < nthreads; t++)
+  {
+    segments.insert(segments.end(),
+                    tasks[t].Segments.begin(), tasks[t].Segments.end());
+  }
+
+  if(nrows > 0 && _NJ > 1)
+  {
+    GridTransform transform(_ModelCrs, _DataGrid->GetCRS());
+    retval = this->JoinSegments(segments, transform, level);
+  }
+
+  level->Extracted = true;
+
+  return retval;
+}
+
+int ContourLayer::ExtractRows(float value, int row0, int row1,
+                              std::vector<MPI_Offset>* segments) const
+{
+  int retval = NVN_NOERR;
+  const float *lo, *hi;
+  float v[4];
+  MPI_Offset edge[4];
+  int crossed[4];
+  int ncrossed, index;
+  float center;
+
+  for(int i = row0; i < row1; i++)
+  {
+    lo = _Values + i * _NJ;
+    hi = lo + _NJ;
+
+    for(int j = 0; j < _NJ - 1; j++)
+    {
+      // The corners go around the cell, and edge k runs from corner k to
+      // corner k + 1.  Edges are known by the grid point they start from,
+      // times two, plus one if they run along the second grid dimension.
+      v[0] = lo[j];
+      v[1] = hi[j];
+      v[2] = hi[j + 1];
+      v[3] = lo[j + 1];
+
+      if(isnan(v[0]) || isnan(v[1]) || isnan(v[2]) || isnan(v[3]))
+        continue;
+
+      index = (v[0] >= value ? 1 : 0) | (v[1] >= value ? 2 : 0) |
+              (v[2] >= value ? 4 : 0) | (v[3] >= value ? 8 : 0);
+
+      if(0 == index || 15 == index)
+        continue;
+
+      edge[0] = 2 * ((MPI_Offset)i * _NJ + j);
+      edge[1] = 2 * ((MPI_Offset)(i + 1) * _NJ + j) + 1;
+      edge[2] = 2 * ((MPI_Offset)i * _NJ + j + 1);
+      edge[3] = 2 * ((MPI_Offset)i * _NJ + j) + 1;
+
+      ncrossed = 0;
+      for(int k = 0; k < 4; k++)
+      {
+        if(((index >> k) & 1) != ((index >> ((k + 1) & 3)) & 1))
+          crossed[ncrossed++] = k;
+      }
+
+      if(2 == ncrossed)
+      {
+        segments->push_back(edge[crossed[0]]);
+        segments->push_back(edge[crossed[1]]);
+      }
+      else
+      {
+        // A saddle, which is split by the value at the center of the cell.
+        // Where the center is on the same side as corners 0 and 2, the
+        // other two corners are cut off, and otherwise those two are.
+        center = 0.25f * (v[0] + v[1] + v[2] + v[3]);
+
+        if((center >= value) == (5 == index))
+        {
+          segments->push_back(edge[0]);  segments->push_back(edge[1]);
+          segments->push_back(edge[2]);  segments->push_back(edge[3]);
+        }
+        else
+        {
+          segments->push_back(edge[3]);  segments->push_back(edge[0]);
+          segments->push_back(edge[1]);  segments->push_back(edge[2]);
+        }
+      }
+    }
+  }
+
+  return retval;
+}
+
+int ContourLayer::JoinSegments(const std::vector<MPI_Offset>& segments,
+                               const GridTransform& transform,
+                               ContourLevel* level) const
+{
+  int retval = NVN_NOERR;
+  int nends = (int)segments.size();
+  std::vector<std::pair<MPI_Offset, int> > ends(nends);
+  std::vector<int> next(nends, -1);
+  std::vector<bool> used(nends / 2, false);
+  float pos[MAX_DIMS];
+  int start, end, first;
+
+  // An edge is shared by at most two cells, so sorting the segment ends by
+  // edge puts the ends that meet next to each other.
+  for(int e = 0; e < nends; e++)
+    ends[e] = std::make_pair(segments[e], e);
+
+  std::sort(ends.begin(), ends.end());
+
+  for(int e = 0; e + 1 < nends; e++)
+  {
+    if(ends[e].first == ends[e + 1].first)
+    {
+      next[ends[e].second] = ends[e + 1].second;
+      next[ends[e + 1].second] = ends[e].second;
+      e++;
+    }
+  }
+
+  // Open lines are walked from one of their loose ends first, and whatever
+  // is left over after that is a closed loop.
+  for(int pass = 0; pass < 2; pass++)
+  {
+    for(int s = 0; s < nends / 2; s++)
+    {
+      if(used[s])
+        continue;
+
+      if(0 == pass)
+      {
+        if(next[2 * s] >= 0 && next[2 * s + 1] >= 0)
+          continue;
+        start = next[2 * s] < 0 ? 2 * s : 2 * s + 1;
+      }
+      else
+      {
+        start = 2 * s;
+      }
+
+      first = (int)level->Verts.size() / 3;
+      this->PlaceCrossing(segments[start], level->Value, transform, pos);
+      level->Verts.insert(level->Verts.end(), pos, pos + 3);
+
+      end = start;
+      while(end >= 0 && ! used[end / 2])
+      {
+        used[end / 2] = true;
+        end ^= 1;
+        this->PlaceCrossing(segments[end], level->Value, transform, pos);
+        level->Verts.insert(level->Verts.end(), pos, pos + 3);
+        end = next[end];
+      }
+
+      level->First.push_back(first);
+      level->Count.push_back((int)level->Verts.size() / 3 - first);
+    }
+  }
+
+  return retval;
+}
+
+int ContourLayer::PlaceCrossing(MPI_Offset edge, float value,
+                                const GridTransform& transform,
+                                float pos[]) const
+{
+  int retval = NVN_NOERR;
+  MPI_Offset point = edge / 2;
+  MPI_Offset p0[MAX_DIMS] = { 0 }, p1[MAX_DIMS] = { 0 };
+  float m0[MAX_DIMS], m1[MAX_DIMS];
+  float v0, v1, t;
+  float zscale = transform.GetModelUnitsPerCell() / 100.0f;
+
+  p0[0] = p1[0] = point / _NJ;
+  p0[1] = p1[1] = point % _NJ;
+  if(edge & 1)
+    p1[1]++;
+  else
+    p1[0]++;
+
+  v0 = _Values[p0[0] * _NJ + p0[1]];
+  v1 = _Values[p1[0] * _NJ + p1[1]];
+  t = v1 != v0 ? (value - v0) / (v1 - v0) : 0.5f;
+
+  // The grid transform is affine, so a point part way along an edge is the
+  // same part of the way between its ends.
+  transform.GridToModel(p0, m0);
+  transform.GridToModel(p1, m1);
+
+  pos[XDIM] = m0[XDIM] + t * (m1[XDIM] - m0[XDIM]);
+  pos[YDIM] = m0[YDIM] + t * (m1[YDIM] - m0[YDIM]);
+  pos[ZDIM] = (value + CONTOUR_LIFT * (_MaxVal - _MinVal)) * zscale;
+
+  return retval;
+}
+
+void* ContourLayer::ExtractThreadEntryPoint(void* arg)
+{
+  ContourTask* task = (ContourTask*)arg;
+
+  task->Layer->ExtractRows(task->Value, task->Row0, task->Row1,
+                           &task->Segments);
+
+  return 0;
+}
@@ -0,0 +1,98 @@
+/*
+ * ContourLayer.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Timothy Morey
+ */
+
+#ifndef __CONTOURLAYER_HPP__
+#define __CONTOURLAYER_HPP__
+
+
+#include "nvn.h"
+
+#include "CartesianCRS.hpp"
+#include "GridTransform.hpp"
+#include "Layer.hpp"
+
+#define MPICH_SKIP_MPICXX 1
+#include <mpi.h>
+
+#include <pthread.h>
+#include <vector>
+
+/**
+ * The most threads that extract one contour level.
+ */
+#define CONTOUR_MAX_THREADS 16
+
+
+class DataGrid;
+
+/**
+ * The polylines of one contour level.  Verts holds xyz triples, and each
+ * polyline is Count[k] vertices starting at First[k].
+ */
+struct ContourLevel
+{
+  float Value;
+  bool Extracted;
+  std::vector<float> Verts;
+  std::vector<int> First;
+  std::vector<int> Count;
+};
+
+/**
+ * A ContourLayer draws isolines of a DataGrid, lifted just above the surface
+ * that a ShadedSurfaceLayer would draw for the same grid.
+ *
+ * Each level is extracted with marching squares, with the rows of cells split
+ * among several threads.  Cells with a corner that has no data are skipped,
+ * so lines stop at the edge of the data.  The crossings are keyed by the grid
+ * edge they lie on, which lets the segments of neighbouring cells be joined
+ * into polylines without comparing positions.
+ *
+ * The levels are cached by value, so changing the set of levels only extracts
+ * the ones that are new.  Levels may be changed from any thread, and are
+ * extracted on the next render.
+ */
+class ContourLayer : public Layer
+{
+public:
+  ContourLayer(DataGrid* grid, const float levels[], int nlevels, int color);
+  virtual ~ContourLayer();
+
+public:
+  virtual const CRS& GetDataCRS() const;
+
+public:
+  virtual int Render(const RenderContext& context);
+  int SetLevels(const float levels[], int nlevels);
+  virtual int SetModelCRS(const CartesianCRS& crs);
+
+protected:
+  virtual NVN_BBox ComputeBounds() const;
+
+protected:
+  int Extract(ContourLevel* level);
+  int ExtractRows(float value, int row0, int row1,
+                  std::vector<MPI_Offset>* segments) const;
+  int JoinSegments(const std::vector<MPI_Offset>& segments,
+                   const GridTransform& transform, ContourLevel* level) const;
+  int PlaceCrossing(MPI_Offset edge, float value,
+                    const GridTransform& transform, float pos[]) const;
+
+  static void* ExtractThreadEntryPoint(void* arg);
+
+protected:
+  DataGrid* _DataGrid;
+  int _Color;
+  int _NI, _NJ;
+  float* _Values;     // The grid as floats, with NAN where there is no data
+  float _MinVal, _MaxVal;
+
+  mutable pthread_mutex_t _Lock;
+  std::vector<ContourLevel*> _Levels;
+};
+
+#endif
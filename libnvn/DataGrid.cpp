@@ -7,6 +7,7 @@
 
 #define MPICH_SKIP_MPICXX 1
 #include <mpi.h>
+#include <math.h>
 #include <string.h>
 
 
@@ -97,6 +98,58 @@ bool DataGrid::HasData(const MPI_Offset i[]) const
     return true;
 }
 
+bool DataGrid::Interpolate(const float pos[], int dim0, int dim1,
+                           MPI_Offset nearest[], double* value) const
+{
+  bool retval = false;
+  MPI_Offset pt[MAX_DIMS];
+  MPI_Offset i0 = (MPI_Offset)floorf(pos[dim0]);
+  MPI_Offset j0 = (MPI_Offset)floorf(pos[dim1]);
+  float t0 = pos[dim0] - i0;
+  float t1 = pos[dim1] - j0;
+  double sum = 0.0, weight = 0.0;
+  Variant v;
+
+  for(int d = 0; d < _NDims; d++)
+  {
+    nearest[d] = (MPI_Offset)roundf(pos[d]);
+    if(nearest[d] < 0) nearest[d] = 0;
+    if(nearest[d] >= _DimLen[d]) nearest[d] = _DimLen[d] - 1;
+    pt[d] = nearest[d];
+  }
+
+  if(pos[dim0] >= 0.0f && pos[dim0] <= _DimLen[dim0] - 1 &&
+     pos[dim1] >= 0.0f && pos[dim1] <= _DimLen[dim1] - 1 &&
+     this->HasData(nearest))
+  {
+    // Corners without data are left out, and the rest are weighted up to
+    // make up for them.  A corner past the last row or column always has a
+    // weight of zero.
+    for(int k = 0; k < 4; k++)
+    {
+      float w = ((k & 1) ? t0 : 1.0f - t0) * ((k & 2) ? t1 : 1.0f - t1);
+
+      pt[dim0] = i0 + (k & 1);
+      pt[dim1] = j0 + ((k & 2) >> 1);
+
+      if(w > 0.0f && this->HasData(pt) &&
+         NVN_NOERR == this->GetElemAsVariant(pt, &v))
+      {
+        sum += w * VariantValueAsDouble(v);
+        weight += w;
+      }
+    }
+
+    if(weight > 0.0)
+    {
+      *value = sum / weight;
+      retval = true;
+    }
+  }
+
+  return retval;
+}
+
 int DataGrid::SetNodataValue(Variant value)
 {
   int retval = NVN_NOERR;
@@ -38,7 +38,19 @@ public:
   VariantType GetVarType() const { return _VarType; }
   bool HasData(const MPI_Offset i[]) const;
 
+  /**
+   * Interpolates the grid at the fractional grid position pos[].  Dims dim0
+   * and dim1 are interpolated bilinearly from the cells around pos that have
+   * data, and the others are rounded.  The cell nearest pos is returned in
+   * nearest[], and nothing is found unless that cell has data.
+   */
+  bool Interpolate(const float pos[], int dim0, int dim1,
+                   MPI_Offset nearest[], double* value) const;
+
 public:
+  int SetDimAffine(int dim, double scale, double offset)
+  { return _Crs.SetDimAffine(dim, scale, offset); }
+
   int SetNodataValue(Variant value);
 
 protected:
@@ -0,0 +1,405 @@
+/*
+ * FrameProfiler.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Timothy Morey
+ */
+
+
+#include "nvn.h"
+
+#include "FrameProfiler.hpp"
+
+#define MPICH_SKIP_MPICXX 1
+#include <mpi.h>
+
+#define GL_GLEXT_PROTOTYPES 1
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <algorithm>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+
+static __thread double g_ThreadFrameSeconds = 0.0;
+
+
+/******************************************************************************
+ * Constructors
+ ******************************************************************************/
+
+FrameProfiler::FrameProfiler()
+  : _NFrames(0),
+    _InFrame(false),
+    _LayerStart(0.0),
+    _QueriesChecked(false),
+    _HasQueries(false),
+    _NextQuery(0),
+    _ActiveQuery(-1)
+{
+  pthread_mutex_init(&_Lock, 0);
+  memset(&_Current, 0, sizeof(_Current));
+
+  for(int i = 0; i < NVN_NUM_PHASES; i++)
+  {
+    _Start[i] = 0.0;
+    _Between[i] = 0.0;
+  }
+
+  for(int i = 0; i < PROFILER_QUERIES; i++)
+  {
+    _Queries[i] = 0;
+    _QuerySerial[i] = 0;
+    _QueryStart[i] = 0.0;
+    _QueryBusy[i] = false;
+  }
+}
+
+FrameProfiler::~FrameProfiler()
+{
+  // The queries belong to a context that may already be gone, so they are
+  // left for the context to clean up.
+  pthread_mutex_destroy(&_Lock);
+}
+
+
+/******************************************************************************
+ * Public Members
+ ******************************************************************************/
+
+int FrameProfiler::AddTime(int phase, double seconds)
+{
+  int retval = NVN_NOERR;
+
+  if(phase < 0 || phase >= NVN_NUM_PHASES)
+    retval = NVN_EINVARGS;
+  else if(_InFrame)
+    _Current.Phase[phase] += seconds;
+  else
+    _Between[phase] += seconds;
+
+  return retval;
+}
+
+int FrameProfiler::AddLoopTime(int phase, double seconds)
+{
+  int retval = NVN_NOERR;
+
+  if(phase < 0 || phase >= NVN_NUM_PHASES)
+  {
+    retval = NVN_EINVARGS;
+  }
+  else
+  {
+    pthread_mutex_lock(&_Lock);
+    _Between[phase] += seconds;
+    pthread_mutex_unlock(&_Lock);
+  }
+
+  return retval;
+}
+
+int FrameProfiler::Begin(int phase)
+{
+  int retval = NVN_NOERR;
+
+  if(phase < 0 || phase >= NVN_NUM_PHASES)
+    retval = NVN_EINVARGS;
+  else
+    _Start[phase] = MPI_Wtime();
+
+  return retval;
+}
+
+int FrameProfiler::End(int phase)
+{
+  int retval = NVN_NOERR;
+
+  if(phase < 0 || phase >= NVN_NUM_PHASES)
+    retval = NVN_EINVARGS;
+  else
+    retval = this->AddTime(phase, MPI_Wtime() - _Start[phase]);
+
+  return retval;
+}
+
+int FrameProfiler::BeginFrame()
+{
+  int retval = NVN_NOERR;
+
+  if(! _QueriesChecked)
+    this->InitQueries();
+
+  memset(&_Current, 0, sizeof(_Current));
+  _Current.Phase[NVN_PHASE_GPU] = -1.0;
+
+  // The loop's time since the last frame is what kept this one waiting.
+  pthread_mutex_lock(&_Lock);
+  for(int i = 0; i < NVN_NUM_PHASES; i++)
+  {
+    _Current.Phase[i] += _Between[i];
+    _Between[i] = 0.0;
+  }
+  pthread_mutex_unlock(&_Lock);
+
+  _Start[NVN_PHASE_FRAME] = MPI_Wtime();
+  _InFrame = true;
+
+  // A query that is still busy is not waited on, and the frame simply goes
+  // without a GPU time.
+  _ActiveQuery = -1;
+  if(_HasQueries)
+  {
+    this->CollectQueries();
+
+    if(! _QueryBusy[_NextQuery])
+    {
+      _ActiveQuery = _NextQuery;
+      _NextQuery = (_NextQuery + 1) % PROFILER_QUERIES;
+      glBeginQuery(GL_TIME_ELAPSED, _Queries[_ActiveQuery]);
+      _QueryStart[_ActiveQuery] = MPI_Wtime();
+    }
+  }
+
+  return retval;
+}
+
+int FrameProfiler::EndFrame()
+{
+  int retval = NVN_NOERR;
+  double elapsed;
+
+  if(! _InFrame)
+  {
+    retval = NVN_EINVARGS;
+  }
+  else
+  {
+    if(_ActiveQuery >= 0)
+    {
+      glEndQuery(GL_TIME_ELAPSED);
+      _QueryBusy[_ActiveQuery] = true;
+      _QuerySerial[_ActiveQuery] = _NFrames;
+      _ActiveQuery = -1;
+    }
+
+    elapsed = MPI_Wtime() - _Start[NVN_PHASE_FRAME];
+    _Current.Phase[NVN_PHASE_FRAME] += elapsed;
+    g_ThreadFrameSeconds += elapsed;
+    _InFrame = false;
+
+    pthread_mutex_lock(&_Lock);
+    _Current.Serial = _NFrames;
+    _Frames[_NFrames % PROFILER_HISTORY] = _Current;
+    _NFrames++;
+    pthread_mutex_unlock(&_Lock);
+  }
+
+  return retval;
+}
+
+int FrameProfiler::BeginLayer(const Layer* layer)
+{
+  int retval = NVN_NOERR;
+
+  _LayerStart = MPI_Wtime();
+
+  return retval;
+}
+
+int FrameProfiler::EndLayer(const Layer* layer)
+{
+  int retval = NVN_NOERR;
+  double elapsed = MPI_Wtime() - _LayerStart;
+  int n = _Current.NLayers;
+
+  _Current.Phase[NVN_PHASE_LAYERS] += elapsed;
+
+  if(n < PROFILER_MAX_LAYERS)
+  {
+    _Current.Layers[n] = layer;
+    _Current.LayerTime[n] = elapsed;
+    _Current.NLayers++;
+  }
+
+  return retval;
+}
+
+double FrameProfiler::GetThreadFrameSeconds()
+{
+  return g_ThreadFrameSeconds;
+}
+
+int FrameProfiler::GetLayerStats(const Layer* layer, NVN_PhaseStats* stats) const
+{
+  int retval = NVN_NOERR;
+  double values[PROFILER_HISTORY];
+  int n = 0;
+
+  if(! stats)
+  {
+    retval = NVN_EINVARGS;
+  }
+  else
+  {
+    pthread_mutex_lock(&_Lock);
+
+    // A layer may be drawn more than once in a frame, so each frame gives one
+    // sample, which is the total time spent in the layer.
+    int nframes = MIN(_NFrames, PROFILER_HISTORY);
+    for(int f = 0; f < nframes; f++)
+    {
+      const ProfiledFrame& frame = _Frames[f];
+      bool drawn = false;
+      double seconds = 0.0;
+
+      for(int k = 0; k < frame.NLayers; k++)
+      {
+        if(frame.Layers[k] == layer)
+        {
+          drawn = true;
+          seconds += frame.LayerTime[k];
+        }
+      }
+
+      if(drawn)
+        values[n++] = seconds;
+    }
+
+    pthread_mutex_unlock(&_Lock);
+
+    retval = ComputeStats(values, n, stats);
+  }
+
+  return retval;
+}
+
+int FrameProfiler::GetStats(NVN_FrameStats* stats) const
+{
+  int retval = NVN_NOERR;
+  double values[NVN_NUM_PHASES][PROFILER_HISTORY];
+  int n[NVN_NUM_PHASES] = { 0 };
+  int nframes;
+
+  if(! stats)
+  {
+    retval = NVN_EINVARGS;
+  }
+  else
+  {
+    // The frames are copied out under the lock, and sorted after it is let
+    // go, so that the render thread is held up as little as possible.
+    pthread_mutex_lock(&_Lock);
+
+    nframes = MIN(_NFrames, PROFILER_HISTORY);
+    for(int f = 0; f < nframes; f++)
+    {
+      for(int i = 0; i < NVN_NUM_PHASES; i++)
+      {
+        if(_Frames[f].Phase[i] >= 0.0)
+          values[i][n[i]++] = _Frames[f].Phase[i];
+      }
+    }
+
+    pthread_mutex_unlock(&_Lock);
+
+    stats->NFrames = nframes;
+    for(int i = 0; i < NVN_NUM_PHASES; i++)
+      ComputeStats(values[i], n[i], &stats->Phase[i]);
+  }
+
+  return retval;
+}
+
+
+/******************************************************************************
+ * Protected Members
+ ******************************************************************************/
+
+int FrameProfiler::CollectQueries()
+{
+  int retval = NVN_NOERR;
+  GLint available;
+  GLuint64 elapsed;
+  unsigned int serial;
+
+  for(int q = 0; q < PROFILER_QUERIES; q++)
+  {
+    if(_QueryBusy[q])
+    {
+      glGetQueryObjectiv(_Queries[q], GL_QUERY_RESULT_AVAILABLE, &available);
+
+      if(available)
+      {
+        glGetQueryObjectui64v(_Queries[q], GL_QUERY_RESULT, &elapsed);
+        _QueryBusy[q] = false;
+        serial = _QuerySerial[q];
+
+        // The frame may have been pushed out of the history already.  Some
+        // drivers also give nonsense for the first query on a context, which
+        // shows up as more time than has passed since it began.
+        pthread_mutex_lock(&_Lock);
+        if(_Frames[serial % PROFILER_HISTORY].Serial == serial &&
+           serial < _NFrames &&
+           elapsed * 1.0e-9 <= MPI_Wtime() - _QueryStart[q])
+        {
+          _Frames[serial % PROFILER_HISTORY].Phase[NVN_PHASE_GPU] =
+            elapsed * 1.0e-9;
+        }
+        pthread_mutex_unlock(&_Lock);
+      }
+    }
+  }
+
+  return retval;
+}
+
+int FrameProfiler::InitQueries()
+{
+  int retval = NVN_NOERR;
+  const char* version = (const char*)glGetString(GL_VERSION);
+  const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+  int major = 0, minor = 0;
+
+  _QueriesChecked = true;
+
+  if(version)
+    sscanf(version, "%d.%d", &major, &minor);
+
+  _HasQueries = major > 3 || (3 == major && minor >= 3) ||
+    (extensions && (strstr(extensions, "GL_ARB_timer_query") ||
+                    strstr(extensions, "GL_EXT_timer_query")));
+
+  if(_HasQueries)
+    glGenQueries(PROFILER_QUERIES, _Queries);
+
+  return retval;
+}
+
+int FrameProfiler::ComputeStats(double values[], int n, NVN_PhaseStats* stats)
+{
+  int retval = NVN_NOERR;
+  double total = 0.0;
+
+  memset(stats, 0, sizeof(NVN_PhaseStats));
+  stats->NFrames = n;
+
+  if(n > 0)
+  {
+    std::sort(values, values + n);
+
+    for(int i = 0; i < n; i++)
+      total += values[i];
+
+    // Nearest-rank percentiles, so that each one is a frame that happened.
+    stats->Mean = total / n;
+    stats->P50 = values[(int)ceil(0.50 * n) - 1];
+    stats->P95 = values[(int)ceil(0.95 * n) - 1];
+    stats->P99 = values[(int)ceil(0.99 * n) - 1];
+    stats->Max = values[n - 1];
+  }
+
+  return retval;
+}
@@ -0,0 +1,124 @@
+/*
+ * FrameProfiler.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Timothy Morey
+ */
+
+#ifndef __FRAMEPROFILER_HPP__
+#define __FRAMEPROFILER_HPP__
+
+
+#include "nvn.h"
+
+#include <pthread.h>
+
+/**
+ * The number of recent frames that the statistics are taken over.
+ */
+#define PROFILER_HISTORY 512
+
+/**
+ * The most layers that are timed separately in one frame.
+ */
+#define PROFILER_MAX_LAYERS 16
+
+/**
+ * The number of GL timer queries that may be in flight at once.
+ */
+#define PROFILER_QUERIES 4
+
+
+class Layer;
+
+/**
+ * The times spent in each phase of one frame, in seconds.
+ */
+struct ProfiledFrame
+{
+  unsigned int Serial;
+  double Phase[NVN_NUM_PHASES];     // NVN_PHASE_GPU is -1 until it is known
+  int NLayers;
+  const Layer* Layers[PROFILER_MAX_LAYERS];
+  double LayerTime[PROFILER_MAX_LAYERS];
+};
+
+/**
+ * A FrameProfiler times the phases of the frames that one window renders,
+ * and keeps the last PROFILER_HISTORY of them so that percentiles can be
+ * taken, which show stutter that an average would hide.
+ *
+ * Phases may nest, so the mesh phase is also counted in the layers phase.
+ * Time that the UI loop spends between frames, on events and messages, is
+ * charged to the next frame.  Where the context has timer queries, the GPU
+ * time of each frame is measured too, and is filled in a few frames later so
+ * that the CPU never waits for it.
+ *
+ * Everything but GetStats and AddLoopTime must be called by the thread that
+ * holds the window's context.
+ */
+class FrameProfiler
+{
+public:
+  FrameProfiler();
+  ~FrameProfiler();
+
+public:
+  int AddTime(int phase, double seconds);
+
+  /**
+   * Charges time that the UI loop spent between frames to the next frame.
+   * Unlike everything else that records, this may be called on any thread.
+   */
+  int AddLoopTime(int phase, double seconds);
+  int Begin(int phase);
+  int End(int phase);
+  int BeginFrame();
+  int EndFrame();
+  int BeginLayer(const Layer* layer);
+  int EndLayer(const Layer* layer);
+
+public:
+  /**
+   * The total time spent in the frames that the calling thread has rendered,
+   * in any window, which lets the UI loop leave frames that it renders itself
+   * out of the time it charges to them.
+   */
+  static double GetThreadFrameSeconds();
+
+  /**
+   * The time that the last finished frame spent in one phase.
+   */
+  double GetLastPhaseSeconds(int phase) const { return _Current.Phase[phase]; }
+
+  int GetLayerStats(const Layer* layer, NVN_PhaseStats* stats) const;
+  int GetStats(NVN_FrameStats* stats) const;
+
+protected:
+  int CollectQueries();
+  int InitQueries();
+
+  static int ComputeStats(double values[], int n, NVN_PhaseStats* stats);
+
+protected:
+  mutable pthread_mutex_t _Lock;
+  ProfiledFrame _Frames[PROFILER_HISTORY];
+  unsigned int _NFrames;          // Frames ever recorded
+
+  bool _InFrame;
+  ProfiledFrame _Current;
+  double _Start[NVN_NUM_PHASES];
+  double _Between[NVN_NUM_PHASES];  // Loop time since the last frame, locked
+  double _LayerStart;
+
+  bool _QueriesChecked;
+  bool _HasQueries;
+  unsigned int _Queries[PROFILER_QUERIES];
+  unsigned int _QuerySerial[PROFILER_QUERIES];
+  double _QueryStart[PROFILER_QUERIES];
+  bool _QueryBusy[PROFILER_QUERIES];
+  int _NextQuery;
+  int _ActiveQuery;               // The query timing this frame, or -1
+};
+
+#endif
@@ -0,0 +1,441 @@
+/*
+ * FrameRecorder.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Timothy Morey
+ */
+
+
+#include "nvn.h"
+
+#include "FrameRecorder.hpp"
+
+#define GL_GLEXT_PROTOTYPES 1
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/******************************************************************************
+ * Constructors
+ ******************************************************************************/
+
+FrameRecorder::FrameRecorder()
+  : _Mode(NVN_RECORD_PPM),
+    _Pipe(0),
+    _Running(false),
+    _BufferWidth(0),
+    _BufferHeight(0),
+    _Next(0),
+    _Pending(false),
+    _PendingWidth(0),
+    _PendingHeight(0),
+    _Stopping(false),
+    _FrameSize(0),
+    _Written(0),
+    _Dropped(0),
+    _Failed(false),
+    _Row(0)
+{
+  _Target[0] = '\0';
+  _Buffers[0] = _Buffers[1] = 0;
+  pthread_mutex_init(&_Lock, 0);
+  pthread_cond_init(&_Wake, 0);
+}
+
+FrameRecorder::~FrameRecorder()
+{
+  // The pixel buffers belong to a context that may already be gone, so only
+  // the encoder is shut down here.  Owners should call Stop first.
+  if(_Running)
+  {
+    pthread_mutex_lock(&_Lock);
+    _Stopping = true;
+    pthread_cond_signal(&_Wake);
+    pthread_mutex_unlock(&_Lock);
+    pthread_join(_EncoderThread, 0);
+
+    if(_Pipe)
+      pclose(_Pipe);
+  }
+
+  for(size_t i = 0; i < _Queue.size(); i++)
+    free(_Queue[i].Pixels);
+  for(size_t i = 0; i < _Free.size(); i++)
+    free(_Free[i]);
+  free(_Row);
+
+  pthread_cond_destroy(&_Wake);
+  pthread_mutex_destroy(&_Lock);
+}
+
+
+/******************************************************************************
+ * Public Members
+ ******************************************************************************/
+
+int FrameRecorder::GetFramesWritten() const
+{
+  int written;
+
+  pthread_mutex_lock(&_Lock);
+  written = _Written;
+  pthread_mutex_unlock(&_Lock);
+
+  return written;
+}
+
+int FrameRecorder::Start(const char* target, int mode)
+{
+  int retval = NVN_NOERR;
+
+  if(_Running || ! target || strlen(target) >= MAX_PATH ||
+     (NVN_RECORD_PPM != mode && NVN_RECORD_PIPE != mode))
+  {
+    retval = NVN_EINVARGS;
+  }
+
+  if(NVN_NOERR == retval)
+  {
+    strcpy(_Target, target);
+    _Mode = mode;
+    _Stopping = false;
+    _Failed = false;
+    _Written = 0;
+    _Dropped = 0;
+    _Pending = false;
+
+    if(NVN_RECORD_PIPE == _Mode)
+    {
+      _Pipe = popen(_Target, "w");
+      if(! _Pipe)
+      {
+        fprintf(stderr, "Unable to start '%s'\n", _Target);
+        retval = NVN_ERROR;
+      }
+    }
+  }
+
+  if(NVN_NOERR == retval)
+  {
+    if(0 == pthread_create(&_EncoderThread, 0, EncoderThreadEntryPoint, this))
+    {
+      _Running = true;
+    }
+    else
+    {
+      retval = NVN_ETHREADFAIL;
+
+      if(_Pipe)
+      {
+        pclose(_Pipe);
+        _Pipe = 0;
+      }
+    }
+  }
+
+  return retval;
+}
+
+int FrameRecorder::Capture(int width, int height)
+{
+  int retval = NVN_NOERR;
+
+  if(_Running && width > 0 && height > 0)
+  {
+    // The buffers are sized for one frame, so a resized window has to finish
+    // with the old frame before it can read a new one.
+    if(width != _BufferWidth || height != _BufferHeight)
+    {
+      this->Flush();
+
+      if(0 == _Buffers[0])
+        glGenBuffers(2, _Buffers);
+
+      for(int i = 0; i < 2; i++)
+      {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, _Buffers[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)width * height * 4, 0,
+                     GL_STREAM_READ);
+      }
+
+      _BufferWidth = width;
+      _BufferHeight = height;
+    }
+
+    // With a pack buffer bound, the read returns as soon as it is queued, and
+    // the previous frame is collected while this one is being copied.
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, _Buffers[_Next]);
+    glReadBuffer(GL_BACK);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+
+    retval = this->QueuePending();
+
+    _Pending = true;
+    _PendingWidth = width;
+    _PendingHeight = height;
+    _Next = 1 - _Next;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  }
+
+  return retval;
+}
+
+int FrameRecorder::Flush()
+{
+  int retval = NVN_NOERR;
+
+  if(_Running && _Pending)
+  {
+    retval = this->QueuePending();
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  }
+
+  return retval;
+}
+
+int FrameRecorder::Stop()
+{
+  int retval = NVN_NOERR;
+
+  if(! _Running)
+  {
+    retval = NVN_EINVARGS;
+  }
+  else
+  {
+    this->Flush();
+
+    pthread_mutex_lock(&_Lock);
+    _Stopping = true;
+    pthread_cond_signal(&_Wake);
+    pthread_mutex_unlock(&_Lock);
+
+    pthread_join(_EncoderThread, 0);
+    _Running = false;
+
+    if(_Pipe)
+    {
+      if(0 != pclose(_Pipe))
+        retval = NVN_ERROR;
+      _Pipe = 0;
+    }
+
+    if(_Failed)
+      retval = NVN_ERROR;
+
+    if(0 != _Buffers[0])
+    {
+      glDeleteBuffers(2, _Buffers);
+      _Buffers[0] = _Buffers[1] = 0;
+      _BufferWidth = _BufferHeight = 0;
+    }
+
+    if(_Dropped > 0)
+      fprintf(stderr, "Dropped %d of the frames recorded to %s\n",
+              _Dropped, _Target);
+  }
+
+  return retval;
+}
+
+
+/******************************************************************************
+ * Protected Members
+ ******************************************************************************/
+
+int FrameRecorder::QueuePending()
+{
+  int retval = NVN_NOERR;
+  size_t size = (size_t)_PendingWidth * _PendingHeight * 4;
+  unsigned char* pixels = 0;
+  bool drop = false;
+  const void* mapped;
+
+  if(_Pending)
+  {
+    _Pending = false;
+
+    pthread_mutex_lock(&_Lock);
+
+    if(_Queue.size() >= RECORDER_MAX_QUEUED || _Failed)
+    {
+      _Dropped++;
+      drop = true;
+    }
+    else
+    {
+      if(size != _FrameSize)
+      {
+        for(size_t i = 0; i < _Free.size(); i++)
+          free(_Free[i]);
+        _Free.clear();
+        _FrameSize = size;
+      }
+
+      if(! _Free.empty())
+      {
+        pixels = _Free.back();
+        _Free.pop_back();
+      }
+    }
+
+    pthread_mutex_unlock(&_Lock);
+
+    if(! drop && ! pixels)
+      pixels = (unsigned char*)malloc(size);
+
+    if(pixels)
+    {
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, _Buffers[1 - _Next]);
+      mapped = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+
+      if(mapped)
+      {
+        RecordedFrame frame;
+
+        memcpy(pixels, mapped, size);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+
+        frame.Pixels = pixels;
+        frame.Width = _PendingWidth;
+        frame.Height = _PendingHeight;
+
+        pthread_mutex_lock(&_Lock);
+        _Queue.push_back(frame);
+        pthread_cond_signal(&_Wake);
+        pthread_mutex_unlock(&_Lock);
+      }
+      else
+      {
+        free(pixels);
+        retval = NVN_ERROR;
+      }
+    }
+  }
+
+  return retval;
+}
+
+int FrameRecorder::WriteFrame(const RecordedFrame& frame)
+{
+  int retval = NVN_NOERR;
+  char filename[MAX_PATH + 16];
+  FILE* file = 0;
+  const unsigned char* src;
+
+  _Row = (unsigned char*)realloc(_Row, (size_t)frame.Width * 3);
+
+  if(! _Row)
+  {
+    retval = NVN_ERROR;
+  }
+  else if(NVN_RECORD_PIPE == _Mode)
+  {
+    file = _Pipe;
+  }
+  else
+  {
+    snprintf(filename, sizeof(filename), "%s%06d.ppm", _Target, _Written);
+    file = fopen(filename, "wb");
+
+    if(! file)
+    {
+      fprintf(stderr, "Unable to open '%s' for writing\n", filename);
+      retval = NVN_ERROR;
+    }
+    else
+    {
+      fprintf(file, "P6\n%d %d\n255\n", frame.Width, frame.Height);
+    }
+  }
+
+  // Frames are read bottom-up, and both PPM files and raw video are written
+  // top-down, without the alpha channel.
+  for(int y = frame.Height - 1; NVN_NOERR == retval && y >= 0; y--)
+  {
+    src = frame.Pixels + (size_t)y * frame.Width * 4;
+
+    for(int x = 0; x < frame.Width; x++)
+    {
+      _Row[3 * x] = src[4 * x];
+      _Row[3 * x + 1] = src[4 * x + 1];
+      _Row[3 * x + 2] = src[4 * x + 2];
+    }
+
+    if(1 != fwrite(_Row, (size_t)frame.Width * 3, 1, file))
+      retval = NVN_ERROR;
+  }
+
+  if(file && file != _Pipe)
+    fclose(file);
+
+  return retval;
+}
+
+void* FrameRecorder::EncoderThreadEntryPoint(void* arg)
+{
+  FrameRecorder* recorder = (FrameRecorder*)arg;
+  RecordedFrame frame;
+  bool done = false;
+  sigset_t sigpipe;
+  int err;
+
+  // An encoder that exits early would otherwise take the whole process down
+  // with SIGPIPE, rather than just failing the write.
+  sigemptyset(&sigpipe);
+  sigaddset(&sigpipe, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &sigpipe, 0);
+
+  while(! done)
+  {
+    pthread_mutex_lock(&recorder->_Lock);
+
+    while(recorder->_Queue.empty() && ! recorder->_Stopping)
+      pthread_cond_wait(&recorder->_Wake, &recorder->_Lock);
+
+    done = recorder->_Queue.empty();
+    if(! done)
+    {
+      frame = recorder->_Queue.front();
+      recorder->_Queue.pop_front();
+    }
+
+    pthread_mutex_unlock(&recorder->_Lock);
+
+    if(! done)
+    {
+      err = recorder->_Failed ? NVN_ERROR : recorder->WriteFrame(frame);
+
+      pthread_mutex_lock(&recorder->_Lock);
+
+      if(NVN_NOERR == err)
+      {
+        recorder->_Written++;
+      }
+      else if(! recorder->_Failed)
+      {
+        // Once the encoder or the disk has given up, the rest of the frames
+        // are dropped instead of piling up.
+        fprintf(stderr, "Recording stopped after %d frames\n",
+                recorder->_Written);
+        recorder->_Failed = true;
+      }
+
+      if((size_t)frame.Width * frame.Height * 4 == recorder->_FrameSize)
+        recorder->_Free.push_back(frame.Pixels);
+      else
+        free(frame.Pixels);
+
+      pthread_mutex_unlock(&recorder->_Lock);
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,117 @@
+/*
+ * FrameRecorder.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Timothy Morey
+ */
+
+#ifndef __FRAMERECORDER_HPP__
+#define __FRAMERECORDER_HPP__
+
+
+#include "nvn.h"
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include <deque>
+#include <vector>
+
+/**
+ * The most frames that may wait for the encoder thread.  Frames rendered
+ * while the queue is full are dropped rather than holding up the render loop.
+ */
+#define RECORDER_MAX_QUEUED 8
+
+
+/**
+ * A captured frame waiting to be written, stored bottom-up as it was read.
+ */
+struct RecordedFrame
+{
+  unsigned char* Pixels;
+  int Width, Height;
+};
+
+/**
+ * A FrameRecorder saves every frame that a window renders, without making the
+ * render loop wait for the read back or the disk.
+ *
+ * Each frame is read into one of two pixel buffer objects, which lets the GL
+ * copy it out of the framebuffer in the background.  The frame is only
+ * mapped one frame later, by which time the copy is done, and is then handed
+ * to an encoder thread.  The encoder either writes numbered PPM files or
+ * pipes raw RGB frames to an external program, such as ffmpeg.
+ *
+ * Capture, Flush and Stop must be called on the thread that renders the
+ * window, with its context current.
+ */
+class FrameRecorder
+{
+public:
+  FrameRecorder();
+  ~FrameRecorder();
+
+public:
+  int GetFramesDropped() const { return _Dropped; }
+  int GetFramesWritten() const;
+  bool IsRecording() const { return _Running; }
+
+public:
+  /**
+   * Starts the encoder thread.  For NVN_RECORD_PPM, target is the prefix of
+   * the file names, which are followed by a six digit frame number.  For
+   * NVN_RECORD_PIPE, target is a shell command that reads the frames from its
+   * standard input.
+   */
+  int Start(const char* target, int mode);
+
+  /**
+   * Starts reading back the frame in the back buffer, and queues the frame
+   * that was started on the previous call.
+   */
+  int Capture(int width, int height);
+
+  /**
+   * Queues the frame that is still being read back, if there is one.
+   */
+  int Flush();
+
+  /**
+   * Flushes, waits for the encoder to write every queued frame, and releases
+   * the pixel buffers.
+   */
+  int Stop();
+
+protected:
+  int QueuePending();
+  int WriteFrame(const RecordedFrame& frame);
+
+  static void* EncoderThreadEntryPoint(void* arg);
+
+protected:
+  int _Mode;
+  char _Target[MAX_PATH];
+  FILE* _Pipe;
+  bool _Running;
+
+  unsigned int _Buffers[2];
+  int _BufferWidth, _BufferHeight;
+  int _Next;                    // The buffer the next frame is read into
+  bool _Pending;                // The other buffer holds an unqueued frame
+  int _PendingWidth, _PendingHeight;
+
+  pthread_t _EncoderThread;
+  mutable pthread_mutex_t _Lock;
+  pthread_cond_t _Wake;
+  bool _Stopping;
+  std::deque<RecordedFrame> _Queue;
+  std::vector<unsigned char*> _Free;
+  size_t _FrameSize;            // The size of the buffers in _Free
+  int _Written;
+  int _Dropped;
+  bool _Failed;
+  unsigned char* _Row;          // Scratch for the encoder thread
+};
+
+#endif
@@ -8,17 +8,24 @@
 
 #include "nvn.h"
 
+#include "Compositor.hpp"
+#include "FrameProfiler.hpp"
+#include "FrameRecorder.hpp"
 #include "GLWindow.hpp"
 #include "GLX.hpp"
 #include "Model.hpp"
 #include "ReferenceFrameLayer.hpp"
+#include "RenderContext.hpp"
+#include "Trace.hpp"
 
+#include <EGL/egl.h>
 #include <GL/gl.h>
 #include <GL/glu.h>
 #include <GL/glx.h>
 #include <math.h>
 #include <pthread.h>
 #include <stdio.h>
+#include <string.h>
 
 
 /******************************************************************************
@@ -39,6 +46,17 @@ typedef struct
   unsigned long status;
 } Hints;
 
+/**
+ * The share group for the next window that cannot share with the others.
+ */
+static int g_NextShareGroup = 1;
+
+/**
+ * The identifier of the next window, which layers use to keep apart what
+ * they cache for each window.
+ */
+static int g_NextWindowID = 1;
+
 
 /******************************************************************************
  * Constructors
@@ -51,15 +69,177 @@ GLWindow::GLWindow(const char* title, int x, int y, int width, int height,
   _Width(width),
   _Height(height),
   _Borderless(borderless),
+  _Offscreen(false),
+  _XWindow(0),
+  _GLXContext(0),
+  _WMDeleteMessage(0),
+  _EGLSurface(EGL_NO_SURFACE),
+  _EGLContext(EGL_NO_CONTEXT),
+  _ShareGroup(0),
+  _WindowID(__sync_fetch_and_add(&g_NextWindowID, 1)),
+  _Model(0),
+  _Frame(0),
+  _ZoomFactor(1.1),
   _LeftMouseDown(false),
   _CtrlDown(false),
   _AltDown(false),
-  _CenterX(0.0f), _CenterY(0.0f),
-  _ZoomLevel(1.0), _ZoomFactor(1.1),
-  _XRotation(0.0f), _ZRotation(0.0f),
+  _AdaptiveDetail(true),
+  _LastInteraction(0.0),
+  _PostedSeq(0),
+  _TakenSeq(0),
+  _FullDetailSeconds(0.0),
+  _RenderedDetail(1.0f),
   _Dirty(true),
-  _Model(0)
+  _RenderedRevision(0),
+  _ResetPending(false),
+  _SyncComm(MPI_COMM_NULL),
+  _CameraRank(0),
+  _SyncBounds(NVN_BBoxEmpty),
+  _Leaving(false),
+  _Compositor(0),
+  _SyncWidth(width),
+  _SyncHeight(height),
+  _Recorder(0),
+  _Profiler(0),
+  _ContextDepth(0),
+  _RenderThreadAlive(false),
+  _KeepRenderThreadAlive(false),
+  _FrameRequested(false),
+  _Tiled(false),
+  _WallWidth(width), _WallHeight(height),
+  _TileX(0), _TileY(0)
+{
+  pthread_mutexattr_t attr;
+
+  pthread_mutex_init(&_HoverLock, 0);
+  memset(&_Hover, 0, sizeof(_Hover));
+  _Profiler = new FrameProfiler();
+
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&_ContextLock, &attr);
+  pthread_mutexattr_destroy(&attr);
+
+  pthread_mutex_init(&_FrameLock, 0);
+  pthread_cond_init(&_FrameCond, 0);
+  snprintf(_ThreadName, MAX_NAME, "Render %s", title ? title : "");
+
+  if(GLX::IsHeadless())
+    this->InitOffscreen();
+  else
+    this->InitXWindow();
+
+  glClearColor(0.0, 0.0, 0.0, 1.0);
+
+  // The context was made current to set it up, and is let go so that the
+  // render thread can take it.
+  this->ReleaseCurrent();
+  this->StartRenderThread();
+}
+
+GLWindow::~GLWindow()
 {
+  this->StopRenderThread();
+
+  // The objects of a share group of its own go with this window's context.
+  if(_Model && 0 != _ShareGroup)
+    _Model->ForgetResources(_ShareGroup);
+
+  if(this->IsSynchronized())
+  {
+    // Tell the other ranks that the group is breaking up, so that nobody is
+    // left waiting on a collective that this window will never join.
+    bool render = false;
+    _Leaving = true;
+    this->SyncFrame(&render);
+  }
+
+  if(_Recorder)
+  {
+    this->StopRecording();
+  }
+
+  if(_Frame)
+  {
+    delete _Frame;
+    _Frame = 0;
+  }
+
+  delete _Profiler;
+  _Profiler = 0;
+
+  if(_Offscreen)
+  {
+    EGLDisplay display = GLX::GetEGLDisplay();
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+
+    if(EGL_NO_CONTEXT != _EGLContext)
+      eglDestroyContext(display, _EGLContext);
+
+    if(EGL_NO_SURFACE != _EGLSurface)
+      eglDestroySurface(display, _EGLSurface);
+  }
+  else
+  {
+    XDestroyWindow(GLX::GetDisplay(), _XWindow);
+  }
+
+  pthread_mutex_destroy(&_HoverLock);
+  pthread_mutex_destroy(&_ContextLock);
+  pthread_mutex_destroy(&_FrameLock);
+  pthread_cond_destroy(&_FrameCond);
+}
+
+
+/******************************************************************************
+ * Initialization
+ ******************************************************************************/
+
+int GLWindow::InitOffscreen()
+{
+  int retval = NVN_NOERR;
+  EGLDisplay display = GLX::GetEGLDisplay();
+  EGLConfig config = GLX::GetEGLConfig();
+
+  EGLint pbufferAttrs[] =
+      {
+          EGL_WIDTH, _Width,
+          EGL_HEIGHT, _Height,
+          EGL_NONE
+      };
+
+  printf("Creating offscreen window...\n");
+
+  _Offscreen = true;
+
+  _EGLSurface = eglCreatePbufferSurface(display, config, pbufferAttrs);
+  if(EGL_NO_SURFACE == _EGLSurface)
+  {
+    retval = NVN_EEGLFAIL;
+    fprintf(stderr, "Unable to create an EGL pbuffer surface.\n");
+  }
+
+  if(NVN_NOERR == retval)
+  {
+    _EGLContext = eglCreateContext(display, config, GLX::GetEGLShareContext(), 0);
+    if(EGL_NO_CONTEXT == GLX::GetEGLShareContext())
+      _ShareGroup = __sync_fetch_and_add(&g_NextShareGroup, 1);
+    if(EGL_NO_CONTEXT == _EGLContext)
+    {
+      retval = NVN_EEGLFAIL;
+      fprintf(stderr, "Unable to create an EGL context.\n");
+    }
+  }
+
+  if(NVN_NOERR == retval)
+    retval = this->MakeCurrent();
+
+  return retval;
+}
+
+int GLWindow::InitXWindow()
+{
+  int retval = NVN_NOERR;
   XSetWindowAttributes windowAttrs;
   Colormap colormap;
   Display* display = GLX::GetDisplay();
@@ -67,11 +247,13 @@ GLWindow::GLWindow(const char* title, int x, int y, int width, int height,
 
   printf("Creating window...\n");
 
-  _GLXContext = glXCreateContext(display, visualInfo, 0, 1);
+  _GLXContext = glXCreateContext(display, visualInfo, GLX::GetShareContext(), 1);
+  if(! GLX::GetShareContext())
+    _ShareGroup = __sync_fetch_and_add(&g_NextShareGroup, 1);
   if(! _GLXContext)
   {
     fprintf(stderr, "Unable to create a GLX context.");
-    return;
+    return NVN_EGLXFAIL;
   }
 
   colormap = XCreateColormap(display,
@@ -140,12 +322,8 @@ GLWindow::GLWindow(const char* title, int x, int y, int width, int height,
 
   glXMakeCurrent(display, _XWindow, _GLXContext);
   XMapWindow(display, _XWindow);
-  glClearColor(0.0, 0.0, 0.0, 1.0);
-}
 
-GLWindow::~GLWindow()
-{
-  XDestroyWindow(GLX::GetDisplay(), _XWindow);
+  return retval;
 }
 
 
@@ -162,78 +340,279 @@ int GLWindow::AsyncRefresh()
   return retval;
 }
 
+int GLWindow::RequestFrame()
+{
+  int retval = NVN_NOERR;
+
+  pthread_mutex_lock(&_FrameLock);
+  _FrameRequested = true;
+  pthread_cond_signal(&_FrameCond);
+  pthread_mutex_unlock(&_FrameLock);
+
+  return retval;
+}
+
 float GLWindow::GetPixelsPerModelUnit() const
+{
+  ViewParms view;
+
+  _View.Load(&view);
+
+  return this->GetPixelsPerModelUnit(view.ZoomLevel);
+}
+
+float GLWindow::GetPixelsPerModelUnit(float zoomlevel) const
 {
   float scale = 0.0f;  // pixels per model unit
 
   if(_Model)
   {
-    NVN_BBox mbounds = _Model->GetBounds();
+    NVN_BBox mbounds = this->GetViewBounds();
     float mwidth = mbounds.Max[XDIM] - mbounds.Min[XDIM];
     float mheight = mbounds.Max[YDIM] - mbounds.Min[YDIM];
-    float viewAspect = (float)_Width / (float)_Height;
+    float viewAspect = (float)this->GetViewWidth() / (float)this->GetViewHeight();
     float dataAspect = mwidth / mheight;
 
     if(viewAspect > dataAspect)
-      scale = (float)_Height / (mheight / _ZoomLevel);
+      scale = (float)this->GetViewHeight() / (mheight / zoomlevel);
     else
-      scale = (float)_Width / (mwidth / _ZoomLevel);
+      scale = (float)this->GetViewWidth() / (mwidth / zoomlevel);
   }
 
   return scale;
 }
 
+NVN_BBox GLWindow::GetViewBounds() const
+{
+  NVN_BBox bounds = NVN_BBoxEmpty;
+
+  // A synchronized window shares the bounds of every rank's model, so that
+  // all ranks derive the same projection.
+  if(this->IsSynchronized())
+    bounds = _SyncBounds;
+  else if(_Model)
+    bounds = _Model->GetBounds();
+
+  return bounds;
+}
+
+bool GLWindow::IsDirty() const
+{
+  // Layers that change on their own, such as streaming series, bump the
+  // model's revision rather than refreshing every window that shows them.
+  // A frame drawn at reduced detail is drawn again once the view comes to
+  // rest.
+  return _Dirty || (_Model && _Model->GetRevision() != _RenderedRevision) ||
+    (_RenderedDetail < 1.0f && ! this->IsInteracting());
+}
+
+bool GLWindow::IsInteracting() const
+{
+  return _LeftMouseDown || _CtrlDown || _AltDown ||
+    MPI_Wtime() - _LastInteraction < LOD_IDLE_SECONDS;
+}
+
+int GLWindow::GetFrameStats(NVN_FrameStats* stats) const
+{
+  int retval = NVN_NOERR;
+
+  retval = _Profiler->GetStats(stats);
+
+  return retval;
+}
+
+int GLWindow::GetHoverProbe(NVN_ProbeResult* result) const
+{
+  int retval = NVN_NOERR;
+
+  pthread_mutex_lock(&_HoverLock);
+  *result = _Hover;
+  pthread_mutex_unlock(&_HoverLock);
+
+  return retval;
+}
+
+int GLWindow::GetLayerStats(const Layer* layer, NVN_PhaseStats* stats) const
+{
+  int retval = NVN_NOERR;
+
+  retval = _Profiler->GetLayerStats(layer, stats);
+
+  return retval;
+}
+
+int GLWindow::PixelToModel(int pixx, int pixy, float* x, float* y) const
+{
+  int retval = NVN_NOERR;
+  ViewParms view;
+
+  _View.Load(&view);
+  retval = this->PixelToModel(view, pixx, pixy, x, y);
+
+  return retval;
+}
+
+int GLWindow::Probe(int pixx, int pixy, NVN_ProbeResult* result) const
+{
+  int retval = NVN_NOERR;
+  float x, y;
+
+  if(_Model)
+  {
+    retval = this->PixelToModel(pixx, pixy, &x, &y);
+
+    if(NVN_NOERR == retval)
+      retval = _Model->Probe(x, y, NVN_PROBE_RADIUS / this->GetPixelsPerModelUnit(),
+                             result);
+  }
+  else
+  {
+    memset(result, 0, sizeof(NVN_ProbeResult));
+  }
+
+  return retval;
+}
+
 int GLWindow::ResetView()
 {
   int retval = NVN_NOERR;
 
   if(_Model)
   {
-    NVN_BBox bounds = _Model->GetBounds();
+    NVN_BBox bounds = this->GetViewBounds();
     float width = bounds.Max[XDIM] - bounds.Min[XDIM];
     float height = bounds.Max[YDIM] - bounds.Min[YDIM];
 
-    _CenterX = bounds.Min[XDIM] + width / 2.0f;
-    _CenterY = bounds.Min[YDIM] + height / 2.0f;
-    _ZoomLevel = 0.98f;  // back off just a bit to make sure the edges are visible
-    _XRotation = 0.0f;
-    _ZRotation = 0.0f;
+    ViewParms view;
+
+    view.CenterX = bounds.Min[XDIM] + width / 2.0f;
+    view.CenterY = bounds.Min[YDIM] + height / 2.0f;
+    view.ZoomLevel = 0.98f;  // back off just a bit to make sure the edges are visible
+    view.XRotation = 0.0f;
+    view.ZRotation = 0.0f;
+    _View.Store(view);
+    _ResetPending = 0 == this->GetViewNDims();
+
+    // A view posted for the old model would undo the reset.
+    __atomic_store_n(&_TakenSeq, __atomic_load_n(&_PostedSeq, __ATOMIC_ACQUIRE),
+                     __ATOMIC_RELEASE);
+
     this->AsyncRefresh();
   }
 
   return retval;
 }
 
-int GLWindow::ShowModel(Model* model)
+int GLWindow::SetAdaptiveDetail(bool enable)
 {
   int retval = NVN_NOERR;
 
-  _Model = model;
-  this->ResetView();
+  _AdaptiveDetail = enable;
+
+  return retval;
+}
+
+int GLWindow::JoinGroup(MPI_Comm comm, int camerarank, Compositor* compositor,
+                        const int tile[])
+{
+  int retval = NVN_NOERR;
+
+  if(this->IsSynchronized())
+    this->LeaveGroup();
+
+  _SyncComm = comm;
+  _CameraRank = camerarank;
+  _Compositor = compositor;
+
+  if(tile)
+  {
+    _Tiled = true;
+    _WallWidth = tile[0];
+    _WallHeight = tile[1];
+    _TileX = tile[2];
+    _TileY = tile[3];
+  }
+
+  this->SyncBounds();
   this->AsyncRefresh();
 
   return retval;
 }
 
+int GLWindow::ShowModel(Model* model)
+{
+  int retval = NVN_NOERR;
+
+  // The render thread holds the context while it draws, so the model and the
+  // frame around it are only swapped between frames.
+  retval = this->LockContext();
+
+  if(NVN_NOERR == retval)
+  {
+    _Model = model;
+
+    if(_Frame)
+    {
+      delete _Frame;
+      _Frame = 0;
+    }
+
+    this->ResetView();
+    this->AsyncRefresh();
+  }
+
+  this->UnlockContext();
+
+  return retval;
+}
+
 int GLWindow::GetViewParms(float* centerx, float* centery, float* zoomlevel,
                            float* xrotation, float* zrotation) const
 {
   int retval = NVN_NOERR;
+  ViewParms view;
+
+  // A driver that reads the view to step it from there must see the view it
+  // posted last, or steps taken between two frames would be lost.
+  if(__atomic_load_n(&_PostedSeq, __ATOMIC_ACQUIRE) !=
+     __atomic_load_n(&_TakenSeq, __ATOMIC_ACQUIRE))
+  {
+    _PostedView.Load(&view);
+  }
+  else
+  {
+    _View.Load(&view);
+  }
 
   if(centerx)
-    *centerx = _CenterX;
+    *centerx = view.CenterX;
 
   if(centery)
-    *centery = _CenterY;
+    *centery = view.CenterY;
 
   if(zoomlevel)
-    *zoomlevel = _ZoomLevel;
+    *zoomlevel = view.ZoomLevel;
 
   if(xrotation)
-    *xrotation = _XRotation;
+    *xrotation = view.XRotation;
 
   if(zrotation)
-    *zrotation = _ZRotation;
+    *zrotation = view.ZRotation;
+
+  return retval;
+}
+
+int GLWindow::PostViewParms(float centerx, float centery, float zoomlevel,
+                            float xrotation, float zrotation)
+{
+  int retval = NVN_NOERR;
+  ViewParms view = { centerx, centery, zoomlevel, xrotation, zrotation };
+
+  _PostedView.Store(view);
+  __atomic_add_fetch(&_PostedSeq, 1, __ATOMIC_RELEASE);
+
+  _LastInteraction = MPI_Wtime();
+  this->AsyncRefresh();
 
   return retval;
 }
@@ -242,12 +621,10 @@ int GLWindow::SetViewParms(float centerx, float centery, float zoomlevel,
                            float xrotation, float zrotation)
 {
   int retval = NVN_NOERR;
+  ViewParms view = { centerx, centery, zoomlevel, xrotation, zrotation };
 
-  _CenterX = centerx;
-  _CenterY = centery;
-  _ZoomLevel = zoomlevel;
-  _XRotation = xrotation;
-  _ZRotation = zrotation;
+  _View.Store(view);
+  _LastInteraction = MPI_Wtime();
   this->AsyncRefresh();
 
   return retval;
@@ -265,7 +642,12 @@ int GLWindow::GetMousePos(int* x, int* y) const
   Window root, child;
   int rootx, rooty, winx, winy;
   unsigned int mask;
-  if(XQueryPointer(GLX::GetDisplay(), _XWindow, &root, &child,
+  if(_Offscreen)
+  {
+    // There is no pointer in a headless session
+    retval = NVN_EXWINFAIL;
+  }
+  else if(XQueryPointer(GLX::GetDisplay(), _XWindow, &root, &child,
       &rootx, &rooty, &winx, &winy, &mask))
   {
     *x = winx;
@@ -283,93 +665,124 @@ int GLWindow::GetMousePos(int* x, int* y) const
 int GLWindow::GetMousePosInModel(float* x, float* y) const
 {
   int retval = NVN_NOERR;
-
   int pixx, pixy;
-  float scale;
 
-  scale = GetPixelsPerModelUnit();
   retval = GetMousePos(&pixx, &pixy);
 
-  float cosx = cos(_XRotation * DEG2RADF);
-  float cosz = cos(_ZRotation * DEG2RADF);
-  float sinz = sin(_ZRotation * DEG2RADF);
-
-  *x = _CenterX -
-      (_Width / 2.0f - pixx) / scale * cosz +
-      (_Height / 2.0f - pixy) / scale / cosx * sinz;
-  *y = _CenterY -
-      (_Width / 2.0f - pixx) / scale * sinz -
-      (_Height / 2.0f - pixy) / scale / cosx * cosz;
+  if(NVN_NOERR == retval)
+    retval = this->PixelToModel(pixx, pixy, x, y);
 
   return retval;
 }
 
+int GLWindow::GetViewNDims() const
+{
+  int ndims = 0;
+
+  NVN_BBox bounds = this->GetViewBounds();
+  for(int i = 0; i < _Model->GetCRS().GetNDims(); i++)
+  {
+    if(bounds.Max[i] > bounds.Min[i]) ndims++;
+  }
+
+  return ndims;
+}
+
 int GLWindow::HandleXButtonPress(XEvent event)
 {
+  int retval = NVN_NOERR;
+
   float x1, y1, x2, y2;
+  ViewParms view;
+
+  _View.Load(&view);
+
+  // Zooming keeps the model point under the pointer where it is, and the new
+  // view is stored whole so that the render thread never sees it half done.
   switch(event.xbutton.button)
   {
   case Button1:
     _LeftMouseDown = true;
     _MouseDownX = event.xbutton.x;
     _MouseDownY = event.xbutton.y;
-    _MouseDownCenterX = _CenterX;
-    _MouseDownCenterY = _CenterY;
+    _MouseDownCenterX = view.CenterX;
+    _MouseDownCenterY = view.CenterY;
     break;
 
   case Button4:
-    GetMousePosInModel(&x1, &y1);
-    _ZoomLevel *= _ZoomFactor;
-    GetMousePosInModel(&x2, &y2);
-    _CenterX -= x2 - x1;
-    _CenterY += y2 - y1;
+    this->PixelToModel(view, event.xbutton.x, event.xbutton.y, &x1, &y1);
+    view.ZoomLevel *= _ZoomFactor;
+    this->PixelToModel(view, event.xbutton.x, event.xbutton.y, &x2, &y2);
+    view.CenterX -= x2 - x1;
+    view.CenterY -= y2 - y1;
+    _View.Store(view);
+    _LastInteraction = MPI_Wtime();
     this->AsyncRefresh();
     break;
 
   case Button5:
-    GetMousePosInModel(&x1, &y1);
-    _ZoomLevel /= _ZoomFactor;
-    GetMousePosInModel(&x2, &y2);
-    _CenterX -= x2 - x1;
-    _CenterY += y2 - y1;
+    this->PixelToModel(view, event.xbutton.x, event.xbutton.y, &x1, &y1);
+    view.ZoomLevel /= _ZoomFactor;
+    this->PixelToModel(view, event.xbutton.x, event.xbutton.y, &x2, &y2);
+    view.CenterX -= x2 - x1;
+    view.CenterY -= y2 - y1;
+    _View.Store(view);
+    _LastInteraction = MPI_Wtime();
     this->AsyncRefresh();
     break;
   }
+
+  return retval;
 }
 
 int GLWindow::HandleXButtonRelease(XEvent event)
 {
+  int retval = NVN_NOERR;
+
   switch(event.xbutton.button)
   {
   case Button1:
     _LeftMouseDown = false;
     break;
   }
+
+  return retval;
 }
 
 int GLWindow::HandleXConfigureNotify(XEvent event)
 {
+  int retval = NVN_NOERR;
+
   _X = event.xconfigure.x;
   _Y = event.xconfigure.y;
   _Width = event.xconfigure.width;
   _Height = event.xconfigure.height;
+
+  return retval;
 }
 
 int GLWindow::HandleXExpose(XEvent event)
 {
+  int retval = NVN_NOERR;
+
   this->AsyncRefresh();
+
+  return retval;
 }
 
 int GLWindow::HandleXKeyPress(XEvent event)
 {
   int retval = NVN_NOERR;
+  ViewParms view;
+
+  _View.Load(&view);
 
   switch(XLookupKeysym(&event.xkey, 0))
   {
   case XK_Alt_L:
   case XK_Alt_R:
     _AltDown = true;
-    _AltDownZRotation = _ZRotation;
+    _AltDownZRotation = view.ZRotation;
     _AltDownX = event.xkey.x;
     _AltDownY = event.xkey.y;
     break;
@@ -377,7 +790,7 @@ int GLWindow::HandleXKeyPress(XEvent event)
   case XK_Control_L:
   case XK_Control_R:
     _CtrlDown = true;
-    _CtrlDownXRotation = _XRotation;
+    _CtrlDownXRotation = view.XRotation;
     _CtrlDownX = event.xkey.x;
     _CtrlDownY = event.xkey.y;
     break;
@@ -413,97 +826,666 @@ int GLWindow::HandleXKeyRelease(XEvent event)
 
 int GLWindow::HandleXMotionNotify(XEvent event)
 {
+  int retval = NVN_NOERR;
+  NVN_ProbeResult hover;
+  ViewParms view;
+
+  if(! _LeftMouseDown && ! _CtrlDown && ! _AltDown)
+  {
+    // The readout under the pointer is only stored, and does not need the
+    // scene to be drawn again.
+    if(NVN_NOERR == this->Probe(event.xmotion.x, event.xmotion.y, &hover))
+    {
+      pthread_mutex_lock(&_HoverLock);
+      _Hover = hover;
+      pthread_mutex_unlock(&_HoverLock);
+    }
+  }
+
+  _View.Load(&view);
+
   if(_LeftMouseDown)
   {
-    float cosx = cos(_XRotation * DEG2RADF);
-    float cosz = cos(_ZRotation * DEG2RADF);
-    float sinz = sin(_ZRotation * DEG2RADF);
-    float scale = this->GetPixelsPerModelUnit();
+    float cosx = cos(view.XRotation * DEG2RADF);
+    float cosz = cos(view.ZRotation * DEG2RADF);
+    float sinz = sin(view.ZRotation * DEG2RADF);
+    float scale = this->GetPixelsPerModelUnit(view.ZoomLevel);
 
-    _CenterX = _MouseDownCenterX +
+    view.CenterX = _MouseDownCenterX +
         ((_MouseDownX - event.xbutton.x) / scale) * cosz -
         ((_MouseDownY - event.xbutton.y) / scale / cosx * sinz);
-    _CenterY = _MouseDownCenterY -
+    view.CenterY = _MouseDownCenterY -
         ((_MouseDownX - event.xbutton.x) / scale) * sinz -
         ((_MouseDownY - event.xbutton.y) / scale / cosx * cosz);
 
+    _View.Store(view);
+    _LastInteraction = MPI_Wtime();
     this->AsyncRefresh();
   }
 
   if(_CtrlDown)
   {
-    _XRotation = _CtrlDownXRotation - (_CtrlDownY - event.xbutton.y);
+    view.XRotation = _CtrlDownXRotation - (_CtrlDownY - event.xbutton.y);
+    _View.Store(view);
+    _LastInteraction = MPI_Wtime();
     this->AsyncRefresh();
   }
 
   if(_AltDown)
   {
-    _ZRotation = _AltDownZRotation + (_AltDownX - event.xbutton.x);
+    view.ZRotation = _AltDownZRotation + (_AltDownX - event.xbutton.x);
+    _View.Store(view);
+    _LastInteraction = MPI_Wtime();
     this->AsyncRefresh();
   }
+
+  return retval;
+}
+
+int GLWindow::MakeCurrent()
+{
+  int retval = NVN_NOERR;
+
+  if(_Offscreen)
+  {
+    if(! eglMakeCurrent(GLX::GetEGLDisplay(), _EGLSurface, _EGLSurface, _EGLContext))
+      retval = NVN_EEGLFAIL;
+  }
+  else
+  {
+    if(! glXMakeCurrent(GLX::GetDisplay(), _XWindow, _GLXContext))
+      retval = NVN_EGLXFAIL;
+  }
+
+  return retval;
+}
+
+int GLWindow::ReadFrame(void* rgba, size_t len)
+{
+  int retval = NVN_NOERR;
+
+  if(! rgba || len < (size_t)_Width * (size_t)_Height * 4)
+    retval = NVN_EINVARGS;
+
+  // A synchronized window must follow the same collective sequence as the UI
+  // loop, so it synchronizes with its peers before deciding to render.  A
+  // frame that is read back is kept, so it is always drawn at full detail.
+  // The context is held from the render through the read, so that the render
+  // thread cannot draw another frame in between.
+  if(NVN_NOERR == retval)
+  {
+    bool render;
+
+    this->LockContext();
+    render = this->IsDirty() || _RenderedDetail < 1.0f;
+
+    if(this->IsSynchronized())
+      retval = this->SyncFrame(&render);
+
+    if(NVN_NOERR == retval && render)
+      retval = this->RenderModel(true);
+
+    if(NVN_NOERR == retval)
+      retval = this->MakeCurrent();
+
+    if(NVN_NOERR == retval)
+    {
+      // A pbuffer only has a back buffer, while an X window has just been
+      // swapped and holds the finished frame in its front buffer.
+      glReadBuffer(_Offscreen ? GL_BACK : GL_FRONT);
+      glPixelStorei(GL_PACK_ALIGNMENT, 1);
+      glReadPixels(0, 0, _Width, _Height, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+    }
+
+    this->UnlockContext();
+  }
+
+  return retval;
 }
 
-int GLWindow::RenderModel()
+int GLWindow::RenderModel(bool fulldetail)
 {
+  int retval = NVN_NOERR;
+  TraceScope trace("RenderModel", "render");
+  float detail = 1.0f;
+
+  // While the view is being moved, a scene that is too slow to keep up is
+  // drawn with only as much detail as fits in LOD_TARGET_SECONDS.  A full
+  // frame that waits on vsync takes about that long anyway, so only frames
+  // that are clearly too slow are reduced.  Synchronized windows always draw
+  // at full detail, so that every rank draws the same scene.
+  if(! fulldetail && _AdaptiveDetail && ! this->IsSynchronized() &&
+     _FullDetailSeconds > 1.5 * LOD_TARGET_SECONDS && this->IsInteracting())
+  {
+    detail = (float)(LOD_TARGET_SECONDS / _FullDetailSeconds);
+  }
+
+  // Clear the flag before the view is read, so that a change made by another
+  // thread while this frame is being drawn is not lost.
+  _Dirty = false;
+  _RenderedDetail = detail;
+  if(_Model)
+    _RenderedRevision = _Model->GetRevision();
+
+  this->TakePostedView();
+
+  retval = this->LockContext();
+
+  if(NVN_NOERR == retval)
+    _Profiler->BeginFrame();
+
   glViewport(0, 0, _Width, _Height);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-  glMatrixMode(GL_PROJECTION);
-  glLoadIdentity();
+  // A view that was reset while the model was still empty is reset again
+  // once something has been added to it, such as the first samples of a
+  // streaming series.
+  if(NVN_NOERR == retval && _Model && _ResetPending &&
+     0 < this->GetViewNDims())
+  {
+    this->ResetView();
+    _Dirty = false;
+  }
+
+  if(NVN_NOERR == retval && _Model)
+  {
+    // The whole frame is drawn from one copy of the view, taken without a
+    // lock, however often the view is changed while it is being drawn.
+    ViewParms view;
+    _View.Load(&view);
+
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+
+    // The view covers the whole display wall, and this window only projects
+    // its own tile of it.  Tiles are placed from the top-left of the wall.
+    float scale = this->GetPixelsPerModelUnit(view.ZoomLevel);
+    float xmin = view.CenterX - (this->GetViewWidth() / 2.0f - _TileX) / scale;
+    float xmax = xmin + _Width / scale;
+    float ymax = view.CenterY + (this->GetViewHeight() / 2.0f - _TileY) / scale;
+    float ymin = ymax - _Height / scale;
+
+    // Models in real-world coordinates can be far larger than a grid indexed
+    // by cell, so the depth range has to cover the scene however it is turned.
+    NVN_BBox bounds = this->GetViewBounds();
+    float depth = 10000.0f;
+    for(int i = 0; i < MAX_DIMS; i++)
+    {
+      if(bounds.Min[i] < bounds.Max[i] &&
+         depth < 2.0f * (bounds.Max[i] - bounds.Min[i]))
+      {
+        depth = 2.0f * (bounds.Max[i] - bounds.Min[i]);
+      }
+    }
+
+    glOrtho(xmin, xmax, ymin, ymax, -depth, depth);
+
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+
+    if(this->GetViewNDims() <= 2)
+    {
+      // For models without depth, just do full ambient lighting
+      float ambcolor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+      glEnable(GL_LIGHTING);
+      glLightModelfv(GL_LIGHT_MODEL_AMBIENT, ambcolor);
+
+      glEnable(GL_COLOR_MATERIAL);
+      glColorMaterial(GL_FRONT, GL_AMBIENT);
+    }
+    else
+    {
+      // If we've got depth, then do a combination of ambient and diffuse
+      // lighting to show off the depth.
+
+      float lightpos[] = { view.CenterX, view.CenterY, depth, 1.0f };
+      float diffcolor[] = { 0.5f, 0.5f, 0.5f, 1.0f };
+      float ambcolor[] = { 0.5f, 0.5f, 0.5f, 1.0f };
+
+      glEnable(GL_LIGHTING);
+      glEnable(GL_LIGHT0);
+      glLightModelfv(GL_LIGHT_MODEL_AMBIENT, ambcolor);
+      glLightfv(GL_LIGHT0, GL_DIFFUSE, diffcolor);
+      glLightfv(GL_LIGHT0, GL_POSITION, lightpos);
+
+      glShadeModel(GL_SMOOTH);
+      glEnable(GL_DEPTH_TEST);
+      glEnable(GL_COLOR_MATERIAL);
+      glColorMaterial(GL_FRONT, GL_AMBIENT_AND_DIFFUSE);
+    }
+
+    glTranslatef(view.CenterX, view.CenterY, 0.0f);
+    glRotatef(view.XRotation, 1.0f, 0.0f, 0.0f);
+    glRotatef(view.ZRotation, 0.0f, 0.0f, 1.0f);
+    glTranslatef(-view.CenterX,-view.CenterY, 0.0f);
+
+    RenderContext context(scale);
+    context.SetProfiler(_Profiler);
+    context.SetDetail(detail);
+    context.SetProgressive(! fulldetail && ! this->IsSynchronized());
+    context.SetShareGroup(_ShareGroup);
+    context.SetWindow(_WindowID);
+    _Model->Render(context);
+
+    // A layer that drew only part of what it has asks for another frame to
+    // draw the rest.
+    if(context.IsFrameRequested())
+      _Dirty = true;
+
+    // The frame is kept between renders, so it only has to be rebuilt when the
+    // bounds of the scene change.
+    if(! _Frame)
+      _Frame = new ReferenceFrameLayer(_Model->GetCRS(), this->GetViewBounds());
+    else
+      _Frame->SetBounds(this->GetViewBounds());
+
+    _Frame->Render(context);
+  }
+
+  // Every rank must take part in compositing, even if it had nothing to draw.
+  if(_Compositor)
+    _Compositor->Composite(_SyncWidth, _SyncHeight);
+
+  // The finished frame is read from the back buffer before it is swapped
+  // away, and the read back completes while the next frame is drawn.
+  if(_Recorder)
+    _Recorder->Capture(_Width, _Height);
+
+  _Profiler->Begin(NVN_PHASE_SWAP);
+  this->SwapBuffers();
+  _Profiler->End(NVN_PHASE_SWAP);
+
+  if(NVN_NOERR == retval)
+    _Profiler->EndFrame();
+
+  // The cost of a full frame is what the layers took to draw, apart from
+  // building their meshes, and what the swap waited on.
+  if(NVN_NOERR == retval && detail >= 1.0f)
+  {
+    _FullDetailSeconds = _Profiler->GetLastPhaseSeconds(NVN_PHASE_LAYERS) -
+      _Profiler->GetLastPhaseSeconds(NVN_PHASE_MESH) +
+      _Profiler->GetLastPhaseSeconds(NVN_PHASE_SWAP);
+  }
+
+  this->UnlockContext();
+
+  return retval;
+}
+
+int GLWindow::StartRecording(const char* target, int mode)
+{
+  int retval = NVN_NOERR;
+  FrameRecorder* recorder = 0;
+
+  if(_Recorder)
+    retval = NVN_EINVARGS;
 
-  float scale = this->GetPixelsPerModelUnit();
-  float xmin = _CenterX - (_Width / 2.0f) / scale;
-  float xmax = _CenterX + (_Width / 2.0f) / scale;
-  float ymin = _CenterY - (_Height / 2.0f) / scale;
-  float ymax = _CenterY + (_Height / 2.0f) / scale;
-  glOrtho(xmin, xmax, ymin, ymax, -10000.0f, 10000.0f);
+  // The recorder is only handed to the render thread once it has started.
+  if(NVN_NOERR == retval)
+  {
+    recorder = new FrameRecorder();
+    retval = recorder->Start(target, mode);
 
-  glMatrixMode(GL_MODELVIEW);
-  glLoadIdentity();
+    if(NVN_NOERR != retval)
+      delete recorder;
+  }
 
-  if(_Model->GetNDims() <= 2)
+  if(NVN_NOERR == retval)
   {
-    // For models without depth, just do full ambient lighting
-    float ambcolor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-    glEnable(GL_LIGHTING);
-    glLightModelfv(GL_LIGHT_MODEL_AMBIENT, ambcolor);
+    retval = this->LockContext();
 
-    glEnable(GL_COLOR_MATERIAL);
-    glColorMaterial(GL_FRONT, GL_AMBIENT);
+    if(NVN_NOERR == retval)
+      _Recorder = recorder;
+    else
+      delete recorder;
+
+    this->UnlockContext();
   }
+
+  return retval;
+}
+
+int GLWindow::StopRecording()
+{
+  int retval = NVN_NOERR;
+
+  if(! _Recorder)
+    retval = NVN_EINVARGS;
+
+  if(NVN_NOERR == retval)
+  {
+    retval = this->LockContext();
+
+    if(NVN_NOERR == retval)
+    {
+      retval = _Recorder->Stop();
+      delete _Recorder;
+      _Recorder = 0;
+    }
+
+    this->UnlockContext();
+  }
+
+  return retval;
+}
+
+int GLWindow::SwapBuffers()
+{
+  int retval = NVN_NOERR;
+  TraceScope trace("SwapBuffers", "render");
+
+  if(_Offscreen)
+    glFinish();
   else
+    glXSwapBuffers(GLX::GetDisplay(), _XWindow);
+
+  return retval;
+}
+
+int GLWindow::LeaveGroup()
+{
+  int retval = NVN_NOERR;
+
+  if(_Compositor)
+  {
+    delete _Compositor;
+    _Compositor = 0;
+  }
+
+  MPI_Comm_free(&_SyncComm);
+  _SyncComm = MPI_COMM_NULL;
+  _SyncBounds = NVN_BBoxEmpty;
+  _Tiled = false;
+  _TileX = 0;
+  _TileY = 0;
+
+  this->AsyncRefresh();
+
+  return retval;
+}
+
+int GLWindow::PixelToModel(const ViewParms& view, int pixx, int pixy,
+                           float* x, float* y) const
+{
+  int retval = NVN_NOERR;
+  float scale = this->GetPixelsPerModelUnit(view.ZoomLevel);
+
+  // Measure from the corner of the whole display wall, not just this tile.
+  pixx += _TileX;
+  pixy += _TileY;
+
+  float cosx = cos(view.XRotation * DEG2RADF);
+  float cosz = cos(view.ZRotation * DEG2RADF);
+  float sinz = sin(view.ZRotation * DEG2RADF);
+
+  *x = view.CenterX -
+      (this->GetViewWidth() / 2.0f - pixx) / scale * cosz +
+      (this->GetViewHeight() / 2.0f - pixy) / scale / cosx * sinz;
+  *y = view.CenterY +
+      (this->GetViewWidth() / 2.0f - pixx) / scale * sinz +
+      (this->GetViewHeight() / 2.0f - pixy) / scale / cosx * cosz;
+
+  return retval;
+}
+
+int GLWindow::SyncBounds()
+{
+  int retval = NVN_NOERR;
+  TraceScope trace("GLWindow::SyncBounds", "mpi");
+  int rank;
+  float local[2 * MAX_DIMS];
+  float global[2 * MAX_DIMS];
+  NVN_BBox bounds = NVN_BBoxEmpty;
+  bool grown = false;
+
+  // This is the first collective on a new group, so it can safely run on the
+  // UI thread while the other ranks join.
+  if(_Model)
+    bounds = _Model->GetBounds();
+
+  for(int i = 0; i < MAX_DIMS; i++)
   {
-    // If we've got depth, then do a combination of ambient and diffuse
-    // lighting to show off the depth.
+    local[i] = -bounds.Min[i];
+    local[MAX_DIMS + i] = bounds.Max[i];
+  }
 
-    float lightpos[] = { _CenterX, _CenterY, 10000.0f, 1.0f };
-    float diffcolor[] = { 0.5f, 0.5f, 0.5f, 1.0f };
-    float ambcolor[] = { 0.5f, 0.5f, 0.5f, 1.0f };
+  MPI_Allreduce(local, global, 2 * MAX_DIMS, MPI_FLOAT, MPI_MAX, _SyncComm);
 
-    glEnable(GL_LIGHTING);
-    glEnable(GL_LIGHT0);
-    glLightModelfv(GL_LIGHT_MODEL_AMBIENT, ambcolor);
-    glLightfv(GL_LIGHT0, GL_DIFFUSE, diffcolor);
-    glLightfv(GL_LIGHT0, GL_POSITION, lightpos);
+  for(int i = 0; i < MAX_DIMS; i++)
+  {
+    _SyncBounds.Min[i] = -global[i];
+    _SyncBounds.Max[i] = global[MAX_DIMS + i];
 
-    glShadeModel(GL_SMOOTH);
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_COLOR_MATERIAL);
-    glColorMaterial(GL_FRONT, GL_AMBIENT_AND_DIFFUSE);
+    if(_SyncBounds.Min[i] < bounds.Min[i] || _SyncBounds.Max[i] > bounds.Max[i])
+      grown = true;
   }
 
-  glTranslatef(_CenterX, _CenterY, 0.0f);
-  glRotatef(_XRotation, 1.0f, 0.0f, 0.0f);
-  glRotatef(_ZRotation, 0.0f, 0.0f, 1.0f);
-  glTranslatef(-_CenterX,-_CenterY, 0.0f);
+  // The camera rank's view was based on its own model until now, so it is
+  // reset if the other ranks have added to the scene.
+  MPI_Comm_rank(_SyncComm, &rank);
+  if(grown && rank == _CameraRank)
+    this->ResetView();
 
+  return retval;
+}
+
+int GLWindow::TakePostedView()
+{
+  int retval = NVN_NOERR;
+  unsigned int posted = __atomic_load_n(&_PostedSeq, __ATOMIC_ACQUIRE);
+  ViewParms view;
+
+  // A view posted while this one is copied is newer than the count, so at
+  // worst it is taken twice.
+  if(posted != __atomic_load_n(&_TakenSeq, __ATOMIC_ACQUIRE))
+  {
+    _PostedView.Load(&view);
+    _View.Store(view);
+    __atomic_store_n(&_TakenSeq, posted, __ATOMIC_RELEASE);
+  }
+
+  return retval;
+}
+
+int GLWindow::SyncFrame(bool* render)
+{
+  int retval = NVN_NOERR;
+  TraceScope trace("GLWindow::SyncFrame", "mpi");
+  float parms[5];
+  ViewParms view;
+  float local[4 + 2 * MAX_DIMS];
+  float global[4 + 2 * MAX_DIMS];
+  NVN_BBox bounds = NVN_BBoxEmpty;
+
+  // The camera rank shares the newest view that was posted to it.
+  this->TakePostedView();
+
+  // A frame is drawn if any rank is dirty.  The projection is based on the
+  // union of all ranks' bounds, and only the area that every window covers is
+  // composited.  Everything is folded into a single max-reduction.
   if(_Model)
-    _Model->Render();
+    bounds = _Model->GetBounds();
 
-  ReferenceFrameLayer frame(_Model->GetCRS(), _Model->GetBounds());
-  frame.Render();
+  local[0] = _Leaving ? 1.0f : 0.0f;
+  local[1] = this->IsDirty() ? 1.0f : 0.0f;
+  local[2] = -(float)_Width;
+  local[3] = -(float)_Height;
+  for(int i = 0; i < MAX_DIMS; i++)
+  {
+    local[4 + i] = -bounds.Min[i];
+    local[4 + MAX_DIMS + i] = bounds.Max[i];
+  }
 
-  glXSwapBuffers(GLX::GetDisplay(), _XWindow);
+  MPI_Allreduce(local, global, 4 + 2 * MAX_DIMS, MPI_FLOAT, MPI_MAX, _SyncComm);
 
-  _Dirty = false;
+  if(global[0] > 0.0f)
+  {
+    // Some rank is destroying its window, so every rank drops out of the
+    // group at this same point and carries on rendering on its own.
+    this->LeaveGroup();
+    *render = true;
+  }
+  else
+  {
+    _SyncWidth = (int)-global[2];
+    _SyncHeight = (int)-global[3];
+    for(int i = 0; i < MAX_DIMS; i++)
+    {
+      _SyncBounds.Min[i] = -global[4 + i];
+      _SyncBounds.Max[i] = global[4 + MAX_DIMS + i];
+    }
+
+    // Every rank renders the scene from the camera rank's point of view.
+    this->GetViewParms(&parms[0], &parms[1], &parms[2], &parms[3], &parms[4]);
+    MPI_Bcast(parms, 5, MPI_FLOAT, _CameraRank, _SyncComm);
+
+    _View.Load(&view);
+    if(parms[0] != view.CenterX || parms[1] != view.CenterY ||
+       parms[2] != view.ZoomLevel || parms[3] != view.XRotation ||
+       parms[4] != view.ZRotation)
+    {
+      this->SetViewParms(parms[0], parms[1], parms[2], parms[3], parms[4]);
+    }
+
+    // The decision is made from collective results only, so that every rank
+    // agrees on it even if a local view change raced with this call.
+    *render = global[1] > 0.0f;
+  }
+
+  return retval;
+}
+
+
+/******************************************************************************
+ * Render Thread
+ ******************************************************************************/
+
+int GLWindow::LockContext()
+{
+  int retval = NVN_NOERR;
+
+  pthread_mutex_lock(&_ContextLock);
+
+  if(0 == _ContextDepth)
+    retval = this->MakeCurrent();
+
+  _ContextDepth++;
+
+  return retval;
+}
+
+int GLWindow::ReleaseCurrent()
+{
+  int retval = NVN_NOERR;
+
+  if(_Offscreen)
+  {
+    if(! eglMakeCurrent(GLX::GetEGLDisplay(), EGL_NO_SURFACE, EGL_NO_SURFACE,
+                        EGL_NO_CONTEXT))
+      retval = NVN_EEGLFAIL;
+  }
+  else
+  {
+    if(! glXMakeCurrent(GLX::GetDisplay(), None, 0))
+      retval = NVN_EGLXFAIL;
+  }
+
+  return retval;
+}
+
+int GLWindow::RunRenderLoop()
+{
+  int retval = NVN_NOERR;
+
+  pthread_mutex_lock(&_FrameLock);
+
+  while(_KeepRenderThreadAlive)
+  {
+    if(! _FrameRequested)
+    {
+      pthread_cond_wait(&_FrameCond, &_FrameLock);
+    }
+    else
+    {
+      _FrameRequested = false;
+      pthread_mutex_unlock(&_FrameLock);
+
+      // The UI thread may have drawn the frame itself in the meantime, such as
+      // for ReadFrame, so the window is checked again once the context is
+      // held.
+      this->LockContext();
+      if(this->IsDirty() && ! this->IsSynchronized())
+        this->RenderModel();
+      this->UnlockContext();
+
+      pthread_mutex_lock(&_FrameLock);
+    }
+  }
+
+  pthread_mutex_unlock(&_FrameLock);
+
+  return retval;
+}
+
+int GLWindow::StartRenderThread()
+{
+  int retval = NVN_NOERR;
+
+  _KeepRenderThreadAlive = true;
+
+  if(0 != pthread_create(&_RenderThread, 0, RenderThreadEntryPoint, this))
+  {
+    // The UI thread draws windows without a render thread itself.
+    retval = NVN_ERROR;
+    _KeepRenderThreadAlive = false;
+    fprintf(stderr, "Failed to create render thread.\n");
+  }
+  else
+  {
+    _RenderThreadAlive = true;
+  }
+
+  return retval;
+}
+
+int GLWindow::StopRenderThread()
+{
+  int retval = NVN_NOERR;
+
+  if(_RenderThreadAlive)
+  {
+    pthread_mutex_lock(&_FrameLock);
+    _KeepRenderThreadAlive = false;
+    pthread_cond_signal(&_FrameCond);
+    pthread_mutex_unlock(&_FrameLock);
+
+    pthread_join(_RenderThread, 0);
+    _RenderThreadAlive = false;
+  }
+
+  return retval;
+}
+
+int GLWindow::UnlockContext()
+{
+  int retval = NVN_NOERR;
+
+  _ContextDepth--;
+
+  if(0 == _ContextDepth)
+    retval = this->ReleaseCurrent();
+
+  pthread_mutex_unlock(&_ContextLock);
+
+  return retval;
+}
+
+void* GLWindow::RenderThreadEntryPoint(void* arg)
+{
+  GLWindow* window = (GLWindow*)arg;
+
+  Trace::SetThreadName(window->_ThreadName);
+  window->RunRenderLoop();
+
+  return 0;
 }
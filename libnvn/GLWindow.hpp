@@ -9,11 +9,32 @@
 #define __GLWINDOW_HPP__
 
 
+#include "nvn.h"
+#include "ViewState.hpp"
+
+#include <EGL/egl.h>
 #include <GL/glx.h>
 #include <X11/Xlib.h>
+#include <pthread.h>
+
+/**
+ * How long a window keeps drawing at reduced detail after the last change to
+ * its view, before it draws the scene again at full detail.
+ */
+#define LOD_IDLE_SECONDS 0.25
+
+/**
+ * The time that a frame should take while the view is being moved.
+ */
+#define LOD_TARGET_SECONDS (1.0 / 60.0)
 
 
+class Compositor;
+class FrameProfiler;
+class FrameRecorder;
+class Layer;
 class Model;
+class ReferenceFrameLayer;
 
 class GLWindow
 {
@@ -24,23 +45,76 @@ public:
 
 public:
   int AsyncRefresh();
+
+  /**
+   * Asks the window's render thread to draw a frame.  Requests made while a
+   * frame is being drawn are merged into one more frame.
+   */
+  int RequestFrame();
   int ResetView();
+  int SetAdaptiveDetail(bool enable);
+  int JoinGroup(MPI_Comm comm, int camerarank, Compositor* compositor,
+                const int tile[]);
   int ShowModel(Model* model);
 
 public:
+  int GetFrameStats(NVN_FrameStats* stats) const;
+  int GetHoverProbe(NVN_ProbeResult* result) const;
+  int GetLayerStats(const Layer* layer, NVN_PhaseStats* stats) const;
+  FrameProfiler* GetProfiler() const { return _Profiler; }
   float GetPixelsPerModelUnit() const;
+  NVN_BBox GetViewBounds() const;
   int GetX() const { return _X; }
   int GetY() const { return _Y; }
   int GetWidth() const { return _Width; }
   int GetHeight() const { return _Height; }
+  int GetViewWidth() const { return _Tiled ? _WallWidth : _Width; }
+  int GetViewHeight() const { return _Tiled ? _WallHeight : _Height; }
+
+  /**
+   * Pixels are counted from the top-left corner of this window, and are
+   * mapped onto the z = 0 plane of the model.
+   */
+  int PixelToModel(int pixx, int pixy, float* x, float* y) const;
+  int Probe(int pixx, int pixy, NVN_ProbeResult* result) const;
   Atom GetWMDeleteMessage() const { return _WMDeleteMessage; }
   bool IsBorderless() const { return _Borderless; }
-  bool IsDirty() const { return _Dirty; }
-  bool Matches(Window xwin) const { return xwin == _XWindow; }
+  bool IsComposited() const { return 0 != _Compositor; }
+  bool HasRenderThread() const { return _RenderThreadAlive; }
+  bool IsDirty() const;
+
+  /**
+   * The view is being moved if a button or modifier that drags it is held
+   * down, or if it was changed less than LOD_IDLE_SECONDS ago.
+   */
+  bool IsInteracting() const;
+  bool IsOffscreen() const { return _Offscreen; }
+
+  /**
+   * Windows whose contexts share GL objects have the same share group, which
+   * is 0 for all of the windows that could share the GLX share context.
+   */
+  int GetShareGroup() const { return _ShareGroup; }
+  bool IsSynchronized() const { return MPI_COMM_NULL != _SyncComm; }
+  bool IsTiled() const { return _Tiled; }
+  bool Matches(Window xwin) const { return ! _Offscreen && xwin == _XWindow; }
 
 public:
+  /**
+   * Gives the view that the next frame will be drawn with, which is the
+   * newest one posted if it has not been applied yet.
+   */
   int GetViewParms(float* centerx, float* centery, float* zoomlevel,
                    float* xrotation, float* zrotation) const;
+
+  /**
+   * Leaves a view for the window to take up at the start of its next frame.
+   * The window keeps only the newest view that was posted, so a driver that
+   * posts faster than the window draws never builds up a backlog.
+   */
+  int PostViewParms(float centerx, float centery, float zoomlevel,
+                    float xrotation, float zrotation);
+
   int SetViewParms(float centerx, float centery, float zoomlevel,
                    float xrotation, float zrotation);
 
@@ -57,20 +131,59 @@ public:
   int HandleXKeyPress(XEvent event);
   int HandleXKeyRelease(XEvent event);
   int HandleXMotionNotify(XEvent event);
-  int RenderModel();
+  int ReadFrame(void* rgba, size_t len);
+  int RenderModel(bool fulldetail = false);
+  int StartRecording(const char* target, int mode);
+  int StopRecording();
+  int StopRenderThread();
+  int SwapBuffers();
+  int SyncFrame(bool* render);
+
+/**
+ * Every window has its own render thread, which draws the frames that the UI
+ * thread asks for, so that windows draw in parallel.  Synchronized windows
+ * are still drawn on the UI thread, in lockstep with their peers.  The GL
+ * context may only be used between LockContext and UnlockContext, which make
+ * it current on the calling thread, and these may be nested.
+ */
+protected:
+  int LockContext();
+  int MakeCurrent();
+  int ReleaseCurrent();
+  int RunRenderLoop();
+  int StartRenderThread();
+  int UnlockContext();
+
+  static void* RenderThreadEntryPoint(void* arg);
+
+protected:
+  float GetPixelsPerModelUnit(float zoomlevel) const;
+  int GetViewNDims() const;
+  int InitOffscreen();
+  int InitXWindow();
+  int LeaveGroup();
+  int PixelToModel(const ViewParms& view, int pixx, int pixy,
+                   float* x, float* y) const;
+  int SyncBounds();
+  int TakePostedView();
 
 protected:
   int _X, _Y, _Width, _Height;
   bool _Borderless;
+  bool _Offscreen;
   char _Title[256];
   Window _XWindow;
   GLXContext _GLXContext;
   Atom _WMDeleteMessage;
+  EGLSurface _EGLSurface;
+  EGLContext _EGLContext;
+  int _ShareGroup;
+  int _WindowID;
 
   Model* _Model;
-  float _CenterX, _CenterY;
-  float _ZoomLevel, _ZoomFactor;
-  float _XRotation, _ZRotation;
+  ReferenceFrameLayer* _Frame;
+  ViewState _View;                  // The view that frames are drawn with
+  float _ZoomFactor;
 
   bool _LeftMouseDown, _CtrlDown, _AltDown;
   int _MouseDownX, _MouseDownY;
@@ -79,7 +192,46 @@ protected:
   int _AltDownX, _AltDownY;
   float _CtrlDownXRotation, _AltDownZRotation;
 
+  bool _AdaptiveDetail;
+  double _LastInteraction;          // When the view was last changed
+
+  ViewState _PostedView;            // The newest view that was posted
+  unsigned int _PostedSeq;          // Counts the views that were posted
+  unsigned int _TakenSeq;           // The count when a view was last taken
+  double _FullDetailSeconds;        // Drawing time of the last full frame
+  float _RenderedDetail;            // The detail of the frame last drawn
+
+  mutable pthread_mutex_t _HoverLock;
+  NVN_ProbeResult _Hover;             // What is under the pointer
+
   bool _Dirty;
+  unsigned int _RenderedRevision;   // The model revision last drawn
+  bool _ResetPending;               // The view was reset on an empty model
+
+  MPI_Comm _SyncComm;
+  int _CameraRank;
+  NVN_BBox _SyncBounds;
+  bool _Leaving;
+
+  Compositor* _Compositor;
+  int _SyncWidth, _SyncHeight;
+
+  FrameRecorder* _Recorder;
+  FrameProfiler* _Profiler;
+
+  pthread_mutex_t _ContextLock;     // Recursive, held while current
+  int _ContextDepth;
+  pthread_t _RenderThread;
+  bool _RenderThreadAlive;
+  bool _KeepRenderThreadAlive;
+  pthread_mutex_t _FrameLock;
+  pthread_cond_t _FrameCond;
+  bool _FrameRequested;
+  char _ThreadName[MAX_NAME];
+
+  bool _Tiled;
+  int _WallWidth, _WallHeight;
+  int _TileX, _TileY;
 };
 
 #endif
@@ -9,12 +9,18 @@
 #include "communication-queue.h"
 #include "nvn.h"
 
+#include "FrameProfiler.hpp"
 #include "GLWindow.hpp"
 #include "GLX.hpp"
+#include "Model.hpp"
+#include "Trace.hpp"
 
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
 #include <GL/glx.h>
 #include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <X11/Xlib.h>
 
@@ -29,44 +35,99 @@
 
 GLX* GLX::_Instance = 0;
 
+// Indexed by UICommand, so the entries must stay in the same order.
+const GLX::CommandEntry GLX::_Commands[NumUICommands] =
+{
+  { &GLX::HandleAddLayer, 0 },
+  { &GLX::HandleCreateWindow, GLX::ReleaseCreateWindow },
+  { &GLX::HandleDestroyWindow, 0 },
+  { &GLX::HandleJoinGroup, 0 },
+  { &GLX::HandleReadFrame, 0 },
+  { &GLX::HandleShowModel, 0 },
+  { &GLX::HandleStartRecording, GLX::ReleaseStartRecording },
+  { &GLX::HandleStopRecording, 0 }
+};
+
 
 /******************************************************************************
  * Public Members:
  ******************************************************************************/
 
-GLX::GLX()
-  : _Display(0),
+GLX::GLX(int backend)
+  : _Backend(backend),
+    _Display(0),
     _VisualInfo(0),
-    _UIThreadAlive(false),
+    _EGLDisplay(EGL_NO_DISPLAY),
+    _EGLConfig(0),
+    _ShareContext(0),
+    _EGLShareContext(EGL_NO_CONTEXT),
+    _UIThreadAlive(true),
+    _UIThreadCreated(false),
     _FocusWindow(0)
 {
   InitQueue(&_UIQueue);
   _KeepUIThreadAlive = true;
 
-  if(0 != pthread_create(&_UIThread, 0, UIThreadEntryPoint, 0))
+  // The thread counts as alive from the start, so that what is posted while
+  // it starts up waits for it in the queue.
+  _UIThreadCreated =
+    0 == pthread_create(&_UIThread, 0, UIThreadEntryPoint, this);
+
+  if(! _UIThreadCreated)
   {
     fprintf(stderr, "Failed to create UI thread.\n");
+    CloseQueue(&_UIQueue);
+    _UIThreadAlive = false;
   }
 }
 
 GLX::~GLX()
 {
-  if(_UIThreadAlive)
+  // The thread is joined even if it has already stopped, which it may have
+  // done before it ever ran its message loop.
+  if(_UIThreadCreated)
   {
     _KeepUIThreadAlive = false;
     pthread_join(_UIThread, 0);
   }
+
+  DestroyQueue(&_UIQueue);
+}
+
+int GLX::AddLayer(Model* model, Layer* layer)
+{
+  int retval = NVN_NOERR;
+
+  // Without a running UI thread, no window is drawing the model, and nothing
+  // would handle a message.
+  if(! _Instance || ! _Instance->_UIThreadAlive ||
+     pthread_equal(_Instance->_UIThread, pthread_self()))
+  {
+    retval = model->AddLayer(layer);
+  }
+  else
+  {
+    Message msg;
+    AddLayerArgs* args = &GetCommandArgs(&msg)->AddLayer;
+
+    InitMessage(&msg, UICommandAddLayer);
+    args->Target = model;
+    args->NewLayer = layer;
+    retval = Post(msg, 0);
+  }
+
+  return retval;
 }
 
 int GLX::CreateWindow(const char* title, int x, int y, int width, int height,
-                      bool borderless, GLWindow** window)
+                      bool borderless, GLWindow** window, Completion* done)
 {
   int retval = NVN_NOERR;
 
   if(! _Instance)
     GLX::Init();
 
-  if(pthread_equal(_Instance->_UIThread, pthread_self()))
+  if(! done && pthread_equal(_Instance->_UIThread, pthread_self()))
   {
     // We are already on the UI thread, so create the window directly.
     *window = new GLWindow(title, x, y, width, height, borderless);
@@ -75,36 +136,30 @@ int GLX::CreateWindow(const char* title, int x, int y, int width, int height,
   else
   {
     Message msg;
-    int handled = 0;
-
-    InitMessage(&msg, "CreateWindow");
-    msg.Arguments[0] = &title;
-    msg.Arguments[1] = &x;
-    msg.Arguments[2] = &y;
-    msg.Arguments[3] = &width;
-    msg.Arguments[4] = &height;
-    msg.Arguments[5] = &borderless;
-    msg.Arguments[6] = window;
-    msg.Handled = &handled;
-    msg.Result = &retval;
-    Push(&_Instance->_UIQueue, msg);
-
-    // Block until the window is created
-    while(! handled)
-      pthread_yield();
+    CreateWindowArgs* args = &GetCommandArgs(&msg)->CreateWindow;
+
+    InitMessage(&msg, UICommandCreateWindow);
+    args->Title = title ? strdup(title) : 0;
+    args->X = x;
+    args->Y = y;
+    args->Width = width;
+    args->Height = height;
+    args->Borderless = borderless;
+    args->Window = window;
+    retval = Post(msg, done);
   }
 
   return retval;
 }
 
-int GLX::DestroyWindow(GLWindow* window)
+int GLX::DestroyWindow(GLWindow* window, Completion* done)
 {
   int retval = NVN_NOERR;
 
   if(! _Instance)
     GLX::Init();
 
-  if(pthread_equal(_Instance->_UIThread, pthread_self()))
+  if(! done && pthread_equal(_Instance->_UIThread, pthread_self()))
   {
     if(_Instance->_Windows.end() !=
         std::find(_Instance->_Windows.begin(), _Instance->_Windows.end(), window))
@@ -116,22 +171,23 @@ int GLX::DestroyWindow(GLWindow* window)
   else
   {
     Message msg;
-    int handled = 0;
-
-    InitMessage(&msg, "DestroyWindow");
-    msg.Arguments[0] = window;
-    msg.Handled = &handled;
-    msg.Result = &retval;
-    Push(&_Instance->_UIQueue, msg);
 
-    // Block until the window is created
-    while(! handled)
-      pthread_yield();
+    InitMessage(&msg, UICommandDestroyWindow);
+    GetCommandArgs(&msg)->DestroyWindow.Window = window;
+    retval = Post(msg, done);
   }
 
   return retval;
 }
 
+int GLX::GetBackend()
+{
+  if(! _Instance)
+    GLX::Init();
+
+  return _Instance->_Backend;
+}
+
 Display* GLX::GetDisplay()
 {
   Display* retval = 0;
@@ -143,6 +199,38 @@ Display* GLX::GetDisplay()
   return retval;
 }
 
+EGLConfig GLX::GetEGLConfig()
+{
+  if(! _Instance)
+    GLX::Init();
+
+  return _Instance->_EGLConfig;
+}
+
+EGLDisplay GLX::GetEGLDisplay()
+{
+  if(! _Instance)
+    GLX::Init();
+
+  return _Instance->_EGLDisplay;
+}
+
+EGLContext GLX::GetEGLShareContext()
+{
+  if(! _Instance)
+    GLX::Init();
+
+  return _Instance->_EGLShareContext;
+}
+
+GLXContext GLX::GetShareContext()
+{
+  if(! _Instance)
+    GLX::Init();
+
+  return _Instance->_ShareContext;
+}
+
 XVisualInfo* GLX::GetVisualInfo()
 {
   XVisualInfo* retval = 0;
@@ -155,12 +243,36 @@ XVisualInfo* GLX::GetVisualInfo()
 }
 
 int GLX::Init()
+{
+  return GLX::Init(NVN_BACKEND_AUTO);
+}
+
+int GLX::Init(int backend)
 {
   int retval = NVN_NOERR;
 
-  if(! _Instance)
+  if(_Instance)
   {
-    _Instance = new GLX();
+    // Once running, the backend cannot be changed, and asking for a different
+    // one is an error rather than quietly keeping the old one.
+    if(NVN_BACKEND_AUTO != backend && _Instance->_Backend != backend)
+      retval = NVN_EINVARGS;
+  }
+  else
+  {
+    if(NVN_BACKEND_AUTO == backend)
+    {
+      const char* display = getenv("DISPLAY");
+      if(display && strlen(display) > 0)
+        backend = NVN_BACKEND_GLX;
+      else
+        backend = NVN_BACKEND_HEADLESS;
+    }
+
+    if(NVN_BACKEND_GLX != backend && NVN_BACKEND_HEADLESS != backend)
+      retval = NVN_EINVARGS;
+    else
+      _Instance = new GLX(backend);
   }
 
   return retval;
@@ -173,11 +285,171 @@ bool GLX::IsActive(GLWindow* window)
           std::find(_Instance->_Windows.begin(), _Instance->_Windows.end(), window);
 }
 
+bool GLX::IsHeadless()
+{
+  return NVN_BACKEND_HEADLESS == GLX::GetBackend();
+}
+
 int GLX::IsInitialized()
 {
   return 0 != _Instance;
 }
 
+int GLX::JoinGroup(GLWindow* window, MPI_Comm comm, int camerarank,
+                   Compositor* compositor, const int tile[])
+{
+  int retval = NVN_NOERR;
+
+  if(! _Instance)
+    GLX::Init();
+
+  // The window joins the group on the UI thread, so that synchronization can
+  // never begin in the middle of a frame that the other ranks are not
+  // rendering.
+  if(pthread_equal(_Instance->_UIThread, pthread_self()))
+  {
+    if(IsActive(window))
+      retval = window->JoinGroup(comm, camerarank, compositor, tile);
+    else
+      retval = NVN_EINVARGS;
+  }
+  else
+  {
+    Message msg;
+    JoinGroupArgs* args = &GetCommandArgs(&msg)->JoinGroup;
+
+    InitMessage(&msg, UICommandJoinGroup);
+    args->Window = window;
+    args->Comm = comm;
+    args->CameraRank = camerarank;
+    args->Comp = compositor;
+    args->HasTile = 0 != tile;
+    for(int i = 0; tile && i < 4; i++)
+      args->Tile[i] = tile[i];
+
+    // Block until the window has joined
+    retval = Post(msg, 0);
+  }
+
+  return retval;
+}
+
+int GLX::ReadFrame(GLWindow* window, void* rgba, size_t len, Completion* done)
+{
+  int retval = NVN_NOERR;
+
+  if(! _Instance)
+    GLX::Init();
+
+  if(! done && pthread_equal(_Instance->_UIThread, pthread_self()))
+  {
+    if(IsActive(window))
+      retval = window->ReadFrame(rgba, len);
+    else
+      retval = NVN_EINVARGS;
+  }
+  else
+  {
+    Message msg;
+    ReadFrameArgs* args = &GetCommandArgs(&msg)->ReadFrame;
+
+    InitMessage(&msg, UICommandReadFrame);
+    args->Window = window;
+    args->RGBA = rgba;
+    args->Len = len;
+    retval = Post(msg, done);
+  }
+
+  return retval;
+}
+
+int GLX::ShowModel(GLWindow* window, Model* model)
+{
+  int retval = NVN_NOERR;
+
+  if(! _Instance)
+    GLX::Init();
+
+  // Once the UI thread has stopped, the windows that are left no longer draw,
+  // so the model can be handed to them directly.
+  if(! _Instance->_UIThreadAlive ||
+     pthread_equal(_Instance->_UIThread, pthread_self()))
+  {
+    if(IsActive(window))
+      retval = window->ShowModel(model);
+    else
+      retval = NVN_EINVARGS;
+  }
+  else
+  {
+    Message msg;
+    ShowModelArgs* args = &GetCommandArgs(&msg)->ShowModel;
+
+    InitMessage(&msg, UICommandShowModel);
+    args->Window = window;
+    args->NewModel = model;
+    retval = Post(msg, 0);
+  }
+
+  return retval;
+}
+
+int GLX::StartRecording(GLWindow* window, const char* target, int mode,
+                        Completion* done)
+{
+  int retval = NVN_NOERR;
+
+  if(! _Instance)
+    GLX::Init();
+
+  if(! done && pthread_equal(_Instance->_UIThread, pthread_self()))
+  {
+    if(IsActive(window))
+      retval = window->StartRecording(target, mode);
+    else
+      retval = NVN_EINVARGS;
+  }
+  else
+  {
+    Message msg;
+    StartRecordingArgs* args = &GetCommandArgs(&msg)->StartRecording;
+
+    InitMessage(&msg, UICommandStartRecording);
+    args->Window = window;
+    args->Target = target ? strdup(target) : 0;
+    args->Mode = mode;
+    retval = Post(msg, done);
+  }
+
+  return retval;
+}
+
+int GLX::StopRecording(GLWindow* window, Completion* done)
+{
+  int retval = NVN_NOERR;
+
+  if(! _Instance)
+    GLX::Init();
+
+  if(! done && pthread_equal(_Instance->_UIThread, pthread_self()))
+  {
+    if(IsActive(window))
+      retval = window->StopRecording();
+    else
+      retval = NVN_EINVARGS;
+  }
+  else
+  {
+    Message msg;
+
+    InitMessage(&msg, UICommandStopRecording);
+    GetCommandArgs(&msg)->StopRecording.Window = window;
+    retval = Post(msg, done);
+  }
+
+  return retval;
+}
+
 int GLX::Shutdown()
 {
   int retval = NVN_NOERR;
@@ -196,6 +468,47 @@ int GLX::Shutdown()
  * Protected Members:
  ******************************************************************************/
 
+int GLX::ChargeLoopTime(int phase, double start, double renderSeconds)
+{
+  int retval = NVN_NOERR;
+
+  // Frames rendered while handling a message, such as for ReadFrame, are
+  // already timed, so only the rest of the time is charged to the windows.
+  double elapsed = MPI_Wtime() - start;
+  elapsed -= this->GetRenderSeconds() - renderSeconds;
+  if(elapsed < 0.0)
+    elapsed = 0.0;
+
+  std::list<GLWindow*>::iterator iter;
+  for(iter = _Windows.begin(); iter != _Windows.end(); iter++)
+    (*iter)->GetProfiler()->AddLoopTime(phase, elapsed);
+
+  return retval;
+}
+
+double GLX::GetRenderSeconds() const
+{
+  // Only frames drawn on the UI thread itself hold up the loop.
+  return FrameProfiler::GetThreadFrameSeconds();
+}
+
+int GLX::HandleAddLayer(UICommandArgs& args)
+{
+  return GLX::AddLayer(args.AddLayer.Target, args.AddLayer.NewLayer);
+}
+
+int GLX::HandleCreateWindow(UICommandArgs& args)
+{
+  CreateWindowArgs& a = args.CreateWindow;
+  return GLX::CreateWindow(a.Title, a.X, a.Y, a.Width, a.Height, a.Borderless,
+                           a.Window);
+}
+
+int GLX::HandleDestroyWindow(UICommandArgs& args)
+{
+  return GLX::DestroyWindow(args.DestroyWindow.Window);
+}
+
 int GLX::HandleFocusIn(XEvent event)
 {
   int retval = NVN_NOERR;
@@ -223,10 +536,133 @@ int GLX::HandleFocusOut(XEvent event)
   return retval;
 }
 
+int GLX::HandleJoinGroup(UICommandArgs& args)
+{
+  JoinGroupArgs& a = args.JoinGroup;
+  return GLX::JoinGroup(a.Window, a.Comm, a.CameraRank, a.Comp,
+                        a.HasTile ? a.Tile : 0);
+}
+
+int GLX::HandleMessage(Message& msg)
+{
+  int retval = NVN_NOERR;
+  int result = NVN_EINVTYPE;
+
+  if(msg.Command >= 0 && msg.Command < NumUICommands)
+    result = (this->*_Commands[msg.Command].Handle)(*GetCommandArgs(&msg));
+
+  if(msg.Done)
+  {
+    Complete(msg.Done, result);
+    ReleaseCompletion(msg.Done);
+  }
+
+  ReleaseCommand(msg);
+
+  return retval;
+}
+
+int GLX::HandleReadFrame(UICommandArgs& args)
+{
+  ReadFrameArgs& a = args.ReadFrame;
+  return GLX::ReadFrame(a.Window, a.RGBA, a.Len);
+}
+
+int GLX::HandleShowModel(UICommandArgs& args)
+{
+  ShowModelArgs& a = args.ShowModel;
+  return GLX::ShowModel(a.Window, a.NewModel);
+}
+
+int GLX::HandleStartRecording(UICommandArgs& args)
+{
+  StartRecordingArgs& a = args.StartRecording;
+  return GLX::StartRecording(a.Window, a.Target, a.Mode);
+}
+
+int GLX::HandleStopRecording(UICommandArgs& args)
+{
+  return GLX::StopRecording(args.StopRecording.Window);
+}
+
+int GLX::InitEGL()
+{
+  int retval = NVN_NOERR;
+  EGLint major, minor, nconfigs;
+
+  EGLint configAttrs[] =
+      {
+          EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+          EGL_RED_SIZE, 8,
+          EGL_GREEN_SIZE, 8,
+          EGL_BLUE_SIZE, 8,
+          EGL_ALPHA_SIZE, 8,
+          EGL_DEPTH_SIZE, 16,
+          EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+          EGL_NONE
+      };
+
+  // Prefer Mesa's surfaceless platform, which needs neither an X server nor
+  // a DRM device, and fall back on whatever the default display is.
+  const char* exts = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+  PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+      (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+  if(exts && strstr(exts, "EGL_MESA_platform_surfaceless") && getPlatformDisplay)
+    _EGLDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                                     EGL_DEFAULT_DISPLAY, 0);
+  else
+    _EGLDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+  if(EGL_NO_DISPLAY == _EGLDisplay ||
+     ! eglInitialize(_EGLDisplay, &major, &minor))
+  {
+    retval = NVN_EEGLFAIL;
+    fprintf(stderr, "Unable to initialize an EGL display.\n");
+  }
+  else if(! eglBindAPI(EGL_OPENGL_API))
+  {
+    retval = NVN_EEGLFAIL;
+    fprintf(stderr, "EGL implementation doesn't support desktop OpenGL.\n");
+  }
+
+  if(NVN_NOERR == retval)
+  {
+    if(! eglChooseConfig(_EGLDisplay, configAttrs, &_EGLConfig, 1, &nconfigs) ||
+       nconfigs < 1)
+    {
+      retval = NVN_EEGLFAIL;
+      fprintf(stderr, "Unable to find an appropriate EGL pbuffer config.\n");
+    }
+  }
+
+  // Without a context to share with, each window keeps its own GL objects.
+  if(NVN_NOERR == retval)
+  {
+    _EGLShareContext = eglCreateContext(_EGLDisplay, _EGLConfig,
+                                        EGL_NO_CONTEXT, 0);
+    if(EGL_NO_CONTEXT == _EGLShareContext)
+      fprintf(stderr, "Unable to create a shared EGL context.\n");
+  }
+
+  return retval;
+}
+
 int GLX::InitUIThread()
 {
   int retval = NVN_NOERR;
 
+  if(NVN_BACKEND_HEADLESS == _Backend)
+    retval = this->InitEGL();
+  else
+    retval = this->InitXDisplay();
+
+  return retval;
+}
+
+int GLX::InitXDisplay()
+{
+  int retval = NVN_NOERR;
+
   int doubleBufferVisual[] =
       {
           GLX_RGBA,
@@ -235,6 +671,10 @@ int GLX::InitUIThread()
           None
       };
 
+  // The render threads swap and make their contexts current on the same
+  // display connection that the UI thread reads events from.
+  XInitThreads();
+
   _Display = XOpenDisplay(0);
   if(! _Display)
   {
@@ -260,6 +700,14 @@ int GLX::InitUIThread()
     }
   }
 
+  // Without a context to share with, each window keeps its own GL objects.
+  if(NVN_NOERR == retval)
+  {
+    _ShareContext = glXCreateContext(_Display, _VisualInfo, 0, 1);
+    if(! _ShareContext)
+      fprintf(stderr, "Unable to create a shared GLX context.\n");
+  }
+
   return retval;
 }
 
@@ -268,13 +716,11 @@ int GLX::RunMessageLoop()
   int retval = NVN_NOERR;
 
   XEvent event;
-  Message msg;
-  int valid;
+  Message batch[QUEUE_BATCH_SIZE];
+  int nmsgs;
   GLWindow* win;
   GLWindow* prevFocus;
-  double renderStart;
-  double renderElapsed = 0.0;
-  int renderCount = 0;
+  double loopStart, renderSeconds;
   bool userModified = false;
   float prevCX, prevCY, prevRX, prevRZ, prevZoom;
   float newCX, newCY, newRX, newRZ, newZoom;
@@ -286,13 +732,16 @@ int GLX::RunMessageLoop()
   float sendbuf[6];
   float* recvbuf = (float*)malloc(6 * commsize);
 
-  _UIThreadAlive = true;
-
   while(_KeepUIThreadAlive)
   {
-    if(XPending(_Display)) // Give X11 messages highest priority, and process
-                           // all if there are any, to avoid a long queue.
+    if(_Display && XPending(_Display)) // Give X11 messages highest priority,
+                                       // and process all if there are any, to
+                                       // avoid a long queue.
     {
+      TraceScope trace("HandleXEvents", "ui");
+      loopStart = MPI_Wtime();
+      renderSeconds = this->GetRenderSeconds();
+
       prevFocus = _FocusWindow;
       if(_FocusWindow)
       {
@@ -370,43 +819,22 @@ int GLX::RunMessageLoop()
           userModified = true;
         }
       }
+
+      this->ChargeLoopTime(NVN_PHASE_EVENTS, loopStart, renderSeconds);
     }
-    else if(_UIQueue.Size > 0) // Local messages receive a lower priority
+    else if(QueueReadyP(&_UIQueue)) // Local messages receive a lower priority
     {
-      Pop(&_UIQueue, &msg, &valid);
-      if(valid)
-      {
-        int ret = NVN_NOERR;
+      TraceScope trace("HandleMessage", "ui");
+      loopStart = MPI_Wtime();
+      renderSeconds = this->GetRenderSeconds();
 
-        if(0 == strcmp("CreateWindow", msg.Message))
-        {
-          const char* title = *(const char**)msg.Arguments[0];
-          int x = *((int*)msg.Arguments[1]);
-          int y = *((int*)msg.Arguments[2]);
-          int width = *((int*)msg.Arguments[3]);
-          int height = *((int*)msg.Arguments[4]);
-          bool borderless = *((bool*)msg.Arguments[5]);
-          GLWindow** window = ((GLWindow**)msg.Arguments[6]);
-          ret = this->CreateWindow(title, x, y, width, height, borderless, window);
-
-          if(msg.Handled)
-            *msg.Handled = 1;
-        }
-        else if(0 == strcmp("DestroyWindow", msg.Message))
-        {
-          GLWindow* window = ((GLWindow*)msg.Arguments[0]);
-          ret = this->DestroyWindow(window);
-
-          if(msg.Handled)
-            *msg.Handled = 1;
-        }
+      // Take everything that is waiting in one pass, rather than going back
+      // around the loop for each message.
+      PopBatch(&_UIQueue, batch, QUEUE_BATCH_SIZE, &nmsgs);
+      for(int i = 0; i < nmsgs; i++)
+        this->HandleMessage(batch[i]);
 
-        if(msg.Result)
-          *((int*)msg.Result) = ret;
-
-        if(msg.DestroyArgs)
-          DestroyArguments(msg);
-      }
+      this->ChargeLoopTime(NVN_PHASE_QUEUE, loopStart, renderSeconds);
     }
     else
     {
@@ -441,46 +869,170 @@ int GLX::RunMessageLoop()
       std::list<GLWindow*>::iterator iter;
       for(iter = _Windows.begin(); iter != _Windows.end(); iter++)
       {
-        if((*iter)->IsDirty())
+        // Synchronized windows render in lockstep with their peers on other
+        // ranks, so they must ask the group whether to draw a frame, and are
+        // drawn right here.  Every other window draws on its own thread.
+        if((*iter)->IsSynchronized() || ! (*iter)->HasRenderThread())
         {
-          renderStart = MPI_Wtime();
+          bool render = (*iter)->IsDirty();
+          if((*iter)->IsSynchronized())
+            (*iter)->SyncFrame(&render);
 
-          (*iter)->RenderModel();
-
-          renderElapsed += MPI_Wtime() - renderStart;
-          renderCount ++;
-          if(renderCount >= 100)
-          {
-            printf("Average render time: %f s\n", renderElapsed / renderCount);
-            renderElapsed = 0.0;
-            renderCount = 0;
-          }
+          if(render)
+            (*iter)->RenderModel();
+        }
+        else if((*iter)->IsDirty())
+        {
+          (*iter)->RequestFrame();
         }
       }
     }
   }
 
-  _UIThreadAlive = false;
-
   return retval;
 }
 
 int GLX::ShutdownUIThread()
 {
   int retval = NVN_NOERR;
+  Message batch[QUEUE_BATCH_SIZE];
+  int nmsgs = 0;
+
+  // Windows that are still open stop drawing before their display goes.
+  std::list<GLWindow*>::iterator iter;
+  for(iter = _Windows.begin(); iter != _Windows.end(); iter++)
+    (*iter)->StopRenderThread();
+
+  if(_ShareContext)
+  {
+    glXDestroyContext(_Display, _ShareContext);
+    _ShareContext = 0;
+  }
+
+  if(EGL_NO_CONTEXT != _EGLShareContext)
+  {
+    eglDestroyContext(_EGLDisplay, _EGLShareContext);
+    _EGLShareContext = EGL_NO_CONTEXT;
+  }
 
   if(_Display)
   {
     XCloseDisplay(_Display);
     _Display = 0;
   }
+
+  if(EGL_NO_DISPLAY != _EGLDisplay)
+  {
+    eglTerminate(_EGLDisplay);
+    _EGLDisplay = EGL_NO_DISPLAY;
+  }
+
+  // Nothing will pop the queue from here on, so later posts are turned away,
+  // and the messages that are still waiting are finished without being
+  // carried out, which releases the threads that are waiting on them.
+  CloseQueue(&_UIQueue);
+
+  do
+  {
+    PopBatch(&_UIQueue, batch, QUEUE_BATCH_SIZE, &nmsgs);
+    for(int i = 0; i < nmsgs; i++)
+    {
+      if(batch[i].Done)
+      {
+        Complete(batch[i].Done, NVN_ENOTINIT);
+        ReleaseCompletion(batch[i].Done);
+      }
+
+      ReleaseCommand(batch[i]);
+    }
+  } while(nmsgs > 0);
+
+  _UIThreadAlive = false;
+
+  return retval;
 }
 
-void* GLX::UIThreadEntryPoint(void* arg)
+int GLX::Post(Message msg, Completion* done)
+{
+  int retval = NVN_NOERR;
+  Completion* wait = done;
+
+  // Without a completion of their own, callers sleep on a private one until
+  // the UI thread has handled the message.
+  if(done)
+    retval = StartCompletion(done);
+  else
+    retval = CreateCompletion(0, 0, &wait);
+
+  if(NVN_NOERR == retval)
+  {
+    // The UI thread releases its reference once it has completed the message.
+    RetainCompletion(wait);
+    msg.Done = wait;
+    retval = Push(&_Instance->_UIQueue, msg);
+
+    // Once the UI thread has stopped, nothing will handle the message, so its
+    // arguments and the UI thread's reference are given up here.
+    if(NVN_NOERR != retval)
+    {
+      ReleaseCommand(msg);
+      ReleaseCompletion(wait);
+      if(done)
+        Complete(done, retval);
+    }
+    else if(! done)
+    {
+      WaitCompletion(wait, -1.0, &retval);
+    }
+
+    if(! done)
+      ReleaseCompletion(wait);
+  }
+  else
+  {
+    ReleaseCommand(msg);
+  }
+
+  return retval;
+}
+
+int GLX::ReleaseCommand(Message& msg)
 {
-  if(NVN_NOERR == _Instance->InitUIThread())
+  int retval = NVN_NOERR;
+
+  if(msg.Command >= 0 && msg.Command < NumUICommands &&
+     _Commands[msg.Command].Release)
   {
-    _Instance->RunMessageLoop();
-    _Instance->ShutdownUIThread();
+    _Commands[msg.Command].Release(*GetCommandArgs(&msg));
   }
+
+  return retval;
+}
+
+void GLX::ReleaseCreateWindow(UICommandArgs& args)
+{
+  free(args.CreateWindow.Title);
+}
+
+void GLX::ReleaseStartRecording(UICommandArgs& args)
+{
+  free(args.StartRecording.Target);
+}
+
+void* GLX::UIThreadEntryPoint(void* arg)
+{
+  // The thread may start before _Instance has been assigned, so use the
+  // object that created it.
+  GLX* glx = (GLX*)arg;
+
+  Trace::SetThreadName("UI");
+
+  // Whatever part of the thread was set up is taken down again, even if it
+  // could not be set up far enough to run.
+  if(NVN_NOERR == glx->InitUIThread())
+    glx->RunMessageLoop();
+
+  glx->ShutdownUIThread();
+
+  return 0;
 }
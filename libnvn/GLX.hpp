@@ -11,8 +11,12 @@
 
 #include "communication-queue.h"
 
+#include "Compositor.hpp"
 #include "GLWindow.hpp"
+#include "UICommands.hpp"
 
+#include <EGL/egl.h>
+#include <GL/glx.h>
 #include <pthread.h>
 #include <X11/Xlib.h>
 
@@ -22,44 +26,108 @@
 /**
  * The GLX singleton object provides an interface to the X11 Glx system.  It
  * creates a UI thread that is capable of launching and managing multiple
- * GLWindows.
+ * GLWindows.  When running headless (no X server), the same UI thread drives
+ * offscreen GLWindows through an EGL pbuffer instead.
+ *
+ * The UI thread handles X events and messages, and asks the windows' render
+ * threads to draw.  Every window's context shares its GL objects with a
+ * context that is never made current, so display lists and textures that a
+ * layer builds in one window can be drawn in any other, and outlive them all.
+ *
+ * The calls that are carried out on the UI thread block their caller until
+ * they are done, unless they are given a Completion, in which case they
+ * return at once and finish the completion when they are done.  Once the UI
+ * thread has stopped, or if it could not start, they fail with NVN_ENOTINIT,
+ * except for AddLayer and ShowModel, which are then carried out directly.
  */
 class GLX
 {
 public:
+  static int AddLayer(Model* model, Layer* layer);
   static int CreateWindow(const char* title,
                           int x, int y, int width, int height,
-                          bool borderless, GLWindow** window);
-  static int DestroyWindow(GLWindow* window);
+                          bool borderless, GLWindow** window,
+                          Completion* done = 0);
+  static int DestroyWindow(GLWindow* window, Completion* done = 0);
+  static int GetBackend();
   static Display* GetDisplay();
+  static GLXContext GetShareContext();
+  static EGLConfig GetEGLConfig();
+  static EGLDisplay GetEGLDisplay();
+  static EGLContext GetEGLShareContext();
   static XVisualInfo* GetVisualInfo();
   static int Init();
+  static int Init(int backend);
   static bool IsActive(GLWindow* window);
+  static bool IsHeadless();
   static int IsInitialized();
+  static int JoinGroup(GLWindow* window, MPI_Comm comm, int camerarank,
+                       Compositor* compositor, const int tile[]);
+  static int ReadFrame(GLWindow* window, void* rgba, size_t len,
+                       Completion* done = 0);
+  static int ShowModel(GLWindow* window, Model* model);
   static int Shutdown();
+  static int StartRecording(GLWindow* window, const char* target, int mode,
+                            Completion* done = 0);
+  static int StopRecording(GLWindow* window, Completion* done = 0);
 
 protected:
-  GLX();
+  GLX(int backend);
   ~GLX();
 
 protected:
+  /**
+   * How the UI thread carries out one kind of command, and frees what its
+   * message owns afterwards, if anything.
+   */
+  struct CommandEntry
+  {
+    int (GLX::*Handle)(UICommandArgs& args);
+    void (*Release)(UICommandArgs& args);
+  };
+
+protected:
+  int ChargeLoopTime(int phase, double start, double renderSeconds);
+  double GetRenderSeconds() const;
+  int HandleAddLayer(UICommandArgs& args);
+  int HandleCreateWindow(UICommandArgs& args);
+  int HandleDestroyWindow(UICommandArgs& args);
   int HandleFocusIn(XEvent event);
   int HandleFocusOut(XEvent event);
+  int HandleJoinGroup(UICommandArgs& args);
+  int HandleMessage(Message& msg);
+  int HandleReadFrame(UICommandArgs& args);
+  int HandleShowModel(UICommandArgs& args);
+  int HandleStartRecording(UICommandArgs& args);
+  int HandleStopRecording(UICommandArgs& args);
+  int InitEGL();
   int InitUIThread();
+  int InitXDisplay();
   int RunMessageLoop();
   int ShutdownUIThread();
 
 protected:
+  static int Post(Message msg, Completion* done);
+  static int ReleaseCommand(Message& msg);
+  static void ReleaseCreateWindow(UICommandArgs& args);
+  static void ReleaseStartRecording(UICommandArgs& args);
   static void* UIThreadEntryPoint(void* arg);
 
 protected:
+  static const CommandEntry _Commands[NumUICommands];
   static GLX* _Instance;
 
 protected:
+  int _Backend;
   Display* _Display;
   XVisualInfo* _VisualInfo;
+  EGLDisplay _EGLDisplay;
+  EGLConfig _EGLConfig;
+  GLXContext _ShareContext;
+  EGLContext _EGLShareContext;
   pthread_t _UIThread;
   bool _UIThreadAlive;
+  bool _UIThreadCreated;
   bool _KeepUIThreadAlive;
   CommunicationQueue _UIQueue;
   std::list<GLWindow*> _Windows;
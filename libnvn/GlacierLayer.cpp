@@ -11,23 +11,50 @@
 #include "variant.h"
 
 #include "DataGrid.hpp"
+#include "FrameProfiler.hpp"
 #include "GlacierLayer.hpp"
+#include "Trace.hpp"
 
 #define MPICH_SKIP_MPICXX 1
 #include <mpi.h>
 
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <GL/gl.h>
 #include <GL/glu.h>
 
 
+/**
+ * The number of grid cells along each side of a separately culled block.
+ */
+#define GLACIER_BLOCK_SIZE 64
+
+/**
+ * The number of grid points in a block, and the most indices or edge
+ * vertices that a block can produce.
+ */
+#define GLACIER_BLOCK_POINTS ((GLACIER_BLOCK_SIZE + 1) * (GLACIER_BLOCK_SIZE + 1))
+#define GLACIER_BLOCK_INDICES (6 * GLACIER_BLOCK_SIZE * GLACIER_BLOCK_SIZE)
+#define GLACIER_BLOCK_EDGES (24 * GLACIER_BLOCK_SIZE * GLACIER_BLOCK_SIZE)
+#define GLACIER_BLOCK_RING ((GLACIER_BLOCK_SIZE + 2) * (GLACIER_BLOCK_SIZE + 2))
+
+/**
+ * The color of the ice surface and the water plane.
+ */
+#define GLACIER_ICE_COLOR 0xBBFFFFFF
+#define GLACIER_WATER_COLOR 0x66FF0000
+
+
 GlacierLayer::GlacierLayer(DataGrid* topg, DataGrid* usurf)
   : _TopgGrid(topg),
     _UsurfGrid(usurf),
     _Ramp(DefaultColorRamp),
-    _DisplayList(0),
-    _Compiled(false)
+    _NLandTriangles(0),
+    _NIceTriangles(0),
+    _NEdgeTriangles(0),
+    _NSkippedCells(0)
 {
   if(_TopgGrid && _UsurfGrid)
   {
@@ -64,13 +91,15 @@ GlacierLayer::~GlacierLayer()
 
 }
 
-NVN_BBox GlacierLayer::GetBounds() const
+NVN_BBox GlacierLayer::ComputeBounds() const
 {
   NVN_BBox bounds = NVN_BBoxEmpty;
 
   GridTransform transform(_ModelCrs, _TopgGrid->GetCRS());
+  float zscale = transform.GetModelUnitsPerCell() / 100.0f;
 
   MPI_Offset minpti[MAX_DIMS], maxpti[MAX_DIMS];
+  float corner1[MAX_DIMS], corner2[MAX_DIMS];
 
   minpti[XDIM] = 0;
   minpti[YDIM] = 0;
@@ -78,11 +107,19 @@ NVN_BBox GlacierLayer::GetBounds() const
   maxpti[XDIM] = _TopgGrid->GetDimLen(0) - 1;
   maxpti[YDIM] = _TopgGrid->GetDimLen(1) - 1;
 
-  transform.GridToModel(minpti, bounds.Min);
-  transform.GridToModel(maxpti, bounds.Max);
+  // A grid dimension may run against its model dimension, so the corners are
+  // sorted after they are transformed.
+  transform.GridToModel(minpti, corner1);
+  transform.GridToModel(maxpti, corner2);
+
+  for(int i = XDIM; i <= YDIM; i++)
+  {
+    bounds.Min[i] = corner1[i] < corner2[i] ? corner1[i] : corner2[i];
+    bounds.Max[i] = corner1[i] < corner2[i] ? corner2[i] : corner1[i];
+  }
 
-  bounds.Min[ZDIM] = VariantValueAsFloat(_MinVal) / 100.0f;
-  bounds.Max[ZDIM] = VariantValueAsFloat(_MaxVal) / 100.0f;
+  bounds.Min[ZDIM] = VariantValueAsFloat(_MinVal) * zscale;
+  bounds.Max[ZDIM] = VariantValueAsFloat(_MaxVal) * zscale;
 
   return bounds;
 }
@@ -95,197 +132,534 @@ const CRS& GlacierLayer::GetDataCRS() const
     return _ModelCrs;
 }
 
-int GlacierLayer::Render()
+int GlacierLayer::Probe(float x, float y, float radius,
+                        NVN_ProbeResult* result) const
 {
-  if(! _Compiled)
-  {
-    if(_DisplayList)
-    {
-      glDeleteLists(_DisplayList, 1);
-      _DisplayList = 0;
-    }
+  int retval = NVN_NOERR;
+  float model[MAX_DIMS] = { 0.0f };
+  float pos[MAX_DIMS] = { 0.0f };
+  const DataGrid* grid = _TopgGrid;
+  double value;
 
-    int datawidth = _TopgGrid->GetDimLen(0);
-    int dataheight = _TopgGrid->GetDimLen(1);
-    MPI_Offset nw[MAX_DIMS], ne[MAX_DIMS], se[MAX_DIMS], sw[MAX_DIMS];
-    MPI_Offset i[MAX_DIMS];
-    Variant value;
-    int color;
+  if(_TopgGrid && _UsurfGrid)
+  {
     GridTransform transform(_ModelCrs, _TopgGrid->GetCRS());
+    int dim0 = transform.GetGridDim(XDIM);
+    int dim1 = transform.GetGridDim(YDIM);
 
-    _DisplayList = glGenLists(1);
+    model[XDIM] = x;
+    model[YDIM] = y;
+    transform.ModelToGrid(model, pos);
 
-    glNewList(_DisplayList, GL_COMPILE);
+    // Where the ice is drawn, it hides the bed, so its surface is what the
+    // point shows.
+    if(0 == dim0 && 1 == dim1 &&
+       this->IsIceCell((MPI_Offset)floorf(pos[0]), (MPI_Offset)floorf(pos[1]), 1))
     {
-      glBegin(GL_TRIANGLES);
-      {
-        for(sw[0] = 0, se[0] = 1, ne[0] = 1, nw[0] = 0;
-            se[0] < datawidth && ne[0] < datawidth;
-            sw[0]++, se[0]++, ne[0]++, nw[0]++)
-        {
-          for(sw[1] = 0, se[1] = 0, ne[1] = 1, nw[1] = 1;
-              se[1] < dataheight && ne[1] < dataheight;
-              sw[1]++, se[1]++, ne[1]++, nw[1]++)
-          {
-            if(_TopgGrid->HasData(ne) &&
-               _TopgGrid->HasData(se) &&
-               _TopgGrid->HasData(sw) &&
-               _TopgGrid->HasData(nw))
-            {
-              this->DrawLandQuad(nw, ne, se, sw, transform);
-            }
-          }
-        }
+      grid = _UsurfGrid;
+    }
 
-        for(sw[0] = 0, se[0] = 1, ne[0] = 1, nw[0] = 0;
-            se[0] < datawidth && ne[0] < datawidth;
-            sw[0]++, se[0]++, ne[0]++, nw[0]++)
-        {
-          for(sw[1] = 0, se[1] = 0, ne[1] = 1, nw[1] = 1;
-              se[1] < dataheight && ne[1] < dataheight;
-              sw[1]++, se[1]++, ne[1]++, nw[1]++)
-          {
-            if(_UsurfGrid->HasData(ne) &&
-               _UsurfGrid->HasData(se) &&
-               _UsurfGrid->HasData(sw) &&
-               _UsurfGrid->HasData(nw))
-            {
-              this->DrawIceQuad(nw, ne, se, sw, transform);
-            }
-          }
-        }
-      }
-      glEnd();
+    if(dim0 >= 0 && dim1 >= 0 &&
+       grid->Interpolate(pos, dim0, dim1, result->Index, &value))
+    {
+      result->Layer = (NVN_Layer)(const Layer*)this;
+      result->Value = value;
     }
-    glEndList();
+  }
+
+  return retval;
+}
+
+int GlacierLayer::Render(const RenderContext& context)
+{
+  int retval = NVN_NOERR;
+  FrameProfiler* profiler = context.GetProfiler();
+  int stride = context.GetDetailStride();
+  GlacierResources* resources =
+    (GlacierResources*)this->GetResources(context);
+
+  // The water plane is built with the full mesh, which is always compiled
+  // first.  The mesh for reduced detail is kept until a frame asks for a
+  // different stride.
+  if(! resources->Compiled ||
+     (1 < stride && stride != resources->CoarseStride))
+  {
+    if(profiler)
+      profiler->Begin(NVN_PHASE_MESH);
+
+    if(! resources->Compiled)
+      this->Compile(resources, 1);
 
-    _Compiled = true;
+    if(1 < stride && stride != resources->CoarseStride)
+      this->Compile(resources, stride);
+
+    if(profiler)
+      profiler->End(NVN_PHASE_MESH);
   }
 
-  glCallList(_DisplayList);
+  if(1 < stride)
+    resources->CoarseMesh.Render(context);
+  else
+    resources->Mesh.Render(context);
 
   glEnable (GL_BLEND);
   glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-  NVN_BBox bounds = this->GetBounds();
-  int watercolor = 0x66FF0000;
-  glBegin(GL_TRIANGLES);
-  {
-    this->DrawTriangle(bounds.Min[0], bounds.Min[1], 0.0f, watercolor,
-                       bounds.Min[0], bounds.Max[1], 0.0f, watercolor,
-                       bounds.Max[0], bounds.Max[1], 0.0f, watercolor);
-    this->DrawTriangle(bounds.Max[0], bounds.Max[1], 0.0f, watercolor,
-                       bounds.Max[0], bounds.Min[1], 0.0f, watercolor,
-                       bounds.Min[0], bounds.Min[1], 0.0f, watercolor);
-  }
-  glEnd();
+  glCallList(resources->WaterList);
+
+  return retval;
 }
 
 int GlacierLayer::SetModelCRS(const CartesianCRS& crs)
 {
   int retval = NVN_NOERR;
+
+  // A render thread may be adding a share group's resources meanwhile.
+  this->LockRender();
+
   _ModelCrs = crs;
-  _Compiled = false;
+
+  for(size_t i = 0; i < _Resources.size(); i++)
+  {
+    ((GlacierResources*)_Resources[i])->Compiled = false;
+    ((GlacierResources*)_Resources[i])->CoarseStride = 0;
+  }
+
+  this->InvalidateBounds();
+  this->UnlockRender();
+
   return retval;
 }
 
-int GlacierLayer::DrawIceQuad(const MPI_Offset pt1[], const MPI_Offset pt2[],
-                              const MPI_Offset pt3[], const MPI_Offset pt4[],
-                              const GridTransform& transform) const
+int GlacierLayer::AddEdge(const float top1[], const float bottom1[],
+                          const float top2[], const float bottom2[],
+                          const float center[], BlockBuffers* buffers)
 {
   int retval = NVN_NOERR;
-  Variant v1, v2, v3, v4;
-  float p1[MAX_DIMS], p2[MAX_DIMS], p3[MAX_DIMS], p4[MAX_DIMS];
-  int color;
+  const float* corner[6] = { top1, top2, bottom2, bottom2, bottom1, top1 };
+  float normal[3];
+  float length;
+  float* pos = buffers->Edge + 3 * buffers->NEdgeVertices;
+  float* norm = buffers->EdgeNormal + 3 * buffers->NEdgeVertices;
+
+  // The wall faces straight out of the cell, away from its center.
+  normal[XDIM] = top2[YDIM] - top1[YDIM];
+  normal[YDIM] = top1[XDIM] - top2[XDIM];
+  normal[ZDIM] = 0.0f;
+  length = sqrtf(normal[XDIM] * normal[XDIM] + normal[YDIM] * normal[YDIM]);
+
+  if(length > 0.0f)
+  {
+    normal[XDIM] /= length;
+    normal[YDIM] /= length;
+  }
 
-  _UsurfGrid->GetElemAsVariant(pt1, &v1);
-  _UsurfGrid->GetElemAsVariant(pt2, &v2);
-  _UsurfGrid->GetElemAsVariant(pt3, &v3);
-  _UsurfGrid->GetElemAsVariant(pt4, &v4);
+  if(normal[XDIM] * ((top1[XDIM] + top2[XDIM]) / 2.0f - center[XDIM]) +
+     normal[YDIM] * ((top1[YDIM] + top2[YDIM]) / 2.0f - center[YDIM]) < 0.0f)
+  {
+    normal[XDIM] = -normal[XDIM];
+    normal[YDIM] = -normal[YDIM];
+  }
 
-  color = 0xBBFFFFFF;
+  for(int i = 0; i < 6; i++)
+  {
+    memcpy(pos + 3 * i, corner[i], 3 * sizeof(float));
+    memcpy(norm + 3 * i, normal, 3 * sizeof(float));
+    buffers->Mesh->ExtendBlock(corner[i]);
+  }
 
-  transform.GridToModel(pt1, p1);
-  p1[ZDIM] = VariantValueAsFloat(v1) / 100.0f;
+  buffers->NEdgeVertices += 6;
+  buffers->NEdgeTriangles += 2;
 
-  transform.GridToModel(pt2, p2);
-  p2[ZDIM] = VariantValueAsFloat(v2) / 100.0f;
+  return retval;
+}
 
-  transform.GridToModel(pt3, p3);
-  p3[ZDIM] = VariantValueAsFloat(v3) / 100.0f;
+int GlacierLayer::AddQuad(MeshBlocks* mesh, const float* pos,
+                          unsigned int k1, unsigned int k2,
+                          unsigned int k3, unsigned int k4,
+                          unsigned int* index, int* nindices)
+{
+  int retval = NVN_NOERR;
+  unsigned int* out = index + *nindices;
 
-  transform.GridToModel(pt4, p4);
-  p4[ZDIM] = VariantValueAsFloat(v4) / 100.0f;
+  mesh->ExtendBlock(pos + 3 * k1);
+  mesh->ExtendBlock(pos + 3 * k2);
+  mesh->ExtendBlock(pos + 3 * k3);
+  mesh->ExtendBlock(pos + 3 * k4);
 
-  if(fabs(p1[ZDIM] - p3[ZDIM]) < fabs(p2[ZDIM] - p4[ZDIM]))
+  // Split the quad along the diagonal with the smaller change in height.
+  if(fabs(pos[3 * k1 + ZDIM] - pos[3 * k3 + ZDIM]) <
+     fabs(pos[3 * k2 + ZDIM] - pos[3 * k4 + ZDIM]))
   {
-    this->DrawTriangle(p1[XDIM], p1[YDIM], p1[ZDIM], color,
-                       p2[XDIM], p2[YDIM], p2[ZDIM], color,
-                       p3[XDIM], p3[YDIM], p3[ZDIM], color);
-    this->DrawTriangle(p3[XDIM], p3[YDIM], p3[ZDIM], color,
-                       p4[XDIM], p4[YDIM], p4[ZDIM], color,
-                       p1[XDIM], p1[YDIM], p1[ZDIM], color);
+    out[0] = k1;  out[1] = k2;  out[2] = k3;
+    out[3] = k3;  out[4] = k4;  out[5] = k1;
   }
   else
   {
-    this->DrawTriangle(p2[XDIM], p2[YDIM], p2[ZDIM], color,
-                       p3[XDIM], p3[YDIM], p3[ZDIM], color,
-                       p4[XDIM], p4[YDIM], p4[ZDIM], color);
-    this->DrawTriangle(p4[XDIM], p4[YDIM], p4[ZDIM], color,
-                       p1[XDIM], p1[YDIM], p1[ZDIM], color,
-                       p2[XDIM], p2[YDIM], p2[ZDIM], color);
+    out[0] = k2;  out[1] = k3;  out[2] = k4;
+    out[3] = k4;  out[4] = k1;  out[5] = k2;
   }
 
+  *nindices += 6;
+
   return retval;
 }
 
-int GlacierLayer::DrawLandQuad(const MPI_Offset pt1[], const MPI_Offset pt2[],
-                               const MPI_Offset pt3[], const MPI_Offset pt4[],
-                               const GridTransform& transform) const
+int GlacierLayer::Compile(GlacierResources* resources, int stride)
 {
   int retval = NVN_NOERR;
-  Variant v1, v2, v3, v4;
-  float p1[MAX_DIMS], p2[MAX_DIMS], p3[MAX_DIMS], p4[MAX_DIMS];
-  int c1, c2, c3, c4;
+  TraceScope trace("GlacierLayer::Compile", "mesh");
+  int datawidth = _TopgGrid->GetDimLen(0);
+  int dataheight = _TopgGrid->GetDimLen(1);
+  MPI_Offset bx, by, xend, yend;
+  MPI_Offset ncellsx, ncellsy;
+  GridTransform transform(_ModelCrs, _TopgGrid->GetCRS());
+  float zscale = transform.GetModelUnitsPerCell() / 100.0f;
+  BlockBuffers buffers;
+
+  buffers.Land = (float*)malloc(3 * GLACIER_BLOCK_POINTS * sizeof(float));
+  buffers.LandNormal = (float*)malloc(3 * GLACIER_BLOCK_POINTS * sizeof(float));
+  buffers.LandColor = (unsigned char*)malloc(4 * GLACIER_BLOCK_POINTS);
+  buffers.LandIndex = (unsigned int*)malloc(GLACIER_BLOCK_INDICES * sizeof(unsigned int));
+  buffers.Ice = (float*)malloc(3 * GLACIER_BLOCK_POINTS * sizeof(float));
+  buffers.IceNormal = (float*)malloc(3 * GLACIER_BLOCK_POINTS * sizeof(float));
+  buffers.IceIndex = (unsigned int*)malloc(GLACIER_BLOCK_INDICES * sizeof(unsigned int));
+  buffers.Edge = (float*)malloc(3 * GLACIER_BLOCK_EDGES * sizeof(float));
+  buffers.EdgeNormal = (float*)malloc(3 * GLACIER_BLOCK_EDGES * sizeof(float));
+  buffers.IceCell = (bool*)malloc(GLACIER_BLOCK_RING * sizeof(bool));
+
+  buffers.Mesh = 1 == stride ? &resources->Mesh : &resources->CoarseMesh;
+  buffers.Stride = stride;
+  buffers.NLandTriangles = 0;
+  buffers.NIceTriangles = 0;
+  buffers.NEdgeTriangles = 0;
+  buffers.NSkippedCells = 0;
+
+  buffers.Mesh->Clear();
+
+  // A coarse mesh takes every stride'th grid point, and the last cell along
+  // each dimension is cut short so that the mesh still reaches the edge of
+  // the grid.  Blocks are counted in these cells.
+  ncellsx = (datawidth - 2 + stride) / stride;
+  ncellsy = (dataheight - 2 + stride) / stride;
+
+  // Land and ice are compiled together in square blocks of cells, so that
+  // only the blocks inside the view frustum need to be drawn.
+  for(bx = 0; bx < ncellsx; bx += GLACIER_BLOCK_SIZE)
+  {
+    xend = MIN(bx + GLACIER_BLOCK_SIZE, ncellsx);
+
+    for(by = 0; by < ncellsy; by += GLACIER_BLOCK_SIZE)
+    {
+      yend = MIN(by + GLACIER_BLOCK_SIZE, ncellsy);
+      this->CompileBlock(bx, by, xend, yend, transform, zscale, &buffers);
+    }
+  }
 
-  _TopgGrid->GetElemAsVariant(pt1, &v1);
-  _TopgGrid->GetElemAsVariant(pt2, &v2);
-  _TopgGrid->GetElemAsVariant(pt3, &v3);
-  _TopgGrid->GetElemAsVariant(pt4, &v4);
+  if(1 == stride)
+    this->CompileWater(resources);
+
+  free(buffers.Land);
+  free(buffers.LandNormal);
+  free(buffers.LandColor);
+  free(buffers.LandIndex);
+  free(buffers.Ice);
+  free(buffers.IceNormal);
+  free(buffers.IceIndex);
+  free(buffers.Edge);
+  free(buffers.EdgeNormal);
+  free(buffers.IceCell);
+
+  if(1 == stride)
+  {
+    _NLandTriangles = buffers.NLandTriangles;
+    _NIceTriangles = buffers.NIceTriangles;
+    _NEdgeTriangles = buffers.NEdgeTriangles;
+    _NSkippedCells = buffers.NSkippedCells;
+    resources->Compiled = true;
+  }
+  else
+  {
+    resources->CoarseStride = stride;
+  }
 
-  c1 = GetColor(_Ramp, v1, _MinVal, _MaxVal);
-  c2 = GetColor(_Ramp, v2, _MinVal, _MaxVal);
-  c3 = GetColor(_Ramp, v3, _MinVal, _MaxVal);
-  c4 = GetColor(_Ramp, v4, _MinVal, _MaxVal);
+  return retval;
+}
 
-  transform.GridToModel(pt1, p1);
-  p1[ZDIM] = VariantValueAsFloat(v1) / 100.0f;
+int GlacierLayer::CompileBlock(MPI_Offset bx, MPI_Offset by,
+                               MPI_Offset xend, MPI_Offset yend,
+                               const GridTransform& transform, float zscale,
+                               BlockBuffers* buffers)
+{
+  int retval = NVN_NOERR;
+  int stride = buffers->Stride;
+  int ni = xend - bx + 1;
+  int nj = yend - by + 1;
+  float xs[GLACIER_BLOCK_SIZE + 1], ys[GLACIER_BLOCK_SIZE + 1];
+  float* row[MAX_DIMS] = { 0 };
+  float pos[MAX_DIMS] = { 0.0f };
+  MPI_Offset pt[MAX_DIMS];
+  MPI_Offset px[GLACIER_BLOCK_SIZE + 1], py[GLACIER_BLOCK_SIZE + 1];
+  unsigned int nw, ne, se, sw;
+  bool* icecell;
+  float center[3];
+  int color;
 
-  transform.GridToModel(pt2, p2);
-  p2[ZDIM] = VariantValueAsFloat(v2) / 100.0f;
+  row[XDIM] = xs;
+  row[YDIM] = ys;
 
-  transform.GridToModel(pt3, p3);
-  p3[ZDIM] = VariantValueAsFloat(v3) / 100.0f;
+  buffers->NLandIndices = 0;
+  buffers->NIceIndices = 0;
+  buffers->NEdgeVertices = 0;
 
-  transform.GridToModel(pt4, p4);
-  p4[ZDIM] = VariantValueAsFloat(v4) / 100.0f;
+  // The grid points that the points of the block sit on.
+  for(int i = 0; i < ni; i++)
+    px[i] = MIN((bx + i) * stride, _TopgGrid->GetDimLen(0) - 1);
+  for(int j = 0; j < nj; j++)
+    py[j] = MIN((by + j) * stride, _TopgGrid->GetDimLen(1) - 1);
 
-  if(fabs(p1[ZDIM] - p3[ZDIM]) < fabs(p2[ZDIM] - p4[ZDIM]))
+  // Fill in the vertices for every grid point in the block.  Land without
+  // data sits at sea level, and ice without data sits on the land.
+  for(int i = 0; i < ni; i++)
   {
-    this->DrawTriangle(p1[XDIM], p1[YDIM], p1[ZDIM], c1,
-                       p2[XDIM], p2[YDIM], p2[ZDIM], c2,
-                       p3[XDIM], p3[YDIM], p3[ZDIM], c3);
-    this->DrawTriangle(p3[XDIM], p3[YDIM], p3[ZDIM], c3,
-                       p4[XDIM], p4[YDIM], p4[ZDIM], c4,
-                       p1[XDIM], p1[YDIM], p1[ZDIM], c1);
+    pt[0] = px[i];
+    pt[1] = py[0];
+
+    // A coarse column skips points, so it is transformed one at a time.
+    if(1 == stride)
+    {
+      transform.GridRowToModel(pt, 1, nj, row);
+    }
+    else
+    {
+      for(int j = 0; j < nj; j++)
+      {
+        pt[1] = py[j];
+        transform.GridToModel(pt, pos);
+        xs[j] = pos[XDIM];
+        ys[j] = pos[YDIM];
+      }
+    }
+
+    for(int j = 0; j < nj; j++)
+    {
+      float* land = buffers->Land + 3 * (i * nj + j);
+      float* ice = buffers->Ice + 3 * (i * nj + j);
+      unsigned char* rgba = buffers->LandColor + 4 * (i * nj + j);
+
+      pt[1] = py[j];
+
+      land[XDIM] = ice[XDIM] = xs[j];
+      land[YDIM] = ice[YDIM] = ys[j];
+      land[ZDIM] = 0.0f;
+
+      if(_TopgGrid->HasData(pt))
+      {
+        Variant value;
+        _TopgGrid->GetElemAsVariant(pt, &value);
+        land[ZDIM] = VariantValueAsFloat(value) * zscale;
+        color = GetColor(_Ramp, value, _MinVal, _MaxVal);
+        rgba[0] = GetR(color);  rgba[1] = GetG(color);
+        rgba[2] = GetB(color);  rgba[3] = GetA(color);
+        this->ComputeNormal(_TopgGrid, pt, transform, zscale,
+                            buffers->LandNormal + 3 * (i * nj + j));
+      }
+
+      ice[ZDIM] = land[ZDIM];
+
+      if(_UsurfGrid->HasData(pt))
+      {
+        ice[ZDIM] = this->GetHeight(_UsurfGrid, pt) * zscale;
+        this->ComputeNormal(_UsurfGrid, pt, transform, zscale,
+                            buffers->IceNormal + 3 * (i * nj + j));
+      }
+    }
   }
-  else
+
+  // Classify the cells of the block, and the cells just outside of it, once,
+  // since each cell is checked again by all of its neighbors.
+  for(int i = -1; i < ni; i++)
   {
-    this->DrawTriangle(p2[XDIM], p2[YDIM], p2[ZDIM], c2,
-                       p3[XDIM], p3[YDIM], p3[ZDIM], c3,
-                       p4[XDIM], p4[YDIM], p4[ZDIM], c4);
-    this->DrawTriangle(p4[XDIM], p4[YDIM], p4[ZDIM], c4,
-                       p1[XDIM], p1[YDIM], p1[ZDIM], c1,
-                       p2[XDIM], p2[YDIM], p2[ZDIM], c2);
+    for(int j = -1; j < nj; j++)
+      buffers->IceCell[(i + 1) * (nj + 1) + j + 1] =
+        this->IsIceCell(bx + i, by + j, stride);
+  }
+
+  icecell = buffers->IceCell + (nj + 1) + 1;
+
+  // Then walk the cells once, building the land and ice surfaces and the walls
+  // around the edges of the ice.  The block is opened first so that it can
+  // collect the bounds of everything that goes into it.
+  buffers->Mesh->BeginBlock();
+
+  for(int i = 0; i < ni - 1; i++)
+  {
+    for(int j = 0; j < nj - 1; j++)
+    {
+      MPI_Offset corner[4][MAX_DIMS] =
+        { { px[i], py[j + 1] }, { px[i + 1], py[j + 1] },
+          { px[i + 1], py[j] }, { px[i], py[j] } };
+
+      nw = i * nj + j + 1;
+      ne = (i + 1) * nj + j + 1;
+      se = (i + 1) * nj + j;
+      sw = i * nj + j;
+
+      if(_TopgGrid->HasData(corner[0]) && _TopgGrid->HasData(corner[1]) &&
+         _TopgGrid->HasData(corner[2]) && _TopgGrid->HasData(corner[3]))
+      {
+        this->AddQuad(buffers->Mesh, buffers->Land, nw, ne, se, sw,
+                      buffers->LandIndex, &buffers->NLandIndices);
+        buffers->NLandTriangles += 2;
+      }
+
+      if(icecell[i * (nj + 1) + j])
+      {
+        const float* ice = buffers->Ice;
+        const float* land = buffers->Land;
+
+        this->AddQuad(buffers->Mesh, ice, nw, ne, se, sw,
+                      buffers->IceIndex, &buffers->NIceIndices);
+        buffers->NIceTriangles += 2;
+
+        center[XDIM] = (ice[3 * nw + XDIM] + ice[3 * se + XDIM]) / 2.0f;
+        center[YDIM] = (ice[3 * nw + YDIM] + ice[3 * se + YDIM]) / 2.0f;
+        center[ZDIM] = 0.0f;
+
+        if(! icecell[(i - 1) * (nj + 1) + j])
+          this->AddEdge(ice + 3 * sw, land + 3 * sw, ice + 3 * nw, land + 3 * nw,
+                        center, buffers);
+        if(! icecell[(i + 1) * (nj + 1) + j])
+          this->AddEdge(ice + 3 * se, land + 3 * se, ice + 3 * ne, land + 3 * ne,
+                        center, buffers);
+        if(! icecell[i * (nj + 1) + j - 1])
+          this->AddEdge(ice + 3 * sw, land + 3 * sw, ice + 3 * se, land + 3 * se,
+                        center, buffers);
+        if(! icecell[i * (nj + 1) + j + 1])
+          this->AddEdge(ice + 3 * nw, land + 3 * nw, ice + 3 * ne, land + 3 * ne,
+                        center, buffers);
+      }
+      else if(_UsurfGrid->HasData(corner[0]) && _UsurfGrid->HasData(corner[1]) &&
+              _UsurfGrid->HasData(corner[2]) && _UsurfGrid->HasData(corner[3]))
+      {
+        buffers->NSkippedCells++;
+      }
+    }
+  }
+
+  // The arrays are copied into the display list when it is compiled, so they
+  // can be reused for the next block straight away.
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_NORMAL_ARRAY);
+
+  if(buffers->NLandIndices > 0)
+  {
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(3, GL_FLOAT, 0, buffers->Land);
+    glNormalPointer(GL_FLOAT, 0, buffers->LandNormal);
+    glColorPointer(4, GL_UNSIGNED_BYTE, 0, buffers->LandColor);
+    glDrawElements(GL_TRIANGLES, buffers->NLandIndices, GL_UNSIGNED_INT,
+                   buffers->LandIndex);
+    glDisableClientState(GL_COLOR_ARRAY);
+  }
+
+  color = GLACIER_ICE_COLOR;
+  glColor4ub(GetR(color), GetG(color), GetB(color), GetA(color));
+
+  if(buffers->NIceIndices > 0)
+  {
+    glVertexPointer(3, GL_FLOAT, 0, buffers->Ice);
+    glNormalPointer(GL_FLOAT, 0, buffers->IceNormal);
+    glDrawElements(GL_TRIANGLES, buffers->NIceIndices, GL_UNSIGNED_INT,
+                   buffers->IceIndex);
+  }
+
+  if(buffers->NEdgeVertices > 0)
+  {
+    glVertexPointer(3, GL_FLOAT, 0, buffers->Edge);
+    glNormalPointer(GL_FLOAT, 0, buffers->EdgeNormal);
+    glDrawArrays(GL_TRIANGLES, 0, buffers->NEdgeVertices);
+  }
+
+  glDisableClientState(GL_NORMAL_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  buffers->Mesh->EndBlock();
+
+  return retval;
+}
+
+int GlacierLayer::CompileWater(GlacierResources* resources)
+{
+  int retval = NVN_NOERR;
+  NVN_BBox bounds = this->GetBounds();
+  int watercolor = GLACIER_WATER_COLOR;
+
+  if(resources->WaterList)
+    glDeleteLists(resources->WaterList, 1);
+
+  resources->WaterList = glGenLists(1);
+  glNewList(resources->WaterList, GL_COMPILE);
+  glBegin(GL_TRIANGLES);
+  {
+    this->DrawTriangle(bounds.Min[0], bounds.Min[1], 0.0f, watercolor,
+                       bounds.Min[0], bounds.Max[1], 0.0f, watercolor,
+                       bounds.Max[0], bounds.Max[1], 0.0f, watercolor);
+    this->DrawTriangle(bounds.Max[0], bounds.Max[1], 0.0f, watercolor,
+                       bounds.Max[0], bounds.Min[1], 0.0f, watercolor,
+                       bounds.Min[0], bounds.Min[1], 0.0f, watercolor);
+  }
+  glEnd();
+  glEndList();
+
+  return retval;
+}
+
+int GlacierLayer::ComputeNormal(const DataGrid* grid, const MPI_Offset pt[],
+                                const GridTransform& transform, float zscale,
+                                float normal[]) const
+{
+  int retval = NVN_NOERR;
+  MPI_Offset lo[MAX_DIMS], hi[MAX_DIMS];
+  float plo[MAX_DIMS], phi[MAX_DIMS];
+  float t[2][3];
+  float length;
+
+  // Central differences along each grid dimension, falling back to one side
+  // at the edges of the grid and the data.
+  for(int d = 0; d < 2; d++)
+  {
+    memcpy(lo, pt, 2 * sizeof(MPI_Offset));
+    memcpy(hi, pt, 2 * sizeof(MPI_Offset));
+    lo[d]--;
+    hi[d]++;
+
+    if(lo[d] < 0 || ! grid->HasData(lo))
+      lo[d] = pt[d];
+    if(hi[d] >= grid->GetDimLen(d) || ! grid->HasData(hi))
+      hi[d] = pt[d];
+
+    transform.GridToModel(lo, plo);
+    transform.GridToModel(hi, phi);
+    plo[ZDIM] = this->GetHeight(grid, lo) * zscale;
+    phi[ZDIM] = this->GetHeight(grid, hi) * zscale;
+
+    for(int i = 0; i < 3; i++)
+      t[d][i] = phi[i] - plo[i];
+  }
+
+  // The normal is oriented the same way as the faces of the quads, which are
+  // wound from the first grid dimension towards the second.
+  normal[XDIM] = t[1][YDIM] * t[0][ZDIM] - t[1][ZDIM] * t[0][YDIM];
+  normal[YDIM] = t[1][ZDIM] * t[0][XDIM] - t[1][XDIM] * t[0][ZDIM];
+  normal[ZDIM] = t[1][XDIM] * t[0][YDIM] - t[1][YDIM] * t[0][XDIM];
+
+  length = sqrtf(normal[XDIM] * normal[XDIM] +
+                 normal[YDIM] * normal[YDIM] +
+                 normal[ZDIM] * normal[ZDIM]);
+
+  if(length > 0.0f)
+  {
+    for(int i = 0; i < 3; i++)
+      normal[i] /= length;
   }
 
   return retval;
@@ -315,4 +689,43 @@ int GlacierLayer::DrawTriangle(float x1, float y1, float z1, int c1,
 
   glColor4ub(GetR(c3), GetG(c3), GetB(c3), GetA(c3));
   glVertex3f(x3, y3, z3);
+
+  return retval;
+}
+
+float GlacierLayer::GetHeight(const DataGrid* grid, const MPI_Offset pt[]) const
+{
+  Variant value;
+  grid->GetElemAsVariant(pt, &value);
+  return VariantValueAsFloat(value);
+}
+
+bool GlacierLayer::IsIceCell(MPI_Offset i, MPI_Offset j, int stride) const
+{
+  bool retval = false;
+  MPI_Offset width = _UsurfGrid->GetDimLen(0);
+  MPI_Offset height = _UsurfGrid->GetDimLen(1);
+  MPI_Offset x0 = i * stride, y0 = j * stride;
+  MPI_Offset x1 = MIN(x0 + stride, width - 1);
+  MPI_Offset y1 = MIN(y0 + stride, height - 1);
+  MPI_Offset corner[4][MAX_DIMS] =
+    { { x0, y0 }, { x1, y0 }, { x1, y1 }, { x0, y1 } };
+
+  // Cells are counted in steps of the stride, and the last one along each
+  // dimension is cut short at the edge of the grid.  A cell is ice if it has
+  // a surface at every corner and some thickness at one of them.  Where
+  // there is no land under the ice, it is all thickness.
+  if(i >= 0 && j >= 0 && x0 < width - 1 && y0 < height - 1 &&
+     _UsurfGrid->HasData(corner[0]) && _UsurfGrid->HasData(corner[1]) &&
+     _UsurfGrid->HasData(corner[2]) && _UsurfGrid->HasData(corner[3]))
+  {
+    for(int k = 0; ! retval && k < 4; k++)
+    {
+      retval = ! _TopgGrid->HasData(corner[k]) ||
+        this->GetHeight(_UsurfGrid, corner[k]) >
+        this->GetHeight(_TopgGrid, corner[k]);
+    }
+  }
+
+  return retval;
 }
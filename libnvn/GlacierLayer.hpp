@@ -15,6 +15,7 @@
 
 #include "GridTransform.hpp"
 #include "Layer.hpp"
+#include "MeshBlocks.hpp"
 
 
 class DataGrid;
@@ -28,24 +29,105 @@ public:
 public:
   ColorRamp& Ramp() { return _Ramp; }
 
+  /**
+   * The number of land, ice and edge triangles in the mesh, once it has been
+   * compiled.
+   */
+  int GetNTriangles() const
+  { return _NLandTriangles + _NIceTriangles + _NEdgeTriangles; }
+
+  /**
+   * The number of cells without ice that were left out of the ice mesh.
+   */
+  int GetNSkippedCells() const { return _NSkippedCells; }
+
 public:
-  virtual NVN_BBox GetBounds() const;
   virtual const CRS& GetDataCRS() const;
 
 public:
-  virtual int Render();
+  virtual int Probe(float x, float y, float radius,
+                    NVN_ProbeResult* result) const;
+  virtual int Render(const RenderContext& context);
   virtual int SetModelCRS(const CartesianCRS& crs);
 
 protected:
-  int DrawIceQuad(const MPI_Offset pt1[], const MPI_Offset pt2[],
-                  const MPI_Offset pt3[], const MPI_Offset pt4[],
-                  const GridTransform& transform) const;
-  int DrawLandQuad(const MPI_Offset pt1[], const MPI_Offset pt2[],
-                   const MPI_Offset pt3[], const MPI_Offset pt4[],
-                   const GridTransform& transform) const;
+  virtual NVN_BBox ComputeBounds() const;
+  virtual LayerResources* CreateResources(int sharegroup) const
+  { return new GlacierResources(sharegroup); }
+
+protected:
+  /**
+   * The meshes and water plane that one share group draws.
+   */
+  struct GlacierResources : public LayerResources
+  {
+    GlacierResources(int sharegroup)
+      : LayerResources(sharegroup), WaterList(0), Compiled(false),
+        CoarseStride(0) {}
+
+    MeshBlocks Mesh;
+    unsigned int WaterList;
+    bool Compiled;
+    MeshBlocks CoarseMesh;          // Drawn at reduced detail
+    int CoarseStride;               // The stride of CoarseMesh, or 0
+  };
+
+  /**
+   * Scratch space for compiling one block of the mesh.  The land and ice
+   * vertices of a block are stored per grid point, and the x/y position of
+   * each point is computed once and shared by the land, ice and edge vertices
+   * that sit on it.  The triangle counts are totals over every block.
+   */
+  struct BlockBuffers
+  {
+    MeshBlocks* Mesh;
+    int Stride;         // Grid points between the points of the mesh
+
+    float* Land;
+    float* LandNormal;
+    unsigned char* LandColor;
+    unsigned int* LandIndex;
+    int NLandIndices;
+
+    float* Ice;
+    float* IceNormal;
+    unsigned int* IceIndex;
+    int NIceIndices;
+
+    float* Edge;
+    float* EdgeNormal;
+    int NEdgeVertices;
+
+    bool* IceCell;      // For the cells of the block and the ring around it
+
+    int NLandTriangles;
+    int NIceTriangles;
+    int NEdgeTriangles;
+    int NSkippedCells;
+  };
+
+protected:
+  int AddEdge(const float top1[], const float bottom1[],
+              const float top2[], const float bottom2[],
+              const float center[], BlockBuffers* buffers);
+  int AddQuad(MeshBlocks* mesh, const float* pos,
+              unsigned int k1, unsigned int k2,
+              unsigned int k3, unsigned int k4,
+              unsigned int* index, int* nindices);
+  int Compile(GlacierResources* resources, int stride);
+  int CompileBlock(MPI_Offset bx, MPI_Offset by,
+                   MPI_Offset xend, MPI_Offset yend,
+                   const GridTransform& transform, float zscale,
+                   BlockBuffers* buffers);
+  int CompileWater(GlacierResources* resources);
+  int ComputeNormal(const DataGrid* grid, const MPI_Offset pt[],
+                    const GridTransform& transform, float zscale,
+                    float normal[]) const;
   int DrawTriangle(float x1, float y1, float z1, int c1,
                    float x2, float y2, float z2, int c2,
                    float x3, float y3, float z3, int c3) const;
+  float GetHeight(const DataGrid* grid, const MPI_Offset pt[]) const;
+  bool IsIceCell(MPI_Offset i, MPI_Offset j, int stride) const;
 
 protected:
   DataGrid* _TopgGrid;
@@ -53,8 +135,11 @@ protected:
   Variant _MinVal;
   Variant _MaxVal;
   ColorRamp _Ramp;
-  unsigned int _DisplayList;
-  bool _Compiled;
+
+  int _NLandTriangles;
+  int _NIceTriangles;
+  int _NEdgeTriangles;
+  int _NSkippedCells;   // Cells with ice data but no ice thickness
 };
 
 #endif
@@ -11,22 +11,63 @@
 GridCRS::GridCRS(int ndims)
   : CRS(ndims)
 {
-
+  this->ResetAffine();
 }
 
 GridCRS::GridCRS(int ndims, const char dimname[][MAX_NAME])
   : CRS(ndims, dimname)
 {
-
+  this->ResetAffine();
 }
 
 GridCRS::GridCRS(const GridCRS& other)
   : CRS(other)
 {
-
+  memcpy(_DimScale, other._DimScale, sizeof(_DimScale));
+  memcpy(_DimOffset, other._DimOffset, sizeof(_DimOffset));
 }
 
 GridCRS::~GridCRS()
 {
 
 }
+
+double GridCRS::GetDimOffset(int dim) const
+{
+  return dim >= 0 && dim < MAX_DIMS ? _DimOffset[dim] : 0.0;
+}
+
+double GridCRS::GetDimScale(int dim) const
+{
+  return dim >= 0 && dim < MAX_DIMS ? _DimScale[dim] : 1.0;
+}
+
+int GridCRS::SetDimAffine(int dim, double scale, double offset)
+{
+  int retval = NVN_NOERR;
+
+  if(dim >= 0 && dim < MAX_DIMS && scale != 0.0)
+  {
+    _DimScale[dim] = scale;
+    _DimOffset[dim] = offset;
+  }
+  else
+  {
+    retval = NVN_EINVARGS;
+  }
+
+  return retval;
+}
+
+int GridCRS::ResetAffine()
+{
+  int retval = NVN_NOERR;
+
+  for(int i = 0; i < MAX_DIMS; i++)
+  {
+    _DimScale[i] = 1.0;
+    _DimOffset[i] = 0.0;
+  }
+
+  return retval;
+}
@@ -12,6 +12,10 @@
 /**
   A GridCRS represents the coordinate system for a n-dimensional regular
   rectangular grid.  Positions in the grid are indexed with integers.
+
+  Each dimension may also carry an affine mapping from grid indices to the
+  real-world coordinate along that dimension, coord = offset + scale * index.
+  By default the mapping is the identity.
 */
 class GridCRS : public CRS
 {
@@ -21,8 +25,17 @@ public:
   GridCRS(const GridCRS& other);
   ~GridCRS();
 
+public:
+  double GetDimOffset(int dim) const;
+  double GetDimScale(int dim) const;
+  int SetDimAffine(int dim, double scale, double offset);
+
 protected:
+  int ResetAffine();
 
+protected:
+  double _DimScale[MAX_DIMS];
+  double _DimOffset[MAX_DIMS];
 };
 
 #endif
@@ -8,12 +8,35 @@
 
 #include <math.h>
 
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
 
 GridTransform::GridTransform(const CRS& basecrs, const GridCRS& gridcrs)
-  : _BaseCRS(basecrs),
-    _GridCRS(gridcrs)
+  : _GridNDims(gridcrs.GetNDims()),
+    _BaseNDims(basecrs.GetNDims())
 {
+  char dimname[MAX_NAME];
+
+  for(int i = 0; i < MAX_DIMS; i++)
+  {
+    _BaseDim[i] = -1;
+    _GridDim[i] = -1;
+    _Scale[i] = 1.0f;
+    _Offset[i] = 0.0f;
+  }
+
+  for(int i = 0; i < _GridNDims; i++)
+  {
+    gridcrs.GetDimName(i, dimname);
+    _BaseDim[i] = basecrs.FindDim(dimname);
+    _Scale[i] = (float)gridcrs.GetDimScale(i);
+    _Offset[i] = (float)gridcrs.GetDimOffset(i);
 
+    if(_BaseDim[i] >= 0)
+      _GridDim[_BaseDim[i]] = i;
+  }
 }
 
 GridTransform::~GridTransform()
@@ -21,17 +44,83 @@ GridTransform::~GridTransform()
 
 }
 
+float GridTransform::GetModelUnitsPerCell() const
+{
+  float retval = 1.0f;
+  float total = 0.0f;
+  int n = 0;
+
+  for(int i = 0; i < _GridNDims; i++)
+  {
+    if(_BaseDim[i] >= 0)
+    {
+      total += fabsf(_Scale[i]);
+      n++;
+    }
+  }
+
+  if(n > 0)
+    retval = total / n;
+
+  return retval;
+}
+
 int GridTransform::GridToModel(const MPI_Offset posin[], float posout[]) const
 {
   int retval = NVN_NOERR;
-  char dimname[MAX_NAME];
 
-  for(int i = 0; i < _GridCRS.GetNDims(); i++)
+  for(int i = 0; i < _GridNDims; i++)
   {
-    _GridCRS.GetDimName(i, dimname);
-    int basedim = _BaseCRS.FindDim(dimname);
-    if(basedim >= 0)
-      posout[basedim] = (float)posin[i];
+    if(_BaseDim[i] >= 0)
+      posout[_BaseDim[i]] = _Offset[i] + _Scale[i] * (float)posin[i];
+  }
+
+  return retval;
+}
+
+int GridTransform::GridRowToModel(const MPI_Offset start[], int griddim, int n,
+                                  float* posout[]) const
+{
+  int retval = NVN_NOERR;
+
+  if(griddim < 0 || griddim >= _GridNDims || n < 0)
+    retval = NVN_EINVARGS;
+
+  for(int i = 0; NVN_NOERR == retval && i < _GridNDims; i++)
+  {
+    int basedim = _BaseDim[i];
+    float* out = basedim >= 0 ? posout[basedim] : 0;
+    float scale = _Scale[i];
+    float offset = _Offset[i];
+    int k = 0;
+
+    if(out && i == griddim)
+    {
+      // Indices are stepped in float, which is exact as long as they stay
+      // below 2^24, so the vector and scalar paths give the same answer.
+#ifdef __SSE__
+      __m128 vscale = _mm_set1_ps(scale);
+      __m128 voffset = _mm_set1_ps(offset);
+      __m128 vstep = _mm_set1_ps(4.0f);
+      __m128 vindex = _mm_setr_ps((float)start[i], (float)(start[i] + 1),
+                                  (float)(start[i] + 2), (float)(start[i] + 3));
+
+      for(; k + 4 <= n; k += 4)
+      {
+        _mm_storeu_ps(out + k, _mm_add_ps(voffset, _mm_mul_ps(vscale, vindex)));
+        vindex = _mm_add_ps(vindex, vstep);
+      }
+#endif
+
+      for(; k < n; k++)
+        out[k] = offset + scale * (float)(start[i] + k);
+    }
+    else if(out)
+    {
+      float value = offset + scale * (float)start[i];
+      for(; k < n; k++)
+        out[k] = value;
+    }
   }
 
   return retval;
@@ -40,14 +129,12 @@ int GridTransform::GridToModel(const MPI_Offset posin[], float posout[]) const
 int GridTransform::ModelToGrid(const float posin[], float posout[]) const
 {
   int retval = NVN_NOERR;
-  char dimname[MAX_NAME];
 
-  for(int i = 0; i < _BaseCRS.GetNDims(); i++)
+  for(int i = 0; i < _BaseNDims; i++)
   {
-    _BaseCRS.GetDimName(i, dimname);
-    int griddim = _GridCRS.FindDim(dimname);
+    int griddim = _GridDim[i];
     if(griddim >= 0)
-      posout[griddim] = posin[i];
+      posout[griddim] = (posin[i] - _Offset[griddim]) / _Scale[griddim];
   }
 
   return retval;
@@ -56,14 +143,12 @@ int GridTransform::ModelToGrid(const float posin[], float posout[]) const
 int GridTransform::ModelToGrid(const float posin[], MPI_Offset posout[]) const
 {
   int retval = NVN_NOERR;
-  char dimname[MAX_NAME];
 
-  for(int i = 0; i < _BaseCRS.GetNDims(); i++)
+  for(int i = 0; i < _BaseNDims; i++)
   {
-    _BaseCRS.GetDimName(i, dimname);
-    int griddim = _GridCRS.FindDim(dimname);
+    int griddim = _GridDim[i];
     if(griddim >= 0)
-      posout[griddim] = roundf(posin[i]);
+      posout[griddim] = roundf((posin[i] - _Offset[griddim]) / _Scale[griddim]);
   }
 
   return retval;
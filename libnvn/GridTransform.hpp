@@ -10,20 +10,48 @@
 #include "GridCRS.hpp"
 
 
+/**
+  A GridTransform maps between the integer indices of a grid and the
+  coordinates of a base CRS.  Dimensions are matched by name, and the matching
+  is resolved once when the transform is built, along with the affine mapping
+  of each grid dimension, so that the per-vertex methods do no string work.
+
+  The transform copies what it needs, so it remains valid if either CRS
+  changes or goes away, but it will not see those changes.
+*/
 class GridTransform
 {
 public:
   GridTransform(const CRS& basecrs, const GridCRS& gridcrs);
   ~GridTransform();
 
+public:
+  int GetGridDim(int basedim) const
+  { return basedim >= 0 && basedim < _BaseNDims ? _GridDim[basedim] : -1; }
+  float GetModelUnitsPerCell() const;
+
 public:
   int GridToModel(const MPI_Offset posin[], float posout[]) const;
   int ModelToGrid(const float posin[], float posout[]) const;
   int ModelToGrid(const float posin[], MPI_Offset posout[]) const;
 
+  /**
+    Transforms the n grid positions that start at start[] and step along
+    griddim into the base CRS.  The result is written in planar form, so that
+    posout[d][k] is coordinate d of the k'th position.  Any posout[d] may be
+    null if that coordinate is not needed, and coordinates of the base CRS
+    that do not come from the grid are left untouched.
+  */
+  int GridRowToModel(const MPI_Offset start[], int griddim, int n,
+                     float* posout[]) const;
+
 protected:
-  const CRS& _BaseCRS;
-  const GridCRS& _GridCRS;
+  int _GridNDims;
+  int _BaseNDims;
+  int _BaseDim[MAX_DIMS];  // The base dim for each grid dim, or -1
+  int _GridDim[MAX_DIMS];  // The grid dim for each base dim, or -1
+  float _Scale[MAX_DIMS];  // Per grid dim
+  float _Offset[MAX_DIMS]; // Per grid dim
 };
 
 #endif
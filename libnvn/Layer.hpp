@@ -9,28 +9,174 @@
 #include "nvn.h"
 
 #include "CartesianCRS.hpp"
+#include "RenderContext.hpp"
+
+#include <pthread.h>
+#include <vector>
+
+
+/**
+ * The GL objects that a layer has made for one share group.  Every window
+ * whose context shares objects with the others draws from the same set, so a
+ * mesh is only built once however many windows show it.  Layers derive their
+ * own sets from this one.  Like all GL objects, the ones in a set are never
+ * deleted by a destructor.
+ */
+struct LayerResources
+{
+  LayerResources(int sharegroup) : ShareGroup(sharegroup) {}
+  virtual ~LayerResources() {}
+
+  int ShareGroup;
+};
 
 
 class Layer
 {
 protected:
-  Layer() : _ModelCrs(4) {};
+  Layer() : _ModelCrs(4), _Revision(0), _BoundsValid(false)
+  {
+    pthread_mutex_init(&_BoundsLock, 0);
+    pthread_mutex_init(&_RenderLock, 0);
+  };
 
 public:
-  virtual ~Layer() {};
+  virtual ~Layer()
+  {
+    for(size_t i = 0; i < _Resources.size(); i++)
+      delete _Resources[i];
+
+    pthread_mutex_destroy(&_BoundsLock);
+    pthread_mutex_destroy(&_RenderLock);
+  };
 
 public:
-  virtual int Render() = 0;
+  /**
+   * A layer may be shown in several windows, whose render threads take turns
+   * to draw it, so Render must only be called with the layer locked.
+   */
+  int LockRender() { pthread_mutex_lock(&_RenderLock); return NVN_NOERR; }
+  int UnlockRender() { pthread_mutex_unlock(&_RenderLock); return NVN_NOERR; }
+
+  /**
+   * Forgets the GL objects made for a share group whose contexts are all
+   * gone, and with them the objects.  The layer must be locked.
+   */
+  int ForgetResources(int sharegroup)
+  {
+    for(size_t i = 0; i < _Resources.size(); i++)
+    {
+      if(sharegroup == _Resources[i]->ShareGroup)
+      {
+        delete _Resources[i];
+        _Resources.erase(_Resources.begin() + i);
+        break;
+      }
+    }
+
+    return NVN_NOERR;
+  }
+
+public:
+  virtual int Render(const RenderContext& context) = 0;
   virtual int SetModelCRS(const CartesianCRS& crs) = 0;
 
+  /**
+   * Fills in result if the layer has data under the model point (x, y), and
+   * leaves it alone otherwise.  Lines count if they are within radius of the
+   * point.  Layers that cannot be probed never find anything.
+   */
+  virtual int Probe(float x, float y, float radius,
+                    NVN_ProbeResult* result) const
+  { return NVN_NOERR; }
+
 public:
-  virtual NVN_BBox GetBounds() const = 0;
   virtual const CRS& GetDataCRS() const = 0;
   virtual const CartesianCRS& GetModelCRS() const { return _ModelCrs; }
 
+  /**
+   * The bounds are computed once and then cached until the layer calls
+   * InvalidateBounds, which it must do whenever its data or model CRS changes.
+   */
+  NVN_BBox GetBounds() const
+  {
+    NVN_BBox bounds;
+
+    // Several render threads may ask at once, so the cached copy is guarded.
+    pthread_mutex_lock(&_BoundsLock);
+
+    if(! _BoundsValid)
+    {
+      // If the bounds are invalidated by another thread while they are being
+      // computed, the result is not trusted past this call.
+      unsigned int revision = _Revision;
+      _CachedBounds = this->ComputeBounds();
+      _BoundsValid = revision == _Revision;
+    }
+
+    bounds = _CachedBounds;
+    pthread_mutex_unlock(&_BoundsLock);
+
+    return bounds;
+  }
+
+  /**
+   * The revision increases every time the layer's bounds are invalidated, and
+   * whenever it changes in a way that needs a redraw, so that owners can tell
+   * when their own cached state has gone stale.
+   */
+  unsigned int GetRevision() const { return _Revision; }
+
+protected:
+  virtual NVN_BBox ComputeBounds() const = 0;
+
+  /**
+   * Makes an empty set of GL objects for a share group that is drawing the
+   * layer for the first time.
+   */
+  virtual LayerResources* CreateResources(int sharegroup) const
+  { return new LayerResources(sharegroup); }
+
+  /**
+   * Finds the set of GL objects for the share group of the frame, and makes
+   * one if there is none yet.  The layer must be locked.
+   */
+  LayerResources* GetResources(const RenderContext& context)
+  {
+    LayerResources* resources = 0;
+
+    for(size_t i = 0; i < _Resources.size() && ! resources; i++)
+    {
+      if(context.GetShareGroup() == _Resources[i]->ShareGroup)
+        resources = _Resources[i];
+    }
+
+    if(! resources)
+    {
+      resources = this->CreateResources(context.GetShareGroup());
+      _Resources.push_back(resources);
+    }
+
+    return resources;
+  }
+
+  int InvalidateBounds()
+  {
+    _BoundsValid = false;
+    _Revision++;
+    return NVN_NOERR;
+  }
+
 protected:
   CartesianCRS _ModelCrs;
+  unsigned int _Revision;
+  std::vector<LayerResources*> _Resources;
 
+private:
+  mutable NVN_BBox _CachedBounds;
+  mutable bool _BoundsValid;
+  mutable pthread_mutex_t _BoundsLock;
+  pthread_mutex_t _RenderLock;
 };
 
 #endif
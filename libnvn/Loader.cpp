@@ -7,12 +7,17 @@
 
 #include "DataGrid.hpp"
 #include "Loader.hpp"
+#include "Trace.hpp"
 
+#include <math.h>
 #include <pnetcdf.h>
 #include <string.h>
 
 
 MPI_Datatype NCTypeToMPI(nc_type type);
+int ReadCoordinateAffine(int ncid, int dimid, const char* dimname,
+                         MPI_Offset start, MPI_Offset count, MPI_Offset stride,
+                         double* scale, double* offset);
 
 
 int DetermineFileFormat(const char* filename, FileFormat* format)
@@ -93,7 +98,7 @@ int LoadCReSISASCIIGrid(const char* filename, DataGrid** grid)
   int mark = 0;
   Variant nodataValue;
   int width, height;
-  float xllcorner, yllcorner, cellsize;
+  float xllcorner = 0.0f, yllcorner = 0.0f, cellsize = 0.0f;
 
   nodataValue.Type = VariantTypeFloat;
   nodataValue.Value.FloatVal = -666.0f;
@@ -143,7 +148,10 @@ int LoadCReSISASCIIGrid(const char* filename, DataGrid** grid)
           break;
 
         case ' ':
-          buf[y * width + x] = atof(readbuf + mark);
+          // Rows are stored south to north, so that the grid runs the same
+          // way as the real-world y coordinate.
+          if(y < height && x < width)
+            buf[(height - 1 - y) * width + x] = atof(readbuf + mark);
           mark = i + 1;
           x ++;
           break;
@@ -162,6 +170,13 @@ int LoadCReSISASCIIGrid(const char* filename, DataGrid** grid)
   {
     *grid = new DataGrid(ndims, dimnames, dimlen, MPI_FLOAT, buf);
     (*grid)->SetNodataValue(nodataValue);
+
+    // Grid positions are the centers of the cells.
+    if(cellsize > 0.0f)
+    {
+      (*grid)->SetDimAffine(0, cellsize, yllcorner + cellsize / 2.0f);
+      (*grid)->SetDimAffine(1, cellsize, xllcorner + cellsize / 2.0f);
+    }
   }
 
   if(f)
@@ -179,6 +194,7 @@ int LoadPNetCDFGrid(const char* filename, const char* varname,
                     DataGrid** grid)
 {
   int retval = NVN_NOERR;
+  TraceScope trace("LoadPNetCDFGrid", "io");
   int ncresult;
   int ncid = 0, varid = 0;
   nc_type vartype;
@@ -188,6 +204,8 @@ int LoadPNetCDFGrid(const char* filename, const char* varname,
   int gridndims;
   MPI_Offset griddimlen[NC_MAX_DIMS];
   char griddimname[MAX_DIMS][MAX_NAME];
+  int griddimsrc[MAX_DIMS];
+  double scale, offset;
   MPI_Datatype gridtype;
   int typesize;
   void* buf = 0;
@@ -244,6 +262,7 @@ int LoadPNetCDFGrid(const char* filename, const char* varname,
         varlen *= count[i];
         griddimlen[gridndims] = count[i];
         strcpy(griddimname[gridndims], dimname[i]);
+        griddimsrc[gridndims] = i;
         gridndims ++;
       }
     }
@@ -275,7 +294,8 @@ int LoadPNetCDFGrid(const char* filename, const char* varname,
     gridtype = NCTypeToMPI(vartype);
     MPI_Type_size(gridtype, &typesize);
     buf = malloc(varlen * typesize);
-    
+
+    TraceScope read("ncmpi_get_vars_all", "mpi");
     ncresult = ncmpi_get_vars_all(ncid, varid, start, count, stride,
                                   buf, varlen, gridtype);
     if(NC_NOERR != ncresult)
@@ -291,6 +311,17 @@ int LoadPNetCDFGrid(const char* filename, const char* varname,
     *grid = new DataGrid(gridndims, griddimname, griddimlen, gridtype, buf);
     if(hasNodataValue)
       (*grid)->SetNodataValue(nodataValue);
+
+    for(int i = 0; i < gridndims; i++)
+    {
+      int d = griddimsrc[i];
+      if(NVN_NOERR == ReadCoordinateAffine(ncid, dimid[d], dimname[d],
+                                           start[d], count[d], stride[d],
+                                           &scale, &offset))
+      {
+        (*grid)->SetDimAffine(i, scale, offset);
+      }
+    }
   }
 
   if(ncid)
@@ -337,3 +368,69 @@ MPI_Datatype NCTypeToMPI(nc_type type)
 		return MPI_BYTE;
 	}
 }
+
+/**
+ * Reads the coordinate variable for a dimension - the 1-D variable with the
+ * same name as the dimension - over the part of the dimension that was loaded,
+ * and finds the affine mapping from grid index to coordinate.  This fails if
+ * there is no coordinate variable, or if its values are not evenly spaced.
+ */
+int ReadCoordinateAffine(int ncid, int dimid, const char* dimname,
+                         MPI_Offset start, MPI_Offset count, MPI_Offset stride,
+                         double* scale, double* offset)
+{
+  int retval = NVN_NOERR;
+  int varid, ndims, vardimid[NC_MAX_DIMS];
+  double* coords = 0;
+  double spacing = 0.0;
+
+  if(NC_NOERR != ncmpi_inq_varid(ncid, dimname, &varid))
+    retval = NVN_ERROR;
+
+  if(NVN_NOERR == retval)
+  {
+    ncmpi_inq_var(ncid, varid, 0, 0, &ndims, vardimid, 0);
+    if(1 != ndims || dimid != vardimid[0] || count < 2)
+      retval = NVN_ERROR;
+  }
+
+  if(NVN_NOERR == retval)
+  {
+    coords = (double*)malloc(count * sizeof(double));
+    if(NC_NOERR != ncmpi_get_vars_all(ncid, varid, &start, &count, &stride,
+                                      coords, count, MPI_DOUBLE))
+    {
+      retval = NVN_ERROR;
+    }
+  }
+
+  if(NVN_NOERR == retval)
+  {
+    spacing = (coords[count - 1] - coords[0]) / (double)(count - 1);
+
+    for(MPI_Offset i = 1; NVN_NOERR == retval && i < count; i++)
+    {
+      if(fabs(coords[i] - coords[0] - i * spacing) > 1.0e-3 * fabs(spacing))
+      {
+        retval = NVN_ERROR;
+        fprintf(stderr, "Coordinate variable '%s' is not evenly spaced, "
+                "so grid indices will be used instead.\n", dimname);
+      }
+    }
+  }
+
+  if(NVN_NOERR == retval && 0.0 != spacing)
+  {
+    *scale = spacing;
+    *offset = coords[0];
+  }
+  else
+  {
+    retval = NVN_ERROR;
+  }
+
+  if(coords)
+    free(coords);
+
+  return retval;
+}
@@ -0,0 +1,118 @@
+/*
+ * MeshBlocks.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Timothy Morey
+ */
+
+
+#include "nvn.h"
+
+#include "MeshBlocks.hpp"
+#include "RenderContext.hpp"
+
+#include <float.h>
+#include <GL/gl.h>
+
+#include <vector>
+
+
+/******************************************************************************
+ * Constructors
+ ******************************************************************************/
+
+MeshBlocks::MeshBlocks()
+  : _Current(0),
+    _CurrentBounds(NVN_BBoxEmpty)
+{
+
+}
+
+MeshBlocks::~MeshBlocks()
+{
+  // The display lists belong to a GL context that may already be gone, so
+  // they are only released by an explicit call to Clear.
+}
+
+
+/******************************************************************************
+ * Public Members
+ ******************************************************************************/
+
+int MeshBlocks::BeginBlock()
+{
+  int retval = NVN_NOERR;
+
+  _Current = glGenLists(1);
+  glNewList(_Current, GL_COMPILE);
+
+  for(int i = 0; i < MAX_DIMS; i++)
+  {
+    _CurrentBounds.Min[i] = FLT_MAX;
+    _CurrentBounds.Max[i] = -FLT_MAX;
+  }
+
+  return retval;
+}
+
+int MeshBlocks::Clear()
+{
+  int retval = NVN_NOERR;
+
+  for(size_t i = 0; i < _Blocks.size(); i++)
+    glDeleteLists(_Blocks[i].DisplayList, 1);
+
+  _Blocks.clear();
+
+  return retval;
+}
+
+int MeshBlocks::EndBlock()
+{
+  int retval = NVN_NOERR;
+
+  glEndList();
+
+  // Blocks that turned out to be empty are not worth keeping.
+  if(_CurrentBounds.Min[XDIM] <= _CurrentBounds.Max[XDIM])
+  {
+    Block block;
+    block.DisplayList = _Current;
+    block.Bounds = _CurrentBounds;
+    _Blocks.push_back(block);
+  }
+  else
+  {
+    glDeleteLists(_Current, 1);
+  }
+
+  _Current = 0;
+
+  return retval;
+}
+
+int MeshBlocks::ExtendBlock(const float pt[])
+{
+  int retval = NVN_NOERR;
+
+  for(int i = 0; i < 3; i++)
+  {
+    if(pt[i] < _CurrentBounds.Min[i]) _CurrentBounds.Min[i] = pt[i];
+    if(pt[i] > _CurrentBounds.Max[i]) _CurrentBounds.Max[i] = pt[i];
+  }
+
+  return retval;
+}
+
+int MeshBlocks::Render(const RenderContext& context) const
+{
+  int retval = NVN_NOERR;
+
+  for(size_t i = 0; i < _Blocks.size(); i++)
+  {
+    if(context.IsVisible(_Blocks[i].Bounds))
+      glCallList(_Blocks[i].DisplayList);
+  }
+
+  return retval;
+}
@@ -0,0 +1,56 @@
+/*
+ * MeshBlocks.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Timothy Morey
+ */
+
+#ifndef __MESHBLOCKS_HPP__
+#define __MESHBLOCKS_HPP__
+
+
+#include "nvn.h"
+
+#include "RenderContext.hpp"
+
+#include <vector>
+
+
+/**
+ * MeshBlocks splits a large mesh into display lists that each cover one block
+ * of the mesh, and remembers the bounds of every block, so that blocks outside
+ * of the view frustum are never sent to GL.  A block is recorded between calls
+ * to BeginBlock and EndBlock, and every vertex drawn into it must also be
+ * passed to ExtendBlock.  The GL context must be current for all of the
+ * methods below except ExtendBlock.
+ */
+class MeshBlocks
+{
+public:
+  MeshBlocks();
+  ~MeshBlocks();
+
+public:
+  int BeginBlock();
+  int Clear();
+  int EndBlock();
+  int ExtendBlock(const float pt[]);
+  int Render(const RenderContext& context) const;
+
+public:
+  int GetNBlocks() const { return (int)_Blocks.size(); }
+
+protected:
+  struct Block
+  {
+    unsigned int DisplayList;
+    NVN_BBox Bounds;
+  };
+
+protected:
+  std::vector<Block> _Blocks;
+  unsigned int _Current;
+  NVN_BBox _CurrentBounds;
+};
+
+#endif
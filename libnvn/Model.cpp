@@ -6,70 +6,241 @@
 #include "nvn.h"
 
 #include "CartesianCRS.hpp"
+#include "FrameProfiler.hpp"
 #include "Layer.hpp"
 #include "Model.hpp"
+#include "RenderContext.hpp"
 
+#include <algorithm>
+#include <functional>
 #include <list>
+#include <vector>
 
 
 Model::Model()
-  : _Crs(4)
+  : _Crs(4),
+    _Revision(0),
+    _CacheRevision(0),
+    _CacheValid(false),
+    _Bounds(NVN_BBoxEmpty),
+    _NDims(0)
 {
+  pthread_rwlockattr_t attr;
 
+  // Windows draw the model back to back, so readers would otherwise keep the
+  // UI thread from ever adding a layer.  Readers must not nest.
+  pthread_rwlockattr_init(&attr);
+  pthread_rwlockattr_setkind_np(&attr,
+                                PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+  pthread_rwlock_init(&_LayersLock, &attr);
+  pthread_rwlockattr_destroy(&attr);
+
+  pthread_mutex_init(&_CacheLock, 0);
 }
 
 Model::~Model()
 {
-
+  pthread_mutex_destroy(&_CacheLock);
+  pthread_rwlock_destroy(&_LayersLock);
 }
 
 NVN_BBox Model::GetBounds() const
 {
-  NVN_BBox bounds = NVN_BBoxEmpty;
+  NVN_BBox bounds;
 
-  std::list<Layer*>::const_iterator iter;
-  for(iter = _Layers.begin(); iter != _Layers.end(); iter++)
-  {
-    NVN_BBoxUnion(bounds, (*iter)->GetBounds(), &bounds);
-  }
+  pthread_rwlock_rdlock(&_LayersLock);
+  pthread_mutex_lock(&_CacheLock);
+  this->UpdateCache();
+  bounds = _Bounds;
+  pthread_mutex_unlock(&_CacheLock);
+  pthread_rwlock_unlock(&_LayersLock);
 
   return bounds;
 }
 
 int Model::GetNDims() const
 {
-  int ndims = 0;
+  int ndims;
 
-  NVN_BBox bounds = this->GetBounds();
-  for(int i = 0; i < _Crs.GetNDims(); i++)
-  {
-    if(bounds.Max[i] > bounds.Min[i]) ndims++;
-  }
+  pthread_rwlock_rdlock(&_LayersLock);
+  pthread_mutex_lock(&_CacheLock);
+  this->UpdateCache();
+  ndims = _NDims;
+  pthread_mutex_unlock(&_CacheLock);
+  pthread_rwlock_unlock(&_LayersLock);
 
   return ndims;
 }
 
+unsigned int Model::GetRevision() const
+{
+  unsigned int revision;
+
+  pthread_rwlock_rdlock(&_LayersLock);
+  revision = this->SumRevisions();
+  pthread_rwlock_unlock(&_LayersLock);
+
+  return revision;
+}
+
 int Model::AddLayer(Layer* layer)
 {
   int retval = NVN_NOERR;
 
   if(layer)
   {
+    pthread_rwlock_wrlock(&_LayersLock);
     layer->SetModelCRS(_Crs);
     _Layers.push_back(layer);
+    _Revision++;
+    pthread_rwlock_unlock(&_LayersLock);
   }
 
   return retval;
 }
 
-int Model::Render()
+int Model::ForgetResources(int sharegroup)
 {
   int retval = NVN_NOERR;
 
+  pthread_rwlock_rdlock(&_LayersLock);
+
   std::list<Layer*>::iterator iter;
   for(iter = _Layers.begin(); iter != _Layers.end(); iter++)
   {
-    (*iter)->Render();
+    (*iter)->LockRender();
+    (*iter)->ForgetResources(sharegroup);
+    (*iter)->UnlockRender();
+  }
+
+  pthread_rwlock_unlock(&_LayersLock);
+
+  return retval;
+}
+
+int Model::Probe(float x, float y, float radius, NVN_ProbeResult* result) const
+{
+  int retval = NVN_NOERR;
+  std::vector<int> candidates;
+  std::vector<Layer*> layers;
+
+  result->Layer = 0;
+  result->X = x;
+  result->Y = y;
+  result->Value = 0.0;
+  for(int i = 0; i < MAX_DIMS; i++)
+    result->Index[i] = 0;
+
+  pthread_rwlock_rdlock(&_LayersLock);
+  pthread_mutex_lock(&_CacheLock);
+
+  this->UpdateCache();
+  _LayerIndex.Query(x, y, radius, &candidates);
+
+  // Layers are drawn in order, so the last one is on top.
+  std::sort(candidates.begin(), candidates.end(), std::greater<int>());
+  candidates.erase(std::unique(candidates.begin(), candidates.end()),
+                   candidates.end());
+
+  for(size_t k = 0; k < candidates.size(); k++)
+    layers.push_back(_LayerList[candidates[k]]);
+
+  // The layers themselves are asked without holding up the render threads
+  // that need the cache.
+  pthread_mutex_unlock(&_CacheLock);
+
+  for(size_t k = 0; NVN_NOERR == retval && 0 == result->Layer &&
+                    k < layers.size(); k++)
+  {
+    retval = layers[k]->Probe(x, y, radius, result);
+  }
+
+  pthread_rwlock_unlock(&_LayersLock);
+
+  return retval;
+}
+
+int Model::Render(const RenderContext& context)
+{
+  int retval = NVN_NOERR;
+
+  FrameProfiler* profiler = context.GetProfiler();
+
+  pthread_rwlock_rdlock(&_LayersLock);
+
+  std::list<Layer*>::iterator iter;
+  for(iter = _Layers.begin(); iter != _Layers.end(); iter++)
+  {
+    if(context.IsVisible((*iter)->GetBounds()))
+    {
+      if(profiler)
+        profiler->BeginLayer(*iter);
+
+      (*iter)->LockRender();
+      (*iter)->Render(context);
+      (*iter)->UnlockRender();
+
+      if(profiler)
+        profiler->EndLayer(*iter);
+    }
+  }
+
+  pthread_rwlock_unlock(&_LayersLock);
+
+  return retval;
+}
+
+
+unsigned int Model::SumRevisions() const
+{
+  // Layer revisions only ever increase, so the sum changes whenever any one
+  // of them does.
+  unsigned int revision = _Revision;
+
+  std::list<Layer*>::const_iterator iter;
+  for(iter = _Layers.begin(); iter != _Layers.end(); iter++)
+  {
+    revision += (*iter)->GetRevision();
+  }
+
+  return revision;
+}
+
+int Model::UpdateCache() const
+{
+  int retval = NVN_NOERR;
+  unsigned int revision = this->SumRevisions();
+
+  // The layers must be locked for reading, and the cache locked.
+
+  if(! _CacheValid || revision != _CacheRevision)
+  {
+    _Bounds = NVN_BBoxEmpty;
+    _LayerList.assign(_Layers.begin(), _Layers.end());
+
+    std::vector<float> extents(4 * _LayerList.size());
+    for(size_t i = 0; i < _LayerList.size(); i++)
+    {
+      NVN_BBox bounds = _LayerList[i]->GetBounds();
+      NVN_BBoxUnion(_Bounds, bounds, &_Bounds);
+
+      extents[4 * i] = bounds.Min[XDIM];
+      extents[4 * i + 1] = bounds.Max[XDIM];
+      extents[4 * i + 2] = bounds.Min[YDIM];
+      extents[4 * i + 3] = bounds.Max[YDIM];
+    }
+
+    _LayerIndex.Build((int)_LayerList.size(),
+                      extents.empty() ? 0 : &extents[0]);
+
+    _NDims = 0;
+    for(int i = 0; i < _Crs.GetNDims(); i++)
+    {
+      if(_Bounds.Max[i] > _Bounds.Min[i]) _NDims++;
+    }
+
+    _CacheRevision = revision;
+    _CacheValid = true;
   }
 
   return retval;
@@ -9,12 +9,24 @@
 #include "nvn.h"
 
 #include "CartesianCRS.hpp"
+#include "SpatialIndex.hpp"
+
+#include <pthread.h>
 
 #include <list>
+#include <vector>
 
 
 class Layer;
+class RenderContext;
 
+/**
+ * A Model may be shown in several windows, whose render threads draw it at
+ * the same time while the UI thread adds layers to it.  The list of layers is
+ * guarded by a read/write lock, which drawing holds for reading so that the
+ * windows still draw in parallel.  The bounds and index that are derived from
+ * the layers are rebuilt under a lock of their own.
+ */
 class Model
 {
 public:
@@ -26,13 +38,47 @@ public:
   const CartesianCRS& GetCRS() const { return _Crs; }
   int GetNDims() const;
 
+  /**
+   * The revision changes whenever a layer is added or any layer's bounds are
+   * invalidated, so callers can cache state that is derived from the model.
+   */
+  unsigned int GetRevision() const;
+
 public:
   int AddLayer(Layer* layer);
-  int Render();
+
+  /**
+   * Has every layer forget the GL objects it made for a share group whose
+   * contexts are all gone.
+   */
+  int ForgetResources(int sharegroup);
+
+  /**
+   * Finds the data under the model point (x, y).  The layers whose bounds are
+   * near the point are found with an index, and asked from the topmost down,
+   * so the first one with data there wins.
+   */
+  int Probe(float x, float y, float radius, NVN_ProbeResult* result) const;
+
+  int Render(const RenderContext& context);
 
 protected:
+  unsigned int SumRevisions() const;
+  int UpdateCache() const;
+
+protected:
+  mutable pthread_rwlock_t _LayersLock;
   std::list<Layer*> _Layers;
   CartesianCRS _Crs;
+  unsigned int _Revision;
+
+  mutable pthread_mutex_t _CacheLock;
+  mutable unsigned int _CacheRevision;
+  mutable bool _CacheValid;
+  mutable NVN_BBox _Bounds;
+  mutable int _NDims;
+  mutable std::vector<Layer*> _LayerList;
+  mutable SpatialIndex _LayerIndex;
 };
 
 #endif
@@ -0,0 +1,458 @@
+/*
+ * MultiLineLayer.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Timothy Morey
+ */
+
+#include "nvn.h"
+
+#include "color-ramp.h"
+
+#include "CartesianCRS.hpp"
+#include "Layer.hpp"
+#include "MultiLineLayer.hpp"
+
+#define GL_GLEXT_PROTOTYPES 1
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <algorithm>
+#include <float.h>
+#include <pthread.h>
+#include <vector>
+
+#define MULTILINE_INITIAL_CAPACITY 4096
+
+
+MultiLineLayer::MultiLineLayer()
+  : _DataCrs(2),
+    _Bounds(NVN_BBoxEmpty),
+    _IndexedVerts(0),
+    _ColorChanges(0),
+    _ColorSpanBase(0),
+    _ColorFirst(0),
+    _ColorEnd(0)
+{
+  pthread_mutex_init(&_Lock, 0);
+}
+
+MultiLineLayer::~MultiLineLayer()
+{
+  // The vertex buffers belong to GL contexts that may already be gone, so
+  // they are left for the contexts to release.
+  pthread_mutex_destroy(&_Lock);
+}
+
+int MultiLineLayer::GetNLines() const
+{
+  int n;
+
+  pthread_mutex_lock(&_Lock);
+  n = (int)_First.size();
+  pthread_mutex_unlock(&_Lock);
+
+  return n;
+}
+
+int MultiLineLayer::AddLine(const float x[], const float y[], int n, int color,
+                            int* line)
+{
+  int retval = NVN_NOERR;
+  int first;
+  float extent[4];
+
+  if(x && y && n >= 2)
+  {
+    pthread_mutex_lock(&_Lock);
+
+    first = (int)_Verts.size() / 2;
+    extent[0] = extent[1] = x[0];
+    extent[2] = extent[3] = y[0];
+    _Verts.reserve(_Verts.size() + 2 * n);
+    _Colors.reserve(_Colors.size() + 4 * n);
+
+    for(int i = 0; i < n; i++)
+    {
+      _Verts.push_back(x[i]);
+      _Verts.push_back(y[i]);
+
+      // Colors are unpacked the same way as in Plot2DLayer.
+      _Colors.push_back(GetA(color));
+      _Colors.push_back(GetB(color));
+      _Colors.push_back(GetG(color));
+      _Colors.push_back(GetR(color));
+
+      if(x[i] < extent[0]) extent[0] = x[i];
+      if(x[i] > extent[1]) extent[1] = x[i];
+      if(y[i] < extent[2]) extent[2] = y[i];
+      if(y[i] > extent[3]) extent[3] = y[i];
+
+      if(0 == first && 0 == i)
+      {
+        _Bounds.Min[XDIM] = _Bounds.Max[XDIM] = x[i];
+        _Bounds.Min[YDIM] = _Bounds.Max[YDIM] = y[i];
+      }
+      else
+      {
+        if(x[i] < _Bounds.Min[XDIM]) _Bounds.Min[XDIM] = x[i];
+        if(x[i] > _Bounds.Max[XDIM]) _Bounds.Max[XDIM] = x[i];
+        if(y[i] < _Bounds.Min[YDIM]) _Bounds.Min[YDIM] = y[i];
+        if(y[i] > _Bounds.Max[YDIM]) _Bounds.Max[YDIM] = y[i];
+      }
+    }
+
+    if(line)
+      *line = (int)_First.size();
+
+    _First.push_back(first);
+    _Count.push_back(n);
+    _Visible.push_back(true);
+    _Extent.insert(_Extent.end(), extent, extent + 4);
+    this->InvalidateBounds();
+
+    pthread_mutex_unlock(&_Lock);
+  }
+  else
+  {
+    retval = NVN_EINVARGS;
+  }
+
+  return retval;
+}
+
+int MultiLineLayer::Probe(float x, float y, float radius,
+                          NVN_ProbeResult* result) const
+{
+  int retval = NVN_NOERR;
+  float best = radius * radius;
+  int bestline = -1, bestvert = 0;
+  float besty = 0.0f;
+  const float *p0, *p1;
+  float dx, dy, len, t, px, py, d;
+  int line;
+
+  pthread_mutex_lock(&_Lock);
+
+  if(_IndexedVerts != (int)_Verts.size() / 2)
+    retval = this->BuildIndex();
+
+  _Candidates.clear();
+  _Index.Query(x, y, radius, &_Candidates);
+
+  for(size_t k = 0; k < _Candidates.size(); k++)
+  {
+    // The nearest point on the segment.
+    p0 = &_Verts[2 * _Candidates[k]];
+    p1 = p0 + 2;
+    dx = p1[0] - p0[0];
+    dy = p1[1] - p0[1];
+    len = dx * dx + dy * dy;
+    t = len > 0.0f ? ((x - p0[0]) * dx + (y - p0[1]) * dy) / len : 0.0f;
+    if(t < 0.0f) t = 0.0f;
+    if(t > 1.0f) t = 1.0f;
+    px = p0[0] + t * dx;
+    py = p0[1] + t * dy;
+    d = (px - x) * (px - x) + (py - y) * (py - y);
+
+    if(d <= best)
+    {
+      line = (int)(std::upper_bound(_First.begin(), _First.end(),
+                                    _Candidates[k]) - _First.begin()) - 1;
+      if(_Visible[line])
+      {
+        best = d;
+        bestline = line;
+        bestvert = _Candidates[k] - _First[line];
+        besty = py;
+      }
+    }
+  }
+
+  if(bestline >= 0)
+  {
+    result->Layer = (NVN_Layer)(const Layer*)this;
+    result->Index[0] = bestline;
+    result->Index[1] = bestvert;
+    result->Value = besty;
+  }
+
+  pthread_mutex_unlock(&_Lock);
+
+  return retval;
+}
+
+int MultiLineLayer::Render(const RenderContext& context)
+{
+  int retval = NVN_NOERR;
+  NVN_BBox visible = context.GetVisibleBounds();
+  bool cull = visible.Min[XDIM] <= visible.Max[XDIM];
+  const float* extent;
+  MultiLineResources* resources =
+    (MultiLineResources*)this->GetResources(context);
+
+  pthread_mutex_lock(&_Lock);
+
+  // The draw list is rebuilt for every frame, which is cheap next to drawing
+  // even thousands of lines, and the whole layer is drawn if the view could
+  // not be found.
+  _DrawFirst.clear();
+  _DrawCount.clear();
+  for(size_t i = 0; i < _First.size(); i++)
+  {
+    extent = &_Extent[4 * i];
+
+    if(_Visible[i] &&
+       (! cull || (extent[0] <= visible.Max[XDIM] &&
+                   extent[1] >= visible.Min[XDIM] &&
+                   extent[2] <= visible.Max[YDIM] &&
+                   extent[3] >= visible.Min[YDIM])))
+    {
+      _DrawFirst.push_back(_First[i]);
+      _DrawCount.push_back(_Count[i]);
+    }
+  }
+
+  retval = this->Upload(resources);
+
+  if(NVN_NOERR == retval && ! _DrawFirst.empty())
+  {
+    glLineWidth(5.0f);
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+
+    glBindBuffer(GL_ARRAY_BUFFER, resources->VertexBuffer);
+    glVertexPointer(2, GL_FLOAT, 0, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, resources->ColorBuffer);
+    glColorPointer(4, GL_UNSIGNED_BYTE, 0, 0);
+
+    glMultiDrawArrays(GL_LINE_STRIP, &_DrawFirst[0], &_DrawCount[0],
+                      (GLsizei)_DrawFirst.size());
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+  }
+
+  pthread_mutex_unlock(&_Lock);
+
+  return retval;
+}
+
+int MultiLineLayer::SetLineColor(int line, int color)
+{
+  int retval = NVN_NOERR;
+  int first, end;
+
+  pthread_mutex_lock(&_Lock);
+
+  if(0 <= line && line < (int)_First.size())
+  {
+    first = _First[line];
+    end = first + _Count[line];
+
+    for(int i = first; i < end; i++)
+    {
+      _Colors[4 * i] = GetA(color);
+      _Colors[4 * i + 1] = GetB(color);
+      _Colors[4 * i + 2] = GetG(color);
+      _Colors[4 * i + 3] = GetR(color);
+    }
+
+    // Only the span of vertices whose colors changed is sent on the next
+    // render.
+    if(_ColorFirst == _ColorEnd)
+    {
+      _ColorFirst = first;
+      _ColorEnd = end;
+    }
+    else
+    {
+      if(first < _ColorFirst) _ColorFirst = first;
+      if(end > _ColorEnd) _ColorEnd = end;
+    }
+
+    _ColorChanges++;
+    _Revision++;
+  }
+  else
+  {
+    retval = NVN_EINVARGS;
+  }
+
+  pthread_mutex_unlock(&_Lock);
+
+  return retval;
+}
+
+int MultiLineLayer::SetLineVisible(int line, bool visible)
+{
+  int retval = NVN_NOERR;
+
+  pthread_mutex_lock(&_Lock);
+
+  if(0 <= line && line < (int)_First.size())
+  {
+    if(_Visible[line] != visible)
+    {
+      _Visible[line] = visible;
+      _Revision++;
+    }
+  }
+  else
+  {
+    retval = NVN_EINVARGS;
+  }
+
+  pthread_mutex_unlock(&_Lock);
+
+  return retval;
+}
+
+int MultiLineLayer::SetModelCRS(const CartesianCRS& crs)
+{
+  int retval = NVN_NOERR;
+
+  // The model CRS is read while the layer is drawn.
+  this->LockRender();
+  _ModelCrs = crs;
+  this->InvalidateBounds();
+  this->UnlockRender();
+
+  return retval;
+}
+
+NVN_BBox MultiLineLayer::ComputeBounds() const
+{
+  NVN_BBox bounds;
+
+  pthread_mutex_lock(&_Lock);
+  bounds = _Bounds;
+  pthread_mutex_unlock(&_Lock);
+
+  return bounds;
+}
+
+int MultiLineLayer::BuildIndex() const
+{
+  int retval = NVN_NOERR;
+  int nverts = (int)_Verts.size() / 2;
+  std::vector<float> extents(4 * nverts);
+  const float *p0, *p1;
+  float* e;
+
+  // Every vertex but the last of each line starts a segment, and the others
+  // get an empty extent so that they are left out.
+  for(int i = 0; i < nverts; i++)
+  {
+    e = &extents[4 * i];
+    e[0] = FLT_MAX;
+    e[1] = -FLT_MAX;
+  }
+
+  for(size_t line = 0; line < _First.size(); line++)
+  {
+    for(int i = _First[line]; i < _First[line] + _Count[line] - 1; i++)
+    {
+      p0 = &_Verts[2 * i];
+      p1 = p0 + 2;
+      e = &extents[4 * i];
+      e[0] = p0[0] < p1[0] ? p0[0] : p1[0];
+      e[1] = p0[0] < p1[0] ? p1[0] : p0[0];
+      e[2] = p0[1] < p1[1] ? p0[1] : p1[1];
+      e[3] = p0[1] < p1[1] ? p1[1] : p0[1];
+    }
+  }
+
+  retval = _Index.Build(nverts, nverts > 0 ? &extents[0] : 0);
+  _IndexedVerts = nverts;
+
+  return retval;
+}
+
+int MultiLineLayer::Upload(MultiLineResources* resources)
+{
+  int retval = NVN_NOERR;
+  int nverts = (int)_Verts.size() / 2;
+  int capacity, first, end;
+  bool current = true;
+
+  if(! resources->VertexBuffer)
+  {
+    glGenBuffers(1, &resources->VertexBuffer);
+    glGenBuffers(1, &resources->ColorBuffer);
+  }
+
+  if(nverts > resources->BufferCapacity)
+  {
+    // The buffers grow by doubling, and everything is sent again.
+    capacity = resources->BufferCapacity > 0 ?
+      2 * resources->BufferCapacity : MULTILINE_INITIAL_CAPACITY;
+    while(capacity < nverts)
+      capacity *= 2;
+
+    glBindBuffer(GL_ARRAY_BUFFER, resources->VertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, 2 * capacity * sizeof(float), 0, GL_STATIC_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, 2 * nverts * sizeof(float), &_Verts[0]);
+
+    glBindBuffer(GL_ARRAY_BUFFER, resources->ColorBuffer);
+    glBufferData(GL_ARRAY_BUFFER, 4 * capacity, 0, GL_STATIC_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, 4 * nverts, &_Colors[0]);
+
+    resources->BufferCapacity = capacity;
+    resources->VertsUploaded = nverts;
+  }
+  else
+  {
+    // Changed colors are sent before new lines, whose colors go with them.
+    // A share group that missed changes from before the span started gets
+    // all of its colors again.
+    if(resources->ColorChanges != _ColorChanges)
+    {
+      first = resources->ColorChanges >= _ColorSpanBase ? _ColorFirst : 0;
+      end = resources->ColorChanges >= _ColorSpanBase ?
+        _ColorEnd : resources->VertsUploaded;
+      if(end > resources->VertsUploaded)
+        end = resources->VertsUploaded;
+
+      if(first < end)
+      {
+        glBindBuffer(GL_ARRAY_BUFFER, resources->ColorBuffer);
+        glBufferSubData(GL_ARRAY_BUFFER, 4 * first, 4 * (end - first),
+                        &_Colors[4 * first]);
+      }
+    }
+
+    if(resources->VertsUploaded < nverts)
+    {
+      first = resources->VertsUploaded;
+
+      glBindBuffer(GL_ARRAY_BUFFER, resources->VertexBuffer);
+      glBufferSubData(GL_ARRAY_BUFFER, 2 * first * sizeof(float),
+                      2 * (nverts - first) * sizeof(float), &_Verts[2 * first]);
+
+      glBindBuffer(GL_ARRAY_BUFFER, resources->ColorBuffer);
+      glBufferSubData(GL_ARRAY_BUFFER, 4 * first, 4 * (nverts - first),
+                      &_Colors[4 * first]);
+
+      resources->VertsUploaded = nverts;
+    }
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  resources->ColorChanges = _ColorChanges;
+
+  for(size_t i = 0; i < _Resources.size(); i++)
+  {
+    if(((MultiLineResources*)_Resources[i])->ColorChanges != _ColorChanges)
+      current = false;
+  }
+
+  if(current)
+  {
+    _ColorFirst = _ColorEnd = 0;
+    _ColorSpanBase = _ColorChanges;
+  }
+
+  return retval;
+}
@@ -0,0 +1,121 @@
+/*
+ * MultiLineLayer.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Timothy Morey
+ */
+
+#ifndef __MULTILINELAYER_HPP__
+#define __MULTILINELAYER_HPP__
+
+
+#include "nvn.h"
+
+#include "CartesianCRS.hpp"
+#include "Layer.hpp"
+#include "SpatialIndex.hpp"
+
+#include <pthread.h>
+#include <vector>
+
+
+/**
+ * A MultiLineLayer draws many 2D polylines, such as the flight lines of a
+ * radar campaign, as a single layer.  All of the vertices are packed into one
+ * GL vertex buffer, with a table of the first vertex and vertex count of each
+ * line, and the visible lines are drawn with one glMultiDrawArrays call.
+ * Lines that lie entirely outside of the view are left out of the call.
+ *
+ * Each line has its own color, which is stored per vertex so that changing it
+ * does not break up the draw, and can be hidden without being removed.  The
+ * bounds of the layer cover hidden lines too, so that toggling a line does not
+ * move the view.
+ *
+ * Lines may be added, changed and probed from any thread.
+ */
+class MultiLineLayer : public Layer
+{
+public:
+  MultiLineLayer();
+  virtual ~MultiLineLayer();
+
+public:
+  virtual const CRS& GetDataCRS() const { return _DataCrs; }
+  int GetNLines() const;
+
+public:
+  int AddLine(const float x[], const float y[], int n, int color, int* line);
+  virtual int Probe(float x, float y, float radius,
+                    NVN_ProbeResult* result) const;
+  virtual int Render(const RenderContext& context);
+  int SetLineColor(int line, int color);
+  int SetLineVisible(int line, bool visible);
+  virtual int SetModelCRS(const CartesianCRS& crs);
+
+protected:
+  /**
+   * The GL copies of _Verts and _Colors in one share group.  VertsUploaded
+   * counts the vertices already in the buffers, and ColorChanges is the value
+   * of _ColorChanges when their colors were last brought up to date.
+   */
+  struct MultiLineResources : public LayerResources
+  {
+    MultiLineResources(int sharegroup)
+      : LayerResources(sharegroup), VertexBuffer(0), ColorBuffer(0),
+        BufferCapacity(0), VertsUploaded(0), ColorChanges(0) {}
+
+    unsigned int VertexBuffer;
+    unsigned int ColorBuffer;
+    int BufferCapacity;
+    int VertsUploaded;
+    unsigned int ColorChanges;
+  };
+
+protected:
+  virtual NVN_BBox ComputeBounds() const;
+  virtual LayerResources* CreateResources(int sharegroup) const
+  { return new MultiLineResources(sharegroup); }
+
+protected:
+  int BuildIndex() const;
+  int Upload(MultiLineResources* resources);
+
+protected:
+  CartesianCRS _DataCrs;
+
+  /**
+   * The lines, guarded by _Lock.  _Verts holds xy pairs and _Colors holds the
+   * matching RGBA bytes, and _Extent holds the xmin, xmax, ymin and ymax of
+   * each line.  _DrawFirst and _DrawCount list the lines drawn by the current
+   * frame.
+   */
+  mutable pthread_mutex_t _Lock;
+  std::vector<float> _Verts;
+  std::vector<unsigned char> _Colors;
+  std::vector<int> _First;
+  std::vector<int> _Count;
+  std::vector<bool> _Visible;
+  std::vector<float> _Extent;
+  std::vector<int> _DrawFirst;
+  std::vector<int> _DrawCount;
+  NVN_BBox _Bounds;
+
+  /**
+   * An index of the segments for probing, which is built on the first probe
+   * after lines are added.  Each segment is known by its first vertex.
+   */
+  mutable SpatialIndex _Index;
+  mutable int _IndexedVerts;
+  mutable std::vector<int> _Candidates;
+
+  /**
+   * _ColorChanges counts the calls to SetLineColor, and the color span lists
+   * the vertices whose colors changed after the count was _ColorSpanBase.
+   * The span is cleared once every share group has sent it.
+   */
+  unsigned int _ColorChanges;
+  unsigned int _ColorSpanBase;
+  int _ColorFirst, _ColorEnd;
+};
+
+#endif
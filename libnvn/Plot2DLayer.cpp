@@ -16,6 +16,7 @@
 #include "Plot2DLayer.hpp"
 
 #include <GL/gl.h>
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -26,7 +27,8 @@ Plot2DLayer::Plot2DLayer(DataGrid* x, DataGrid* y, int color)
     _Color(color),
     _N(0),
     _DataType(),
-    _DataCrs(2)
+    _DataCrs(2),
+    _Decimation(NVN_DECIMATE_MINMAX)
 {
   if(_X && _Y)
   {
@@ -41,6 +43,8 @@ Plot2DLayer::Plot2DLayer(DataGrid* x, DataGrid* y, int color)
 
   Variant xv, yv;
   MPI_Offset i[MAX_DIMS];
+  float xs[1024], ys[1024];
+  int n = 0;
   for(i[0] = 0; i[0] < _N; i[0]++)
   {
     _X->GetElemAsVariant(i, &xv);
@@ -50,6 +54,16 @@ Plot2DLayer::Plot2DLayer(DataGrid* x, DataGrid* y, int color)
     _Y->GetElemAsVariant(i, &yv);
     if(0 > VariantCompare(yv, _MinY)) _MinY = yv;
     if(0 < VariantCompare(yv, _MaxY)) _MaxY = yv;
+
+    // The samples are copied into the decimator in chunks, which builds its
+    // summary as it goes.
+    xs[n] = VariantValueAsFloat(xv);
+    ys[n] = VariantValueAsFloat(yv);
+    if(++n == 1024 || i[0] == _N - 1)
+    {
+      _Series.Append(xs, ys, n);
+      n = 0;
+    }
   }
 }
 
@@ -58,7 +72,7 @@ Plot2DLayer::~Plot2DLayer()
 
 }
 
-NVN_BBox Plot2DLayer::GetBounds() const
+NVN_BBox Plot2DLayer::ComputeBounds() const
 {
   NVN_BBox bounds = NVN_BBoxEmpty;
 
@@ -71,29 +85,76 @@ NVN_BBox Plot2DLayer::GetBounds() const
   return bounds;
 }
 
-int Plot2DLayer::Render()
+int Plot2DLayer::Probe(float x, float y, float radius,
+                       NVN_ProbeResult* result) const
 {
   int retval = NVN_NOERR;
+  int index;
+  float value;
 
-  // TODO: current rendering won't work well if there is a single point, and
-  // won't be efficient if there are a lot of points.
+  // Plots are probed along x, so the point hits if it is within radius above
+  // or below the plot.
+  if(_Series.Interpolate(x, &index, &value) && fabsf(value - y) <= radius)
+  {
+    result->Layer = (NVN_Layer)(const Layer*)this;
+    result->Index[0] = index;
+    result->Value = value;
+  }
 
-  MPI_Offset i[MAX_DIMS];
-  Variant x, y;
+  return retval;
+}
 
-  glLineWidth(5.0f);
-  glBegin(GL_LINE_STRIP);
+int Plot2DLayer::Render(const RenderContext& context)
+{
+  int retval = NVN_NOERR;
+  NVN_BBox visible = context.GetVisibleBounds();
+  float xmin = VariantValueAsFloat(_MinX);
+  float xmax = VariantValueAsFloat(_MaxX);
+  const float* verts = 0;
+  int nverts = 0;
+  int columns;
+
+  // Only the part of the plot inside the view needs to be spread over pixel
+  // columns, and the whole plot is used if the view could not be found.
+  if(visible.Min[XDIM] <= visible.Max[XDIM])
   {
-    for(i[0] = 0; i[0] < _N; i[0]++)
-    {
-      _X->GetElemAsVariant(i, &x);
-      _Y->GetElemAsVariant(i, &y);
+    if(visible.Min[XDIM] > xmin) xmin = visible.Min[XDIM];
+    if(visible.Max[XDIM] < xmax) xmax = visible.Max[XDIM];
+  }
 
-      glColor4ub(GetA(_Color), GetB(_Color), GetG(_Color), GetR(_Color));
-      glVertex3f(VariantValueAsFloat(x), VariantValueAsFloat(y), 0.0f);
-    }
+  columns = (int)ceilf((xmax - xmin) * context.GetPixelsPerModelUnit());
+  if(columns > context.GetViewportWidth())
+    columns = context.GetViewportWidth();
+  if(columns < 1)
+    columns = 1;
+
+  retval = _Series.Decimate(xmin, xmax, columns, _Decimation, &verts, &nverts);
+
+  if(NVN_NOERR == retval && nverts > 0)
+  {
+    glLineWidth(5.0f);
+    glColor4ub(GetA(_Color), GetB(_Color), GetG(_Color), GetR(_Color));
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(2, GL_FLOAT, 0, verts);
+    glDrawArrays(1 == nverts ? GL_POINTS : GL_LINE_STRIP, 0, nverts);
+    glDisableClientState(GL_VERTEX_ARRAY);
+  }
+
+  return retval;
+}
+
+int Plot2DLayer::SetDecimation(int mode)
+{
+  int retval = NVN_NOERR;
+
+  // Nothing else marks the plot as changed, so the revision is bumped to
+  // have the windows that show it redraw with the new mode.
+  if(mode != _Decimation)
+  {
+    _Decimation = mode;
+    _Revision++;
   }
-  glEnd();
 
   return retval;
 }
@@ -102,5 +163,6 @@ int Plot2DLayer::SetModelCRS(const CartesianCRS& crs)
 {
   int retval = NVN_NOERR;
   _ModelCrs = crs;
+  this->InvalidateBounds();
   return retval;
 }
@@ -13,6 +13,7 @@
 
 #include "CartesianCRS.hpp"
 #include "Layer.hpp"
+#include "SeriesDecimator.hpp"
 
 #define MPICH_SKIP_MPICXX 1
 #include <mpi.h>
@@ -27,13 +28,21 @@ public:
   virtual ~Plot2DLayer();
 
 public:
-  virtual NVN_BBox GetBounds() const;
   virtual const CRS& GetDataCRS() const { return _DataCrs; }
 
 public:
-  virtual int Render();
+  virtual int Probe(float x, float y, float radius,
+                    NVN_ProbeResult* result) const;
+  virtual int Render(const RenderContext& context);
   virtual int SetModelCRS(const CartesianCRS& crs);
 
+public:
+  int GetDecimation() const { return _Decimation; }
+  int SetDecimation(int mode);
+
+protected:
+  virtual NVN_BBox ComputeBounds() const;
+
 protected:
   DataGrid* _X;
   DataGrid* _Y;
@@ -43,6 +52,8 @@ protected:
   Variant _MinX, _MinY;
   Variant _MaxX, _MaxY;
   CartesianCRS _DataCrs;
+  SeriesDecimator _Series;
+  int _Decimation;
 };
 
 #endif
@@ -0,0 +1,571 @@
+/*
+ * RasterTiles.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Timothy Morey
+ */
+
+
+#include "nvn.h"
+
+#include "FrameProfiler.hpp"
+#include "GridTransform.hpp"
+#include "RasterTiles.hpp"
+#include "RenderContext.hpp"
+#include "Trace.hpp"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <GL/gl.h>
+
+#include <vector>
+
+
+static int GetNLevels(int width, int height);
+
+
+/******************************************************************************
+ * Constructors
+ ******************************************************************************/
+
+RasterTiles::RasterTiles()
+  : _Width(0),
+    _Height(0),
+    _ColorFunc(0),
+    _ColorArg(0),
+    _NResident(0),
+    _Frame(0)
+{
+  _Overview.TextureID = 0;
+  _Overview.Pixels = 0;
+}
+
+RasterTiles::~RasterTiles()
+{
+  // The textures belong to a GL context that may already be gone, so they are
+  // only released by an explicit call to Clear.
+}
+
+
+/******************************************************************************
+ * Public Members
+ ******************************************************************************/
+
+int RasterTiles::Clear()
+{
+  int retval = NVN_NOERR;
+
+  for(size_t i = 0; i < _Tiles.size(); i++)
+  {
+    if(_Tiles[i].TextureID)
+      glDeleteTextures(1, &_Tiles[i].TextureID);
+  }
+
+  if(_Overview.TextureID)
+    glDeleteTextures(1, &_Overview.TextureID);
+
+  _Tiles.clear();
+  _Overview.TextureID = 0;
+  _NResident = 0;
+
+  return retval;
+}
+
+int RasterTiles::Render(const RenderContext& context,
+                        const GridTransform& transform, float z,
+                        bool* complete)
+{
+  int retval = NVN_NOERR;
+  std::vector<Tile*> visible;
+  Tile* batch[RASTER_TILES_PER_FRAME + 1];
+  int nbatch = 0;
+  int nmissing = 0;
+  NVN_BBox bounds;
+  float ambient[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+
+  if(_Tiles.empty())
+    retval = this->Layout();
+
+  _Frame++;
+
+  // The overview is always built first, so that there is something to show
+  // for every tile that is not ready yet.
+  if(NVN_NOERR == retval && ! _Overview.TextureID)
+    batch[nbatch++] = &_Overview;
+
+  for(size_t i = 0; NVN_NOERR == retval && i < _Tiles.size(); i++)
+  {
+    this->GetTileBounds(_Tiles[i], transform, z, &bounds);
+
+    if(context.IsVisible(bounds))
+    {
+      visible.push_back(&_Tiles[i]);
+      _Tiles[i].LastUsed = _Frame;
+
+      if(! _Tiles[i].TextureID)
+      {
+        if(! context.IsProgressive() || nbatch < RASTER_TILES_PER_FRAME)
+        {
+          // A frame that must be complete builds everything it can see, in
+          // batches that keep the memory for the pixels bounded.
+          batch[nbatch++] = &_Tiles[i];
+
+          if(RASTER_TILES_PER_FRAME < nbatch)
+          {
+            retval = this->Build(batch, nbatch, context);
+            nbatch = 0;
+          }
+        }
+        else
+        {
+          nmissing++;
+        }
+      }
+    }
+  }
+
+  if(NVN_NOERR == retval && 0 < nbatch)
+    retval = this->Build(batch, nbatch, context);
+
+  if(NVN_NOERR == retval)
+    retval = this->Evict();
+
+  if(NVN_NOERR == retval)
+  {
+    // The raster is not lit, so it is tinted by the ambient light to match
+    // the meshes drawn around it.
+    if(glIsEnabled(GL_LIGHTING))
+      glGetFloatv(GL_LIGHT_MODEL_AMBIENT, ambient);
+
+    // Only points where all four corners of a cell have data are opaque
+    // enough to pass the alpha test, which leaves out the same cells that a
+    // mesh would.
+    glPushAttrib(GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_TEXTURE_BIT |
+                 GL_DEPTH_BUFFER_BIT | GL_CURRENT_BIT);
+    glDisable(GL_LIGHTING);
+    glEnable(GL_ALPHA_TEST);
+    glAlphaFunc(GL_GREATER, 0.99f);
+    glDepthFunc(GL_LEQUAL);
+    glEnable(GL_TEXTURE_2D);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+    glColor4f(ambient[0], ambient[1], ambient[2], 1.0f);
+
+    if(0 < nmissing && _Overview.TextureID)
+      this->Draw(_Overview, transform, z);
+
+    for(size_t i = 0; i < visible.size(); i++)
+    {
+      if(visible[i]->TextureID)
+        this->Draw(*visible[i], transform, z);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glPopAttrib();
+  }
+
+  if(complete)
+    *complete = 0 == nmissing;
+
+  return retval;
+}
+
+int RasterTiles::SetGrid(MPI_Offset width, MPI_Offset height,
+                         ColorFunc func, const void* arg)
+{
+  int retval = NVN_NOERR;
+
+  if(_Tiles.empty() && ! _Overview.TextureID)
+  {
+    _Width = width;
+    _Height = height;
+    _ColorFunc = func;
+    _ColorArg = arg;
+  }
+  else
+  {
+    // The tiles have to be released in the GL context first.
+    retval = NVN_ERROR;
+  }
+
+  return retval;
+}
+
+
+/******************************************************************************
+ * Protected Members
+ ******************************************************************************/
+
+int RasterTiles::Build(Tile* batch[], int ntiles, const RenderContext& context)
+{
+  int retval = NVN_NOERR;
+  TraceScope trace("RasterTiles::Build", "mesh");
+  FrameProfiler* profiler = context.GetProfiler();
+  int nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  pthread_t threads[RASTER_MAX_THREADS];
+  bool started[RASTER_MAX_THREADS];
+  Task tasks[RASTER_MAX_THREADS];
+
+  if(profiler)
+    profiler->Begin(NVN_PHASE_MESH);
+
+  if(nthreads > RASTER_MAX_THREADS) nthreads = RASTER_MAX_THREADS;
+  if(nthreads > ntiles) nthreads = ntiles;
+  if(nthreads < 1) nthreads = 1;
+
+  // The tiles are colored in parallel, but GL is only called from this
+  // thread, once they are all done.
+  for(int t = 0; t < nthreads; t++)
+  {
+    tasks[t].Tiles = this;
+    tasks[t].Batch = batch;
+    tasks[t].NTiles = ntiles;
+    tasks[t].First = t;
+    tasks[t].Stride = nthreads;
+    started[t] = t > 0 &&
+      0 == pthread_create(&threads[t], 0, FillThreadEntryPoint, &tasks[t]);
+  }
+
+  for(int t = 0; t < nthreads; t++)
+  {
+    if(! started[t])
+      FillThreadEntryPoint(&tasks[t]);
+  }
+
+  for(int t = 0; t < nthreads; t++)
+  {
+    if(started[t])
+      pthread_join(threads[t], 0);
+  }
+
+  for(int i = 0; i < ntiles; i++)
+  {
+    if(batch[i]->Pixels && NVN_NOERR == this->Upload(batch[i]))
+      _NResident++;
+    else
+      retval = NVN_ERROR;
+
+    free(batch[i]->Pixels);
+    batch[i]->Pixels = 0;
+  }
+
+  if(profiler)
+    profiler->End(NVN_PHASE_MESH);
+
+  return retval;
+}
+
+int RasterTiles::Draw(const Tile& tile, const GridTransform& transform,
+                      float z) const
+{
+  int retval = NVN_NOERR;
+  MPI_Offset pt[MAX_DIMS] = { 0 };
+  MPI_Offset end[2];
+  float s[2], t[2];
+  float corner[4][MAX_DIMS];
+
+  // A coarse tile may sample past the end of the grid, so the quad is cut
+  // back to the last grid point, and its texture coordinates with it.  The
+  // texel centers sit on the grid points.
+  end[0] = MIN(tile.Start[0] + (MPI_Offset)(tile.Size[0] - 1) * tile.Step,
+               _Width - 1);
+  end[1] = MIN(tile.Start[1] + (MPI_Offset)(tile.Size[1] - 1) * tile.Step,
+               _Height - 1);
+
+  s[0] = 0.5f / tile.Size[0];
+  t[0] = 0.5f / tile.Size[1];
+  s[1] = (0.5f + (float)(end[0] - tile.Start[0]) / tile.Step) / tile.Size[0];
+  t[1] = (0.5f + (float)(end[1] - tile.Start[1]) / tile.Step) / tile.Size[1];
+
+  for(int c = 0; c < 4; c++)
+  {
+    pt[0] = (1 == c || 2 == c) ? end[0] : tile.Start[0];
+    pt[1] = (2 <= c) ? end[1] : tile.Start[1];
+    transform.GridToModel(pt, corner[c]);
+  }
+
+  glBindTexture(GL_TEXTURE_2D, tile.TextureID);
+
+  glBegin(GL_QUADS);
+  glTexCoord2f(s[0], t[0]);  glVertex3f(corner[0][XDIM], corner[0][YDIM], z);
+  glTexCoord2f(s[1], t[0]);  glVertex3f(corner[1][XDIM], corner[1][YDIM], z);
+  glTexCoord2f(s[1], t[1]);  glVertex3f(corner[2][XDIM], corner[2][YDIM], z);
+  glTexCoord2f(s[0], t[1]);  glVertex3f(corner[3][XDIM], corner[3][YDIM], z);
+  glEnd();
+
+  return retval;
+}
+
+int RasterTiles::Evict()
+{
+  int retval = NVN_NOERR;
+  Tile* oldest;
+
+  // Tiles drawn by this frame are never released, even if there are more of
+  // them than RASTER_MAX_RESIDENT.
+  while(_NResident > RASTER_MAX_RESIDENT)
+  {
+    oldest = 0;
+
+    for(size_t i = 0; i < _Tiles.size(); i++)
+    {
+      if(_Tiles[i].TextureID && _Tiles[i].LastUsed != _Frame &&
+         (! oldest || _Tiles[i].LastUsed < oldest->LastUsed))
+      {
+        oldest = &_Tiles[i];
+      }
+    }
+
+    if(! oldest)
+      break;
+
+    glDeleteTextures(1, &oldest->TextureID);
+    oldest->TextureID = 0;
+    _NResident--;
+  }
+
+  return retval;
+}
+
+int RasterTiles::Fill(Tile* tile) const
+{
+  int retval = NVN_NOERR;
+  MPI_Offset pt[MAX_DIMS] = { 0 };
+  int nlevels = GetNLevels(tile->Size[0], tile->Size[1]);
+  size_t npixels = 0;
+  int w, h, sw, sh;
+  unsigned char* src;
+  unsigned char* dst;
+  unsigned char* p;
+  int* texel;
+  int x0, x1, y0, y1;
+  unsigned int sum[4], weight;
+
+  w = tile->Size[0];
+  h = tile->Size[1];
+  for(int l = 0; l < nlevels; l++)
+  {
+    npixels += (size_t)w * h;
+    w = MAX(w / 2, 1);
+    h = MAX(h / 2, 1);
+  }
+
+  tile->Pixels = (unsigned char*)malloc(npixels * 4);
+
+  if(! tile->Pixels)
+  {
+    retval = NVN_ERROR;
+  }
+  else
+  {
+    texel = (int*)tile->Pixels;
+
+    for(int j = 0; j < tile->Size[1]; j++)
+    {
+      pt[1] = MIN(tile->Start[1] + (MPI_Offset)j * tile->Step, _Height - 1);
+
+      for(int i = 0; i < tile->Size[0]; i++, texel++)
+      {
+        pt[0] = MIN(tile->Start[0] + (MPI_Offset)i * tile->Step, _Width - 1);
+        *texel = _ColorFunc(_ColorArg, pt);
+      }
+    }
+
+    // Each mipmap level averages 2x2 texels of the one before, with the
+    // colors weighted by alpha, so that points without data do not darken the
+    // points around them.
+    src = tile->Pixels;
+    sw = tile->Size[0];
+    sh = tile->Size[1];
+
+    for(int l = 1; l < nlevels; l++)
+    {
+      dst = src + (size_t)sw * sh * 4;
+      w = MAX(sw / 2, 1);
+      h = MAX(sh / 2, 1);
+
+      for(int y = 0; y < h; y++)
+      {
+        y0 = MIN(2 * y, sh - 1);
+        y1 = MIN(2 * y + 1, sh - 1);
+
+        for(int x = 0; x < w; x++)
+        {
+          x0 = MIN(2 * x, sw - 1);
+          x1 = MIN(2 * x + 1, sw - 1);
+
+          sum[0] = sum[1] = sum[2] = sum[3] = 0;
+
+          for(int k = 0; k < 4; k++)
+          {
+            p = src + ((size_t)((k & 2) ? y1 : y0) * sw +
+                       ((k & 1) ? x1 : x0)) * 4;
+            for(int c = 0; c < 3; c++)
+              sum[c] += p[c] * p[3];
+            sum[3] += p[3];
+          }
+
+          p = dst + ((size_t)y * w + x) * 4;
+          weight = sum[3];
+          for(int c = 0; c < 3; c++)
+            p[c] = weight ? (unsigned char)(sum[c] / weight) : 0;
+          p[3] = (unsigned char)(sum[3] / 4);
+        }
+      }
+
+      src = dst;
+      sw = w;
+      sh = h;
+    }
+  }
+
+  return retval;
+}
+
+int RasterTiles::GetTileBounds(const Tile& tile,
+                               const GridTransform& transform, float z,
+                               NVN_BBox* bounds) const
+{
+  int retval = NVN_NOERR;
+  MPI_Offset pt[MAX_DIMS] = { 0 };
+  MPI_Offset end[2];
+  float pos[MAX_DIMS] = { 0.0f };
+
+  *bounds = NVN_BBoxEmpty;
+  bounds->Min[ZDIM] = bounds->Max[ZDIM] = z;
+
+  end[0] = MIN(tile.Start[0] + (MPI_Offset)(tile.Size[0] - 1) * tile.Step,
+               _Width - 1);
+  end[1] = MIN(tile.Start[1] + (MPI_Offset)(tile.Size[1] - 1) * tile.Step,
+               _Height - 1);
+
+  // The transform is affine, so the tile's corners bound it.
+  for(int c = 0; c < 4; c++)
+  {
+    pt[0] = (c & 1) ? end[0] : tile.Start[0];
+    pt[1] = (c & 2) ? end[1] : tile.Start[1];
+    transform.GridToModel(pt, pos);
+
+    for(int i = XDIM; i <= YDIM; i++)
+    {
+      if(0 == c || pos[i] < bounds->Min[i]) bounds->Min[i] = pos[i];
+      if(0 == c || pos[i] > bounds->Max[i]) bounds->Max[i] = pos[i];
+    }
+  }
+
+  return retval;
+}
+
+int RasterTiles::Layout()
+{
+  int retval = NVN_NOERR;
+  int step = 1;
+  Tile tile;
+
+  if(_Width < 2 || _Height < 2 || ! _ColorFunc)
+  {
+    retval = NVN_EINVARGS;
+  }
+  else
+  {
+    tile.Step = 1;
+    tile.TextureID = 0;
+    tile.LastUsed = 0;
+    tile.Pixels = 0;
+
+    // Neighbouring tiles overlap by one grid point, so that every cell lies
+    // wholly inside some tile.
+    for(MPI_Offset j = 0; j < _Height - 1; j += RASTER_TILE_SIZE - 1)
+    {
+      for(MPI_Offset i = 0; i < _Width - 1; i += RASTER_TILE_SIZE - 1)
+      {
+        tile.Start[0] = i;
+        tile.Start[1] = j;
+        tile.Size[0] = RASTER_TILE_SIZE;
+        tile.Size[1] = RASTER_TILE_SIZE;
+        if(_Width - i < RASTER_TILE_SIZE) tile.Size[0] = (int)(_Width - i);
+        if(_Height - j < RASTER_TILE_SIZE) tile.Size[1] = (int)(_Height - j);
+        _Tiles.push_back(tile);
+      }
+    }
+
+    // The overview samples the whole grid into a single tile, and may run
+    // one sample past the end of the grid.
+    while((_Width - 2) / step + 2 > RASTER_TILE_SIZE ||
+          (_Height - 2) / step + 2 > RASTER_TILE_SIZE)
+    {
+      step++;
+    }
+
+    _Overview.Start[0] = 0;
+    _Overview.Start[1] = 0;
+    _Overview.Size[0] = (int)(1 == step ? _Width : (_Width - 2) / step + 2);
+    _Overview.Size[1] = (int)(1 == step ? _Height : (_Height - 2) / step + 2);
+    _Overview.Step = step;
+    _Overview.TextureID = 0;
+    _Overview.LastUsed = 0;
+    _Overview.Pixels = 0;
+  }
+
+  return retval;
+}
+
+int RasterTiles::Upload(Tile* tile)
+{
+  int retval = NVN_NOERR;
+  int nlevels = GetNLevels(tile->Size[0], tile->Size[1]);
+  int w = tile->Size[0];
+  int h = tile->Size[1];
+  unsigned char* pixels = tile->Pixels;
+
+  glGenTextures(1, &tile->TextureID);
+  glBindTexture(GL_TEXTURE_2D, tile->TextureID);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                  GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, nlevels - 1);
+
+  for(int l = 0; l < nlevels; l++)
+  {
+    glTexImage2D(GL_TEXTURE_2D, l, GL_RGBA, w, h, 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    pixels += (size_t)w * h * 4;
+    w = MAX(w / 2, 1);
+    h = MAX(h / 2, 1);
+  }
+
+  return retval;
+}
+
+void* RasterTiles::FillThreadEntryPoint(void* arg)
+{
+  Task* task = (Task*)arg;
+
+  for(int i = task->First; i < task->NTiles; i += task->Stride)
+    task->Tiles->Fill(task->Batch[i]);
+
+  return 0;
+}
+
+
+/******************************************************************************
+ * Helpers
+ ******************************************************************************/
+
+int GetNLevels(int width, int height)
+{
+  int nlevels = 1;
+
+  while(1 < width || 1 < height)
+  {
+    width = MAX(width / 2, 1);
+    height = MAX(height / 2, 1);
+    nlevels++;
+  }
+
+  return nlevels;
+}
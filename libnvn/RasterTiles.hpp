@@ -0,0 +1,125 @@
+/*
+ * RasterTiles.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Timothy Morey
+ */
+
+#ifndef __RASTERTILES_HPP__
+#define __RASTERTILES_HPP__
+
+
+#include "nvn.h"
+
+#include "GridTransform.hpp"
+#include "RenderContext.hpp"
+
+#include <vector>
+
+
+/**
+ * The number of texels along each side of a tile.  Neighbouring tiles share
+ * the grid points along their common edge, so that the filtering is seamless.
+ */
+#define RASTER_TILE_SIZE 256
+
+/**
+ * The most tiles that are kept as textures.  The tiles that have gone unused
+ * for the longest are released first.
+ */
+#define RASTER_MAX_RESIDENT 256
+
+/**
+ * The most tiles that are built for a progressive frame.  The rest of the
+ * view is covered by the overview until later frames have built them.
+ */
+#define RASTER_TILES_PER_FRAME 16
+
+/**
+ * The most threads that color tiles at once.
+ */
+#define RASTER_MAX_THREADS 16
+
+
+/**
+ * RasterTiles draws a regular 2D grid as a flat image, with one texel per
+ * grid point, in place of a triangle mesh.  The grid is split into square
+ * tiles that are colored and mipmapped on demand, only once they come into
+ * view, and a single coarse overview stands in for the tiles that are not
+ * ready yet.  The GL context must be current for Clear and Render.
+ */
+class RasterTiles
+{
+public:
+  /**
+   * Gives the color of the grid point pt[], as packed by color-ramp.h, with
+   * an alpha of zero for a point that has no data.  It is called from several
+   * threads at once.
+   */
+  typedef int (*ColorFunc)(const void* arg, const MPI_Offset pt[]);
+
+public:
+  RasterTiles();
+  ~RasterTiles();
+
+public:
+  int Clear();
+
+  /**
+   * Draws the visible part of the grid on the plane at height z.  The flag
+   * complete is cleared if any part of it was drawn from the overview, in
+   * which case the caller should ask for another frame.
+   */
+  int Render(const RenderContext& context, const GridTransform& transform,
+             float z, bool* complete);
+
+  int SetGrid(MPI_Offset width, MPI_Offset height,
+              ColorFunc func, const void* arg);
+
+public:
+  int GetNResident() const { return _NResident; }
+
+protected:
+  struct Tile
+  {
+    MPI_Offset Start[2];          // The grid point of the first texel
+    int Size[2];                  // The texels along each dimension
+    int Step;                     // The grid points between texels
+    unsigned int TextureID;       // 0 until the tile is resident
+    unsigned int LastUsed;        // The frame that last drew the tile
+    unsigned char* Pixels;        // Every mipmap level, while being built
+  };
+
+  struct Task
+  {
+    const RasterTiles* Tiles;
+    Tile** Batch;
+    int NTiles;
+    int First;
+    int Stride;
+  };
+
+protected:
+  int Build(Tile* batch[], int ntiles, const RenderContext& context);
+  int Draw(const Tile& tile, const GridTransform& transform, float z) const;
+  int Evict();
+  int Fill(Tile* tile) const;
+  int GetTileBounds(const Tile& tile, const GridTransform& transform, float z,
+                    NVN_BBox* bounds) const;
+  int Layout();
+  int Upload(Tile* tile);
+
+  static void* FillThreadEntryPoint(void* arg);
+
+protected:
+  MPI_Offset _Width;
+  MPI_Offset _Height;
+  ColorFunc _ColorFunc;
+  const void* _ColorArg;
+  std::vector<Tile> _Tiles;
+  Tile _Overview;
+  int _NResident;
+  unsigned int _Frame;
+};
+
+#endif
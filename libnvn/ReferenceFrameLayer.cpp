@@ -26,7 +26,7 @@ ReferenceFrameLayer::~ReferenceFrameLayer()
 
 }
 
-int ReferenceFrameLayer::Render()
+int ReferenceFrameLayer::Render(const RenderContext& context)
 {
   int retval = NVN_NOERR;
 
@@ -85,7 +85,13 @@ int ReferenceFrameLayer::Render()
 int ReferenceFrameLayer::SetBounds(NVN_BBox bounds)
 {
   int retval = NVN_NOERR;
-  _Bounds = bounds;
+
+  if(0 != memcmp(&bounds, &_Bounds, sizeof(NVN_BBox)))
+  {
+    _Bounds = bounds;
+    this->InvalidateBounds();
+  }
+
   return retval;
 }
 
@@ -93,5 +99,6 @@ int ReferenceFrameLayer::SetModelCRS(const CartesianCRS& crs)
 {
   int retval = NVN_NOERR;
   _ModelCrs = crs;
+  this->InvalidateBounds();
   return retval;
 }
@@ -22,14 +22,16 @@ public:
   virtual ~ReferenceFrameLayer();
 
 public:
-  virtual NVN_BBox GetBounds() const { return _Bounds; }
   virtual const CRS& GetDataCRS() const { return _ModelCrs; }
 
 public:
-  virtual int Render();
+  virtual int Render(const RenderContext& context);
   int SetBounds(NVN_BBox bounds);
   int SetModelCRS(const CartesianCRS& crs);
 
+protected:
+  virtual NVN_BBox ComputeBounds() const { return _Bounds; }
+
 protected:
   NVN_BBox _Bounds;
 };
@@ -0,0 +1,261 @@
+/*
+ * RenderContext.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Timothy Morey
+ */
+
+
+#include "nvn.h"
+
+#include "RenderContext.hpp"
+
+#include <float.h>
+#include <GL/gl.h>
+#include <math.h>
+
+
+/******************************************************************************
+ * Constructors
+ ******************************************************************************/
+
+RenderContext::RenderContext(float pixelsPerModelUnit)
+  : _PixelsPerModelUnit(pixelsPerModelUnit),
+    _Profiler(0),
+    _Detail(1.0f),
+    _Progressive(false),
+    _FrameRequested(false),
+    _ShareGroup(0),
+    _Window(0),
+    _ViewportWidth(0),
+    _ViewportHeight(0)
+{
+  float proj[16], modelview[16];
+  float* clip = _Clip;
+  int viewport[4];
+
+  glGetFloatv(GL_PROJECTION_MATRIX, proj);
+  glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+  glGetIntegerv(GL_VIEWPORT, viewport);
+
+  _ViewportWidth = viewport[2];
+  _ViewportHeight = viewport[3];
+
+  // clip = proj * modelview, with both matrices stored column-major.
+  for(int col = 0; col < 4; col++)
+  {
+    for(int row = 0; row < 4; row++)
+    {
+      clip[col * 4 + row] = 0.0f;
+      for(int k = 0; k < 4; k++)
+        clip[col * 4 + row] += proj[k * 4 + row] * modelview[col * 4 + k];
+    }
+  }
+
+  // The frustum planes are sums and differences of the rows of the clip
+  // matrix (Gribb and Hartmann).  Each plane faces into the frustum.
+  for(int i = 0; i < 3; i++)
+  {
+    for(int col = 0; col < 4; col++)
+    {
+      _Planes[2 * i][col] = clip[col * 4 + 3] + clip[col * 4 + i];
+      _Planes[2 * i + 1][col] = clip[col * 4 + 3] - clip[col * 4 + i];
+    }
+  }
+}
+
+RenderContext::~RenderContext()
+{
+
+}
+
+
+/******************************************************************************
+ * Public Members
+ ******************************************************************************/
+
+NVN_BBox RenderContext::GetVisibleBounds() const
+{
+  NVN_BBox bounds = NVN_BBoxEmpty;
+  float corners[4][2] = { { -1.0f, -1.0f }, { 1.0f, -1.0f },
+                          { 1.0f, 1.0f }, { -1.0f, 1.0f } };
+  float a = _Clip[0], b = _Clip[4], c = _Clip[1], d = _Clip[5];
+  float det = a * d - b * c;
+
+  // Each corner of the viewport is a point on the z = 0 plane where
+  //   clip * (x, y, 0, 1) = (ndcx, ndcy, ?, 1),
+  // which is a 2x2 linear system in x and y.
+  if(fabsf(det) > FLT_MIN)
+  {
+    for(int i = 0; i < 4; i++)
+    {
+      float rx = corners[i][0] - _Clip[12];
+      float ry = corners[i][1] - _Clip[13];
+      float x = (d * rx - b * ry) / det;
+      float y = (a * ry - c * rx) / det;
+
+      if(0 == i || x < bounds.Min[XDIM]) bounds.Min[XDIM] = x;
+      if(0 == i || x > bounds.Max[XDIM]) bounds.Max[XDIM] = x;
+      if(0 == i || y < bounds.Min[YDIM]) bounds.Min[YDIM] = y;
+      if(0 == i || y > bounds.Max[YDIM]) bounds.Max[YDIM] = y;
+    }
+  }
+
+  return bounds;
+}
+
+int RenderContext::GetDetailStride() const
+{
+  int stride = 1;
+
+  // Striding a grid in both dimensions divides its triangles by the square of
+  // the stride.
+  while(stride < LOD_MAX_STRIDE && stride * stride * _Detail < 1.0f)
+    stride *= 2;
+
+  return stride;
+}
+
+bool RenderContext::IsVisible(const NVN_BBox& bounds) const
+{
+  bool visible = true;
+  float min[3], max[3];
+
+  for(int i = 0; i < 3; i++)
+  {
+    if(bounds.Min[i] <= bounds.Max[i])
+    {
+      min[i] = bounds.Min[i];
+      max[i] = bounds.Max[i];
+    }
+    else
+    {
+      min[i] = 0.0f;
+      max[i] = 0.0f;
+    }
+  }
+
+  // The box is outside if its corner that lies furthest along a plane's
+  // normal is still behind that plane.
+  for(int p = 0; p < 6 && visible; p++)
+  {
+    const float* plane = _Planes[p];
+    float d = plane[3];
+
+    for(int i = 0; i < 3; i++)
+      d += plane[i] * (plane[i] >= 0.0f ? max[i] : min[i]);
+
+    if(d < 0.0f)
+      visible = false;
+  }
+
+  return visible;
+}
+
+bool RenderContext::IsTopDown() const
+{
+  // Column 2 of the clip matrix carries z into the clip coordinates, and only
+  // its depth row may be nonzero.  The rotations leave rounding error behind,
+  // so it is measured against the x and y columns.
+  float scale = fabsf(_Clip[0]) + fabsf(_Clip[1]) +
+                fabsf(_Clip[4]) + fabsf(_Clip[5]);
+
+  return fabsf(_Clip[8]) + fabsf(_Clip[9]) <= 1.0e-5f * scale;
+}
+
+bool RenderContext::Unproject(const float ndc[], float pos[]) const
+{
+  bool found = true;
+  double m[4][8];
+  double in[4], out[4];
+  double pivot, factor;
+  int best;
+
+  // The clip matrix is inverted by Gauss-Jordan elimination on [clip | I],
+  // with the rows taken from the column-major storage.
+  for(int row = 0; row < 4; row++)
+  {
+    for(int col = 0; col < 4; col++)
+    {
+      m[row][col] = _Clip[col * 4 + row];
+      m[row][col + 4] = row == col ? 1.0 : 0.0;
+    }
+  }
+
+  for(int col = 0; col < 4 && found; col++)
+  {
+    best = col;
+    for(int row = col + 1; row < 4; row++)
+    {
+      if(fabs(m[row][col]) > fabs(m[best][col]))
+        best = row;
+    }
+
+    if(fabs(m[best][col]) < DBL_MIN)
+    {
+      found = false;
+    }
+    else
+    {
+      for(int k = 0; k < 8; k++)
+      {
+        double tmp = m[col][k];
+        m[col][k] = m[best][k];
+        m[best][k] = tmp;
+      }
+
+      pivot = m[col][col];
+      for(int k = 0; k < 8; k++)
+        m[col][k] /= pivot;
+
+      for(int row = 0; row < 4; row++)
+      {
+        factor = m[row][col];
+        if(row != col && 0.0 != factor)
+        {
+          for(int k = 0; k < 8; k++)
+            m[row][k] -= factor * m[col][k];
+        }
+      }
+    }
+  }
+
+  if(found)
+  {
+    in[0] = ndc[0];
+    in[1] = ndc[1];
+    in[2] = ndc[2];
+    in[3] = 1.0;
+
+    for(int row = 0; row < 4; row++)
+    {
+      out[row] = 0.0;
+      for(int k = 0; k < 4; k++)
+        out[row] += m[row][k + 4] * in[k];
+    }
+
+    if(fabs(out[3]) < DBL_MIN)
+    {
+      found = false;
+    }
+    else
+    {
+      for(int i = 0; i < 3; i++)
+        pos[i] = (float)(out[i] / out[3]);
+    }
+  }
+
+  return found;
+}
+
+bool RenderContext::IsSameView(const RenderContext& other) const
+{
+  bool same = _ViewportWidth == other._ViewportWidth &&
+    _ViewportHeight == other._ViewportHeight &&
+    this->GetDetailStride() == other.GetDetailStride();
+
+  for(int i = 0; i < 16 && same; i++)
+    same = _Clip[i] == other._Clip[i];
+
+  return same;
+}
@@ -0,0 +1,138 @@
+/*
+ * RenderContext.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Timothy Morey
+ */
+
+#ifndef __RENDERCONTEXT_HPP__
+#define __RENDERCONTEXT_HPP__
+
+
+#include "nvn.h"
+
+/**
+ * The coarsest grid stride that layers are asked to draw at while the view
+ * is being moved.
+ */
+#define LOD_MAX_STRIDE 16
+
+
+class FrameProfiler;
+
+/**
+ * A RenderContext describes the view that a frame is being rendered for.  It
+ * is captured from the GL state once the projection and modelview matrices
+ * have been set up, and is passed down to every layer, so that layers can skip
+ * geometry that falls outside of the view frustum.
+ */
+class RenderContext
+{
+public:
+  RenderContext(float pixelsPerModelUnit);
+  ~RenderContext();
+
+public:
+  float GetPixelsPerModelUnit() const { return _PixelsPerModelUnit; }
+  int GetViewportWidth() const { return _ViewportWidth; }
+  int GetViewportHeight() const { return _ViewportHeight; }
+
+  /**
+   * The profiler of the frame being rendered, or 0 if it is not profiled.
+   */
+  FrameProfiler* GetProfiler() const { return _Profiler; }
+  void SetProfiler(FrameProfiler* profiler) { _Profiler = profiler; }
+
+  /**
+   * The fraction of the full-detail work that the frame can afford, which
+   * is 1 except while the view is being moved on a scene that is too slow to
+   * draw at full detail.
+   */
+  float GetDetail() const { return _Detail; }
+  void SetDetail(float detail) { _Detail = detail; }
+
+  /**
+   * The stride at which grid layers should sample their points to fit in the
+   * detail of the frame.  It is always a power of two, so that the layers can
+   * keep a reduced mesh from one frame to the next.
+   */
+  int GetDetailStride() const;
+
+  /**
+   * Identifies the GL contexts that share objects with the one being drawn.
+   * Objects made in one share group cannot be used in any other.
+   */
+  int GetShareGroup() const { return _ShareGroup; }
+  void SetShareGroup(int sharegroup) { _ShareGroup = sharegroup; }
+
+  /**
+   * Identifies the window being drawn, so that layers which keep an image of
+   * the view can keep one for each window.  Frames that are not drawn for a
+   * window all have window 0.
+   */
+  int GetWindow() const { return _Window; }
+  void SetWindow(int window) { _Window = window; }
+
+  /**
+   * Whether layers may spread expensive work over several frames, drawing a
+   * stand-in for whatever is not ready yet and calling RequestFrame to ask
+   * for another frame.  Frames that are read back, or that must match the
+   * frames of other ranks, are never progressive.
+   */
+  bool IsProgressive() const { return _Progressive; }
+  void SetProgressive(bool progressive) { _Progressive = progressive; }
+
+  /**
+   * Asks the window for another frame once this one is done, without
+   * changing the revision of the layer, so that nothing that is cached
+   * against the revisions of the model has to be rebuilt.
+   */
+  void RequestFrame() const { _FrameRequested = true; }
+  bool IsFrameRequested() const { return _FrameRequested; }
+
+  /**
+   * Finds the part of the z = 0 plane that is covered by the viewport, which
+   * is exact for the orthographic projections used by the windows.
+   */
+  NVN_BBox GetVisibleBounds() const;
+
+  /**
+   * Conservatively tests if any part of the box may be visible.  Dimensions
+   * for which the box is empty are treated as lying at zero.
+   */
+  bool IsVisible(const NVN_BBox& bounds) const;
+
+  /**
+   * Tests if the view looks straight down the z axis, so that the height of
+   * a point has no effect on where it lands in the viewport.
+   */
+  bool IsTopDown() const;
+
+  /**
+   * Finds the model point that projects to the normalized device coordinates
+   * ndc[], where the depth ndc[2] runs from -1 at the near plane to 1 at the
+   * far plane.  Fails if the view cannot be inverted.
+   */
+  bool Unproject(const float ndc[], float pos[]) const;
+
+  /**
+   * Tests if this context has the same view and detail as another, so that
+   * anything drawn for one can be reused for the other.
+   */
+  bool IsSameView(const RenderContext& other) const;
+
+protected:
+  float _Clip[16];
+  float _Planes[6][4];
+  float _PixelsPerModelUnit;
+  FrameProfiler* _Profiler;
+  float _Detail;
+  bool _Progressive;
+  mutable bool _FrameRequested;
+  int _ShareGroup;
+  int _Window;
+  int _ViewportWidth;
+  int _ViewportHeight;
+};
+
+#endif
@@ -0,0 +1,396 @@
+/*
+ * SeriesDecimator.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Timothy Morey
+ */
+
+
+#include "nvn.h"
+
+#include "SeriesDecimator.hpp"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+/******************************************************************************
+ * Constructors
+ ******************************************************************************/
+
+SeriesDecimator::SeriesDecimator()
+  : _X(0),
+    _Y(0),
+    _N(0),
+    _Capacity(0),
+    _Sorted(true),
+    _NLevels(1),
+    _Verts(0),
+    _NVerts(0),
+    _VertCapacity(0)
+{
+  for(int k = 0; k < DECIMATOR_MAX_LEVELS; k++)
+  {
+    _MinIndex[k] = 0;
+    _MaxIndex[k] = 0;
+  }
+}
+
+SeriesDecimator::~SeriesDecimator()
+{
+  free(_X);
+  free(_Y);
+  free(_Verts);
+
+  for(int k = 0; k < DECIMATOR_MAX_LEVELS; k++)
+  {
+    free(_MinIndex[k]);
+    free(_MaxIndex[k]);
+  }
+}
+
+
+/******************************************************************************
+ * Public Members
+ ******************************************************************************/
+
+int SeriesDecimator::Append(const float x[], const float y[], int n)
+{
+  int retval = NVN_NOERR;
+  int from = _N;
+
+  retval = this->Reserve(_N + n);
+
+  if(NVN_NOERR == retval)
+  {
+    for(int i = 0; i < n; i++)
+    {
+      if(_N > 0 && x[i] < _X[_N - 1])
+        _Sorted = false;
+
+      _X[_N] = x[i];
+      _Y[_N] = y[i];
+      _N++;
+    }
+
+    retval = this->UpdateLevels(from);
+  }
+
+  return retval;
+}
+
+int SeriesDecimator::Clear()
+{
+  int retval = NVN_NOERR;
+
+  _N = 0;
+  _NLevels = 1;
+  _Sorted = true;
+
+  return retval;
+}
+
+int SeriesDecimator::Decimate(float xmin, float xmax, int columns, int mode,
+                              const float** verts, int* nverts)
+{
+  int retval = NVN_NOERR;
+  int i0, i1, k, span, perbucket;
+
+  _NVerts = 0;
+
+  if(_N > 0 && _Sorted && columns > 0 && NVN_DECIMATE_NONE != mode)
+  {
+    // Include one sample on either side of the view, so that the lines that
+    // leave the view are still drawn.
+    i0 = this->FindIndex(xmin) - 1;
+    i1 = this->FindIndex(xmax);
+    if(i0 < 0) i0 = 0;
+    if(i1 > _N - 1) i1 = _N - 1;
+    if(i0 > i1) i0 = i1;
+    span = i1 - i0 + 1;
+
+    // Pick the coarsest level whose runs still fit in a pixel column.  LTTB
+    // wants a few candidates per column to choose from.
+    perbucket = span / (NVN_DECIMATE_LTTB == mode ? 4 * columns : columns);
+    k = 0;
+    while(k + 1 < _NLevels && (2 << k) <= perbucket)
+      k++;
+
+    retval = this->ReserveVerts(2 * ((span >> k) + 2));
+
+    if(NVN_NOERR == retval && 0 == k)
+    {
+      for(int i = i0; i <= i1; i++)
+        this->EmitPoint(i);
+    }
+    else if(NVN_NOERR == retval)
+    {
+      for(int b = i0 >> k; b <= i1 >> k; b++)
+      {
+        int mn = _MinIndex[k][b];
+        int mx = _MaxIndex[k][b];
+
+        this->EmitPoint(mn < mx ? mn : mx);
+        if(mn != mx)
+          this->EmitPoint(mn < mx ? mx : mn);
+      }
+    }
+
+    if(NVN_NOERR == retval && NVN_DECIMATE_LTTB == mode)
+      retval = this->LargestTriangles(0, columns);
+  }
+  else if(_N > 0)
+  {
+    retval = this->ReserveVerts(_N);
+    for(int i = 0; NVN_NOERR == retval && i < _N; i++)
+      this->EmitPoint(i);
+  }
+
+  *verts = _Verts;
+  *nverts = NVN_NOERR == retval ? _NVerts : 0;
+
+  return retval;
+}
+
+
+bool SeriesDecimator::Interpolate(float x, int* index, float* y) const
+{
+  bool retval = false;
+  int i;
+  float t;
+
+  if(_Sorted && _N > 0 && x >= _X[0] && x <= _X[_N - 1])
+  {
+    i = this->FindIndex(x);
+
+    if(0 == i || _X[i] == x)
+    {
+      *index = i;
+      *y = _Y[i];
+    }
+    else
+    {
+      t = (x - _X[i - 1]) / (_X[i] - _X[i - 1]);
+      *index = t < 0.5f ? i - 1 : i;
+      *y = _Y[i - 1] + t * (_Y[i] - _Y[i - 1]);
+    }
+
+    retval = true;
+  }
+
+  return retval;
+}
+
+
+/******************************************************************************
+ * Protected Members
+ ******************************************************************************/
+
+int SeriesDecimator::EmitPoint(int i)
+{
+  int retval = NVN_NOERR;
+
+  _Verts[2 * _NVerts] = _X[i];
+  _Verts[2 * _NVerts + 1] = _Y[i];
+  _NVerts++;
+
+  return retval;
+}
+
+int SeriesDecimator::FindIndex(float x) const
+{
+  int lo = 0;
+  int hi = _N;
+
+  // The first sample at or beyond x.
+  while(lo < hi)
+  {
+    int mid = lo + (hi - lo) / 2;
+    if(_X[mid] < x)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
+int SeriesDecimator::LargestTriangles(int start, int threshold)
+{
+  int retval = NVN_NOERR;
+  float* pts = _Verts + 2 * start;
+  int m = _NVerts - start;
+  int o = 1;
+  float ax, ay;
+
+  // Each output point is written at or before the points still to be read,
+  // so the thinning can be done in place.
+  if(threshold >= 3 && threshold < m)
+  {
+    double every = (double)(m - 2) / (double)(threshold - 2);
+    ax = pts[0];
+    ay = pts[1];
+
+    for(int i = 0; i < threshold - 2; i++)
+    {
+      int avgstart = (int)floor((i + 1) * every) + 1;
+      int avgend = (int)floor((i + 2) * every) + 1;
+      int rangestart = (int)floor(i * every) + 1;
+      int rangeend = avgstart;
+      float avgx = 0.0f, avgy = 0.0f;
+      float maxarea = -1.0f;
+      int best = rangestart;
+
+      if(avgend > m) avgend = m;
+
+      for(int j = avgstart; j < avgend; j++)
+      {
+        avgx += pts[2 * j];
+        avgy += pts[2 * j + 1];
+      }
+
+      if(avgend > avgstart)
+      {
+        avgx /= (avgend - avgstart);
+        avgy /= (avgend - avgstart);
+      }
+      else
+      {
+        avgx = pts[2 * (m - 1)];
+        avgy = pts[2 * (m - 1) + 1];
+      }
+
+      for(int j = rangestart; j < rangeend; j++)
+      {
+        float area = fabsf((ax - avgx) * (pts[2 * j + 1] - ay) -
+                           (ax - pts[2 * j]) * (avgy - ay));
+        if(area > maxarea)
+        {
+          maxarea = area;
+          best = j;
+        }
+      }
+
+      ax = pts[2 * best];
+      ay = pts[2 * best + 1];
+      pts[2 * o] = ax;
+      pts[2 * o + 1] = ay;
+      o++;
+    }
+
+    pts[2 * o] = pts[2 * (m - 1)];
+    pts[2 * o + 1] = pts[2 * (m - 1) + 1];
+    o++;
+
+    _NVerts = start + o;
+  }
+
+  return retval;
+}
+
+int SeriesDecimator::Reserve(int npoints)
+{
+  int retval = NVN_NOERR;
+  int capacity = _Capacity;
+
+  if(npoints > _Capacity)
+  {
+    capacity = _Capacity * 2;
+    if(capacity < npoints) capacity = npoints;
+    if(capacity < 1024) capacity = 1024;
+
+    // Each array is only replaced once it has grown, so a failed allocation
+    // leaves every array at least as large as the old capacity.
+    float* x = (float*)realloc(_X, capacity * sizeof(float));
+    if(x)
+      _X = x;
+
+    float* y = (float*)realloc(_Y, capacity * sizeof(float));
+    if(y)
+      _Y = y;
+
+    if(! x || ! y)
+      retval = NVN_ERROR;
+
+    for(int k = 1; NVN_NOERR == retval && k < DECIMATOR_MAX_LEVELS; k++)
+    {
+      int nbuckets = ((capacity - 1) >> k) + 1;
+
+      int* minindex = (int*)realloc(_MinIndex[k], nbuckets * sizeof(int));
+      if(minindex)
+        _MinIndex[k] = minindex;
+
+      int* maxindex = (int*)realloc(_MaxIndex[k], nbuckets * sizeof(int));
+      if(maxindex)
+        _MaxIndex[k] = maxindex;
+
+      if(! minindex || ! maxindex)
+        retval = NVN_ERROR;
+    }
+
+    if(NVN_NOERR == retval)
+    {
+      _Capacity = capacity;
+    }
+    else
+    {
+      fprintf(stderr, "Unable to allocate space for %d samples.\n", npoints);
+    }
+  }
+
+  return retval;
+}
+
+int SeriesDecimator::ReserveVerts(int nverts)
+{
+  int retval = NVN_NOERR;
+
+  if(nverts > _VertCapacity)
+  {
+    float* verts = (float*)realloc(_Verts, 2 * nverts * sizeof(float));
+    if(verts)
+    {
+      _Verts = verts;
+      _VertCapacity = nverts;
+    }
+    else
+    {
+      retval = NVN_ERROR;
+      fprintf(stderr, "Unable to allocate space for %d vertices.\n", nverts);
+    }
+  }
+
+  return retval;
+}
+
+int SeriesDecimator::UpdateLevels(int from)
+{
+  int retval = NVN_NOERR;
+  int k;
+
+  // Level k summarizes runs of 2^k samples, and is built from the two runs
+  // below it, so only the runs that include new samples are touched.
+  for(k = 1; k < DECIMATOR_MAX_LEVELS && (1 << (k - 1)) < _N; k++)
+  {
+    int last = (_N - 1) >> k;
+    int lastchild = (_N - 1) >> (k - 1);
+
+    for(int b = from >> k; b <= last; b++)
+    {
+      int c0 = 2 * b;
+      int c1 = 2 * b + 1 <= lastchild ? 2 * b + 1 : c0;
+      int mn0 = 1 == k ? c0 : _MinIndex[k - 1][c0];
+      int mn1 = 1 == k ? c1 : _MinIndex[k - 1][c1];
+      int mx0 = 1 == k ? c0 : _MaxIndex[k - 1][c0];
+      int mx1 = 1 == k ? c1 : _MaxIndex[k - 1][c1];
+
+      _MinIndex[k][b] = _Y[mn1] < _Y[mn0] ? mn1 : mn0;
+      _MaxIndex[k][b] = _Y[mx1] > _Y[mx0] ? mx1 : mx0;
+    }
+  }
+
+  _NLevels = k;
+
+  return retval;
+}
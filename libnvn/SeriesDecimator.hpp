@@ -0,0 +1,92 @@
+/*
+ * SeriesDecimator.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Timothy Morey
+ */
+
+#ifndef __SERIESDECIMATOR_HPP__
+#define __SERIESDECIMATOR_HPP__
+
+
+#include "nvn.h"
+
+
+/**
+ * The deepest level of the min/max summary, which is enough for any series
+ * that can be indexed with an int.
+ */
+#define DECIMATOR_MAX_LEVELS 32
+
+
+/**
+ * A SeriesDecimator reduces a long x/y series to roughly one vertex per pixel
+ * column of the current view.  Alongside the samples it keeps a pyramid of
+ * min/max summaries, where level k holds the index of the smallest and the
+ * largest y value in each run of 2^k samples.  Drawing picks the level whose
+ * runs are about one pixel wide, so the cost of a frame is bounded by the
+ * width of the screen rather than the length of the series, and the peaks
+ * within each pixel are never lost.  Zooming in drops to finer levels, and
+ * eventually to the samples themselves.
+ *
+ * The summary can optionally be thinned further with the Largest-Triangle-
+ * Three-Buckets algorithm, which keeps the visual shape of the series with
+ * one vertex per column.
+ *
+ * Both methods rely on x being sorted.  A series with unsorted x, such as a
+ * flight line, is always drawn in full.
+ */
+class SeriesDecimator
+{
+public:
+  SeriesDecimator();
+  ~SeriesDecimator();
+
+public:
+  int Append(const float x[], const float y[], int n);
+  int Clear();
+
+  /**
+   * Finds the vertices to draw for the part of the series between xmin and
+   * xmax, when that range is spread over the given number of pixel columns.
+   * The vertices are x/y pairs, and remain valid until the next call.
+   */
+  int Decimate(float xmin, float xmax, int columns, int mode,
+               const float** verts, int* nverts);
+
+  /**
+   * Finds y at x by interpolating between the samples on either side, along
+   * with the index of the nearer one.  Nothing is found if x is outside of
+   * the series or the series is not sorted.
+   */
+  bool Interpolate(float x, int* index, float* y) const;
+
+public:
+  int GetNPoints() const { return _N; }
+  bool IsSorted() const { return _Sorted; }
+
+protected:
+  int EmitPoint(int i);
+  int FindIndex(float x) const;
+  int LargestTriangles(int start, int threshold);
+  int Reserve(int npoints);
+  int ReserveVerts(int nverts);
+  int UpdateLevels(int from);
+
+protected:
+  float* _X;
+  float* _Y;
+  int _N;
+  int _Capacity;
+  bool _Sorted;
+
+  int _NLevels;
+  int* _MinIndex[DECIMATOR_MAX_LEVELS];
+  int* _MaxIndex[DECIMATOR_MAX_LEVELS];
+
+  float* _Verts;
+  int _NVerts;
+  int _VertCapacity;
+};
+
+#endif
@@ -0,0 +1,345 @@
+/*
+ * SeriesLayer.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Timothy Morey
+ */
+
+#include "nvn.h"
+
+#include "color-ramp.h"
+
+#include "CartesianCRS.hpp"
+#include "Layer.hpp"
+#include "SeriesLayer.hpp"
+
+#define GL_GLEXT_PROTOTYPES 1
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SERIES_INITIAL_CAPACITY 1024
+
+
+SeriesLayer::SeriesLayer(int capacity, int color)
+  : _Color(color),
+    _Growable(capacity <= 0),
+    _DataCrs(2),
+    _Ring(0),
+    _Capacity(capacity > 0 ? capacity : SERIES_INITIAL_CAPACITY),
+    _Head(0),
+    _Count(0),
+    _Total(0),
+    _Dropped(false),
+    _Bounds(NVN_BBoxEmpty)
+{
+  bool allocated = true;
+
+  pthread_mutex_init(&_Lock, 0);
+
+  _Ring = (float*)malloc(2 * _Capacity * sizeof(float));
+  allocated = 0 != _Ring;
+
+  // A ring that grows never drops a sample, so its running bounds are enough.
+  for(int k = 0; k < 4; k++)
+  {
+    _Extremes[k].Slots = 0;
+    _Extremes[k].Head = 0;
+    _Extremes[k].Count = 0;
+
+    if(! _Growable)
+    {
+      _Extremes[k].Slots = (int*)malloc(_Capacity * sizeof(int));
+      allocated = allocated && 0 != _Extremes[k].Slots;
+    }
+  }
+
+  if(! allocated)
+  {
+    _Capacity = 0;
+    fprintf(stderr, "Unable to allocate the series ring buffer.\n");
+  }
+}
+
+SeriesLayer::~SeriesLayer()
+{
+  // The vertex buffer belongs to a GL context that may already be gone, so it
+  // is left for the context to release.
+  free(_Ring);
+  for(int k = 0; k < 4; k++)
+    free(_Extremes[k].Slots);
+  pthread_mutex_destroy(&_Lock);
+}
+
+int SeriesLayer::Append(const float x[], const float y[], int n)
+{
+  int retval = NVN_NOERR;
+  int slot;
+
+  pthread_mutex_lock(&_Lock);
+
+  for(int i = 0; i < n && NVN_NOERR == retval; i++)
+  {
+    if(_Count == _Capacity)
+    {
+      if(_Growable)
+      {
+        retval = this->Grow();
+      }
+      else if(_Capacity > 0)
+      {
+        this->PopExtremes(_Head);
+        _Head = (_Head + 1) % _Capacity;
+        _Count--;
+        _Dropped = true;
+      }
+      else
+      {
+        retval = NVN_ERROR;
+      }
+    }
+
+    if(NVN_NOERR == retval)
+    {
+      slot = (_Head + _Count) % _Capacity;
+      _Ring[2 * slot] = x[i];
+      _Ring[2 * slot + 1] = y[i];
+      _Count++;
+
+      if(! _Growable)
+        this->PushExtremes(slot);
+
+      if(0 == _Total++)
+      {
+        _Bounds.Min[XDIM] = _Bounds.Max[XDIM] = x[i];
+        _Bounds.Min[YDIM] = _Bounds.Max[YDIM] = y[i];
+      }
+      else
+      {
+        if(x[i] < _Bounds.Min[XDIM]) _Bounds.Min[XDIM] = x[i];
+        if(x[i] > _Bounds.Max[XDIM]) _Bounds.Max[XDIM] = x[i];
+        if(y[i] < _Bounds.Min[YDIM]) _Bounds.Min[YDIM] = y[i];
+        if(y[i] > _Bounds.Max[YDIM]) _Bounds.Max[YDIM] = y[i];
+      }
+    }
+  }
+
+  if(n > 0)
+    this->InvalidateBounds();
+
+  pthread_mutex_unlock(&_Lock);
+
+  return retval;
+}
+
+int SeriesLayer::Render(const RenderContext& context)
+{
+  int retval = NVN_NOERR;
+  int head, count, capacity, first;
+  GLuint join[2];
+  SeriesResources* resources = (SeriesResources*)this->GetResources(context);
+
+  pthread_mutex_lock(&_Lock);
+  retval = this->Upload(resources);
+  head = _Head;
+  count = _Count;
+  capacity = _Capacity;
+  pthread_mutex_unlock(&_Lock);
+
+  // Appends made after this point only touch the ring, so the buffer holds
+  // exactly the samples counted above until the next upload.
+  if(NVN_NOERR == retval && count > 0)
+  {
+    glLineWidth(5.0f);
+    glColor4ub(GetA(_Color), GetB(_Color), GetG(_Color), GetR(_Color));
+
+    glBindBuffer(GL_ARRAY_BUFFER, resources->Buffer);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(2, GL_FLOAT, 0, 0);
+
+    if(head + count <= capacity)
+    {
+      glDrawArrays(1 == count ? GL_POINTS : GL_LINE_STRIP, head, count);
+    }
+    else
+    {
+      // The samples wrap around the end of the ring, so they are drawn as two
+      // strips with a segment joining the newest slot of the first strip to
+      // the oldest slot of the second.
+      first = capacity - head;
+      glDrawArrays(GL_LINE_STRIP, head, first);
+      glDrawArrays(GL_LINE_STRIP, 0, count - first);
+
+      join[0] = capacity - 1;
+      join[1] = 0;
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+      glDrawElements(GL_LINES, 2, GL_UNSIGNED_INT, join);
+    }
+
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+
+  return retval;
+}
+
+int SeriesLayer::SetModelCRS(const CartesianCRS& crs)
+{
+  int retval = NVN_NOERR;
+  _ModelCrs = crs;
+  this->InvalidateBounds();
+  return retval;
+}
+
+NVN_BBox SeriesLayer::ComputeBounds() const
+{
+  NVN_BBox bounds = NVN_BBoxEmpty;
+
+  pthread_mutex_lock(&_Lock);
+
+  if(! _Dropped)
+  {
+    bounds = _Bounds;
+  }
+  else if(_Count > 0)
+  {
+    // Once samples have been dropped the running bounds may be too large, so
+    // the fronts of the queues give the bounds of the samples still kept.
+    bounds.Min[XDIM] = _Ring[2 * _Extremes[0].Slots[_Extremes[0].Head]];
+    bounds.Max[XDIM] = _Ring[2 * _Extremes[1].Slots[_Extremes[1].Head]];
+    bounds.Min[YDIM] = _Ring[2 * _Extremes[2].Slots[_Extremes[2].Head] + 1];
+    bounds.Max[YDIM] = _Ring[2 * _Extremes[3].Slots[_Extremes[3].Head] + 1];
+  }
+
+  pthread_mutex_unlock(&_Lock);
+
+  return bounds;
+}
+
+int SeriesLayer::Grow()
+{
+  int retval = NVN_NOERR;
+  int capacity = 2 * _Capacity;
+  int first = _Capacity - _Head;
+  float* ring = (float*)malloc(2 * capacity * sizeof(float));
+
+  if(ring)
+  {
+    // The kept samples are unrolled to the front of the new ring, which also
+    // moves them in the vertex buffer, so the next upload sends all of them.
+    if(first > _Count)
+      first = _Count;
+    memcpy(ring, _Ring + 2 * _Head, 2 * first * sizeof(float));
+    memcpy(ring + 2 * first, _Ring, 2 * (_Count - first) * sizeof(float));
+
+    free(_Ring);
+    _Ring = ring;
+    _Capacity = capacity;
+    _Head = 0;
+  }
+  else
+  {
+    retval = NVN_ERROR;
+    fprintf(stderr, "Unable to grow the series ring buffer to %d samples.\n",
+            capacity);
+  }
+
+  return retval;
+}
+
+int SeriesLayer::PopExtremes(int slot)
+{
+  int retval = NVN_NOERR;
+
+  // Only the oldest sample is ever dropped, so it can only be at the front.
+  for(int k = 0; k < 4; k++)
+  {
+    ExtremeQueue* queue = &_Extremes[k];
+
+    if(queue->Count > 0 && slot == queue->Slots[queue->Head])
+    {
+      queue->Head = (queue->Head + 1) % _Capacity;
+      queue->Count--;
+    }
+  }
+
+  return retval;
+}
+
+int SeriesLayer::PushExtremes(int slot)
+{
+  int retval = NVN_NOERR;
+
+  for(int k = 0; k < 4; k++)
+  {
+    ExtremeQueue* queue = &_Extremes[k];
+    int dim = k / 2;
+    bool largest = 1 == k % 2;
+    float value = _Ring[2 * slot + dim];
+    float last;
+
+    // Older samples that the new one matches or outdoes can never be the
+    // extreme again, since they will be dropped before it is.
+    while(queue->Count > 0)
+    {
+      last = _Ring[2 * queue->Slots[(queue->Head + queue->Count - 1) % _Capacity] + dim];
+      if(largest ? last <= value : last >= value)
+        queue->Count--;
+      else
+        break;
+    }
+
+    queue->Slots[(queue->Head + queue->Count) % _Capacity] = slot;
+    queue->Count++;
+  }
+
+  return retval;
+}
+
+int SeriesLayer::Upload(SeriesResources* resources)
+{
+  int retval = NVN_NOERR;
+  unsigned long pending = _Total - resources->Uploaded;
+  int first, n;
+
+  if(! resources->Buffer)
+    glGenBuffers(1, &resources->Buffer);
+
+  glBindBuffer(GL_ARRAY_BUFFER, resources->Buffer);
+
+  if(resources->BufferCapacity != _Capacity ||
+     pending >= (unsigned long)_Capacity)
+  {
+    if(resources->BufferCapacity != _Capacity)
+    {
+      glBufferData(GL_ARRAY_BUFFER, 2 * _Capacity * sizeof(float), _Ring,
+                   GL_DYNAMIC_DRAW);
+      resources->BufferCapacity = _Capacity;
+    }
+    else
+    {
+      glBufferSubData(GL_ARRAY_BUFFER, 0, 2 * _Capacity * sizeof(float), _Ring);
+    }
+  }
+  else if(pending > 0)
+  {
+    // Only the newest samples are sent, in two pieces if they wrap around the
+    // end of the ring.
+    first = (_Head + _Count - (int)pending) % _Capacity;
+    n = MIN(_Capacity - first, (int)pending);
+
+    glBufferSubData(GL_ARRAY_BUFFER, 2 * first * sizeof(float),
+                    2 * n * sizeof(float), _Ring + 2 * first);
+    if(n < (int)pending)
+      glBufferSubData(GL_ARRAY_BUFFER, 0, 2 * (pending - n) * sizeof(float),
+                      _Ring);
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  resources->Uploaded = _Total;
+
+  return retval;
+}
@@ -0,0 +1,112 @@
+/*
+ * SeriesLayer.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Timothy Morey
+ */
+
+#ifndef __SERIESLAYER_HPP__
+#define __SERIESLAYER_HPP__
+
+
+#include "nvn.h"
+
+#include "CartesianCRS.hpp"
+#include "Layer.hpp"
+
+#include <pthread.h>
+
+
+/**
+ * A SeriesLayer is a 2D line plot that samples can be appended to while it is
+ * being shown, for watching diagnostics as a simulation runs.
+ *
+ * The samples live in a ring buffer.  A layer with a fixed capacity keeps the
+ * most recent samples and drops the oldest, and a layer without one doubles
+ * its ring whenever it fills up.  Either way an append costs O(1) amortized.
+ * The ring is mirrored in a GL vertex buffer, and each render only uploads
+ * the slots written since the last one, so the existing polyline is never
+ * rebuilt.
+ *
+ * Append may be called from any thread.  Every append bumps the layer's
+ * revision, which causes the windows that show it to redraw.
+ */
+class SeriesLayer : public Layer
+{
+public:
+  SeriesLayer(int capacity, int color);
+  virtual ~SeriesLayer();
+
+public:
+  virtual const CRS& GetDataCRS() const { return _DataCrs; }
+
+public:
+  int Append(const float x[], const float y[], int n);
+  virtual int Render(const RenderContext& context);
+  virtual int SetModelCRS(const CartesianCRS& crs);
+
+protected:
+  /**
+   * The GL copy of the ring in one share group.  Uploaded counts the samples
+   * that had been appended when it was last brought up to date.
+   */
+  struct SeriesResources : public LayerResources
+  {
+    SeriesResources(int sharegroup)
+      : LayerResources(sharegroup), Buffer(0), BufferCapacity(0),
+        Uploaded(0) {}
+
+    unsigned int Buffer;
+    int BufferCapacity;
+    unsigned long Uploaded;
+  };
+
+protected:
+  virtual NVN_BBox ComputeBounds() const;
+  virtual LayerResources* CreateResources(int sharegroup) const
+  { return new SeriesResources(sharegroup); }
+
+protected:
+  int Grow();
+  int PopExtremes(int slot);
+  int PushExtremes(int slot);
+  int Upload(SeriesResources* resources);
+
+protected:
+  int _Color;
+  bool _Growable;
+  CartesianCRS _DataCrs;
+
+  /**
+   * The ring, guarded by _Lock.  Slot (_Head + i) % _Capacity holds the i'th
+   * oldest of the _Count samples that are kept, and _Total counts every sample
+   * ever appended.
+   */
+  mutable pthread_mutex_t _Lock;
+  float* _Ring;
+  int _Capacity;
+  int _Head;
+  int _Count;
+  unsigned long _Total;
+  bool _Dropped;
+  NVN_BBox _Bounds;
+
+  /**
+   * A ring that drops samples keeps the bounds of the samples it still holds
+   * in four queues, for the smallest and largest x and y.  Each queue holds
+   * the slots of the samples that are yet to be outdone by a newer sample, in
+   * the order they were appended, so its front is the current extreme and a
+   * dropped sample only ever leaves from the front.  Each sample enters and
+   * leaves each queue once, so the bounds cost O(1) amortized per append.
+   */
+  struct ExtremeQueue
+  {
+    int* Slots;
+    int Head;
+    int Count;
+  };
+
+  ExtremeQueue _Extremes[4];        // Smallest x, largest x, smallest y, largest y
+};
+
+#endif
@@ -8,9 +8,11 @@
 
 #include "CartesianCRS.hpp"
 #include "DataGrid.hpp"
+#include "FrameProfiler.hpp"
 #include "GridCRS.hpp"
 #include "GridTransform.hpp"
 #include "ShadedSurfaceLayer.hpp"
+#include "Trace.hpp"
 
 #define MPICH_SKIP_MPICXX 1
 #include <mpi.h>
@@ -20,16 +22,18 @@
 #include <GL/gl.h>
 #include <GL/glu.h>
 
+
+/**
+ * The number of grid cells along each side of a separately culled block.
+ */
+#define SURFACE_BLOCK_SIZE 64
+
+
 ShadedSurfaceLayer::ShadedSurfaceLayer(DataGrid* grid)
 : Layer(),
   _DataGrid(grid),
   _Ramp(DefaultColorRamp),
-  _TexBitmap(0),
-  _TexWidth(0),
-  _TexHeight(0),
-  _TextureID(-1),
-  _DisplayList(0),
-  _Compiled(false)
+  _NTriangles(0)
 {
   if(_DataGrid)
   {
@@ -57,20 +61,18 @@ ShadedSurfaceLayer::ShadedSurfaceLayer(DataGrid* grid)
 
 ShadedSurfaceLayer::~ShadedSurfaceLayer()
 {
-  if(_TexBitmap)
-  {
-    free(_TexBitmap);
-    _TexBitmap = 0;
-  }
+
 }
 
-NVN_BBox ShadedSurfaceLayer::GetBounds() const
+NVN_BBox ShadedSurfaceLayer::ComputeBounds() const
 {
   NVN_BBox bounds = NVN_BBoxEmpty;
 
   GridTransform transform(_ModelCrs, _DataGrid->GetCRS());
+  float zscale = transform.GetModelUnitsPerCell() / 100.0f;
 
   MPI_Offset minpti[MAX_DIMS], maxpti[MAX_DIMS];
+  float corner1[MAX_DIMS], corner2[MAX_DIMS];
 
   minpti[XDIM] = 0;
   minpti[YDIM] = 0;
@@ -78,15 +80,36 @@ NVN_BBox ShadedSurfaceLayer::GetBounds() const
   maxpti[XDIM] = _DataGrid->GetDimLen(0) - 1;
   maxpti[YDIM] = _DataGrid->GetDimLen(1) - 1;
 
-  transform.GridToModel(minpti, bounds.Min);
-  transform.GridToModel(maxpti, bounds.Max);
+  // A grid dimension may run against its model dimension, so the corners are
+  // sorted after they are transformed.
+  transform.GridToModel(minpti, corner1);
+  transform.GridToModel(maxpti, corner2);
+
+  for(int i = XDIM; i <= YDIM; i++)
+  {
+    bounds.Min[i] = corner1[i] < corner2[i] ? corner1[i] : corner2[i];
+    bounds.Max[i] = corner1[i] < corner2[i] ? corner2[i] : corner1[i];
+  }
 
-  bounds.Min[ZDIM] = VariantValueAsFloat(_MinVal) / 100.0f;
-  bounds.Max[ZDIM] = VariantValueAsFloat(_MaxVal) / 100.0f;
+  bounds.Min[ZDIM] = VariantValueAsFloat(_MinVal) * zscale;
+  bounds.Max[ZDIM] = VariantValueAsFloat(_MaxVal) * zscale;
 
   return bounds;
 }
 
+LayerResources* ShadedSurfaceLayer::CreateResources(int sharegroup) const
+{
+  SurfaceResources* resources = new SurfaceResources(sharegroup);
+
+  if(_DataGrid)
+  {
+    resources->Raster.SetGrid(_DataGrid->GetDimLen(0),
+                              _DataGrid->GetDimLen(1), GetRasterColor, this);
+  }
+
+  return resources;
+}
+
 const CRS& ShadedSurfaceLayer::GetDataCRS() const
 {
   if(_DataGrid)
@@ -95,142 +118,207 @@ const CRS& ShadedSurfaceLayer::GetDataCRS() const
     return _ModelCrs;
 }
 
-int ShadedSurfaceLayer::Render()
+int ShadedSurfaceLayer::Probe(float x, float y, float radius,
+                              NVN_ProbeResult* result) const
 {
-  if(! _Compiled)
+  int retval = NVN_NOERR;
+  float model[MAX_DIMS] = { 0.0f };
+  float pos[MAX_DIMS] = { 0.0f };
+  double value;
+
+  if(_DataGrid)
   {
-    if(_DisplayList)
+    // The inverse transform takes the point straight to a grid position.
+    GridTransform transform(_ModelCrs, _DataGrid->GetCRS());
+    int dim0 = transform.GetGridDim(XDIM);
+    int dim1 = transform.GetGridDim(YDIM);
+
+    model[XDIM] = x;
+    model[YDIM] = y;
+    transform.ModelToGrid(model, pos);
+
+    if(dim0 >= 0 && dim1 >= 0 &&
+       _DataGrid->Interpolate(pos, dim0, dim1, result->Index, &value))
     {
-      glDeleteLists(_DisplayList, 1);
-      _DisplayList = 0;
+      result->Layer = (NVN_Layer)(const Layer*)this;
+      result->Value = value;
     }
+  }
 
-    int datawidth = _DataGrid->GetDimLen(0);
-    int dataheight = _DataGrid->GetDimLen(1);
-    MPI_Offset nw[MAX_DIMS], ne[MAX_DIMS], se[MAX_DIMS], sw[MAX_DIMS];
-    MPI_Offset i[MAX_DIMS];
-    Variant value;
-    int color;
+  return retval;
+}
+
+int ShadedSurfaceLayer::Render(const RenderContext& context)
+{
+  int retval = NVN_NOERR;
+  FrameProfiler* profiler = context.GetProfiler();
+  int stride = context.GetDetailStride();
+  bool complete = true;
+  SurfaceResources* resources =
+    (SurfaceResources*)this->GetResources(context);
+
+  if(context.IsTopDown() && _DataGrid &&
+     1 < _DataGrid->GetDimLen(0) && 1 < _DataGrid->GetDimLen(1))
+  {
+    // Seen from straight above, the heights of the surface cannot be seen, so
+    // it is drawn as a flat image at the bottom of the layer.  Until every
+    // tile in view is ready, the layer asks for more frames.
     GridTransform transform(_ModelCrs, _DataGrid->GetCRS());
+    retval = resources->Raster.Render(context, transform,
+                                      this->GetBounds().Min[ZDIM],
+                                      &complete);
+
+    if(! complete)
+      context.RequestFrame();
+  }
+  else
+  {
+    // The mesh for reduced detail is only built once a frame asks for it, and
+    // is kept until a frame asks for a different stride.
+    if((1 == stride && ! resources->Compiled) ||
+       (1 < stride && stride != resources->CoarseStride))
+    {
+      if(profiler)
+        profiler->Begin(NVN_PHASE_MESH);
 
-    _DisplayList = glGenLists(1);
+      this->Compile(resources, stride);
 
-    glNewList(_DisplayList, GL_COMPILE);
+      if(profiler)
+        profiler->End(NVN_PHASE_MESH);
+    }
+
+    if(1 < stride)
+      resources->CoarseMesh.Render(context);
+    else
+      resources->Mesh.Render(context);
+  }
+
+  return retval;
+}
+
+int ShadedSurfaceLayer::SetModelCRS(const CartesianCRS& crs)
+{
+  int retval = NVN_NOERR;
+
+  // A render thread may be adding a share group's resources meanwhile.
+  this->LockRender();
+
+  _ModelCrs = crs;
+
+  for(size_t i = 0; i < _Resources.size(); i++)
+  {
+    ((SurfaceResources*)_Resources[i])->Compiled = false;
+    ((SurfaceResources*)_Resources[i])->CoarseStride = 0;
+  }
+
+  this->InvalidateBounds();
+  this->UnlockRender();
+
+  return retval;
+}
+
+int ShadedSurfaceLayer::Compile(SurfaceResources* resources, int stride)
+{
+  int retval = NVN_NOERR;
+  TraceScope trace("ShadedSurfaceLayer::Compile", "mesh");
+  int datawidth = _DataGrid->GetDimLen(0);
+  int dataheight = _DataGrid->GetDimLen(1);
+  MeshBlocks* mesh = 1 == stride ? &resources->Mesh : &resources->CoarseMesh;
+  MPI_Offset nw[MAX_DIMS], ne[MAX_DIMS], se[MAX_DIMS], sw[MAX_DIMS];
+  MPI_Offset bx, by, xend, yend, i, j;
+  MPI_Offset ncellsx, ncellsy;
+  GridTransform transform(_ModelCrs, _DataGrid->GetCRS());
+  float zscale = transform.GetModelUnitsPerCell() / 100.0f;
+  float rowbuf[4][SURFACE_BLOCK_SIZE + 1];
+  float* row0[MAX_DIMS] = { 0 };
+  float* row1[MAX_DIMS] = { 0 };
+  float p1[MAX_DIMS], p2[MAX_DIMS], p3[MAX_DIMS], p4[MAX_DIMS];
+  int ntriangles = 0;
+  int k;
+
+  row0[XDIM] = rowbuf[0];  row0[YDIM] = rowbuf[1];
+  row1[XDIM] = rowbuf[2];  row1[YDIM] = rowbuf[3];
+
+  mesh->Clear();
+
+  // A coarse mesh takes every stride'th grid point, and the last cell along
+  // each dimension is cut short so that the mesh still reaches the edge of
+  // the grid.  Blocks and rows are counted in these cells.
+  ncellsx = (datawidth - 2 + stride) / stride;
+  ncellsy = (dataheight - 2 + stride) / stride;
+
+  // The surface is compiled in square blocks of cells, so that only the
+  // blocks inside the view frustum need to be drawn.
+  for(bx = 0; bx < ncellsx; bx += SURFACE_BLOCK_SIZE)
+  {
+    xend = MIN(bx + SURFACE_BLOCK_SIZE, ncellsx);
+
+    for(by = 0; by < ncellsy; by += SURFACE_BLOCK_SIZE)
     {
+      yend = MIN(by + SURFACE_BLOCK_SIZE, ncellsy);
+
+      mesh->BeginBlock();
       glBegin(GL_TRIANGLES);
       {
-        for(sw[0] = 0, se[0] = 1, ne[0] = 1, nw[0] = 0; 
-            se[0] < datawidth && ne[0] < datawidth;
-            sw[0]++, se[0]++, ne[0]++, nw[0]++)
+        for(i = bx; i < xend; i++)
         {
-          for(sw[1] = 0, se[1] = 0, ne[1] = 1, nw[1] = 1; 
-              se[1] < dataheight && ne[1] < dataheight;
-              sw[1]++, se[1]++, ne[1]++, nw[1]++)
-          {        
-            if(_DataGrid->HasData(ne) && 
+          sw[0] = nw[0] = i * stride;
+          se[0] = ne[0] = MIN((i + 1) * stride, datawidth - 1);
+
+          // Each pair of rows is transformed in one batch, and the quads
+          // between them pick their corners out of the batch.
+          sw[1] = by * stride;
+          se[1] = by * stride;
+          this->TransformColumn(transform, sw, yend - by + 1, stride, row0);
+          this->TransformColumn(transform, se, yend - by + 1, stride, row1);
+
+          for(j = by; j < yend; j++)
+          {
+            sw[1] = se[1] = j * stride;
+            nw[1] = ne[1] = MIN((j + 1) * stride, dataheight - 1);
+
+            if(_DataGrid->HasData(ne) &&
                _DataGrid->HasData(se) &&
                _DataGrid->HasData(sw) &&
                _DataGrid->HasData(nw))
             {
-              this->DrawQuad(nw, ne, se, sw, transform);
+              k = j - by;
+              p1[XDIM] = row0[XDIM][k + 1];  p1[YDIM] = row0[YDIM][k + 1];
+              p2[XDIM] = row1[XDIM][k + 1];  p2[YDIM] = row1[YDIM][k + 1];
+              p3[XDIM] = row1[XDIM][k];      p3[YDIM] = row1[YDIM][k];
+              p4[XDIM] = row0[XDIM][k];      p4[YDIM] = row0[YDIM][k];
+              this->DrawQuad(mesh, nw, ne, se, sw, p1, p2, p3, p4, zscale);
+              ntriangles += 2;
             }
           }
         }
       }
       glEnd();
+      mesh->EndBlock();
     }
-    glEndList();
-
-    _Compiled = true;
   }
 
-  glCallList(_DisplayList);
-
-  // int datawidth = this->GetWidth();
-  // int dataheight = this->GetHeight();
-
-  // if(0 == _TexBitmap)
-  // {
-  // 	_TexWidth = 1;
-  // 	_TexHeight = 1;
-
-  // 	while(_TexWidth < datawidth)
-  // 		_TexWidth *= 2;
-
-  // 	while(_TexHeight < dataheight)
-  // 		_TexHeight *= 2;
-
-  // 	_TexBitmap = (char*)malloc(_TexWidth * _TexHeight * 4);
-  // 	Variant value;
-  //   MPI_Offset pos[MAX_DIMS];
-  // 	for(pos[0] = 0; pos[0] < datawidth; pos[0]++)
-  // 	{
-  // 		for(pos[1] = 0; pos[1] < dataheight; pos[1]++)
-  // 		{
-  //       if(_DataGrid->HasData(pos))
-  //       {
-  //         _DataGrid->GetElemAsVariant(pos, &value);
-  //         ((int*)_TexBitmap)[pos[1] * _TexWidth + pos[0]] = 
-  //           GetColor(_Ramp, value, _MinVal, _MaxVal);
-  //       }
-  //       else
-  //       {
-  //         ((int*)_TexBitmap)[pos[1] * _TexWidth + pos[0]] = 0x00000000;
-  //       }
-  // 		}
-  // 	}
-
-  // 	glGenTextures(1, &_TextureID);
-  // 	glBindTexture(GL_TEXTURE_2D, _TextureID);
-  // 	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-  // 	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
-  // 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  // 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  // 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-  // 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-  // 	glTexImage2D(GL_TEXTURE_2D, 0, 4,
-  // 							 _TexWidth, _TexHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, _TexBitmap);
-
-  //   // TODO: we're done with _TexBitmap now, and might as well free it, but then
-  //   // we'd need a different flag telling us if we need to create the texture...
-  // }
-
-  // glBindTexture(GL_TEXTURE_2D, _TextureID);
-  // glEnable(GL_TEXTURE_2D);
-
-  // glBegin(GL_QUADS);
-  // {
-  //   glTexCoord2f(0.0f, 0.0f);
-  //   glVertex3f(0.0f, 0.0f, 0.0f);
-
-  //   glTexCoord2f((float)datawidth / (float)_TexWidth, 0.0f);
-  //   glVertex3f((float)datawidth, 0.0f, 0.0f);
-
-  //   glTexCoord2f((float)datawidth / (float)_TexWidth, 
-  // 						 (float)dataheight / (float)_TexHeight);
-  //   glVertex3f((float)datawidth, (float)dataheight, 0.0f);
-
-  //   glTexCoord2f(0.0f, (float)dataheight / (float)_TexHeight);
-  //   glVertex3f(0.0f, (float)dataheight, 0.0f);
-  // }
-  // glEnd();
-}
+  if(1 == stride)
+  {
+    _NTriangles = ntriangles;
+    resources->Compiled = true;
+  }
+  else
+  {
+    resources->CoarseStride = stride;
+  }
 
-int ShadedSurfaceLayer::SetModelCRS(const CartesianCRS& crs)
-{
-  int retval = NVN_NOERR;
-  _ModelCrs = crs;
-  _Compiled = false;
   return retval;
 }
 
-int ShadedSurfaceLayer::DrawQuad(const MPI_Offset pt1[], const MPI_Offset pt2[],
+int ShadedSurfaceLayer::DrawQuad(MeshBlocks* mesh,
+                                 const MPI_Offset pt1[], const MPI_Offset pt2[],
                                  const MPI_Offset pt3[], const MPI_Offset pt4[],
-                                 const GridTransform& transform) const
+                                 float p1[], float p2[], float p3[], float p4[],
+                                 float zscale)
 {
   int retval = NVN_NOERR;
   Variant v1, v2, v3, v4;
-  float p1[MAX_DIMS], p2[MAX_DIMS], p3[MAX_DIMS], p4[MAX_DIMS];
   int c1, c2, c3, c4;
 
   _DataGrid->GetElemAsVariant(pt1, &v1);
@@ -243,17 +331,15 @@ int ShadedSurfaceLayer::DrawQuad(const MPI_Offset pt1[], const MPI_Offset pt2[],
   c3 = GetColor(_Ramp, v3, _MinVal, _MaxVal);
   c4 = GetColor(_Ramp, v4, _MinVal, _MaxVal);
 
-  transform.GridToModel(pt1, p1);
-  p1[ZDIM] = VariantValueAsFloat(v1) / 100.0f;
-
-  transform.GridToModel(pt2, p2);
-  p2[ZDIM] = VariantValueAsFloat(v2) / 100.0f;
+  p1[ZDIM] = VariantValueAsFloat(v1) * zscale;
+  p2[ZDIM] = VariantValueAsFloat(v2) * zscale;
+  p3[ZDIM] = VariantValueAsFloat(v3) * zscale;
+  p4[ZDIM] = VariantValueAsFloat(v4) * zscale;
 
-  transform.GridToModel(pt3, p3);
-  p3[ZDIM] = VariantValueAsFloat(v3) / 100.0f;
-
-  transform.GridToModel(pt4, p4);
-  p4[ZDIM] = VariantValueAsFloat(v4) / 100.0f;
+  mesh->ExtendBlock(p1);
+  mesh->ExtendBlock(p2);
+  mesh->ExtendBlock(p3);
+  mesh->ExtendBlock(p4);
 
   if(fabs(p1[ZDIM] - p3[ZDIM]) < fabs(p2[ZDIM] - p4[ZDIM]))
   {
@@ -331,4 +417,55 @@ int ShadedSurfaceLayer::DrawTriangle(float x1, float y1, float z1, int c1,
 
   glColor4ub(GetR(c3), GetG(c3), GetB(c3), GetA(c3));
   glVertex3f(x3, y3, z3);
+
+  return retval;
+}
+
+int ShadedSurfaceLayer::TransformColumn(const GridTransform& transform,
+                                        const MPI_Offset start[], int n,
+                                        int stride, float* posout[]) const
+{
+  int retval = NVN_NOERR;
+  MPI_Offset pt[MAX_DIMS];
+  float pos[MAX_DIMS] = { 0.0f };
+
+  // Whole columns are transformed in one batch, but a coarse column skips
+  // points and is cut short at the edge of the grid, so it is transformed one
+  // point at a time.
+  if(1 == stride)
+  {
+    retval = transform.GridRowToModel(start, 1, n, posout);
+  }
+  else
+  {
+    pt[0] = start[0];
+
+    for(int k = 0; k < n; k++)
+    {
+      pt[1] = MIN(start[1] + k * stride, _DataGrid->GetDimLen(1) - 1);
+      transform.GridToModel(pt, pos);
+      posout[XDIM][k] = pos[XDIM];
+      posout[YDIM][k] = pos[YDIM];
+    }
+  }
+
+  return retval;
+}
+
+int ShadedSurfaceLayer::GetRasterColor(const void* arg, const MPI_Offset pt[])
+{
+  const ShadedSurfaceLayer* layer = (const ShadedSurfaceLayer*)arg;
+  Variant value;
+  int color = 0;
+
+  // The raster is drawn with an alpha test in place of the checks that the
+  // mesh makes for missing data, so every point with data is opaque.
+  if(layer->_DataGrid->HasData(pt) &&
+     NVN_NOERR == layer->_DataGrid->GetElemAsVariant(pt, &value))
+  {
+    color = GetColor(layer->_Ramp, value, layer->_MinVal, layer->_MaxVal);
+    ((unsigned char*)&color)[ALPHA] = 255;
+  }
+
+  return color;
 }
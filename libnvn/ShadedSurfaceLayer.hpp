@@ -15,6 +15,8 @@
 #include "CartesianCRS.hpp"
 #include "GridTransform.hpp"
 #include "Layer.hpp"
+#include "MeshBlocks.hpp"
+#include "RasterTiles.hpp"
 
 
 class DataGrid;
@@ -28,35 +30,63 @@ public:
 public:
   ColorRamp& Ramp() { return _Ramp; }
 
+  /**
+   * The number of triangles in the mesh, once it has been compiled.
+   */
+  int GetNTriangles() const { return _NTriangles; }
+
 public:
-  virtual NVN_BBox GetBounds() const;
   virtual const CRS& GetDataCRS() const;
 
 public:
-  virtual int Render();
+  virtual int Probe(float x, float y, float radius,
+                    NVN_ProbeResult* result) const;
+  virtual int Render(const RenderContext& context);
   virtual int SetModelCRS(const CartesianCRS& crs);
 
 protected:
-  int DrawQuad(const MPI_Offset pt1[], const MPI_Offset pt2[],
+  /**
+   * The meshes and raster tiles that one share group draws.
+   */
+  struct SurfaceResources : public LayerResources
+  {
+    SurfaceResources(int sharegroup)
+      : LayerResources(sharegroup), Compiled(false), CoarseStride(0) {}
+
+    MeshBlocks Mesh;
+    bool Compiled;
+    MeshBlocks CoarseMesh;          // Drawn at reduced detail
+    int CoarseStride;               // The stride of CoarseMesh, or 0
+    RasterTiles Raster;             // Drawn for views from straight above
+  };
+
+protected:
+  virtual NVN_BBox ComputeBounds() const;
+  virtual LayerResources* CreateResources(int sharegroup) const;
+
+protected:
+  int Compile(SurfaceResources* resources, int stride);
+  int DrawQuad(MeshBlocks* mesh,
+               const MPI_Offset pt1[], const MPI_Offset pt2[],
                const MPI_Offset pt3[], const MPI_Offset pt4[],
-               const GridTransform& transform) const;
+               float p1[], float p2[], float p3[], float p4[],
+               float zscale);
   int DrawTriangle(const MPI_Offset pt1[], const MPI_Offset pt2[],
                    const MPI_Offset pt3[]) const;
   int DrawTriangle(float x1, float y1, float z1, int c1,
                    float x2, float y2, float z2, int c2,
                    float x3, float y3, float z3, int c3) const;
+  int TransformColumn(const GridTransform& transform, const MPI_Offset start[],
+                      int n, int stride, float* posout[]) const;
+
+  static int GetRasterColor(const void* arg, const MPI_Offset pt[]);
 
 protected:
   DataGrid* _DataGrid;
   ColorRamp _Ramp;
   Variant _MinVal;
   Variant _MaxVal;
-  char* _TexBitmap;
-  int _TexWidth;
-  int _TexHeight;
-  unsigned int _TextureID;
-  unsigned int _DisplayList;
-  bool _Compiled;
+  int _NTriangles;
 };
 
 
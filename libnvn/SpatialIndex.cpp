@@ -0,0 +1,207 @@
+/*
+ * SpatialIndex.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Timothy Morey
+ */
+
+
+#include "nvn.h"
+
+#include "SpatialIndex.hpp"
+
+#include <float.h>
+#include <math.h>
+#include <vector>
+
+
+/******************************************************************************
+ * Constructors
+ ******************************************************************************/
+
+SpatialIndex::SpatialIndex()
+  : _NItems(0),
+    _NX(0),
+    _NY(0),
+    _XMin(0.0f),
+    _YMin(0.0f),
+    _CellWidth(1.0f),
+    _CellHeight(1.0f)
+{
+
+}
+
+SpatialIndex::~SpatialIndex()
+{
+
+}
+
+
+/******************************************************************************
+ * Public Members
+ ******************************************************************************/
+
+int SpatialIndex::Build(int n, const float extents[])
+{
+  int retval = NVN_NOERR;
+  float xmin = FLT_MAX, xmax = -FLT_MAX;
+  float ymin = FLT_MAX, ymax = -FLT_MAX;
+  float width, height, side;
+  int i0, i1, j0, j1;
+  const float* e;
+
+  this->Clear();
+
+  for(int k = 0; k < n; k++)
+  {
+    e = extents + 4 * k;
+    if(e[0] <= e[1] && e[2] <= e[3])
+    {
+      if(e[0] < xmin) xmin = e[0];
+      if(e[1] > xmax) xmax = e[1];
+      if(e[2] < ymin) ymin = e[2];
+      if(e[3] > ymax) ymax = e[3];
+      _NItems++;
+    }
+  }
+
+  if(_NItems > 0)
+  {
+    // Aim for about one item per cell, with square cells where possible.
+    width = xmax - xmin;
+    height = ymax - ymin;
+    side = sqrtf(width * height / _NItems);
+
+    if(side > 0.0f)
+    {
+      _NX = (int)ceilf(width / side);
+      _NY = (int)ceilf(height / side);
+    }
+    else
+    {
+      // Every item lies on one line, so the index only needs one row.
+      _NX = width > 0.0f ? _NItems : 1;
+      _NY = height > 0.0f ? _NItems : 1;
+    }
+
+    if(_NX < 1) _NX = 1;
+    if(_NY < 1) _NY = 1;
+    if(_NX > SPATIAL_INDEX_MAX_CELLS) _NX = SPATIAL_INDEX_MAX_CELLS;
+    if(_NY > SPATIAL_INDEX_MAX_CELLS) _NY = SPATIAL_INDEX_MAX_CELLS;
+
+    _XMin = xmin;
+    _YMin = ymin;
+    _CellWidth = width > 0.0f ? width / _NX : 1.0f;
+    _CellHeight = height > 0.0f ? height / _NY : 1.0f;
+
+    // The cells are packed into one array, so the items are counted per cell
+    // before they are placed.
+    _CellStart.assign(_NX * _NY + 1, 0);
+
+    for(int pass = 0; pass < 2; pass++)
+    {
+      for(int k = 0; k < n; k++)
+      {
+        e = extents + 4 * k;
+        if(e[0] <= e[1] && e[2] <= e[3])
+        {
+          this->GetCell(e[0], e[2], &i0, &j0);
+          this->GetCell(e[1], e[3], &i1, &j1);
+
+          for(int j = j0; j <= j1; j++)
+          {
+            for(int i = i0; i <= i1; i++)
+            {
+              if(0 == pass)
+                _CellStart[j * _NX + i + 1]++;
+              else
+                _Items[_CellStart[j * _NX + i]++] = k;
+            }
+          }
+        }
+      }
+
+      if(0 == pass)
+      {
+        for(int c = 0; c < _NX * _NY; c++)
+          _CellStart[c + 1] += _CellStart[c];
+
+        _Items.resize(_CellStart[_NX * _NY]);
+      }
+      else
+      {
+        // Placing the items moved each start to the end of its cell, which
+        // is the start of the next one.
+        for(int c = _NX * _NY; c > 0; c--)
+          _CellStart[c] = _CellStart[c - 1];
+        _CellStart[0] = 0;
+      }
+    }
+  }
+
+  return retval;
+}
+
+int SpatialIndex::Clear()
+{
+  int retval = NVN_NOERR;
+
+  _NItems = 0;
+  _NX = _NY = 0;
+  _CellStart.clear();
+  _Items.clear();
+
+  return retval;
+}
+
+int SpatialIndex::Query(float x, float y, float radius,
+                        std::vector<int>* items) const
+{
+  int retval = NVN_NOERR;
+  int i0, i1, j0, j1;
+
+  if(! items)
+  {
+    retval = NVN_EINVARGS;
+  }
+  else if(_NItems > 0 &&
+          x + radius >= _XMin && x - radius <= _XMin + _NX * _CellWidth &&
+          y + radius >= _YMin && y - radius <= _YMin + _NY * _CellHeight)
+  {
+    this->GetCell(x - radius, y - radius, &i0, &j0);
+    this->GetCell(x + radius, y + radius, &i1, &j1);
+
+    for(int j = j0; j <= j1; j++)
+    {
+      for(int i = i0; i <= i1; i++)
+      {
+        int c = j * _NX + i;
+        items->insert(items->end(),
+                      _Items.begin() + _CellStart[c],
+                      _Items.begin() + _CellStart[c + 1]);
+      }
+    }
+  }
+
+  return retval;
+}
+
+
+/******************************************************************************
+ * Protected Members
+ ******************************************************************************/
+
+int SpatialIndex::GetCell(float x, float y, int* i, int* j) const
+{
+  int retval = NVN_NOERR;
+
+  *i = (int)floorf((x - _XMin) / _CellWidth);
+  *j = (int)floorf((y - _YMin) / _CellHeight);
+
+  if(*i < 0) *i = 0;
+  if(*i >= _NX) *i = _NX - 1;
+  if(*j < 0) *j = 0;
+  if(*j >= _NY) *j = _NY - 1;
+
+  return retval;
+}
@@ -0,0 +1,68 @@
+/*
+ * SpatialIndex.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Timothy Morey
+ */
+
+#ifndef __SPATIALINDEX_HPP__
+#define __SPATIALINDEX_HPP__
+
+
+#include "nvn.h"
+
+#include <vector>
+
+/**
+ * The most cells along either side of a SpatialIndex.
+ */
+#define SPATIAL_INDEX_MAX_CELLS 1024
+
+
+/**
+ * A SpatialIndex is a uniform grid over the x/y plane that finds the items,
+ * such as layers or line segments, whose extents are near a point.  Each item
+ * is listed in every cell its extent overlaps, and the grid is sized so that a
+ * cell holds a handful of items on average, which keeps a query close to
+ * constant time.
+ *
+ * The index is built once from a snapshot of the extents, and has to be built
+ * again if they change.
+ */
+class SpatialIndex
+{
+public:
+  SpatialIndex();
+  ~SpatialIndex();
+
+public:
+  int GetNItems() const { return _NItems; }
+
+public:
+  /**
+   * Indexes n items, where extents holds the xmin, xmax, ymin and ymax of
+   * each one.  Items with an empty extent are left out.
+   */
+  int Build(int n, const float extents[]);
+  int Clear();
+
+  /**
+   * Appends to items every item whose cell is within radius of (x, y).  The
+   * list may contain items that are farther away than that, and may list an
+   * item more than once, so the caller still has to measure each one.
+   */
+  int Query(float x, float y, float radius, std::vector<int>* items) const;
+
+protected:
+  int GetCell(float x, float y, int* i, int* j) const;
+
+protected:
+  int _NItems;
+  int _NX, _NY;
+  float _XMin, _YMin;
+  float _CellWidth, _CellHeight;
+  std::vector<int> _CellStart;  // _NX * _NY + 1 offsets into _Items
+  std::vector<int> _Items;
+};
+
+#endif
@@ -0,0 +1,283 @@
+/*
+ * Trace.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Timothy Morey
+ */
+
+
+#include "nvn.h"
+
+#include "Trace.hpp"
+
+#define MPICH_SKIP_MPICXX 1
+#include <mpi.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/******************************************************************************
+ * Static members
+ ******************************************************************************/
+
+bool Trace::_Enabled = false;
+double Trace::_Epoch = 0.0;
+pthread_mutex_t Trace::_Lock = PTHREAD_MUTEX_INITIALIZER;
+TraceBuffer* Trace::_Buffers[TRACE_MAX_THREADS];
+int Trace::_NBuffers = 0;
+
+static __thread TraceBuffer* g_ThreadBuffer = 0;
+static __thread const char* g_ThreadName = 0;
+static __thread bool g_NoBuffer = false;
+
+static void WriteJSONString(FILE* file, const char* str);
+
+
+/******************************************************************************
+ * Public Members
+ ******************************************************************************/
+
+int Trace::Begin(const char* name, const char* category)
+{
+  int retval = NVN_NOERR;
+  TraceBuffer* buffer = GetBuffer();
+  TraceEvent* event;
+
+  // Room is always kept for the ends of the events that are open, so that a
+  // full buffer never leaves an event without its end.
+  if(! buffer)
+  {
+    retval = NVN_ERROR;
+  }
+  else if(buffer->Count + buffer->Depth + 2 > TRACE_BUFFER_EVENTS)
+  {
+    buffer->Dropped++;
+    retval = NVN_ERROR;
+  }
+  else
+  {
+    event = &buffer->Events[buffer->Count];
+    event->Name = name;
+    event->Category = category;
+    event->Time = MPI_Wtime() - _Epoch;
+    event->Phase = 'B';
+
+    buffer->Depth++;
+    __atomic_store_n(&buffer->Count, buffer->Count + 1, __ATOMIC_RELEASE);
+  }
+
+  return retval;
+}
+
+int Trace::End()
+{
+  int retval = NVN_NOERR;
+  TraceBuffer* buffer = g_ThreadBuffer;
+  TraceEvent* event;
+
+  if(! buffer || buffer->Depth <= 0)
+  {
+    retval = NVN_EINVARGS;
+  }
+  else
+  {
+    event = &buffer->Events[buffer->Count];
+    event->Name = 0;
+    event->Category = 0;
+    event->Time = MPI_Wtime() - _Epoch;
+    event->Phase = 'E';
+
+    buffer->Depth--;
+    __atomic_store_n(&buffer->Count, buffer->Count + 1, __ATOMIC_RELEASE);
+  }
+
+  return retval;
+}
+
+int Trace::SetEnabled(bool enabled)
+{
+  int retval = NVN_NOERR;
+
+  pthread_mutex_lock(&_Lock);
+  if(enabled && 0.0 == _Epoch)
+    _Epoch = MPI_Wtime();
+  __atomic_store_n(&_Enabled, enabled, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&_Lock);
+
+  return retval;
+}
+
+int Trace::SetThreadName(const char* name)
+{
+  int retval = NVN_NOERR;
+
+  g_ThreadName = name;
+
+  if(g_ThreadBuffer && name)
+  {
+    pthread_mutex_lock(&_Lock);
+    strncpy(g_ThreadBuffer->ThreadName, name, MAX_NAME - 1);
+    pthread_mutex_unlock(&_Lock);
+  }
+
+  return retval;
+}
+
+int Trace::Write(const char* prefix)
+{
+  int retval = NVN_NOERR;
+  char filename[MAX_PATH + 16];
+  FILE* file = 0;
+  int rank = 0;
+  int initialized = 0;
+  int nbuffers;
+  int count;
+
+  if(! prefix || strlen(prefix) >= MAX_PATH)
+  {
+    retval = NVN_EINVARGS;
+  }
+  else
+  {
+    MPI_Initialized(&initialized);
+    if(initialized)
+      MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    snprintf(filename, sizeof(filename), "%s.%d.json", prefix, rank);
+    file = fopen(filename, "w");
+    if(! file)
+    {
+      fprintf(stderr, "Unable to open '%s' for writing\n", filename);
+      retval = NVN_ERROR;
+    }
+  }
+
+  if(NVN_NOERR == retval)
+  {
+    pthread_mutex_lock(&_Lock);
+    nbuffers = _NBuffers;
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    // Each rank is a process, and each thread is named, so the files from
+    // all of the ranks can be loaded side by side.
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+            "\"args\":{\"name\":\"rank %d\"}}", rank, rank);
+
+    for(int b = 0; b < nbuffers; b++)
+    {
+      fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+              "\"tid\":%d,\"args\":{\"name\":",
+              rank, _Buffers[b]->ThreadIndex);
+      WriteJSONString(file, _Buffers[b]->ThreadName);
+      fprintf(file, "}}");
+
+      if(_Buffers[b]->Dropped > 0)
+      {
+        fprintf(stderr, "Trace dropped %d events on thread '%s'\n",
+                _Buffers[b]->Dropped, _Buffers[b]->ThreadName);
+      }
+    }
+
+    pthread_mutex_unlock(&_Lock);
+
+    for(int b = 0; b < nbuffers; b++)
+    {
+      const TraceBuffer* buffer = _Buffers[b];
+      count = __atomic_load_n(&buffer->Count, __ATOMIC_ACQUIRE);
+
+      for(int i = 0; i < count; i++)
+      {
+        const TraceEvent& event = buffer->Events[i];
+
+        if('B' == event.Phase)
+        {
+          fprintf(file, ",\n{\"name\":");
+          WriteJSONString(file, event.Name);
+          fprintf(file, ",\"cat\":");
+          WriteJSONString(file, event.Category);
+          fprintf(file, ",\"ph\":\"B\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d}",
+                  event.Time * 1.0e6, rank, buffer->ThreadIndex);
+        }
+        else
+        {
+          fprintf(file, ",\n{\"ph\":\"E\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d}",
+                  event.Time * 1.0e6, rank, buffer->ThreadIndex);
+        }
+      }
+    }
+
+    fprintf(file, "\n]}\n");
+
+    if(0 != fclose(file))
+      retval = NVN_ERROR;
+  }
+
+  return retval;
+}
+
+
+/******************************************************************************
+ * Protected Members
+ ******************************************************************************/
+
+TraceBuffer* Trace::GetBuffer()
+{
+  TraceBuffer* buffer = g_ThreadBuffer;
+
+  // Buffers are only made for threads that record something, and are kept
+  // after their threads exit, so that their events can still be written.
+  if(! buffer && ! g_NoBuffer)
+  {
+    pthread_mutex_lock(&_Lock);
+
+    if(_NBuffers < TRACE_MAX_THREADS)
+    {
+      buffer = (TraceBuffer*)calloc(1, sizeof(TraceBuffer));
+
+      if(buffer)
+      {
+        buffer->ThreadIndex = _NBuffers;
+        if(g_ThreadName)
+          strncpy(buffer->ThreadName, g_ThreadName, MAX_NAME - 1);
+        else
+          snprintf(buffer->ThreadName, MAX_NAME, "thread %d", _NBuffers);
+
+        _Buffers[_NBuffers++] = buffer;
+        g_ThreadBuffer = buffer;
+      }
+    }
+
+    // A thread that cannot have a buffer does not keep asking for one.
+    g_NoBuffer = ! buffer;
+
+    pthread_mutex_unlock(&_Lock);
+  }
+
+  return buffer;
+}
+
+
+/******************************************************************************
+ * Helpers
+ ******************************************************************************/
+
+void WriteJSONString(FILE* file, const char* str)
+{
+  fputc('"', file);
+
+  for(const char* c = str ? str : ""; *c; c++)
+  {
+    if('"' == *c || '\\' == *c)
+      fprintf(file, "\\%c", *c);
+    else if((unsigned char)*c < 0x20)
+      fprintf(file, "\\u%04x", *c);
+    else
+      fputc(*c, file);
+  }
+
+  fputc('"', file);
+}
@@ -0,0 +1,115 @@
+/*
+ * Trace.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Timothy Morey
+ */
+
+#ifndef __TRACE_HPP__
+#define __TRACE_HPP__
+
+
+#include "nvn.h"
+
+#include <pthread.h>
+
+/**
+ * The number of events that one thread can record before it starts dropping
+ * them.
+ */
+#define TRACE_BUFFER_EVENTS 65536
+
+/**
+ * The most threads that can record events.
+ */
+#define TRACE_MAX_THREADS 64
+
+
+/**
+ * One begin ('B') or end ('E') event.  Names and categories must be string
+ * constants, since only the pointers are kept.
+ */
+struct TraceEvent
+{
+  const char* Name;
+  const char* Category;
+  double Time;
+  char Phase;
+};
+
+/**
+ * The events recorded by one thread.  Only that thread ever writes to it, and
+ * Count is published after each event is filled in, so the buffer can be read
+ * while it is still being written without any locking.
+ */
+struct TraceBuffer
+{
+  TraceEvent Events[TRACE_BUFFER_EVENTS];
+  int Count;
+  int Depth;                        // Events begun and not yet ended
+  int Dropped;
+  int ThreadIndex;
+  char ThreadName[MAX_NAME];
+};
+
+/**
+ * Trace records when the threads of a process enter and leave the parts of
+ * nvn that are worth seeing on a timeline - loading, mesh building, the UI
+ * loop, the server, and MPI communication - and writes them in the Chrome
+ * trace format, which both chrome://tracing and Perfetto can open.
+ *
+ * Tracing starts out disabled, and then costs a single flag test per scope.
+ */
+class Trace
+{
+public:
+  static bool IsEnabled() { return __atomic_load_n(&_Enabled, __ATOMIC_RELAXED); }
+
+  static int Begin(const char* name, const char* category);
+  static int End();
+  static int SetEnabled(bool enabled);
+  static int SetThreadName(const char* name);
+
+  /**
+   * Writes the events recorded so far to <prefix>.<rank>.json.  This may be
+   * called while other threads are still recording.
+   */
+  static int Write(const char* prefix);
+
+protected:
+  static TraceBuffer* GetBuffer();
+
+protected:
+  static bool _Enabled;
+  static double _Epoch;
+  static pthread_mutex_t _Lock;
+  static TraceBuffer* _Buffers[TRACE_MAX_THREADS];
+  static int _NBuffers;
+};
+
+/**
+ * A TraceScope records an event that lasts as long as the scope does.  The
+ * event is ended even if tracing is disabled in the meantime, so that begin
+ * and end events always pair up.
+ */
+class TraceScope
+{
+public:
+  TraceScope(const char* name, const char* category = "nvn")
+    : _Active(Trace::IsEnabled())
+  {
+    if(_Active)
+      _Active = NVN_NOERR == Trace::Begin(name, category);
+  }
+
+  ~TraceScope()
+  {
+    if(_Active)
+      Trace::End();
+  }
+
+protected:
+  bool _Active;
+};
+
+#endif
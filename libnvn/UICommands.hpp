@@ -0,0 +1,127 @@
+/*
+ * UICommands.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Timothy Morey
+ */
+
+#ifndef __UICOMMANDS_HPP__
+#define __UICOMMANDS_HPP__
+
+
+#include "communication-queue.h"
+#include "nvn.h"
+
+#include <mpi.h>
+
+
+class Compositor;
+class GLWindow;
+class Layer;
+class Model;
+
+
+/**
+ * The commands that other threads send to the UI thread.  Each one indexes
+ * the UI thread's table of handlers, so a message is dispatched without
+ * looking at anything but its command.
+ */
+enum UICommand
+{
+  UICommandAddLayer = 0,
+  UICommandCreateWindow,
+  UICommandDestroyWindow,
+  UICommandJoinGroup,
+  UICommandReadFrame,
+  UICommandShowModel,
+  UICommandStartRecording,
+  UICommandStopRecording,
+  NumUICommands
+};
+
+struct AddLayerArgs
+{
+  Model* Target;
+  Layer* NewLayer;
+};
+
+struct CreateWindowArgs
+{
+  char* Title;                    // Owned by the message
+  int X;
+  int Y;
+  int Width;
+  int Height;
+  bool Borderless;
+  GLWindow** Window;
+};
+
+struct DestroyWindowArgs
+{
+  GLWindow* Window;
+};
+
+struct JoinGroupArgs
+{
+  GLWindow* Window;
+  MPI_Comm Comm;
+  int CameraRank;
+  Compositor* Comp;
+  bool HasTile;
+  int Tile[4];
+};
+
+struct ReadFrameArgs
+{
+  GLWindow* Window;
+  void* RGBA;
+  size_t Len;
+};
+
+struct ShowModelArgs
+{
+  GLWindow* Window;
+  Model* NewModel;
+};
+
+struct StartRecordingArgs
+{
+  GLWindow* Window;
+  char* Target;                   // Owned by the message
+  int Mode;
+};
+
+struct StopRecordingArgs
+{
+  GLWindow* Window;
+};
+
+/**
+ * The arguments of a command, which are stored by value in the payload of
+ * its message.  Anything a message owns is handed over with it, and is freed
+ * once, by whichever thread ends up with the message.
+ */
+union UICommandArgs
+{
+  AddLayerArgs AddLayer;
+  CreateWindowArgs CreateWindow;
+  DestroyWindowArgs DestroyWindow;
+  JoinGroupArgs JoinGroup;
+  ReadFrameArgs ReadFrame;
+  ShowModelArgs ShowModel;
+  StartRecordingArgs StartRecording;
+  StopRecordingArgs StopRecording;
+};
+
+// Fails to compile if a command outgrows the payload of a message.
+typedef char UICommandArgsFit[sizeof(UICommandArgs) <= MSG_PAYLOAD_SIZE ? 1 : -1];
+
+/**
+ * Gives the arguments of a message that holds a command.
+ */
+inline UICommandArgs* GetCommandArgs(Message* msg)
+{
+  return (UICommandArgs*)msg->Payload.Bytes;
+}
+
+#endif
@@ -0,0 +1,91 @@
+/*
+ * ViewState.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Timothy Morey
+ */
+
+
+#include "nvn.h"
+
+#include "ViewState.hpp"
+
+#include <sched.h>
+
+
+/******************************************************************************
+ * Constructors
+ ******************************************************************************/
+
+ViewState::ViewState()
+  : _Sequence(0)
+{
+  _View.CenterX = 0.0f;
+  _View.CenterY = 0.0f;
+  _View.ZoomLevel = 1.0f;
+  _View.XRotation = 0.0f;
+  _View.ZRotation = 0.0f;
+}
+
+
+/******************************************************************************
+ * Public Members
+ ******************************************************************************/
+
+int ViewState::Load(ViewParms* view) const
+{
+  int retval = NVN_NOERR;
+  unsigned int before = 0;
+  unsigned int after = 0;
+
+  do
+  {
+    before = __atomic_load_n(&_Sequence, __ATOMIC_ACQUIRE);
+
+    // The fields are read one at a time, and are only trusted if no write
+    // began or ended while they were being read.
+    __atomic_load(&_View.CenterX, &view->CenterX, __ATOMIC_RELAXED);
+    __atomic_load(&_View.CenterY, &view->CenterY, __ATOMIC_RELAXED);
+    __atomic_load(&_View.ZoomLevel, &view->ZoomLevel, __ATOMIC_RELAXED);
+    __atomic_load(&_View.XRotation, &view->XRotation, __ATOMIC_RELAXED);
+    __atomic_load(&_View.ZRotation, &view->ZRotation, __ATOMIC_RELAXED);
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    after = __atomic_load_n(&_Sequence, __ATOMIC_RELAXED);
+  } while((before & 1) || before != after);
+
+  return retval;
+}
+
+int ViewState::Store(const ViewParms& view)
+{
+  int retval = NVN_NOERR;
+  unsigned int seq = 0;
+  bool claimed = false;
+
+  // A writer claims the state by making the sequence odd, which also turns
+  // away any other writer until it is done.
+  while(! claimed)
+  {
+    seq = __atomic_load_n(&_Sequence, __ATOMIC_RELAXED);
+    if(seq & 1)
+      sched_yield();
+    else
+      claimed = __atomic_compare_exchange_n(&_Sequence, &seq, seq + 1, false,
+                                            __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+  }
+
+  // Readers must see the odd sequence before any of the new fields, or they
+  // could take new fields under an old even sequence.
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  __atomic_store(&_View.CenterX, &view.CenterX, __ATOMIC_RELAXED);
+  __atomic_store(&_View.CenterY, &view.CenterY, __ATOMIC_RELAXED);
+  __atomic_store(&_View.ZoomLevel, &view.ZoomLevel, __ATOMIC_RELAXED);
+  __atomic_store(&_View.XRotation, &view.XRotation, __ATOMIC_RELAXED);
+  __atomic_store(&_View.ZRotation, &view.ZRotation, __ATOMIC_RELAXED);
+
+  __atomic_store_n(&_Sequence, seq + 2, __ATOMIC_RELEASE);
+
+  return retval;
+}
@@ -0,0 +1,47 @@
+/*
+ * ViewState.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Timothy Morey
+ */
+
+#ifndef __VIEWSTATE_HPP__
+#define __VIEWSTATE_HPP__
+
+
+/**
+ * The camera of a window: the model point at the center of the view, how far
+ * it is zoomed in, and its rotations about the x and z axes, in degrees.
+ */
+struct ViewParms
+{
+  float CenterX;
+  float CenterY;
+  float ZoomLevel;
+  float XRotation;
+  float ZRotation;
+};
+
+
+/**
+ * ViewState holds a camera that any thread may read or replace at any time,
+ * guarded by a sequence lock.  The sequence is odd while a write is under
+ * way, and a reader that sees it change copies the camera again, so readers
+ * never wait on a lock and never see half of one camera and half of another.
+ * Writers take turns with each other.
+ */
+class ViewState
+{
+public:
+  ViewState();
+
+public:
+  int Load(ViewParms* view) const;
+  int Store(const ViewParms& view);
+
+protected:
+  unsigned int _Sequence;
+  ViewParms _View;
+};
+
+#endif
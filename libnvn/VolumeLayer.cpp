@@ -0,0 +1,808 @@
+/*
+ * VolumeLayer.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Timothy Morey
+ */
+
+#include "nvn.h"
+
+#include "color-ramp.h"
+#include "variant.h"
+
+#include "CartesianCRS.hpp"
+#include "DataGrid.hpp"
+#include "GridTransform.hpp"
+#include "Layer.hpp"
+#include "RenderContext.hpp"
+#include "VolumeLayer.hpp"
+
+#define MPICH_SKIP_MPICXX 1
+#include <mpi.h>
+
+#include <GL/gl.h>
+#include <float.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+/**
+ * The most pixels in the marched image, which is stretched over the viewport
+ * when the viewport is bigger.
+ */
+#define VOLUME_MAX_PIXELS (512 * 512)
+
+/**
+ * The opacity of one step through the grid where the ramp is fully opaque.
+ * Steps are one voxel long.
+ */
+#define VOLUME_OPACITY 0.04f
+
+/**
+ * The opacity at which a ray is treated as solid and stops being marched.
+ */
+#define VOLUME_OPAQUE 0.98f
+
+/**
+ * The number of rays that are marched together.
+ */
+#define VOLUME_PACKET 4
+
+
+/**
+ * The rows of the image that are marched by one thread.
+ */
+struct VolumeTask
+{
+  const VolumeLayer* Layer;
+  const VolumeMarch* March;
+  int FirstRow;
+  int RowStride;
+};
+
+
+VolumeLayer::VolumeLayer(DataGrid* grid)
+  : Layer(),
+    _DataGrid(grid),
+    _Ramp(DefaultColorRamp),
+    _NI(0),
+    _NJ(0),
+    _NK(0),
+    _Values(0),
+    _MinVal(FLT_MAX),
+    _MaxVal(-FLT_MAX),
+    _NBI(0),
+    _NBJ(0),
+    _NBK(0),
+    _Blocks(0)
+{
+  MPI_Offset pos[MAX_DIMS] = { 0 };
+  Variant value;
+  float* v;
+
+  if(_DataGrid && _DataGrid->GetDimLen(0) > 1 &&
+     _DataGrid->GetDimLen(1) > 1 && _DataGrid->GetDimLen(2) > 1)
+  {
+    _NI = _DataGrid->GetDimLen(0);
+    _NJ = _DataGrid->GetDimLen(1);
+    _NK = _DataGrid->GetDimLen(2);
+    _Values = (float*)malloc((size_t)_NI * _NJ * _NK * sizeof(float));
+  }
+
+  // The grid is read once into a plain array, with the third dimension
+  // varying fastest, so that the rays never have to go through the DataGrid.
+  if(_Values)
+  {
+    v = _Values;
+
+    for(pos[0] = 0; pos[0] < _NI; pos[0]++)
+    {
+      for(pos[1] = 0; pos[1] < _NJ; pos[1]++)
+      {
+        for(pos[2] = 0; pos[2] < _NK; pos[2]++, v++)
+        {
+          if(_DataGrid->HasData(pos) &&
+             NVN_NOERR == _DataGrid->GetElemAsVariant(pos, &value))
+          {
+            *v = VariantValueAsFloat(value);
+            if(*v < _MinVal) _MinVal = *v;
+            if(*v > _MaxVal) _MaxVal = *v;
+          }
+          else
+          {
+            *v = NAN;
+          }
+        }
+      }
+    }
+
+    this->BuildTable();
+  }
+
+  if(! _Values || NVN_NOERR != this->BuildBlocks())
+  {
+    if(_NI > 0)
+      fprintf(stderr, "Unable to allocate the volume grid.\n");
+
+    _NI = _NJ = _NK = 0;
+  }
+}
+
+VolumeLayer::~VolumeLayer()
+{
+  // The textures belong to contexts that may already be gone, so they are
+  // left for the contexts to clean up.
+  free(_Blocks);
+  free(_Values);
+}
+
+const CRS& VolumeLayer::GetDataCRS() const
+{
+  if(_DataGrid)
+    return _DataGrid->GetCRS();
+  else
+    return _ModelCrs;
+}
+
+int VolumeLayer::Render(const RenderContext& context)
+{
+  int retval = NVN_NOERR;
+  VolumeResources* resources = (VolumeResources*)this->GetResources(context);
+  VolumeMarch* march = 0;
+
+  if(_NI > 0 && _MinVal <= _MaxVal)
+  {
+    for(size_t i = 0; i < resources->Marches.size() && ! march; i++)
+    {
+      if(context.GetWindow() == resources->Marches[i]->Window)
+        march = resources->Marches[i];
+    }
+
+    if(! march)
+    {
+      march = new VolumeMarch(context.GetWindow());
+      resources->Marches.push_back(march);
+    }
+
+    if(! march->View || ! march->View->IsSameView(context) ||
+       march->Revision != _Revision)
+    {
+      retval = this->March(context, march);
+
+      delete march->View;
+      march->View = new RenderContext(context);
+      march->Revision = _Revision;
+      march->TextureValid = false;
+    }
+
+    // The image is only sent to the texture again once it has been marched
+    // again.
+    if(NVN_NOERR == retval && march->Image && ! march->TextureValid)
+    {
+      if((unsigned int)-1 == march->TextureID)
+        glGenTextures(1, &march->TextureID);
+
+      glBindTexture(GL_TEXTURE_2D, march->TextureID);
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
+                   march->ImageWidth, march->ImageHeight, 0,
+                   GL_RGBA, GL_UNSIGNED_BYTE, march->Image);
+      march->TextureValid = true;
+    }
+
+    if(NVN_NOERR == retval && march->TextureValid)
+    {
+      // The image already covers the viewport, so it is drawn as one quad in
+      // device coordinates.  Its colors are premultiplied by their opacity.
+      glPushAttrib(GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_TEXTURE_BIT);
+      glDisable(GL_LIGHTING);
+      glDisable(GL_DEPTH_TEST);
+      glEnable(GL_BLEND);
+      glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+      glEnable(GL_TEXTURE_2D);
+      glBindTexture(GL_TEXTURE_2D, march->TextureID);
+      glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+
+      glMatrixMode(GL_PROJECTION);
+      glPushMatrix();
+      glLoadIdentity();
+      glMatrixMode(GL_MODELVIEW);
+      glPushMatrix();
+      glLoadIdentity();
+
+      glBegin(GL_QUADS);
+      glTexCoord2f(0.0f, 0.0f);  glVertex2f(-1.0f, -1.0f);
+      glTexCoord2f(1.0f, 0.0f);  glVertex2f(1.0f, -1.0f);
+      glTexCoord2f(1.0f, 1.0f);  glVertex2f(1.0f, 1.0f);
+      glTexCoord2f(0.0f, 1.0f);  glVertex2f(-1.0f, 1.0f);
+      glEnd();
+
+      glPopMatrix();
+      glMatrixMode(GL_PROJECTION);
+      glPopMatrix();
+      glMatrixMode(GL_MODELVIEW);
+
+      glPopAttrib();
+    }
+  }
+
+  return retval;
+}
+
+int VolumeLayer::SetModelCRS(const CartesianCRS& crs)
+{
+  int retval = NVN_NOERR;
+
+  _ModelCrs = crs;
+  this->InvalidateBounds();
+
+  return retval;
+}
+
+int VolumeLayer::SetRamp(const ColorRamp& ramp)
+{
+  int retval = NVN_NOERR;
+
+  // The table is read while the image is marched, so it is only changed
+  // between frames.
+  this->LockRender();
+  _Ramp = ramp;
+  retval = this->BuildTable();
+  _Revision++;
+  this->UnlockRender();
+
+  return retval;
+}
+
+NVN_BBox VolumeLayer::ComputeBounds() const
+{
+  NVN_BBox bounds = NVN_BBoxEmpty;
+  float scale[3], offset[3];
+  int basedim[3];
+  float a, b;
+
+  if(_NI > 0 && NVN_NOERR == this->GetVoxelTransform(scale, offset, basedim))
+  {
+    const int len[3] = { _NI, _NJ, _NK };
+
+    for(int d = 0; d < 3; d++)
+    {
+      a = offset[d];
+      b = offset[d] + scale[d] * (len[d] - 1);
+      bounds.Min[basedim[d]] = a < b ? a : b;
+      bounds.Max[basedim[d]] = a < b ? b : a;
+    }
+  }
+
+  return bounds;
+}
+
+int VolumeLayer::BuildBlocks()
+{
+  int retval = NVN_NOERR;
+  int i1, j1, k1;
+  bool found;
+
+  _NBI = (_NI - 2) / VOLUME_BLOCK_SIZE + 1;
+  _NBJ = (_NJ - 2) / VOLUME_BLOCK_SIZE + 1;
+  _NBK = (_NK - 2) / VOLUME_BLOCK_SIZE + 1;
+  _Blocks = (unsigned char*)malloc((size_t)_NBI * _NBJ * _NBK);
+
+  if(! _Blocks)
+  {
+    retval = NVN_ERROR;
+  }
+
+  // A block covers the cells that start in it, so it reaches one voxel into
+  // the next block as well, and is empty only if none of those voxels has
+  // data.
+  for(int bi = 0; NVN_NOERR == retval && bi < _NBI; bi++)
+  {
+    for(int bj = 0; bj < _NBJ; bj++)
+    {
+      for(int bk = 0; bk < _NBK; bk++)
+      {
+        i1 = MIN((bi + 1) * VOLUME_BLOCK_SIZE, _NI - 1);
+        j1 = MIN((bj + 1) * VOLUME_BLOCK_SIZE, _NJ - 1);
+        k1 = MIN((bk + 1) * VOLUME_BLOCK_SIZE, _NK - 1);
+        found = false;
+
+        for(int i = bi * VOLUME_BLOCK_SIZE; ! found && i <= i1; i++)
+        {
+          for(int j = bj * VOLUME_BLOCK_SIZE; ! found && j <= j1; j++)
+          {
+            const float* v = _Values + ((size_t)i * _NJ + j) * _NK;
+
+            for(int k = bk * VOLUME_BLOCK_SIZE; ! found && k <= k1; k++)
+              found = ! isnan(v[k]);
+          }
+        }
+
+        _Blocks[((size_t)bi * _NBJ + bj) * _NBK + bk] = found ? 1 : 0;
+      }
+    }
+  }
+
+  return retval;
+}
+
+int VolumeLayer::BuildTable()
+{
+  int retval = NVN_NOERR;
+  Variant minval, maxval, value;
+  float alpha;
+  int color;
+
+  minval.Type = maxval.Type = value.Type = VariantTypeFloat;
+  minval.Value.FloatVal = _MinVal;
+  maxval.Value.FloatVal = _MaxVal;
+
+  for(int i = 0; i < VOLUME_TABLE_SIZE; i++)
+  {
+    value.Value.FloatVal =
+      _MinVal + (_MaxVal - _MinVal) * i / (VOLUME_TABLE_SIZE - 1);
+    color = GetColor(_Ramp, value, minval, maxval);
+
+    alpha = VOLUME_OPACITY * (unsigned char)GetA(color) / 255.0f;
+    _Table[i][0] = alpha * (unsigned char)GetR(color) / 255.0f;
+    _Table[i][1] = alpha * (unsigned char)GetG(color) / 255.0f;
+    _Table[i][2] = alpha * (unsigned char)GetB(color) / 255.0f;
+    _Table[i][3] = alpha;
+  }
+
+  return retval;
+}
+
+int VolumeLayer::GetVoxelTransform(float scale[], float offset[],
+                                   int basedim[]) const
+{
+  int retval = NVN_NOERR;
+  MPI_Offset index[MAX_DIMS] = { 0 };
+  float origin[MAX_DIMS] = { 0.0f }, step[MAX_DIMS] = { 0.0f };
+
+  GridTransform transform(_ModelCrs, _DataGrid->GetCRS());
+
+  for(int d = 0; d < 3; d++)
+  {
+    basedim[d] = -1;
+    for(int b = 0; b < MAX_DIMS; b++)
+    {
+      if(d == transform.GetGridDim(b))
+        basedim[d] = b;
+    }
+  }
+
+  // A third dimension that the model does not know, such as a level index,
+  // is stood up along z with cells as tall as they are wide.
+  if(basedim[2] < 0 && transform.GetGridDim(ZDIM) < 0)
+    basedim[2] = ZDIM;
+
+  for(int d = 0; NVN_NOERR == retval && d < 3; d++)
+  {
+    if(basedim[d] < XDIM || basedim[d] > ZDIM ||
+       (d > 0 && basedim[d] == basedim[0]) ||
+       (d > 1 && basedim[d] == basedim[1]))
+    {
+      retval = NVN_EINVARGS;
+    }
+  }
+
+  if(NVN_NOERR == retval)
+  {
+    transform.GridToModel(index, origin);
+
+    for(int d = 0; d < 3; d++)
+    {
+      if(d == transform.GetGridDim(basedim[d]))
+      {
+        index[d] = 1;
+        transform.GridToModel(index, step);
+        index[d] = 0;
+
+        offset[d] = origin[basedim[d]];
+        scale[d] = step[basedim[d]] - origin[basedim[d]];
+      }
+      else
+      {
+        offset[d] = 0.0f;
+        scale[d] = transform.GetModelUnitsPerCell();
+      }
+
+      if(0.0f == scale[d])
+        retval = NVN_EINVARGS;
+    }
+  }
+
+  return retval;
+}
+
+int VolumeLayer::March(const RenderContext& context, VolumeMarch* march) const
+{
+  int retval = NVN_NOERR;
+  int width = context.GetViewportWidth();
+  int height = context.GetViewportHeight();
+  int factor = context.GetDetailStride();
+  int nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  pthread_t threads[VOLUME_MAX_THREADS];
+  bool started[VOLUME_MAX_THREADS];
+  VolumeTask tasks[VOLUME_MAX_THREADS];
+  float scale[3], offset[3];
+  int basedim[3];
+  float ndc[3], corner[4][3], model[4][3];
+  float length;
+
+  // The image is marched at a fraction of the viewport's resolution while
+  // the frame asks for reduced detail.
+  while((long)(width / factor) * (height / factor) > VOLUME_MAX_PIXELS)
+    factor++;
+
+  width = MAX(width / factor, 1);
+  height = MAX(height / factor, 1);
+
+  if(width != march->ImageWidth || height != march->ImageHeight ||
+     ! march->Image)
+  {
+    free(march->Image);
+    march->Image = (unsigned char*)malloc((size_t)width * height * 4);
+    march->ImageWidth = march->Image ? width : 0;
+    march->ImageHeight = march->Image ? height : 0;
+    if(! march->Image)
+      retval = NVN_ERROR;
+  }
+
+  if(NVN_NOERR == retval)
+    retval = this->GetVoxelTransform(scale, offset, basedim);
+
+  // The views are orthographic, so every ray has the same direction, and the
+  // origins on the near plane are an affine function of the pixel.  Three
+  // corners of the near plane and one of the far plane pin them down.
+  for(int c = 0; NVN_NOERR == retval && c < 4; c++)
+  {
+    ndc[0] = 1 == c ? 1.0f : -1.0f;
+    ndc[1] = 2 == c ? 1.0f : -1.0f;
+    ndc[2] = 3 == c ? 1.0f : -1.0f;
+
+    if(! context.Unproject(ndc, model[c]))
+      retval = NVN_EINVARGS;
+
+    for(int d = 0; d < 3; d++)
+      corner[c][d] = (model[c][basedim[d]] - offset[d]) / scale[d];
+  }
+
+  if(NVN_NOERR == retval)
+  {
+    length = 0.0f;
+
+    for(int d = 0; d < 3; d++)
+    {
+      march->RayStepU[d] = (corner[1][d] - corner[0][d]) / width;
+      march->RayStepV[d] = (corner[2][d] - corner[0][d]) / height;
+      march->RayOrigin[d] = corner[0][d] +
+        0.5f * (march->RayStepU[d] + march->RayStepV[d]);
+      march->RayDir[d] = corner[3][d] - corner[0][d];
+      length += march->RayDir[d] * march->RayDir[d];
+    }
+
+    length = sqrtf(length);
+    if(length > 0.0f)
+    {
+      for(int d = 0; d < 3; d++)
+        march->RayDir[d] /= length;
+    }
+    else
+    {
+      retval = NVN_EINVARGS;
+    }
+  }
+
+  if(NVN_NOERR == retval)
+  {
+    if(nthreads > VOLUME_MAX_THREADS) nthreads = VOLUME_MAX_THREADS;
+    if(nthreads > height) nthreads = height;
+    if(nthreads < 1) nthreads = 1;
+
+    // The rows are dealt out in turn, so that each thread gets its share of
+    // the rows that cross the grid and of those that miss it.
+    for(int t = 0; t < nthreads; t++)
+    {
+      tasks[t].Layer = this;
+      tasks[t].March = march;
+      tasks[t].FirstRow = t;
+      tasks[t].RowStride = nthreads;
+      started[t] = t > 0 &&
+        0 == pthread_create(&threads[t], 0, MarchThreadEntryPoint, &tasks[t]);
+    }
+
+    for(int t = 0; t < nthreads; t++)
+    {
+      if(! started[t])
+        MarchThreadEntryPoint(&tasks[t]);
+    }
+
+    for(int t = 0; t < nthreads; t++)
+    {
+      if(started[t])
+        pthread_join(threads[t], 0);
+    }
+  }
+  else if(march->Image)
+  {
+    memset(march->Image, 0, (size_t)march->ImageWidth * march->ImageHeight * 4);
+  }
+
+  return retval;
+}
+
+int VolumeLayer::MarchRow(const VolumeMarch& march, int row) const
+{
+  int retval = NVN_NOERR;
+  float origin[3];
+  unsigned char* pixels = march.Image + (size_t)row * march.ImageWidth * 4;
+
+  for(int u = 0; u < march.ImageWidth; u += VOLUME_PACKET)
+  {
+    for(int d = 0; d < 3; d++)
+      origin[d] = march.RayOrigin[d] + u * march.RayStepU[d] +
+        row * march.RayStepV[d];
+
+    this->MarchPacket(march, origin, MIN(VOLUME_PACKET, march.ImageWidth - u),
+                      pixels + 4 * u);
+  }
+
+  return retval;
+}
+
+int VolumeLayer::MarchPacket(const VolumeMarch& march, const float origin[],
+                             int npixels, unsigned char* pixels) const
+{
+  int retval = NVN_NOERR;
+  const int len[3] = { _NI, _NJ, _NK };
+  const size_t stride[3] = { (size_t)_NJ * _NK, (size_t)_NK, 1 };
+  const float zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+  const float tablescale = (VOLUME_TABLE_SIZE - 1) /
+    (_MaxVal > _MinVal ? _MaxVal - _MinVal : 1.0f);
+  float o[3][VOLUME_PACKET];
+  float tin[VOLUME_PACKET], tout[VOLUME_PACKET];
+  float acc[4][VOLUME_PACKET];
+  float corner[8][VOLUME_PACKET];
+  float frac[3][VOLUME_PACKET];
+  float value[VOLUME_PACKET];
+  float sample[4][VOLUME_PACKET];
+  bool active[VOLUME_PACKET];
+  float tstart = FLT_MAX, tend = -FLT_MAX;
+  float t, skip, leave, p;
+  int cell[3], block;
+  bool occupied;
+
+  // Each ray is clipped to the box through the centers of the outer voxels.
+  for(int l = 0; l < VOLUME_PACKET; l++)
+  {
+    tin[l] = -FLT_MAX;
+    tout[l] = FLT_MAX;
+
+    for(int d = 0; d < 3; d++)
+    {
+      o[d][l] = origin[d] + l * march.RayStepU[d];
+
+      if(0.0f != march.RayDir[d])
+      {
+        float t0 = (0.0f - o[d][l]) / march.RayDir[d];
+        float t1 = ((len[d] - 1) - o[d][l]) / march.RayDir[d];
+        if(t0 > t1) { float tmp = t0; t0 = t1; t1 = tmp; }
+        if(t0 > tin[l]) tin[l] = t0;
+        if(t1 < tout[l]) tout[l] = t1;
+      }
+      else if(o[d][l] < 0.0f || o[d][l] > len[d] - 1)
+      {
+        tin[l] = FLT_MAX;
+      }
+    }
+
+    if(l >= npixels)
+    {
+      tin[l] = FLT_MAX;
+      tout[l] = -FLT_MAX;
+    }
+
+    if(tin[l] <= tout[l])
+    {
+      if(tin[l] < tstart) tstart = tin[l];
+      if(tout[l] > tend) tend = tout[l];
+    }
+
+    for(int c = 0; c < 4; c++)
+      acc[c][l] = 0.0f;
+  }
+
+  t = tstart;
+  while(t <= tend)
+  {
+    // Rays that are in blocks without data are moved on to where they leave
+    // the block, and rays that have not reached the grid yet to where they
+    // enter it, as long as none of the rays has anything to sample here.
+    occupied = false;
+    skip = FLT_MAX;
+
+    for(int l = 0; l < VOLUME_PACKET; l++)
+    {
+      active[l] = t >= tin[l] && t <= tout[l] && acc[3][l] < VOLUME_OPAQUE;
+
+      if(active[l])
+      {
+        for(int d = 0; d < 3; d++)
+        {
+          p = o[d][l] + t * march.RayDir[d];
+          cell[d] = (int)p;
+          if(cell[d] > len[d] - 2) cell[d] = len[d] - 2;
+          if(cell[d] < 0) cell[d] = 0;
+          frac[d][l] = p - cell[d];
+        }
+
+        block = ((cell[0] / VOLUME_BLOCK_SIZE) * _NBJ +
+                 cell[1] / VOLUME_BLOCK_SIZE) * _NBK +
+                 cell[2] / VOLUME_BLOCK_SIZE;
+
+        if(_Blocks[block])
+        {
+          const float* v = _Values + cell[0] * stride[0] +
+                           cell[1] * stride[1] + cell[2];
+
+          occupied = true;
+          for(int c = 0; c < 8; c++)
+          {
+            corner[c][l] = v[((c >> 2) & 1) * stride[0] +
+                             ((c >> 1) & 1) * stride[1] + (c & 1)];
+          }
+        }
+        else
+        {
+          for(int c = 0; c < 8; c++)
+            corner[c][l] = NAN;
+
+          for(int d = 0; d < 3; d++)
+          {
+            if(0.0f != march.RayDir[d])
+            {
+              p = o[d][l] + t * march.RayDir[d];
+              int b = cell[d] / VOLUME_BLOCK_SIZE;
+              leave = ((march.RayDir[d] > 0.0f ? b + 1 : b) *
+                       VOLUME_BLOCK_SIZE - p) / march.RayDir[d];
+              if(leave < skip) skip = leave;
+            }
+          }
+        }
+      }
+      else
+      {
+        for(int c = 0; c < 8; c++)
+          corner[c][l] = NAN;
+        for(int d = 0; d < 3; d++)
+          frac[d][l] = 0.0f;
+
+        if(t < tin[l] && tin[l] <= tout[l] && tin[l] - t < skip)
+          skip = tin[l] - t;
+      }
+    }
+
+    if(! occupied)
+    {
+      if(FLT_MAX == skip)
+        break;
+
+      t += (skip > 0.0f ? skip : 0.0f) + 0.001f;
+      continue;
+    }
+
+    // The eight corners of each ray's cell are blended trilinearly, with the
+    // third dimension first.  A corner without data leaves NAN behind.
+#ifdef __SSE__
+    {
+      __m128 fi = _mm_loadu_ps(frac[0]);
+      __m128 fj = _mm_loadu_ps(frac[1]);
+      __m128 fk = _mm_loadu_ps(frac[2]);
+      __m128 c[8];
+
+      for(int k = 0; k < 8; k++)
+        c[k] = _mm_loadu_ps(corner[k]);
+
+      for(int k = 0; k < 8; k += 2)
+        c[k] = _mm_add_ps(c[k], _mm_mul_ps(fk, _mm_sub_ps(c[k + 1], c[k])));
+      for(int k = 0; k < 8; k += 4)
+        c[k] = _mm_add_ps(c[k], _mm_mul_ps(fj, _mm_sub_ps(c[k + 2], c[k])));
+      c[0] = _mm_add_ps(c[0], _mm_mul_ps(fi, _mm_sub_ps(c[4], c[0])));
+
+      _mm_storeu_ps(value, c[0]);
+    }
+#else
+    for(int l = 0; l < VOLUME_PACKET; l++)
+    {
+      float c[8];
+
+      for(int k = 0; k < 8; k++)
+        c[k] = corner[k][l];
+
+      for(int k = 0; k < 8; k += 2)
+        c[k] = c[k] + frac[2][l] * (c[k + 1] - c[k]);
+      for(int k = 0; k < 8; k += 4)
+        c[k] = c[k] + frac[1][l] * (c[k + 2] - c[k]);
+      value[l] = c[0] + frac[0][l] * (c[4] - c[0]);
+    }
+#endif
+
+    for(int l = 0; l < VOLUME_PACKET; l++)
+    {
+      const float* entry = zero;
+
+      if(! isnan(value[l]))
+      {
+        int index = (int)((value[l] - _MinVal) * tablescale + 0.5f);
+        if(index < 0) index = 0;
+        if(index >= VOLUME_TABLE_SIZE) index = VOLUME_TABLE_SIZE - 1;
+        entry = _Table[index];
+      }
+
+      for(int ch = 0; ch < 4; ch++)
+        sample[ch][l] = entry[ch];
+    }
+
+    // Front to back compositing of the premultiplied samples.
+#ifdef __SSE__
+    {
+      __m128 one = _mm_set1_ps(1.0f);
+      __m128 remain = _mm_sub_ps(one, _mm_loadu_ps(acc[3]));
+
+      for(int ch = 0; ch < 4; ch++)
+      {
+        _mm_storeu_ps(acc[ch],
+                      _mm_add_ps(_mm_loadu_ps(acc[ch]),
+                                 _mm_mul_ps(remain, _mm_loadu_ps(sample[ch]))));
+      }
+    }
+#else
+    for(int l = 0; l < VOLUME_PACKET; l++)
+    {
+      float remain = 1.0f - acc[3][l];
+
+      for(int ch = 0; ch < 4; ch++)
+        acc[ch][l] += remain * sample[ch][l];
+    }
+#endif
+
+    t += 1.0f;
+  }
+
+  for(int l = 0; l < npixels; l++)
+  {
+    for(int ch = 0; ch < 4; ch++)
+    {
+      float c = acc[ch][l] * 255.0f + 0.5f;
+      pixels[4 * l + ch] = (unsigned char)(c > 255.0f ? 255.0f : c);
+    }
+  }
+
+  return retval;
+}
+
+void* VolumeLayer::MarchThreadEntryPoint(void* arg)
+{
+  VolumeTask* task = (VolumeTask*)arg;
+
+  for(int row = task->FirstRow; row < task->March->ImageHeight;
+      row += task->RowStride)
+  {
+    task->Layer->MarchRow(*task->March, row);
+  }
+
+  return 0;
+}
@@ -0,0 +1,158 @@
+/*
+ * VolumeLayer.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Timothy Morey
+ */
+
+#ifndef __VOLUMELAYER_HPP__
+#define __VOLUMELAYER_HPP__
+
+
+#include "nvn.h"
+
+#include "color-ramp.h"
+
+#include "CartesianCRS.hpp"
+#include "GridTransform.hpp"
+#include "Layer.hpp"
+#include "RenderContext.hpp"
+
+#define MPICH_SKIP_MPICXX 1
+#include <mpi.h>
+#include <stdlib.h>
+
+/**
+ * The most threads that march the rays of one frame.
+ */
+#define VOLUME_MAX_THREADS 16
+
+/**
+ * The number of voxels along each side of a block that is skipped as a whole
+ * when it has no data.
+ */
+#define VOLUME_BLOCK_SIZE 8
+
+/**
+ * The number of entries in the table that maps values to colors.
+ */
+#define VOLUME_TABLE_SIZE 256
+
+
+class DataGrid;
+
+/**
+ * The image marched for the view of one window, with the rays it was
+ * marched along and the texture that it is drawn from.  Each window keeps
+ * its own, so that windows with different views do not march over each
+ * other's images on every frame.
+ */
+struct VolumeMarch
+{
+  VolumeMarch(int window)
+    : Window(window), ImageWidth(0), ImageHeight(0), Image(0), View(0),
+      Revision(0), TextureID(-1), TextureValid(false) {}
+  ~VolumeMarch() { delete View; free(Image); }
+
+  int Window;
+
+  // The rays in voxel coordinates.  The origin of the ray through pixel
+  // (u, v) is RayOrigin + u * RayStepU + v * RayStepV.
+  float RayOrigin[3];
+  float RayStepU[3];
+  float RayStepV[3];
+  float RayDir[3];
+
+  int ImageWidth, ImageHeight;
+  unsigned char* Image;
+
+  RenderContext* View;     // The view that the image was marched for
+  unsigned int Revision;   // The revision of the layer that was marched
+
+  unsigned int TextureID;
+  bool TextureValid;       // Whether the texture holds the current image
+};
+
+
+/**
+ * A VolumeLayer draws a three dimensional DataGrid as a translucent cloud,
+ * colored by a ColorRamp.  The grid's first two dimensions lie along x and y
+ * as for the other layers, and the third one is placed along z.
+ *
+ * The image is ray marched on the CPU, so that it does not depend on what
+ * the GL implementation can do with 3D textures.  Rays are marched four at a
+ * time with SSE where it is available, the rows of the image are shared among
+ * several threads, and blocks of the grid that have no data are stepped over
+ * in one go.  Each window keeps its own image, which is only marched again
+ * when its view or the layer changes, and is drawn on top of what has already
+ * been rendered.
+ */
+class VolumeLayer : public Layer
+{
+public:
+  VolumeLayer(DataGrid* grid);
+  virtual ~VolumeLayer();
+
+public:
+  const ColorRamp& GetRamp() const { return _Ramp; }
+
+  /**
+   * Recolors the volume with a new ramp, which rebuilds the table of colors
+   * and marches the image again on the next frame.
+   */
+  int SetRamp(const ColorRamp& ramp);
+
+public:
+  virtual const CRS& GetDataCRS() const;
+
+public:
+  virtual int Render(const RenderContext& context);
+  virtual int SetModelCRS(const CartesianCRS& crs);
+
+protected:
+  /**
+   * The marches of the windows of one share group, whose textures can only
+   * be drawn in that group.
+   */
+  struct VolumeResources : public LayerResources
+  {
+    VolumeResources(int sharegroup) : LayerResources(sharegroup) {}
+    virtual ~VolumeResources()
+    {
+      for(size_t i = 0; i < Marches.size(); i++)
+        delete Marches[i];
+    }
+
+    std::vector<VolumeMarch*> Marches;
+  };
+
+protected:
+  virtual NVN_BBox ComputeBounds() const;
+  virtual LayerResources* CreateResources(int sharegroup) const
+  { return new VolumeResources(sharegroup); }
+
+protected:
+  int BuildBlocks();
+  int BuildTable();
+  int GetVoxelTransform(float scale[], float offset[], int basedim[]) const;
+  int March(const RenderContext& context, VolumeMarch* march) const;
+  int MarchRow(const VolumeMarch& march, int row) const;
+  int MarchPacket(const VolumeMarch& march, const float origin[], int npixels,
+                  unsigned char* pixels) const;
+
+  static void* MarchThreadEntryPoint(void* arg);
+
+protected:
+  DataGrid* _DataGrid;
+  ColorRamp _Ramp;
+  int _NI, _NJ, _NK;
+  float* _Values;          // The grid as floats, with NAN where there is no data
+  float _MinVal, _MaxVal;
+
+  int _NBI, _NBJ, _NBK;
+  unsigned char* _Blocks;  // 1 for each block with data in or next to it
+
+  float _Table[VOLUME_TABLE_SIZE][4];  // Premultiplied rgba per step
+};
+
+#endif
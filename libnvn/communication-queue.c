@@ -4,65 +4,157 @@
   This file implements the interface defined in communication-queue.h.
 */
 
+#include <errno.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "communication-queue.h"
 #include "nvn.h"
 
 
+/*****************************************************************************
+ * Local functions:
+ *****************************************************************************/
+
+/**
+  @return Nonzero if the slot at the tail still holds a message from the last
+  lap around the ring.  The loads are sequentially consistent, so that they
+  cannot be seen before the waiter count that a producer raised first.
+*/
+static int QueueFullP(CommunicationQueue* queue)
+{
+  unsigned long tail = __atomic_load_n(&queue->Tail, __ATOMIC_SEQ_CST);
+  QueueSlot* slot = &queue->Slots[tail & (QUEUE_SIZE - 1)];
+  unsigned long seq = __atomic_load_n(&slot->Sequence, __ATOMIC_SEQ_CST);
+
+  return (long)(seq - tail) < 0;
+}
+
+
 /*****************************************************************************
  * communication-queue.h implementations:
  *****************************************************************************/
 
-int DestroyArguments(Message msg)
+int CloseQueue(CommunicationQueue* queue)
+{
+  int retval = NVN_NOERR;
+
+  if(queue)
+  {
+    pthread_mutex_lock(&queue->Lock);
+    __atomic_store_n(&queue->Closed, 1, __ATOMIC_SEQ_CST);
+    pthread_cond_broadcast(&queue->Space);
+    pthread_mutex_unlock(&queue->Lock);
+
+    // A producer that saw the queue open is only ever a moment from
+    // publishing its message, so wait for it rather than miss the message.
+    while(0 < __atomic_load_n(&queue->Pushing, __ATOMIC_SEQ_CST))
+      sched_yield();
+  }
+  else
+  {
+    retval = NVN_EINVARGS;
+  }
+
+  return retval;
+}
+
+int Complete(Completion* done, int result)
 {
   int retval = NVN_NOERR;
-  int i = 0;
 
-  if(msg.DestroyArgs)
+  if(done)
   {
-    for(i = 0; i < ARGS_SIZE; i++)
+    CompletionFunc func = 0;
+    void* arg = 0;
+
+    pthread_mutex_lock(&done->Mutex);
+
+    if(! done->Done)
+    {
+      done->Done = 1;
+      done->Result = result;
+      func = done->Callback;
+      arg = done->CallbackArg;
+      pthread_cond_broadcast(&done->Cond);
+    }
+    else
     {
-      if(msg.Arguments[i])
-        free(msg.Arguments[i]);
+      retval = NVN_EINVARGS;
     }
+
+    pthread_mutex_unlock(&done->Mutex);
+
+    // The callback is made without the lock, so that it may wait on the
+    // completion or release it itself.
+    if(func)
+      func((intptr_t)done, result, arg);
+  }
+  else
+  {
+    retval = NVN_EINVARGS;
   }
 
   return retval;
 }
 
-int DestroyQueue(CommunicationQueue queue)
+int CreateCompletion(CompletionFunc func, void* arg, Completion** done)
 {
   int retval = NVN_NOERR;
 
-	retval = 0 == pthread_mutex_destroy(&queue.Mutex);
+  if(done)
+  {
+    *done = (Completion*)malloc(sizeof(Completion));
+    if(*done)
+    {
+      memset(*done, 0, sizeof(Completion));
+      pthread_mutex_init(&(*done)->Mutex, 0);
+      pthread_cond_init(&(*done)->Cond, 0);
+      (*done)->Refs = 1;
+      (*done)->Callback = func;
+      (*done)->CallbackArg = arg;
+    }
+    else
+    {
+      retval = NVN_ERROR;
+    }
+  }
+  else
+  {
+    retval = NVN_EINVARGS;
+  }
 
   return retval;
 }
 
-int EqualMessagesP(Message m1, Message m2)
+int DestroyQueue(CommunicationQueue* queue)
 {
-  int equal = 0;
-  int i;
+  int retval = NVN_NOERR;
 
-  equal = 0 == strcmp(m1.Message, m2.Message);
-  
-  for(i = 0; equal && i < ARGS_SIZE; i++)
-    equal = m1.Arguments[i] == m2.Arguments[i];
+  if(queue)
+  {
+    pthread_cond_destroy(&queue->Space);
+    pthread_mutex_destroy(&queue->Lock);
+  }
+  else
+  {
+    retval = NVN_EINVARGS;
+  }
 
-  return equal;
+  return retval;
 }
 
-int InitMessage(Message* msg, const char* text)
+int InitMessage(Message* msg, int command)
 {
   int retval = NVN_NOERR;
 
-  if(msg && text)
+  if(msg)
   {
     memset(msg, 0, sizeof(Message));
-    strcpy(msg->Message, text);
+    msg->Command = command;
   }
   else
   {
@@ -78,14 +170,17 @@ int InitQueue(CommunicationQueue* queue)
 
   if(queue)
   {
-    int i = 0;
+    unsigned long i = 0;
 
-    queue->Capacity = QUEUE_SIZE;
-    queue->Front = 0;
-    queue->Size = 0;
+    memset(queue, 0, sizeof(CommunicationQueue));
     for(i = 0; i < QUEUE_SIZE; i++)
-      InitMessage(&queue->Messages[i], "INVALID");
-		pthread_mutex_init(&queue->Mutex, 0);
+    {
+      queue->Slots[i].Sequence = i;
+      InitMessage(&queue->Slots[i].Msg, -1);
+    }
+
+    pthread_mutex_init(&queue->Lock, 0);
+    pthread_cond_init(&queue->Space, 0);
   }
   else
   {
@@ -98,30 +193,62 @@ int InitQueue(CommunicationQueue* queue)
 int Pop(CommunicationQueue* queue, Message* msg, int* valid)
 {
   int retval = NVN_NOERR;
+  int count = 0;
 
   if(queue && msg)
   {
-	  InitMessage(msg, "INVALID");
+    retval = PopBatch(queue, msg, 1, &count);
+    if(0 == count)
+      InitMessage(msg, -1);
+
     if(valid)
-      *valid = 0;
+      *valid = count;
+  }
+  else
+  {
+    retval = NVN_EINVARGS;
+  }
+
+  return retval;
+}
 
-    if(queue->Size > 0)
+int PopBatch(CommunicationQueue* queue, Message msgs[], int max, int* count)
+{
+  int retval = NVN_NOERR;
+
+  if(queue && msgs && count)
+  {
+    unsigned long head = queue->Head;
+    QueueSlot* slot = 0;
+
+    *count = 0;
+    while(*count < max)
     {
-      int i = 0;
-    
-			pthread_mutex_lock(&queue->Mutex);
+      slot = &queue->Slots[head & (QUEUE_SIZE - 1)];
+      if(__atomic_load_n(&slot->Sequence, __ATOMIC_ACQUIRE) != head + 1)
+        break;
+
+      msgs[(*count)++] = slot->Msg;
 
-		  if(queue->Size > 0)
-		  {
-			  *msg = queue->Messages[queue->Front];
-        if(valid)
-          *valid = 1;
+      // Hand the slot back to the producers for the next lap around the ring.
+      __atomic_store_n(&slot->Sequence, head + QUEUE_SIZE, __ATOMIC_RELEASE);
+      head++;
+    }
 
-        queue->Size--;
-        queue->Front = (queue->Front + 1) % queue->Capacity;
-		  }
+    __atomic_store_n(&queue->Head, head, __ATOMIC_RELAXED);
 
-			pthread_mutex_unlock(&queue->Mutex);
+    // The fence keeps the freed slots ahead of the look at the waiter count,
+    // which pairs with the producers raising the count before they look at
+    // the slots.
+    if(*count > 0)
+    {
+      __atomic_thread_fence(__ATOMIC_SEQ_CST);
+      if(__atomic_load_n(&queue->Waiters, __ATOMIC_RELAXED))
+      {
+        pthread_mutex_lock(&queue->Lock);
+        pthread_cond_broadcast(&queue->Space);
+        pthread_mutex_unlock(&queue->Lock);
+      }
     }
   }
   else
@@ -138,102 +265,185 @@ int Push(CommunicationQueue* queue, Message msg)
 
   if(queue)
   {
-    int pushed = 0;
-
-    if(queue->Size < queue->Capacity)
+    // The consumer wakes the waiters whenever it frees slots, or closes the
+    // queue, so a full queue only lasts for as long as the consumer is busy.
+    while(NVN_EQFULL == (retval = TryPush(queue, msg)))
     {
-      pthread_mutex_lock(&queue->Mutex);
+      pthread_mutex_lock(&queue->Lock);
+      __atomic_add_fetch(&queue->Waiters, 1, __ATOMIC_SEQ_CST);
 
-      if(queue->Size < queue->Capacity)
+      while(QueueFullP(queue) &&
+            ! __atomic_load_n(&queue->Closed, __ATOMIC_SEQ_CST))
       {
-        queue->Messages[(queue->Front + queue->Size) % queue->Capacity] = msg;
-        queue->Size++;
-        pushed = 1;
+        pthread_cond_wait(&queue->Space, &queue->Lock);
       }
 
-			pthread_mutex_unlock(&queue->Mutex);
-    }
-    
-    if(! pushed)
-    {
-      retval = NVN_EQFULL;
-      fprintf(stderr, "Queue full - '%s' message dropped.\n", msg.Message);
+      __atomic_sub_fetch(&queue->Waiters, 1, __ATOMIC_RELAXED);
+      pthread_mutex_unlock(&queue->Lock);
     }
   }
+  else
+  {
+    retval = NVN_EINVARGS;
+  }
 
   return retval;
 }
 
-int PushIfUnique(CommunicationQueue* queue, Message msg)
+int QueueReadyP(CommunicationQueue* queue)
 {
-  int retval = NVN_NOERR;
+  int ready = 0;
 
   if(queue)
   {
-    int full = 0;
-    int found = 0;
+    unsigned long head = __atomic_load_n(&queue->Head, __ATOMIC_RELAXED);
+    QueueSlot* slot = &queue->Slots[head & (QUEUE_SIZE - 1)];
+    ready = __atomic_load_n(&slot->Sequence, __ATOMIC_ACQUIRE) == head + 1;
+  }
 
-    if(QueueContainsP(queue, msg))
-    {
-      found = 1;
-    }
-    else if (queue->Size >= queue->Capacity)
+  return ready;
+}
+
+int ReleaseCompletion(Completion* done)
+{
+  int retval = NVN_NOERR;
+
+  if(done)
+  {
+    if(0 == __atomic_sub_fetch(&done->Refs, 1, __ATOMIC_ACQ_REL))
     {
-      full = 1;
+      pthread_cond_destroy(&done->Cond);
+      pthread_mutex_destroy(&done->Mutex);
+      free(done);
     }
-    else
+  }
+  else
+  {
+    retval = NVN_EINVARGS;
+  }
+
+  return retval;
+}
+
+int RetainCompletion(Completion* done)
+{
+  int retval = NVN_NOERR;
+
+  if(done)
+    __atomic_add_fetch(&done->Refs, 1, __ATOMIC_RELAXED);
+  else
+    retval = NVN_EINVARGS;
+
+  return retval;
+}
+
+int StartCompletion(Completion* done)
+{
+  int retval = NVN_NOERR;
+
+  if(! done || __atomic_exchange_n(&done->Started, 1, __ATOMIC_ACQ_REL))
+    retval = NVN_EINVARGS;
+
+  return retval;
+}
+
+int TryPush(CommunicationQueue* queue, Message msg)
+{
+  int retval = NVN_NOERR;
+
+  if(queue)
+  {
+    unsigned long tail = __atomic_load_n(&queue->Tail, __ATOMIC_RELAXED);
+    unsigned long seq = 0;
+    QueueSlot* slot = 0;
+    int claimed = 0;
+
+    // The producer is counted before it looks at Closed, so that CloseQueue
+    // either turns it away or waits for its message to be published.
+    __atomic_add_fetch(&queue->Pushing, 1, __ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&queue->Closed, __ATOMIC_SEQ_CST))
+      retval = NVN_ENOTINIT;
+
+    while(! claimed && NVN_NOERR == retval)
     {
-      pthread_mutex_lock(&queue->Mutex);
+      slot = &queue->Slots[tail & (QUEUE_SIZE - 1)];
+      seq = __atomic_load_n(&slot->Sequence, __ATOMIC_ACQUIRE);
 
-      if(QueueContainsP(queue, msg))
+      if(seq == tail)
       {
-        found = 1;
+        // On failure, tail is reloaded with the position another producer
+        // left behind, and we try again from there.
+        claimed = __atomic_compare_exchange_n(&queue->Tail, &tail, tail + 1, 0,
+                                              __ATOMIC_RELAXED,
+                                              __ATOMIC_RELAXED);
       }
-      else if (queue->Size >= queue->Capacity)
+      else if((long)(seq - tail) < 0)
       {
-        full = 1;
+        // The consumer has not yet emptied this slot from the last lap.
+        retval = NVN_EQFULL;
       }
       else
       {
-        queue->Messages[(queue->Front + queue->Size) % queue->Capacity] = msg;
-        queue->Size++;
+        tail = __atomic_load_n(&queue->Tail, __ATOMIC_RELAXED);
       }
-
-			pthread_mutex_unlock(&queue->Mutex);
     }
-    
-    if(found)
-    {
-      retval = NVN_ENOTUNIQUE;
-      printf("Dropped non-unique message.\n");
-    }
-    else if(full)
+
+    if(claimed)
     {
-      retval = NVN_EQFULL;
-      fprintf(stderr, "Queue full - '%s' message dropped.\n", msg.Message);
+      slot->Msg = msg;
+      __atomic_store_n(&slot->Sequence, tail + 1, __ATOMIC_RELEASE);
     }
+
+    __atomic_sub_fetch(&queue->Pushing, 1, __ATOMIC_RELEASE);
+  }
+  else
+  {
+    retval = NVN_EINVARGS;
   }
 
   return retval;
 }
 
-int QueueContainsP(CommunicationQueue* queue, Message msg)
+int WaitCompletion(Completion* done, double timeout, int* result)
 {
-  int contains = 0;
-  int i;
+  int retval = NVN_NOERR;
 
-  if(queue)
+  if(done)
   {
-    for(i = queue->Front; i < queue->Front + queue->Size; i++)
+    struct timespec deadline;
+
+    if(timeout >= 0.0)
     {
-      if(EqualMessagesP(msg, queue->Messages[i % queue->Capacity]))
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      deadline.tv_sec += (time_t)timeout;
+      deadline.tv_nsec += (long)((timeout - (time_t)timeout) * 1.0e9);
+      if(deadline.tv_nsec >= 1000000000L)
       {
-        contains = 1;
-        break;
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
       }
     }
+
+    pthread_mutex_lock(&done->Mutex);
+
+    while(! done->Done && NVN_NOERR == retval)
+    {
+      if(timeout < 0.0)
+        pthread_cond_wait(&done->Cond, &done->Mutex);
+      else if(ETIMEDOUT ==
+              pthread_cond_timedwait(&done->Cond, &done->Mutex, &deadline))
+        retval = done->Done ? NVN_NOERR : NVN_ETIMEOUT;
+    }
+
+    if(done->Done && result)
+      *result = done->Result;
+
+    pthread_mutex_unlock(&done->Mutex);
+  }
+  else
+  {
+    retval = NVN_EINVARGS;
   }
 
-  return contains;
+  return retval;
 }
-
@@ -4,67 +4,174 @@
   This file defines an interface by which threads may communicate.  A queue
   is defined that can be managed by one thread and can accept messages/requests
   from many other threads.
+
+  The queue is a bounded ring without locks.  Producers claim slots by
+  advancing the tail with a compare-and-swap, and each slot carries a sequence
+  number that tells the producers when it is free and the one consumer when
+  its message has been written.  Only one thread may pop from a queue.
+
+  A producer that finds the ring full sleeps until the consumer frees a slot.
+  Once the consumer has stopped for good it closes the queue, and pushes fail
+  from then on rather than wait for a thread that will never pop them.
+
+  A thread that needs to know when its message has been handled attaches a
+  Completion, and sleeps on it rather than polling.
 */
 
 #ifndef __COMMUNICATION_QUEUE_H
 #define __COMMUNICATION_QUEUE_H
 
-#define ARGS_SIZE 8
-#define MSG_SIZE 32
-#define QUEUE_SIZE 32
+#define MSG_PAYLOAD_SIZE 64
+#define QUEUE_SIZE 256        /* Must be a power of two */
+#define QUEUE_BATCH_SIZE 32   /* The most messages the UI thread takes at once */
+#define QUEUE_CACHE_LINE 64
 
 #include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
+struct Completion;
+
+/**
+  Called once a completion is finished, on the thread that finished it.  The
+  completion is passed as the integer handle that nvn.h gives out for it.
+*/
+typedef void (*CompletionFunc)(intptr_t done, int result, void* arg);
+
+/**
+  Tracks a command that another thread carries out, so that the thread that
+  asked for it can wait, with or without a timeout, or be called back when it
+  is finished.  A completion is counted, and is freed when its last reference
+  is released.  Each one is used for a single command.
+*/
+typedef struct Completion
+{
+  pthread_mutex_t Mutex;
+  pthread_cond_t Cond;
+  int Refs;
+  int Started;
+  int Done;
+  int Result;
+  CompletionFunc Callback;
+  void* CallbackArg;
+} Completion;
+
+/**
+  A message is a command number, which the consumer gives its own meaning to,
+  and the command's arguments, which are stored by value in the payload.
+*/
 typedef struct
 {
-  char Message[MSG_SIZE];
-  void* Arguments[ARGS_SIZE];
-  int DestroyArgs;
-  int* Handled;
-  void* Result;
-  size_t ResultSize;
+  int Command;
+  union
+  {
+    void* Align;
+    double AlignDouble;
+    unsigned char Bytes[MSG_PAYLOAD_SIZE];
+  } Payload;
+  Completion* Done;
 } Message;
 
 typedef struct
 {
-  Message Messages[QUEUE_SIZE];
-  int Capacity;
-  int Front;
-  int Size;
-  pthread_mutex_t Mutex;
+  unsigned long Sequence;
+  Message Msg;
+} QueueSlot;
+
+/**
+   Slot i % QUEUE_SIZE is free for the producer that claims position i when its
+   sequence is i, and holds a message for the consumer when it is i + 1.  The
+   tail is shared by the producers and the head belongs to the consumer, so
+   they are kept on separate cache lines.  The lock and condition are only
+   used by producers that wait for room, and by the consumer to wake them.
+ */
+typedef struct
+{
+  QueueSlot Slots[QUEUE_SIZE];
+  char Pad0[QUEUE_CACHE_LINE];
+  unsigned long Tail;
+  char Pad1[QUEUE_CACHE_LINE];
+  unsigned long Head;
+  char Pad2[QUEUE_CACHE_LINE];
+  int Closed;         /* Set once the consumer will pop no more messages */
+  int Pushing;        /* Producers that may still publish a message */
+  int Waiters;        /* Producers sleeping until a slot is freed */
+  pthread_mutex_t Lock;
+  pthread_cond_t Space;
 } CommunicationQueue;
 
 /**
+  Closes the queue once the consumer will pop no more messages.  Producers
+  waiting for room are woken, later pushes fail, and the call returns once
+  every push that got in ahead of it has finished, so that the consumer can
+  pop whatever is left.
+
   @return An nvn error code indicating if the operation was successful.
 */
-int DestroyArguments(Message msg);
+int CloseQueue(CommunicationQueue* queue);
 
 /**
+  Marks the completion as finished with the given result, wakes any threads
+  waiting on it, and calls its callback.
+
   @return An nvn error code indicating if the operation was successful.
 */
-int DestroyQueue(CommunicationQueue queue);
+int Complete(Completion* done, int result);
 
 /**
-   Two messages are said to be equal if they have equal names (string compare)
-   and equal arguments (pointer compare).
- */
-int EqualMessagesP(Message m1, Message m2);
+  Creates a completion with one reference, which belongs to the caller.
+
+  @param[in] func Called when the completion is finished, or null.
+  @param[in] arg Passed to func.
+  @param[out] done The new completion.
+
+  @return An nvn error code indicating if the operation was successful.
+*/
+int CreateCompletion(CompletionFunc func, void* arg, Completion** done);
+
+/**
+  @return An nvn error code indicating if the operation was successful.
+*/
+int DestroyQueue(CommunicationQueue* queue);
 
 /**
   @return An nvn error code indicating if the operation was successful.
 */
-int InitMessage(Message* msg, const char* text);
+int InitMessage(Message* msg, int command);
 
 /**
   @return An nvn error code indicating if the operation was successful.
 */
 int InitQueue(CommunicationQueue* queue);
 
+/**
+  Gives up a reference to the completion, and frees it if that was the last.
+
+  @return An nvn error code indicating if the operation was successful.
+*/
+int ReleaseCompletion(Completion* done);
+
+/**
+  Adds a reference to the completion.
+
+  @return An nvn error code indicating if the operation was successful.
+*/
+int RetainCompletion(Completion* done);
+
+/**
+  Claims the completion for a command.
+
+  @return NVN_EINVARGS if the completion has already been used for another
+  command, or another nvn error code indicating if the operation was
+  successful.
+*/
+int StartCompletion(Completion* done);
+
 /**
   @param[in] queue The queue from which we will pop a message.
   @param[out] msg The message that was popped.
@@ -77,13 +184,54 @@ int InitQueue(CommunicationQueue* queue);
 int Pop(CommunicationQueue* queue, Message* msg, int* valid);
 
 /**
+  Pops the messages that are waiting, in the order they were pushed, up to
+  max of them.  A message that is still being written by its producer ends
+  the batch, along with everything pushed after it.
+
+  @param[in] queue The queue from which we will pop the messages.
+  @param[out] msgs The messages that were popped.
+  @param[in] max The most messages that fit in msgs.
+  @param[out] count The number of messages that were popped.
+
   @return An nvn error code indicating if the operation was successful.
 */
+int PopBatch(CommunicationQueue* queue, Message msgs[], int max, int* count);
+
+/**
+  Pushes a message, and sleeps until the consumer frees a slot if the queue is
+  full, so that no message is dropped while the consumer is running.
+
+  @return NVN_ENOTINIT if the queue has been closed, or another nvn error code
+  indicating if the operation was successful.
+*/
 int Push(CommunicationQueue* queue, Message msg);
 
-int PushIfUnique(CommunicationQueue* queue, Message msg);
+/**
+  @return Nonzero if the next message in the queue is ready to be popped.  Only
+  the consumer thread may call this.
+*/
+int QueueReadyP(CommunicationQueue* queue);
 
-int QueueContainsP(CommunicationQueue* queue, Message msg);
+/**
+  Pushes a message if there is room for it.
+
+  @return NVN_EQFULL if the queue is full, NVN_ENOTINIT if it has been closed,
+  or another nvn error code indicating if the operation was successful.
+*/
+int TryPush(CommunicationQueue* queue, Message msg);
+
+/**
+  Waits until the completion is finished.
+
+  @param[in] done The completion to wait on.
+  @param[in] timeout The most seconds to wait, or a negative number to wait
+  for as long as it takes.
+  @param[out] result The result that the completion finished with, if it did.
+
+  @return NVN_ETIMEOUT if the completion was not finished in time, or another
+  nvn error code indicating if the operation was successful.
+*/
+int WaitCompletion(Completion* done, double timeout, int* result);
 
 #ifdef __cplusplus
 }
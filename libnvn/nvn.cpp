@@ -5,16 +5,23 @@
 
 #include "nvn.h"
 
+#include "Compositor.hpp"
+#include "ContourLayer.hpp"
 #include "DataGrid.hpp"
 #include "GlacierLayer.hpp"
 #include "GLWindow.hpp"
 #include "GLX.hpp"
 #include "Loader.hpp"
 #include "Model.hpp"
+#include "MultiLineLayer.hpp"
 #include "Plot2DLayer.hpp"
+#include "SeriesLayer.hpp"
 #include "ShadedSurfaceLayer.hpp"
+#include "Trace.hpp"
+#include "VolumeLayer.hpp"
 
 #include <float.h>
+#include <stdio.h>
 #include <string.h>
 
 
@@ -34,7 +41,9 @@ const char* g_ErrMsg[NVN_NUMERRS] =
   "Failed to establish network connection",
   "Failed to start thread",
   "Socket communication error",
-  "Client closed connection"
+  "Client closed connection",
+  "EGL Error",
+  "Timed out"
 };
 
 NVN_BBox NVN_BBoxEmpty =
@@ -43,6 +52,21 @@ NVN_BBox NVN_BBoxEmpty =
   { FLT_MIN, FLT_MIN, FLT_MIN, FLT_MIN }
 };
 
+/**
+ * The deepest that the application's traced events can nest and still be
+ * recorded, which is the number of bits in g_AppTraceRecorded.
+ */
+#define APP_TRACE_DEPTH 64
+
+/**
+ * The application's traced events that the calling thread has begun and not
+ * yet ended.  Bit i is set if the i'th of them was recorded, so that an end
+ * is only recorded for a begin that was, however tracing is toggled between
+ * the two.
+ */
+static __thread unsigned long long g_AppTraceRecorded = 0;
+static __thread int g_AppTraceDepth = 0;
+
 
 /*****************************************************************************
  * Public function implementations
@@ -56,7 +80,7 @@ extern "C" NVN_Err NVN_AddLayer(NVN_Model model, NVN_Layer layer)
   {
     Model* m = (Model*)model;
     Layer* l = (Layer*)layer;
-    m->AddLayer(l);
+    retval = GLX::AddLayer(m, l);
   }
   else
   {
@@ -66,6 +90,34 @@ extern "C" NVN_Err NVN_AddLayer(NVN_Model model, NVN_Layer layer)
   return retval;
 }
 
+extern "C" NVN_Err NVN_AddLine(NVN_Layer layer, const float x[], const float y[],
+                               int n, int color, int* line)
+{
+  NVN_Err retval = NVN_NOERR;
+  MultiLineLayer* lines = dynamic_cast<MultiLineLayer*>((Layer*)layer);
+
+  if(lines)
+    retval = lines->AddLine(x, y, n, color, line);
+  else
+    retval = NVN_EINVARGS;
+
+  return retval;
+}
+
+extern "C" NVN_Err NVN_AppendToSeries(NVN_Layer layer, const float x[],
+                                      const float y[], int n)
+{
+  NVN_Err retval = NVN_NOERR;
+  SeriesLayer* series = dynamic_cast<SeriesLayer*>((Layer*)layer);
+
+  if(series && x && y && n >= 0)
+    retval = series->Append(x, y, n);
+  else
+    retval = NVN_EINVARGS;
+
+  return retval;
+}
+
 extern "C" NVN_Err NVN_BBoxUnion(NVN_BBox b1, NVN_BBox b2, NVN_BBox* u)
 {
   NVN_Err retval = NVN_NOERR;
@@ -94,6 +146,43 @@ extern "C" NVN_Err NVN_BBoxUnion(NVN_BBox b1, NVN_BBox b2, NVN_BBox* u)
   return retval;
 }
 
+extern "C" NVN_Err NVN_CreateCompletion(NVN_CompletionFunc func, void* arg,
+                                        NVN_Completion* done)
+{
+  NVN_Err retval = NVN_NOERR;
+
+  if(done)
+  {
+    Completion* c = 0;
+    retval = CreateCompletion(func, arg, &c);
+    *done = (NVN_Completion)c;
+  }
+  else
+  {
+    retval = NVN_EINVARGS;
+  }
+
+  return retval;
+}
+
+extern "C" NVN_Err NVN_CreateContourLayer(NVN_DataGrid grid, const float levels[],
+                                          int nlevels, int color, NVN_Layer* layer)
+{
+  NVN_Err retval = NVN_NOERR;
+
+  if(grid && layer && nlevels >= 0 && (levels || 0 == nlevels))
+  {
+    DataGrid* g = (DataGrid*)grid;
+    *layer = (NVN_Layer)new ContourLayer(g, levels, nlevels, color);
+  }
+  else
+  {
+    retval = NVN_EINVARGS;
+  }
+
+  return retval;
+}
+
 extern "C" NVN_Err NVN_CreateDataGrid(int ndims,
                                       const MPI_Offset dimlen[],
                                       MPI_Datatype type,
@@ -146,6 +235,22 @@ extern "C" NVN_Err NVN_CreateModel(NVN_Model* model)
   return retval;
 }
 
+extern "C" NVN_Err NVN_CreateMultiLineLayer(NVN_Layer* layer)
+{
+  NVN_Err retval = NVN_NOERR;
+
+  if(layer)
+  {
+    *layer = (NVN_Layer)new MultiLineLayer();
+  }
+  else
+  {
+    retval = NVN_EINVARGS;
+  }
+
+  return retval;
+}
+
 extern "C" NVN_Err NVN_CreatePlot2DLayer(NVN_DataGrid x, NVN_DataGrid y, int color,
                                          NVN_Layer* layer)
 {
@@ -163,6 +268,23 @@ extern "C" NVN_Err NVN_CreatePlot2DLayer(NVN_DataGrid x, NVN_DataGrid y, int col
   return retval;
 }
 
+extern "C" NVN_Err NVN_CreateSeriesLayer(int capacity, int color,
+                                         NVN_Layer* layer)
+{
+  NVN_Err retval = NVN_NOERR;
+
+  if(layer && capacity >= 0)
+  {
+    *layer = (NVN_Layer)new SeriesLayer(capacity, color);
+  }
+  else
+  {
+    retval = NVN_EINVARGS;
+  }
+
+  return retval;
+}
+
 extern "C" NVN_Err NVN_CreateShadedSurfaceLayer(NVN_DataGrid grid, NVN_Layer* layer)
 {
   NVN_Err retval = NVN_NOERR;
@@ -180,6 +302,23 @@ extern "C" NVN_Err NVN_CreateShadedSurfaceLayer(NVN_DataGrid grid, NVN_Layer* la
   return retval;
 }
 
+extern "C" NVN_Err NVN_CreateVolumeLayer(NVN_DataGrid grid, NVN_Layer* layer)
+{
+  NVN_Err retval = NVN_NOERR;
+
+  if(grid && layer && ((DataGrid*)grid)->GetDimLen(2) > 1)
+  {
+    DataGrid* g = (DataGrid*)grid;
+    *layer = (NVN_Layer)new VolumeLayer(g);
+  }
+  else
+  {
+    retval = NVN_EINVARGS;
+  }
+
+  return retval;
+}
+
 extern "C" NVN_Err NVN_CreateWindow(const char* title,
                                     int x, int y,
                                     int width, int height,
@@ -202,6 +341,41 @@ extern "C" NVN_Err NVN_CreateWindow(const char* title,
   return retval;
 }
 
+extern "C" NVN_Err NVN_CreateWindowAsync(const char* title,
+                                         int x, int y,
+                                         int width, int height,
+                                         int borderless,
+                                         NVN_Window* window,
+                                         NVN_Completion done)
+{
+  NVN_Err retval = NVN_NOERR;
+
+  if(window && done)
+  {
+    *window = 0;
+    retval = GLX::CreateWindow(title, x, y, width, height, (bool)borderless,
+                               (GLWindow**)window, (Completion*)done);
+  }
+  else
+  {
+    retval = NVN_EINVARGS;
+  }
+
+  return retval;
+}
+
+extern "C" NVN_Err NVN_DestroyCompletion(NVN_Completion done)
+{
+  NVN_Err retval = NVN_NOERR;
+
+  if(done)
+    retval = ReleaseCompletion((Completion*)done);
+  else
+    retval = NVN_EINVARGS;
+
+  return retval;
+}
+
 extern "C" NVN_Err NVN_DestroyWindow(NVN_Window window)
 {
   NVN_Err retval = NVN_NOERR;
@@ -215,6 +389,55 @@ extern "C" NVN_Err NVN_DestroyWindow(NVN_Window window)
   return retval;
 }
 
+extern "C" NVN_Err NVN_DestroyWindowAsync(NVN_Window window,
+                                          NVN_Completion done)
+{
+  NVN_Err retval = NVN_NOERR;
+
+  if(window && done)
+    retval = GLX::DestroyWindow((GLWindow*)window, (Completion*)done);
+  else
+    retval = NVN_EINVARGS;
+
+  return retval;
+}
+
+extern "C" NVN_Err NVN_EnableCompositing(NVN_Window window, MPI_Comm comm,
+                                         int displayrank)
+{
+  NVN_Err retval = NVN_NOERR;
+  int provided = MPI_THREAD_SINGLE;
+
+  MPI_Query_thread(&provided);
+
+  if(! window)
+  {
+    retval = NVN_EINVARGS;
+  }
+  else if(provided < MPI_THREAD_MULTIPLE)
+  {
+    fprintf(stderr, "Compositing requires MPI_THREAD_MULTIPLE.\n");
+    retval = NVN_ETHREADFAIL;
+  }
+  else
+  {
+    // The window's private communicator is created here, on the calling
+    // thread, because every rank in comm has to take part.
+    MPI_Comm group;
+    MPI_Comm_dup(comm, &group);
+
+    Compositor* c = new Compositor(group, displayrank);
+    retval = GLX::JoinGroup((GLWindow*)window, group, displayrank, c, 0);
+    if(NVN_NOERR != retval)
+    {
+      delete c;
+      MPI_Comm_free(&group);
+    }
+  }
+
+  return retval;
+}
+
 extern "C" NVN_Err NVN_ErrMsg(NVN_Err err, char msg[], size_t len)
 {
   NVN_Err retval = NVN_NOERR;
@@ -231,6 +454,58 @@ extern "C" NVN_Err NVN_ErrMsg(NVN_Err err, char msg[], size_t len)
   return retval;
 }
 
+extern "C" NVN_Err NVN_GetFrameStats(NVN_Window window, NVN_FrameStats* stats)
+{
+  NVN_Err retval = NVN_NOERR;
+
+  if(window && stats)
+  {
+    GLWindow* w = (GLWindow*)window;
+    retval = w->GetFrameStats(stats);
+  }
+  else
+  {
+    retval = NVN_EINVARGS;
+  }
+
+  return retval;
+}
+
+extern "C" NVN_Err NVN_GetHoverProbe(NVN_Window window, NVN_ProbeResult* result)
+{
+  NVN_Err retval = NVN_NOERR;
+
+  if(window && result)
+  {
+    GLWindow* w = (GLWindow*)window;
+    retval = w->GetHoverProbe(result);
+  }
+  else
+  {
+    retval = NVN_EINVARGS;
+  }
+
+  return retval;
+}
+
+extern "C" NVN_Err NVN_GetLayerStats(NVN_Window window, NVN_Layer layer,
+                                     NVN_PhaseStats* stats)
+{
+  NVN_Err retval = NVN_NOERR;
+
+  if(window && layer && stats)
+  {
+    GLWindow* w = (GLWindow*)window;
+    retval = w->GetLayerStats((Layer*)layer, stats);
+  }
+  else
+  {
+    retval = NVN_EINVARGS;
+  }
+
+  return retval;
+}
+
 extern "C" NVN_Err NVN_GetViewParms(NVN_Window window, float* centerx, float* centery,
                                     float* zoomlevel, float* xrotation, float* zrotation)
 {
@@ -258,6 +533,15 @@ extern "C" NVN_Err NVN_Init()
   return retval;
 }
 
+extern "C" NVN_Err NVN_InitBackend(int backend)
+{
+  NVN_Err retval = NVN_NOERR;
+
+  retval = GLX::Init(backend);
+
+  return retval;
+}
+
 extern "C" NVN_Err NVN_LoadDataGrid(NVN_DataGridDescriptor desc, NVN_DataGrid* grid)
 {
   NVN_Err retval = NVN_NOERR;
@@ -292,6 +576,198 @@ extern "C" NVN_Err NVN_LoadDataGrid(NVN_DataGridDescriptor desc, NVN_DataGrid* g
   return retval;
 }
 
+extern "C" NVN_Err NVN_Probe(NVN_Window window, int x, int y,
+                             NVN_ProbeResult* result)
+{
+  NVN_Err retval = NVN_NOERR;
+
+  if(window && result)
+  {
+    GLWindow* w = (GLWindow*)window;
+    retval = w->Probe(x, y, result);
+  }
+  else
+  {
+    retval = NVN_EINVARGS;
+  }
+
+  return retval;
+}
+
+extern "C" NVN_Err NVN_ProbeModel(NVN_Model model, float x, float y,
+                                  float radius, NVN_ProbeResult* result)
+{
+  NVN_Err retval = NVN_NOERR;
+
+  if(model && result)
+  {
+    Model* m = (Model*)model;
+    retval = m->Probe(x, y, radius, result);
+  }
+  else
+  {
+    retval = NVN_EINVARGS;
+  }
+
+  return retval;
+}
+
+extern "C" NVN_Err NVN_ReadFrame(NVN_Window window, void* rgba, size_t len)
+{
+  NVN_Err retval = NVN_NOERR;
+
+  if(window && rgba)
+  {
+    GLWindow* w = (GLWindow*)window;
+    retval = GLX::ReadFrame(w, rgba, len);
+  }
+  else
+  {
+    retval = NVN_EINVARGS;
+  }
+
+  return retval;
+}
+
+extern "C" NVN_Err NVN_ReadFrameAsync(NVN_Window window, void* rgba, size_t len,
+                                      NVN_Completion done)
+{
+  NVN_Err retval = NVN_NOERR;
+
+  if(window && rgba && done)
+  {
+    GLWindow* w = (GLWindow*)window;
+    retval = GLX::ReadFrame(w, rgba, len, (Completion*)done);
+  }
+  else
+  {
+    retval = NVN_EINVARGS;
+  }
+
+  return retval;
+}
+
+extern "C" NVN_Err NVN_SetAdaptiveDetail(NVN_Window window, int enable)
+{
+  NVN_Err retval = NVN_NOERR;
+
+  if(window)
+  {
+    GLWindow* w = (GLWindow*)window;
+    retval = w->SetAdaptiveDetail(0 != enable);
+  }
+  else
+  {
+    retval = NVN_EINVARGS;
+  }
+
+  return retval;
+}
+
+extern "C" NVN_Err NVN_SetContourLevels(NVN_Layer layer, const float levels[],
+                                        int nlevels)
+{
+  NVN_Err retval = NVN_NOERR;
+  ContourLayer* contours = dynamic_cast<ContourLayer*>((Layer*)layer);
+
+  if(contours)
+    retval = contours->SetLevels(levels, nlevels);
+  else
+    retval = NVN_EINVARGS;
+
+  return retval;
+}
+
+extern "C" NVN_Err NVN_SetDisplayTile(NVN_Window window, MPI_Comm comm,
+                                      int wallwidth, int wallheight,
+                                      int tilex, int tiley)
+{
+  NVN_Err retval = NVN_NOERR;
+  int provided = MPI_THREAD_SINGLE;
+  int tile[4] = { wallwidth, wallheight, tilex, tiley };
+
+  MPI_Query_thread(&provided);
+
+  if(! window || wallwidth <= 0 || wallheight <= 0 ||
+     tilex < 0 || tilex >= wallwidth || tiley < 0 || tiley >= wallheight)
+  {
+    retval = NVN_EINVARGS;
+  }
+  else if(provided < MPI_THREAD_MULTIPLE)
+  {
+    fprintf(stderr, "Display tiles require MPI_THREAD_MULTIPLE.\n");
+    retval = NVN_ETHREADFAIL;
+  }
+  else
+  {
+    MPI_Comm group;
+    MPI_Comm_dup(comm, &group);
+
+    retval = GLX::JoinGroup((GLWindow*)window, group, 0, 0, tile);
+    if(NVN_NOERR != retval)
+      MPI_Comm_free(&group);
+  }
+
+  return retval;
+}
+
+extern "C" NVN_Err NVN_SetLineColor(NVN_Layer layer, int line, int color)
+{
+  NVN_Err retval = NVN_NOERR;
+  MultiLineLayer* lines = dynamic_cast<MultiLineLayer*>((Layer*)layer);
+
+  if(lines)
+    retval = lines->SetLineColor(line, color);
+  else
+    retval = NVN_EINVARGS;
+
+  return retval;
+}
+
+extern "C" NVN_Err NVN_SetLineVisible(NVN_Layer layer, int line, int visible)
+{
+  NVN_Err retval = NVN_NOERR;
+  MultiLineLayer* lines = dynamic_cast<MultiLineLayer*>((Layer*)layer);
+
+  if(lines)
+    retval = lines->SetLineVisible(line, 0 != visible);
+  else
+    retval = NVN_EINVARGS;
+
+  return retval;
+}
+
+extern "C" NVN_Err NVN_SetPlotDecimation(NVN_Layer layer, int mode)
+{
+  NVN_Err retval = NVN_NOERR;
+  Plot2DLayer* plot = dynamic_cast<Plot2DLayer*>((Layer*)layer);
+
+  if(plot && mode >= NVN_DECIMATE_NONE && mode <= NVN_DECIMATE_LTTB)
+    retval = plot->SetDecimation(mode);
+  else
+    retval = NVN_EINVARGS;
+
+  return retval;
+}
+
+extern "C" NVN_Err NVN_SetTraceThreadName(const char* name)
+{
+  NVN_Err retval = NVN_NOERR;
+
+  retval = Trace::SetThreadName(name);
+
+  return retval;
+}
+
+extern "C" NVN_Err NVN_SetTracing(int enable)
+{
+  NVN_Err retval = NVN_NOERR;
+
+  retval = Trace::SetEnabled(0 != enable);
+
+  return retval;
+}
+
 extern "C" NVN_Err NVN_SetViewParms(NVN_Window window, float centerx, float centery,
                                     float zoomlevel, float xrotation, float zrotation)
 {
@@ -300,7 +776,8 @@ extern "C" NVN_Err NVN_SetViewParms(NVN_Window window, float centerx, float cent
   if(window)
   {
     GLWindow* w = (GLWindow*)window;
-    retval = w->SetViewParms(centerx, centery, zoomlevel, xrotation, zrotation);
+    retval = w->PostViewParms(centerx, centery, zoomlevel, xrotation,
+                              zrotation);
   }
   else
   {
@@ -318,7 +795,7 @@ extern "C" NVN_Err NVN_ShowModel(NVN_Window window, NVN_Model model)
   {
     GLWindow* w = (GLWindow*)window;
     Model* m = (Model*)model;
-    w->ShowModel(m);
+    retval = GLX::ShowModel(w, m);
   }
   else
   {
@@ -337,6 +814,148 @@ extern "C" NVN_Err NVN_Shutdown()
   return retval;
 }
 
+extern "C" NVN_Err NVN_StartRecording(NVN_Window window, const char* target,
+                                      int mode)
+{
+  NVN_Err retval = NVN_NOERR;
+
+  if(window && target)
+  {
+    GLWindow* w = (GLWindow*)window;
+    retval = GLX::StartRecording(w, target, mode);
+  }
+  else
+  {
+    retval = NVN_EINVARGS;
+  }
+
+  return retval;
+}
+
+extern "C" NVN_Err NVN_StartRecordingAsync(NVN_Window window,
+                                           const char* target, int mode,
+                                           NVN_Completion done)
+{
+  NVN_Err retval = NVN_NOERR;
+
+  if(window && target && done)
+  {
+    GLWindow* w = (GLWindow*)window;
+    retval = GLX::StartRecording(w, target, mode, (Completion*)done);
+  }
+  else
+  {
+    retval = NVN_EINVARGS;
+  }
+
+  return retval;
+}
+
+extern "C" NVN_Err NVN_StopRecording(NVN_Window window)
+{
+  NVN_Err retval = NVN_NOERR;
+
+  if(window)
+  {
+    GLWindow* w = (GLWindow*)window;
+    retval = GLX::StopRecording(w);
+  }
+  else
+  {
+    retval = NVN_EINVARGS;
+  }
+
+  return retval;
+}
+
+extern "C" NVN_Err NVN_StopRecordingAsync(NVN_Window window,
+                                          NVN_Completion done)
+{
+  NVN_Err retval = NVN_NOERR;
+
+  if(window && done)
+  {
+    GLWindow* w = (GLWindow*)window;
+    retval = GLX::StopRecording(w, (Completion*)done);
+  }
+  else
+  {
+    retval = NVN_EINVARGS;
+  }
+
+  return retval;
+}
+
+extern "C" NVN_Err NVN_TraceBegin(const char* name)
+{
+  NVN_Err retval = NVN_NOERR;
+  bool recorded = false;
+
+  if(! name)
+  {
+    retval = NVN_EINVARGS;
+  }
+  else
+  {
+    if(Trace::IsEnabled() && g_AppTraceDepth < APP_TRACE_DEPTH)
+    {
+      retval = Trace::Begin(name, "app");
+      recorded = NVN_NOERR == retval;
+    }
+
+    if(recorded)
+      g_AppTraceRecorded |= 1ULL << g_AppTraceDepth;
+    else if(g_AppTraceDepth < APP_TRACE_DEPTH)
+      g_AppTraceRecorded &= ~(1ULL << g_AppTraceDepth);
+
+    g_AppTraceDepth++;
+  }
+
+  return retval;
+}
+
+extern "C" NVN_Err NVN_TraceEnd()
+{
+  NVN_Err retval = NVN_NOERR;
+
+  // Events begun while tracing was off were never recorded, so they are not
+  // ended either, or the end would close an event that is still open.
+  if(g_AppTraceDepth > 0)
+  {
+    g_AppTraceDepth--;
+
+    if(g_AppTraceDepth < APP_TRACE_DEPTH &&
+       (g_AppTraceRecorded & (1ULL << g_AppTraceDepth)))
+    {
+      Trace::End();
+    }
+  }
+
+  return retval;
+}
+
+extern "C" NVN_Err NVN_WaitCompletion(NVN_Completion done, double timeout,
+                                      NVN_Err* result)
+{
+  NVN_Err retval = NVN_NOERR;
+
+  if(done)
+    retval = WaitCompletion((Completion*)done, timeout, result);
+  else
+    retval = NVN_EINVARGS;
+
+  return retval;
+}
+
+extern "C" NVN_Err NVN_WriteTrace(const char* prefix)
+{
+  NVN_Err retval = NVN_NOERR;
+
+  retval = Trace::Write(prefix);
+
+  return retval;
+}
+
 
 /*****************************************************************************
  * Public predicate implementations
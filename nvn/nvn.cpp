@@ -39,6 +39,11 @@ int StartRCServer(NVN_Window vis, Server** server);
 
 int StopRCServer(Server* server);
 
+/**
+   Renders a single frame of the window and saves it as a binary PPM image.
+ */
+int WriteFramePPM(NVN_Window vis, int width, int height, const char* filename);
+
 
 int main(int argc, char* argv[])
 {
@@ -57,14 +62,21 @@ int main(int argc, char* argv[])
   int listenForRemote = 0;
   Server* rcserver = 0;
   bool glaciermode = false;
-
-  MPI_Init(&argc, &argv);
+  char framefile[256];
+  int composite = 0;
+  int tile[4] = { 0, 0, 0, 0 };
+  int tiled = 0;
+  int provided;
+  char traceprefix[256];
+
+  // Compositing makes MPI calls from the UI thread.
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
   MPI_Comm_size(MPI_COMM_WORLD, &commsize);
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 
-  NVN_Init();
-
   memset(filename, 0, 256);
+  memset(framefile, 0, 256);
+  memset(traceprefix, 0, 256);
   memset(varname, 0, 16 * 256);
 
   for(i = 0; i < MAX_DIMS; i++)
@@ -74,7 +86,7 @@ int main(int argc, char* argv[])
     slabstride[i] = 1;
   }
 
-  while((c = getopt(argc, argv, "ac:f:gh:rs:t:v:w:")) != -1)
+  while((c = getopt(argc, argv, "ac:d:f:gh:mo:rs:t:v:w:x:")) != -1)
   {
     switch(c)
     {
@@ -87,6 +99,15 @@ int main(int argc, char* argv[])
       ParseHyperslab(optarg, slabcount);
       break;
 
+    case 'd':
+      // Display wall tile, as <wallwidth>x<wallheight>+<tilex>+<tiley>
+      if(4 == sscanf(optarg, "%dx%d+%d+%d",
+                     &tile[0], &tile[1], &tile[2], &tile[3]))
+        tiled = 1;
+      else
+        fprintf(stderr, "Invalid display tile: %s\n", optarg);
+      break;
+
     case 'f':
       // Input data filename
       strcpy(filename, optarg);
@@ -101,6 +122,16 @@ int main(int argc, char* argv[])
       height = atoi(optarg);
       break;
 
+    case 'm':
+      // Composite every rank's frame into the window on rank 0
+      composite = 1;
+      break;
+
+    case 'o':
+      // Render a single offscreen frame to this file and exit
+      strcpy(framefile, optarg);
+      break;
+
     case 'r':
       listenForRemote = 1;
       break;
@@ -153,6 +184,11 @@ int main(int argc, char* argv[])
       width = atoi(optarg);
       break;
 
+    case 'x':
+      // Trace the run, and write the events to <prefix>.<rank>.json
+      strcpy(traceprefix, optarg);
+      break;
+
     default:
       fprintf(stderr, "Unrecognized option: %c\n", optarg);
       break;
@@ -161,6 +197,26 @@ int main(int argc, char* argv[])
 
   printf("done with options\n");
 
+  // An offscreen run destroys its window as soon as the frame is written, so
+  // there would be nothing left for a remote control to drive.
+  if(strlen(framefile) > 0 && listenForRemote)
+  {
+    fprintf(stderr, "The -o and -r options cannot be used together.\n");
+    MPI_Finalize();
+    return 1;
+  }
+
+  if(strlen(traceprefix) > 0)
+  {
+    NVN_SetTraceThreadName("main");
+    NVN_SetTracing(1);
+  }
+
+  if(strlen(framefile) > 0 || (composite && rank > 0))
+    NVN_InitBackend(NVN_BACKEND_HEADLESS);
+  else
+    NVN_Init();
+
   //if(nvars != commsize)
   //{
   //  fprintf(stderr, "nvars=%d != commsize=%d\n", nvars, commsize);
@@ -237,13 +293,35 @@ int main(int argc, char* argv[])
   {
     nvnresult = NVN_CreateModel(&model);
     nvnresult = NVN_AddLayer(model, layer);
-    nvnresult = NVN_CreateWindow("nvn", 100, 100, 640, 480, 0, &vis);
+    if(tiled)
+      nvnresult = NVN_CreateWindow("nvn", 0, 0, width, height, 1, &vis);
+    else
+      nvnresult = NVN_CreateWindow("nvn", 100, 100, width, height, 0, &vis);
     nvnresult = NVN_ShowModel(vis, model);
 
+    if(composite)
+      nvnresult = NVN_EnableCompositing(vis, MPI_COMM_WORLD, 0);
+    else if(tiled)
+      nvnresult = NVN_SetDisplayTile(vis, MPI_COMM_WORLD,
+                                     tile[0], tile[1], tile[2], tile[3]);
+
+    if(strlen(framefile) > 0)
+    {
+      // With compositing, every rank has to take part in the frame, but only
+      // the display rank holds the finished image.
+      WriteFramePPM(vis, width, height,
+                    (composite && rank > 0) ? 0 : framefile);
+      NVN_DestroyWindow(vis);
+    }
+
     if(listenForRemote)
       StartRCServer(vis, &rcserver);
 
-    if(autonavigate)
+    if(strlen(framefile) > 0)
+    {
+      // Nothing left to do - the frame has been written
+    }
+    else if(autonavigate)
     {
       AutoNavigate(vis);
     }
@@ -257,6 +335,9 @@ int main(int argc, char* argv[])
       StopRCServer(rcserver);
   }
 
+  if(strlen(traceprefix) > 0)
+    NVN_WriteTrace(traceprefix);
+
   NVN_Shutdown();
   MPI_Finalize();
 
@@ -360,3 +441,44 @@ int StopRCServer(Server* server)
 
   return retval;
 }
+
+int WriteFramePPM(NVN_Window vis, int width, int height, const char* filename)
+{
+  int retval = NVN_NOERR;
+  size_t len = (size_t)width * (size_t)height * 4;
+  unsigned char* rgba = (unsigned char*)malloc(len);
+  FILE* f = 0;
+
+  retval = NVN_ReadFrame(vis, rgba, len);
+
+  if(NVN_NOERR == retval && filename)
+  {
+    f = fopen(filename, "wb");
+    if(! f)
+    {
+      retval = NVN_ERROR;
+      fprintf(stderr, "Unable to open '%s' for writing.\n", filename);
+    }
+  }
+
+  if(NVN_NOERR == retval && f)
+  {
+    // PPM rows run top to bottom, while glReadPixels rows run bottom to top.
+    fprintf(f, "P6\n%d %d\n255\n", width, height);
+    for(int y = height - 1; y >= 0; y--)
+    {
+      for(int x = 0; x < width; x++)
+        fwrite(rgba + (y * width + x) * 4, 1, 3, f);
+    }
+  }
+
+  if(f)
+  {
+    fclose(f);
+    f = 0;
+  }
+
+  free(rgba);
+
+  return retval;
+}
@@ -545,6 +545,7 @@ int HandleStreamClient(ServerEx* server, SOCKET acceptSocket,
     }
     else
     {
+      NVN_TraceBegin("ReceiveMessage");
       CheckReceiveBuffer(server, msgSize);
 
       received = 0;
@@ -573,7 +574,11 @@ int HandleStreamClient(ServerEx* server, SOCKET acceptSocket,
         }
       }
 
+      NVN_TraceEnd();
+
+      NVN_TraceBegin("InvokeCallback");
       InvokeCallback(server, clientName, msgSize, 0);
+      NVN_TraceEnd();
     }
   }
 
@@ -658,6 +663,7 @@ void* ServerThreadEntryPoint(void* arg)
 #endif
 {
   ServerEx* sex = (ServerEx*)arg;
+  NVN_SetTraceThreadName("Server");
   if(sex)
   {
     sex->ServerThreadAlive = 1;